@@ -0,0 +1,213 @@
+/*
+ * Measures `LDAllFlags` for a store of flags that all fall through to a
+ * percentage rollout, the shape of a bootstrap endpoint where bucketing
+ * dominates. The collection is evaluated with an increasing number of
+ * workers to show how the call scales with cores, then the serialized
+ * result is compared with writing it directly through `LDAllFlagsState`.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <launchdarkly/api.h>
+
+#include "client.h"
+#include "store.h"
+#include "utility.h"
+
+#define FLAG_COUNT 10000
+#define ITERATIONS 20
+#define MAX_THREADS 8
+
+static struct LDJSON *
+makeFlag(const unsigned int index)
+{
+    struct LDJSON *flag, *variations, *fallthrough, *rollout, *weighted;
+    char           key[64];
+    unsigned int   i;
+
+    snprintf(key, sizeof(key), "rollout-flag-%u", index);
+
+    if (!(flag = LDNewObject()) ||
+        !LDObjectSetKey(flag, "key", LDNewText(key)) ||
+        !LDObjectSetKey(flag, "version", LDNewNumber(1)) ||
+        !LDObjectSetKey(flag, "on", LDNewBool(LDBooleanTrue)) ||
+        !LDObjectSetKey(flag, "salt", LDNewText("0123456789abcdef")) ||
+        !(variations = LDNewArray()) ||
+        !LDArrayPush(variations, LDNewBool(LDBooleanTrue)) ||
+        !LDArrayPush(variations, LDNewBool(LDBooleanFalse)) ||
+        !LDObjectSetKey(flag, "variations", variations) ||
+        !(weighted = LDNewArray()))
+    {
+        goto error;
+    }
+
+    for (i = 0; i < 2; i++) {
+        struct LDJSON *variation;
+
+        if (!(variation = LDNewObject()) ||
+            !LDObjectSetKey(variation, "variation", LDNewNumber(i)) ||
+            !LDObjectSetKey(variation, "weight", LDNewNumber(50000)) ||
+            !LDArrayPush(weighted, variation))
+        {
+            goto error;
+        }
+    }
+
+    if (!(rollout = LDNewObject()) ||
+        !LDObjectSetKey(rollout, "variations", weighted) ||
+        !(fallthrough = LDNewObject()) ||
+        !LDObjectSetKey(fallthrough, "rollout", rollout) ||
+        !LDObjectSetKey(flag, "fallthrough", fallthrough))
+    {
+        goto error;
+    }
+
+    return flag;
+
+error:
+    fprintf(stderr, "failed to build flag\n");
+
+    exit(1);
+}
+
+static struct LDClient *
+makeClient(const unsigned int workers)
+{
+    struct LDConfig *config;
+    struct LDClient *client;
+    unsigned int     i;
+
+    if (!(config = LDConfigNew("key"))) {
+        return NULL;
+    }
+
+    /* no network activity, the store is filled directly */
+    LDConfigSetUseLDD(config, LDBooleanTrue);
+    LDConfigSetSendEvents(config, LDBooleanFalse);
+    LDConfigSetAllFlagsWorkers(config, workers);
+
+    if (!(client = LDClientInit(config, 0)) ||
+        !LDStoreInitEmpty(client->store))
+    {
+        return NULL;
+    }
+
+    for (i = 0; i < FLAG_COUNT; i++) {
+        if (!LDStoreUpsert(client->store, LD_FLAG, makeFlag(i))) {
+            return NULL;
+        }
+    }
+
+    return client;
+}
+
+int
+main(void)
+{
+    struct LDClient *   client;
+    struct LDUser *     user;
+    struct LDJSON *     result;
+    struct LDTextBuffer buffer;
+    char *              text;
+    unsigned int        threadCount, i;
+    double              start, end, serial;
+
+    if (!(user = LDUserNew("6c3a2e1f-9b57-4d0e-8f44-2a51c9d0b7e3"))) {
+        return 1;
+    }
+
+    serial = 0;
+
+    for (threadCount = 1; threadCount <= MAX_THREADS; threadCount *= 2) {
+        /* the calling thread is one of the threads */
+        if (!(client = makeClient(threadCount - 1))) {
+            fprintf(stderr, "failed to prepare client\n");
+
+            return 1;
+        }
+
+        LDi_getMonotonicMilliseconds(&start);
+
+        for (i = 0; i < ITERATIONS; i++) {
+            if (!(result = LDAllFlags(client, user))) {
+                fprintf(stderr, "LDAllFlags failed\n");
+
+                return 1;
+            }
+
+            LDJSONFree(result);
+        }
+
+        LDi_getMonotonicMilliseconds(&end);
+
+        if (threadCount == 1) {
+            serial = end - start;
+        }
+
+        printf(
+            "%u flags, %u threads: %.2f ms per LDAllFlags, %.2fx\n",
+            FLAG_COUNT,
+            threadCount,
+            (end - start) / ITERATIONS,
+            serial / (end - start));
+
+        LDClientClose(client);
+    }
+
+    if (!(client = makeClient(0))) {
+        fprintf(stderr, "failed to prepare client\n");
+
+        return 1;
+    }
+
+    LDi_getMonotonicMilliseconds(&start);
+
+    for (i = 0; i < ITERATIONS; i++) {
+        if (!(result = LDAllFlags(client, user)) ||
+            !(text = LDJSONSerialize(result)))
+        {
+            fprintf(stderr, "LDAllFlags failed\n");
+
+            return 1;
+        }
+
+        LDFree(text);
+        LDJSONFree(result);
+    }
+
+    LDi_getMonotonicMilliseconds(&end);
+
+    printf(
+        "%u flags: %.2f ms per serialized LDAllFlags\n",
+        FLAG_COUNT,
+        (end - start) / ITERATIONS);
+
+    memset(&buffer, 0, sizeof(buffer));
+
+    LDi_getMonotonicMilliseconds(&start);
+
+    for (i = 0; i < ITERATIONS; i++) {
+        buffer.length = 0;
+
+        if (!LDAllFlagsState(client, user, 0, NULL, &buffer)) {
+            fprintf(stderr, "LDAllFlagsState failed\n");
+
+            return 1;
+        }
+    }
+
+    LDi_getMonotonicMilliseconds(&end);
+
+    printf(
+        "%u flags: %.2f ms per LDAllFlagsState\n",
+        FLAG_COUNT,
+        (end - start) / ITERATIONS);
+
+    LDFree(buffer.text);
+    LDClientClose(client);
+    LDUserFree(user);
+
+    return 0;
+}
@@ -0,0 +1,99 @@
+/*
+ * Measures the cost of a store lookup, `LDStoreGet` followed by releasing the
+ * reference, with several threads reading the same flag. This is the access
+ * pattern of concurrent evaluations of a single hot flag.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <launchdarkly/api.h>
+
+#include "concurrency.h"
+#include "store.h"
+#include "utility.h"
+
+#define ITERATIONS 2000000
+#define MAX_THREADS 8
+
+static struct LDStore *store;
+
+static THREAD_RETURN
+reader(void *const argument)
+{
+    unsigned long    i;
+    struct LDJSONRC *flag;
+
+    (void)argument;
+
+    for (i = 0; i < ITERATIONS; i++) {
+        if (!LDStoreGet(store, LD_FLAG, "hot", &flag) || !flag) {
+            fprintf(stderr, "LDStoreGet failed\n");
+
+            exit(1);
+        }
+
+        LDJSONRCDecrement(flag);
+    }
+
+    return THREAD_RETURN_DEFAULT;
+}
+
+static struct LDJSON *
+makeFlag(void)
+{
+    struct LDJSON *flag;
+
+    if (!(flag = LDNewObject()) ||
+        !LDObjectSetKey(flag, "key", LDNewText("hot")) ||
+        !LDObjectSetKey(flag, "version", LDNewNumber(1)))
+    {
+        fprintf(stderr, "failed to build flag\n");
+
+        exit(1);
+    }
+
+    return flag;
+}
+
+int
+main(void)
+{
+    struct LDConfig *config;
+    ld_thread_t      threads[MAX_THREADS];
+    unsigned int     threadCount, i;
+    double           start, end;
+
+    if (!(config = LDConfigNew("key")) || !(store = LDStoreNew(config)) ||
+        !LDStoreInitEmpty(store) || !LDStoreUpsert(store, LD_FLAG, makeFlag()))
+    {
+        fprintf(stderr, "failed to prepare store\n");
+
+        return 1;
+    }
+
+    for (threadCount = 1; threadCount <= MAX_THREADS; threadCount *= 2) {
+        LDi_getMonotonicMilliseconds(&start);
+
+        for (i = 0; i < threadCount; i++) {
+            LDi_thread_create(&threads[i], reader, NULL);
+        }
+
+        for (i = 0; i < threadCount; i++) {
+            LDi_thread_join(&threads[i]);
+        }
+
+        LDi_getMonotonicMilliseconds(&end);
+
+        printf(
+            "%u threads: %.1f ns per get, %.2f million gets per second\n",
+            threadCount,
+            (end - start) * 1000000.0 / ITERATIONS,
+            ITERATIONS * threadCount / ((end - start) * 1000.0));
+    }
+
+    LDStoreDestroy(store);
+    LDConfigFree(config);
+
+    return 0;
+}
@@ -122,6 +122,17 @@ LDUserSetSecondary(struct LDUser *const user, const char *const secondary);
 LD_EXPORT(void)
 LDUserSetCustom(struct LDUser *const user, struct LDJSON *const custom);
 
+/**
+ * @brief Index the user's custom attributes so that evaluations look them up
+ * in constant time. Intended for users that are evaluated many times. The
+ * custom JSON must not be modified afterwards; `LDUserSetCustom` discards the
+ * index, and calling this again rebuilds it.
+ * @param[in] user The user to prepare. May not be `NULL`.
+ * @return True on success, False on failure. A user that failed to prepare
+ * can still be evaluated.
+ */
+LD_EXPORT(LDBoolean) LDUserPrepare(struct LDUser *const user);
+
 /**
  * @brief Mark an attribute as private.
  * @param[in] user The user to mutate. May not be `NULL`.
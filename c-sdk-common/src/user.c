@@ -39,6 +39,9 @@ LDi_userNew(const char *const key)
     user->custom    = NULL;
     user->country   = NULL;
 
+    user->attributes     = NULL;
+    user->attributeIndex = NULL;
+
     return user;
 
 error:
@@ -47,6 +50,15 @@ error:
     return NULL;
 }
 
+static void
+freeAttributeIndex(struct LDUser *const user)
+{
+    HASH_CLEAR(hh, user->attributeIndex);
+    LDFree(user->attributes);
+
+    user->attributes = NULL;
+}
+
 void
 LDUserFree(struct LDUser *const user)
 {
@@ -60,6 +72,7 @@ LDUserFree(struct LDUser *const user)
         LDFree(user->name);
         LDFree(user->avatar);
         LDFree(user->country);
+        freeAttributeIndex(user);
         LDJSONFree(user->custom);
         LDJSONFree(user->privateAttributeNames);
         LDFree(user);
@@ -202,6 +215,57 @@ LDUserSetSecondary(struct LDUser *const user, const char *const secondary)
     return LDSetString(&user->secondary, secondary);
 }
 
+LDBoolean
+LDUserPrepare(struct LDUser *const user)
+{
+    const struct LDJSON *   iter;
+    struct LDUserAttribute *entry, *existing;
+
+    LD_ASSERT_API(user);
+
+#ifdef LAUNCHDARKLY_DEFENSIVE
+    if (user == NULL) {
+        LD_LOG(LD_LOG_WARNING, "LDUserPrepare NULL user");
+
+        return LDBooleanFalse;
+    }
+#endif
+
+    freeAttributeIndex(user);
+
+    if (!user->custom || LDCollectionGetSize(user->custom) == 0) {
+        return LDBooleanTrue;
+    }
+
+    if (!(user->attributes = (struct LDUserAttribute *)LDAlloc(
+              sizeof(struct LDUserAttribute) *
+              LDCollectionGetSize(user->custom))))
+    {
+        return LDBooleanFalse;
+    }
+
+    entry = user->attributes;
+
+    for (iter = LDGetIter(user->custom); iter; iter = LDIterNext(iter)) {
+        entry->name  = LDIterKey(iter);
+        entry->value = iter;
+
+        /* the first of duplicate keys wins, as in `LDObjectLookup` */
+        HASH_FIND_STR(user->attributeIndex, entry->name, existing);
+
+        if (existing) {
+            continue;
+        }
+
+        HASH_ADD_KEYPTR(
+            hh, user->attributeIndex, entry->name, strlen(entry->name), entry);
+
+        entry++;
+    }
+
+    return LDBooleanTrue;
+}
+
 void
 LDUserSetCustom(struct LDUser *const user, struct LDJSON *const custom)
 {
@@ -215,6 +279,7 @@ LDUserSetCustom(struct LDUser *const user, struct LDJSON *const custom)
     }
 #endif
 
+    freeAttributeIndex(user);
     LDJSONFree(user->custom);
 
     user->custom = custom;
@@ -489,62 +554,137 @@ LDi_userToJSON(
 #undef addstring
 }
 
-struct LDJSON *
-LDi_valueOfAttribute(
-    const struct LDUser *const user, const char *const attribute)
+LDAttributeSlot
+LDi_attributeSlot(const char *const attribute)
 {
-    LD_ASSERT(user);
     LD_ASSERT(attribute);
 
     if (strcmp(attribute, "key") == 0) {
-        if (user->key) {
-            return LDNewText(user->key);
-        }
+        return LD_ATTRIBUTE_KEY;
     } else if (strcmp(attribute, "secondary") == 0) {
-        if (user->secondary) {
-            return LDNewText(user->secondary);
-        }
+        return LD_ATTRIBUTE_SECONDARY;
     } else if (strcmp(attribute, "ip") == 0) {
-        if (user->ip) {
-            return LDNewText(user->ip);
-        }
+        return LD_ATTRIBUTE_IP;
     } else if (strcmp(attribute, "email") == 0) {
-        if (user->email) {
-            return LDNewText(user->email);
-        }
+        return LD_ATTRIBUTE_EMAIL;
     } else if (strcmp(attribute, "firstName") == 0) {
-        if (user->firstName) {
-            return LDNewText(user->firstName);
-        }
+        return LD_ATTRIBUTE_FIRST_NAME;
     } else if (strcmp(attribute, "lastName") == 0) {
-        if (user->lastName) {
-            return LDNewText(user->lastName);
-        }
+        return LD_ATTRIBUTE_LAST_NAME;
     } else if (strcmp(attribute, "avatar") == 0) {
-        if (user->avatar) {
-            return LDNewText(user->avatar);
-        }
+        return LD_ATTRIBUTE_AVATAR;
     } else if (strcmp(attribute, "country") == 0) {
-        if (user->country) {
-            return LDNewText(user->country);
-        }
+        return LD_ATTRIBUTE_COUNTRY;
     } else if (strcmp(attribute, "name") == 0) {
-        if (user->name) {
-            return LDNewText(user->name);
-        }
+        return LD_ATTRIBUTE_NAME;
     } else if (strcmp(attribute, "anonymous") == 0) {
-        return LDNewBool(user->anonymous);
-    } else if (user->custom) {
-        const struct LDJSON *node = NULL;
+        return LD_ATTRIBUTE_ANONYMOUS;
+    }
+
+    return LD_ATTRIBUTE_CUSTOM;
+}
+
+const struct LDJSON *
+LDi_viewSlot(
+    const struct LDUser *const    user,
+    const LDAttributeSlot         slot,
+    const char *const             attribute,
+    struct LDAttributeView *const view)
+{
+    const char *            text;
+    struct LDUserAttribute *entry;
+
+    LD_ASSERT(user);
+    LD_ASSERT(attribute);
+    LD_ASSERT(view);
+
+    text = NULL;
+
+    switch (slot) {
+    case LD_ATTRIBUTE_KEY:
+        text = user->key;
+        break;
+    case LD_ATTRIBUTE_SECONDARY:
+        text = user->secondary;
+        break;
+    case LD_ATTRIBUTE_IP:
+        text = user->ip;
+        break;
+    case LD_ATTRIBUTE_EMAIL:
+        text = user->email;
+        break;
+    case LD_ATTRIBUTE_FIRST_NAME:
+        text = user->firstName;
+        break;
+    case LD_ATTRIBUTE_LAST_NAME:
+        text = user->lastName;
+        break;
+    case LD_ATTRIBUTE_AVATAR:
+        text = user->avatar;
+        break;
+    case LD_ATTRIBUTE_COUNTRY:
+        text = user->country;
+        break;
+    case LD_ATTRIBUTE_NAME:
+        text = user->name;
+        break;
+    case LD_ATTRIBUTE_ANONYMOUS:
+        memset(&view->node, 0, sizeof(view->node));
+
+        view->node.type = user->anonymous ? cJSON_True : cJSON_False;
+
+        return (const struct LDJSON *)&view->node;
+    case LD_ATTRIBUTE_CUSTOM:
+        if (!user->custom) {
+            return NULL;
+        }
 
         LD_ASSERT(LDJSONGetType(user->custom) == LDObject);
 
-        if ((node = LDObjectLookup(user->custom, attribute))) {
-            return LDJSONDuplicate(node);
+        if (!user->attributeIndex) {
+            return LDObjectLookup(user->custom, attribute);
         }
 
+        HASH_FIND_STR(user->attributeIndex, attribute, entry);
+
+        return entry ? entry->value : NULL;
+    }
+
+    if (!text) {
         return NULL;
     }
 
-    return NULL;
+    /* a reference node never frees or copies its string */
+    memset(&view->node, 0, sizeof(view->node));
+
+    view->node.type        = cJSON_String | cJSON_IsReference;
+    view->node.valuestring = (char *)text;
+
+    return (const struct LDJSON *)&view->node;
+}
+
+const struct LDJSON *
+LDi_viewAttribute(
+    const struct LDUser *const    user,
+    const char *const             attribute,
+    struct LDAttributeView *const view)
+{
+    return LDi_viewSlot(user, LDi_attributeSlot(attribute), attribute, view);
+}
+
+struct LDJSON *
+LDi_valueOfAttribute(
+    const struct LDUser *const user, const char *const attribute)
+{
+    struct LDAttributeView view;
+    const struct LDJSON *  value;
+
+    LD_ASSERT(user);
+    LD_ASSERT(attribute);
+
+    if (!(value = LDi_viewAttribute(user, attribute, &view))) {
+        return NULL;
+    }
+
+    return LDJSONDuplicate(value);
 }
@@ -2,6 +2,17 @@
 
 #include <launchdarkly/json.h>
 
+#include "cJSON.h"
+#include "uthash.h"
+
+/* An entry of the custom attribute index built by `LDUserPrepare` */
+struct LDUserAttribute
+{
+    const char *         name;
+    const struct LDJSON *value;
+    UT_hash_handle       hh;
+};
+
 struct LDUser
 {
     char *         key;
@@ -16,8 +27,53 @@ struct LDUser
     char *         country;
     struct LDJSON *privateAttributeNames; /* Array of Text */
     struct LDJSON *custom;                /* Object, may be NULL */
+    /* index of `custom`, NULL until the user is prepared */
+    struct LDUserAttribute *attributes;
+    struct LDUserAttribute *attributeIndex;
+};
+
+/* Built in attributes are stored in fixed fields rather than by name */
+typedef enum
+{
+    LD_ATTRIBUTE_CUSTOM = 0,
+    LD_ATTRIBUTE_KEY,
+    LD_ATTRIBUTE_SECONDARY,
+    LD_ATTRIBUTE_IP,
+    LD_ATTRIBUTE_EMAIL,
+    LD_ATTRIBUTE_FIRST_NAME,
+    LD_ATTRIBUTE_LAST_NAME,
+    LD_ATTRIBUTE_AVATAR,
+    LD_ATTRIBUTE_COUNTRY,
+    LD_ATTRIBUTE_NAME,
+    LD_ATTRIBUTE_ANONYMOUS
+} LDAttributeSlot;
+
+LDAttributeSlot
+LDi_attributeSlot(const char *const attribute);
+
+/* Storage for a borrowed attribute. Built in attributes are not stored as
+JSON, so their node is built in place. */
+struct LDAttributeView
+{
+    cJSON node;
 };
 
+/* Returns the attribute without copying it, or NULL if the user does not
+have it. The result is valid while both `user` and `view` are. */
+const struct LDJSON *
+LDi_viewAttribute(
+    const struct LDUser *const    user,
+    const char *const             attribute,
+    struct LDAttributeView *const view);
+
+/* As `LDi_viewAttribute` with the slot of `attribute` already resolved */
+const struct LDJSON *
+LDi_viewSlot(
+    const struct LDUser *const    user,
+    const LDAttributeSlot         slot,
+    const char *const             attribute,
+    struct LDAttributeView *const view);
+
 struct LDJSON *
 LDi_valueOfAttribute(
     const struct LDUser *const user, const char *const attribute);
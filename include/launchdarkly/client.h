@@ -123,3 +123,70 @@ LD_EXPORT(LDBoolean) LDClientIsOffline(struct LDClient *const client);
  * @return True if signalled, False on error.
  */
 LD_EXPORT(LDBoolean) LDClientFlush(struct LDClient *const client);
+
+/** @brief Counters of the evaluation cache, see
+ * `LDConfigSetEvaluationCacheCapacity` */
+struct LDEvaluationCacheStats
+{
+    /** @brief Evaluations answered from the cache */
+    unsigned long hits;
+    /** @brief Evaluations that could have been cached but were not */
+    unsigned long misses;
+    /** @brief The number of results currently held */
+    unsigned int entries;
+};
+
+/**
+ * @brief Read the counters of the evaluation cache. They are all zero when
+ * the cache is not enabled.
+ * @param[in] client The client to use. May not be `NULL`.
+ * @param[out] stats Where to write the counters. May not be `NULL`.
+ * @return True on success, False on failure.
+ */
+LD_EXPORT(LDBoolean)
+LDClientGetEvaluationCacheStats(
+    struct LDClient *const               client,
+    struct LDEvaluationCacheStats *const stats);
+
+/** @brief Counters of the analytics event buffer, see
+ * `LDConfigSetEventsCapacity` */
+struct LDEventStats
+{
+    /** @brief Events discarded because the buffer was full */
+    unsigned long dropped;
+};
+
+/**
+ * @brief Read the counters of the analytics event buffer. They count from
+ * the creation of the client.
+ * @param[in] client The client to use. May not be `NULL`.
+ * @param[out] stats Where to write the counters. May not be `NULL`.
+ * @return True on success, False on failure.
+ */
+LD_EXPORT(LDBoolean)
+LDClientGetEventStats(
+    struct LDClient *const client, struct LDEventStats *const stats);
+
+/** @brief Counters of the feature store backend cache, see
+ * `LDConfigSetFeatureStoreBackendMaxStaleness` */
+struct LDStoreCacheStats
+{
+    /** @brief Expired items served while they were refreshed in the
+     * background */
+    unsigned long staleServes;
+    /** @brief Background refreshes that completed */
+    unsigned long refreshes;
+    /** @brief Background refreshes that failed */
+    unsigned long refreshFailures;
+};
+
+/**
+ * @brief Read the counters of the feature store backend cache. They count
+ * from the creation of the client, and are all zero without a backend.
+ * @param[in] client The client to use. May not be `NULL`.
+ * @param[out] stats Where to write the counters. May not be `NULL`.
+ * @return True on success, False on failure.
+ */
+LD_EXPORT(LDBoolean)
+LDClientGetStoreCacheStats(
+    struct LDClient *const client, struct LDStoreCacheStats *const stats);
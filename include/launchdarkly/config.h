@@ -93,7 +93,8 @@ LDConfigSetSendEvents(
 /**
  * @brief The capacity of the events buffer. The client buffers up to this many
  * events in memory before flushing. If the capacity is exceeded before the
- * buffer is flushed, events will be discarded.
+ * buffer is flushed, events will be discarded, and counted in
+ * `LDClientGetEventStats`. The buffer is allocated up front.
  * @param[in] config The configuration to modify. May not be `NULL`.
  * @param[in] eventsCapacity
  * @return Void.
@@ -236,6 +237,93 @@ LD_EXPORT(void)
 LDConfigSetFeatureStoreBackendCacheTTL(
     struct LDConfig *const config, const unsigned int milliseconds);
 
+/**
+ * @brief When a feature store backend is provided, allow expired items to be
+ * served from memory for up to this long past the cache TTL. A stale item is
+ * returned immediately while a background thread refreshes it from the
+ * backend. Items older than the TTL plus this bound are always fetched before
+ * being returned. Set the value to zero to disable serving stale items, which
+ * is the default. If no backend exists this value is ignored. Stale serves
+ * and refreshes are counted by `LDClientGetStoreCacheStats`.
+ * @param[in] config The configuration to modify. May not be `NULL`.
+ * @param[in] milliseconds How long past the TTL an item may be served.
+ * @return Void.
+ */
+LD_EXPORT(void)
+LDConfigSetFeatureStoreBackendMaxStaleness(
+    struct LDConfig *const config, const unsigned int milliseconds);
+
+/**
+ * @brief When using daemon mode with a feature store backend, reload all
+ * items from the backend in the background at half the cache TTL, so that
+ * evaluations do not wait on the backend when cached items expire. Items
+ * removed from the backend still expire normally. Has no effect if the cache
+ * TTL is zero. Disabled by default.
+ * @param[in] config The configuration to modify. May not be `NULL`.
+ * @param[in] refresh If true the cache is refreshed proactively.
+ * @return Void.
+ */
+LD_EXPORT(void)
+LDConfigSetFeatureStoreBackendProactiveRefresh(
+    struct LDConfig *const config, const LDBoolean refresh);
+
+/**
+ * @brief Runs `task(argument)` exactly once, on any thread. The task may run
+ * after the call that submitted it has returned, but it must not be dropped.
+ * @param[in] task The function to run.
+ * @param[in] argument The argument to pass to `task`.
+ * @param[in] context The context given to `LDConfigSetAllFlagsExecutor`.
+ */
+typedef void (*LDTaskExecutor)(
+    void (*task)(void *argument), void *argument, void *context);
+
+/**
+ * @brief Evaluate flags for `LDAllFlags` on this many additional threads.
+ * The calling thread always takes part, so the work is split at most
+ * `workers + 1` ways. Small flag collections are evaluated on the calling
+ * thread alone. Unless an executor is set, the client starts its own pool of
+ * `workers` threads. The default is zero, which evaluates every flag on the
+ * calling thread.
+ * @param[in] config The configuration to modify. May not be `NULL`.
+ * @param[in] workers The number of additional threads to use.
+ * @return Void.
+ */
+LD_EXPORT(void)
+LDConfigSetAllFlagsWorkers(
+    struct LDConfig *const config, const unsigned int workers);
+
+/**
+ * @brief Run the `LDAllFlags` workers on a thread pool owned by the
+ * application instead of threads owned by the client. Each `LDAllFlags` call
+ * submits up to the number of tasks set by `LDConfigSetAllFlagsWorkers`.
+ * @param[in] config The configuration to modify. May not be `NULL`.
+ * @param[in] executor Submits a task to the application's pool. May be
+ * `NULL` to use threads owned by the client.
+ * @param[in] context Passed to every call of `executor`. Ownership is not
+ * transferred.
+ * @return Void.
+ */
+LD_EXPORT(void)
+LDConfigSetAllFlagsExecutor(
+    struct LDConfig *const config,
+    LDTaskExecutor         executor,
+    void *const            context);
+
+/**
+ * @brief Cache the results of single flag evaluations. Results are shared by
+ * users with the same values for the attributes a flag can read, and the
+ * whole cache is discarded whenever flag or segment data changes. Flags with
+ * prerequisites are never cached. Events are recorded for every evaluation,
+ * whether or not the result came from the cache. The default is zero, which
+ * disables the cache.
+ * @param[in] config The configuration to modify. May not be `NULL`.
+ * @param[in] capacity The maximum number of results held.
+ * @return Void.
+ */
+LD_EXPORT(void)
+LDConfigSetEvaluationCacheCapacity(
+    struct LDConfig *const config, const unsigned int capacity);
+
 /**
  * @brief Indicates to LaunchDarkly the name and version of an SDK wrapper
  * library. If `wrapperVersion` is set `wrapperName` must be set.
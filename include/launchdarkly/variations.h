@@ -5,6 +5,8 @@
 
 #pragma once
 
+#include <stddef.h>
+
 #include <launchdarkly/boolean.h>
 #include <launchdarkly/client.h>
 #include <launchdarkly/export.h>
@@ -238,6 +240,98 @@ LDJSONVariation(
     const struct LDJSON *const fallback,
     struct LDDetails *const    details);
 
+/** @brief The value type of a flag evaluated with `LDVariations` */
+enum LDVariationType
+{
+    /** @brief Evaluated as by `LDBoolVariation` */
+    LD_VARIATION_BOOL,
+    /** @brief Evaluated as by `LDIntVariation` */
+    LD_VARIATION_INT,
+    /** @brief Evaluated as by `LDDoubleVariation` */
+    LD_VARIATION_DOUBLE,
+    /** @brief Evaluated as by `LDStringVariation` */
+    LD_VARIATION_STRING,
+    /** @brief Evaluated as by `LDJSONVariation` */
+    LD_VARIATION_JSON
+};
+
+/** @brief A flag to evaluate with `LDVariations`. Requests do not refer to
+ * a user, so the same array may be used for every call. */
+struct LDVariationRequest
+{
+    /** @brief The key of the flag to evaluate. May not be `NULL`. */
+    const char *key;
+    /** @brief The expected value type, which selects the `fallback` member */
+    enum LDVariationType type;
+    /** @brief The value to return on error. Ownership of `text` and `json`
+     * is not transferred, both may be `NULL`. */
+    union {
+        LDBoolean            boolean;
+        int                  integer;
+        double               number;
+        const char *         text;
+        const struct LDJSON *json;
+    } fallback;
+};
+
+/** @brief The outcome of one `LDVariationRequest`. Must be cleaned up with
+ * `LDVariationResultsClear`. */
+struct LDVariationResult
+{
+    /** @brief The type of the request, which selects the `value` member */
+    enum LDVariationType type;
+    /** @brief The evaluated value, or the fallback on any error. `text` must
+     * be freed with `LDFree` and `json` with `LDJSONFree`, which
+     * `LDVariationResultsClear` does. Either may be `NULL` as described by
+     * `LDStringVariation` and `LDJSONVariation`. */
+    union {
+        LDBoolean      boolean;
+        int            integer;
+        double         number;
+        char *         text;
+        struct LDJSON *json;
+    } value;
+    /** @brief The evaluation explanation */
+    struct LDDetails details;
+};
+
+/**
+ * @brief Evaluate several flags for one user.
+ *
+ * Each result is the same as that of the typed variation function for its
+ * request, and the same analytics events are recorded. All flags are read
+ * from one view of the store and their events recorded together, which is
+ * cheaper than evaluating them one at a time.
+ * @param[in] client The client to use. May not be `NULL`.
+ * @param[in] user The user to evaluate the flags against. May not be `NULL`.
+ * @param[in] requests The flags to evaluate. May not be `NULL`.
+ * @param[out] results An array of `count` results, written in the order of
+ * `requests`. May not be `NULL`.
+ * @param[in] count The number of requests.
+ * @param[in] detailed If true evaluation reasons are included in events, as
+ * when `details` is passed to a typed variation function.
+ * @return False if the batch could not be evaluated, in which case every
+ * result holds its fallback and the details describe the error. The results
+ * must be cleared in either case.
+ */
+LD_EXPORT(LDBoolean)
+LDVariations(
+    struct LDClient *const                 client,
+    const struct LDUser *const             user,
+    const struct LDVariationRequest *const requests,
+    struct LDVariationResult *const        results,
+    const unsigned int                     count,
+    const LDBoolean                        detailed);
+
+/**
+ * @brief Free any resources associated with results of `LDVariations`
+ * @param[in] results The results to clear. May be `NULL` if `count` is 0.
+ * @param[in] count The number of results.
+ */
+LD_EXPORT(void)
+LDVariationResultsClear(
+    struct LDVariationResult *const results, const unsigned int count);
+
 /**
  * @brief Returns a map from feature flag keys to values for a given user.
  * This does not send analytics events back to LaunchDarkly.
@@ -248,3 +342,54 @@ LDJSONVariation(
  */
 LD_EXPORT(struct LDJSON *)
 LDAllFlags(struct LDClient *const client, const struct LDUser *const user);
+
+/** @brief Options for `LDAllFlagsState`, combined with bitwise or */
+enum LDAllFlagsStateOption
+{
+    /** @brief Only include flags that are available to client side SDKs */
+    LD_ALLFLAGS_CLIENT_SIDE_ONLY = 1 << 0,
+    /** @brief Include a `"$flagsState"` object with the variation index,
+     * version, and event tracking settings of each flag */
+    LD_ALLFLAGS_WITH_METADATA = 1 << 1,
+    /** @brief Include the evaluation reason of each flag in `"$flagsState"`.
+     * Implies `LD_ALLFLAGS_WITH_METADATA`. */
+    LD_ALLFLAGS_WITH_REASONS = 1 << 2
+};
+
+/** @brief A growable text buffer. Zero initialize before first use. */
+struct LDTextBuffer
+{
+    /** @brief NUL terminated text once anything has been written. Must be
+     * freed with `LDFree`. */
+    char *text;
+    /** @brief The number of bytes of text, excluding the terminator */
+    size_t length;
+    /** @brief The number of bytes allocated for `text` */
+    size_t capacity;
+};
+
+/**
+ * @brief Evaluates all flags for a user and writes them as JSON text, the
+ * format expected by the bootstrap option of client side SDKs.
+ *
+ * Without options the text is the same as the serialization of `LDAllFlags`.
+ * The text is written straight into `buffer` without building a JSON tree,
+ * and the buffer may be reused by setting `length` to 0 between calls.
+ * This does not send analytics events back to LaunchDarkly.
+ * @param[in] client The client to use. May not be `NULL`.
+ * @param[in] user The user to evaluate flags for. Ownership is not transferred.
+ * May not be `NULL`.
+ * @param[in] options A combination of `LDAllFlagsStateOption` values, or 0.
+ * @param[in] keyPrefix Only flags whose keys start with this are included.
+ * May be `NULL` to include every flag.
+ * @param[in,out] buffer The text is appended at `buffer->length`. Nothing is
+ * appended on failure. May not be `NULL`.
+ * @return True on success, False on failure.
+ */
+LD_EXPORT(LDBoolean)
+LDAllFlagsState(
+    struct LDClient *const     client,
+    const struct LDUser *const user,
+    const unsigned int         options,
+    const char *const          keyPrefix,
+    struct LDTextBuffer *const buffer);
@@ -0,0 +1,124 @@
+#include "assertion.h"
+#include "atomic.h"
+
+#if defined(__ATOMIC_SEQ_CST)
+/* GCC >= 4.7 and Clang */
+#define LD_ATOMIC_BUILTINS
+#elif defined(__GNUC__)
+/* older GCC only has the legacy full barrier builtins */
+#define LD_ATOMIC_SYNC
+#elif defined(_WIN32)
+#include <windows.h>
+#define LD_ATOMIC_INTERLOCKED
+#else
+#include <pthread.h>
+#define LD_ATOMIC_MUTEX
+
+static pthread_mutex_t atomicLock = PTHREAD_MUTEX_INITIALIZER;
+#endif
+
+long
+LDi_atomicAdd(volatile long *const value, const long delta)
+{
+#if defined(LD_ATOMIC_MUTEX)
+    long result;
+#endif
+
+    LD_ASSERT(value);
+
+#if defined(LD_ATOMIC_BUILTINS)
+    return __atomic_add_fetch(value, delta, __ATOMIC_SEQ_CST);
+#elif defined(LD_ATOMIC_SYNC)
+    return __sync_add_and_fetch(value, delta);
+#elif defined(LD_ATOMIC_INTERLOCKED)
+    return InterlockedExchangeAdd(value, delta) + delta;
+#else
+    pthread_mutex_lock(&atomicLock);
+    result = *value += delta;
+    pthread_mutex_unlock(&atomicLock);
+
+    return result;
+#endif
+}
+
+long
+LDi_atomicLoad(volatile long *const value)
+{
+    LD_ASSERT(value);
+
+#if defined(LD_ATOMIC_BUILTINS)
+    return __atomic_load_n(value, __ATOMIC_SEQ_CST);
+#elif defined(LD_ATOMIC_INTERLOCKED)
+    return InterlockedCompareExchange(value, 0, 0);
+#else
+    return LDi_atomicAdd(value, 0);
+#endif
+}
+
+void
+LDi_atomicStore(volatile long *const value, const long desired)
+{
+    LD_ASSERT(value);
+
+#if defined(LD_ATOMIC_BUILTINS)
+    __atomic_store_n(value, desired, __ATOMIC_SEQ_CST);
+#elif defined(LD_ATOMIC_SYNC)
+    __sync_synchronize();
+    *value = desired;
+    __sync_synchronize();
+#elif defined(LD_ATOMIC_INTERLOCKED)
+    InterlockedExchange(value, desired);
+#else
+    pthread_mutex_lock(&atomicLock);
+    *value = desired;
+    pthread_mutex_unlock(&atomicLock);
+#endif
+}
+
+void *
+LDi_atomicLoadPointer(void *volatile *const value)
+{
+#if defined(LD_ATOMIC_SYNC) || defined(LD_ATOMIC_MUTEX)
+    void *result;
+#endif
+
+    LD_ASSERT(value);
+
+#if defined(LD_ATOMIC_BUILTINS)
+    return __atomic_load_n(value, __ATOMIC_SEQ_CST);
+#elif defined(LD_ATOMIC_SYNC)
+    __sync_synchronize();
+    result = *value;
+    __sync_synchronize();
+
+    return result;
+#elif defined(LD_ATOMIC_INTERLOCKED)
+    return InterlockedCompareExchangePointer(value, NULL, NULL);
+#else
+    pthread_mutex_lock(&atomicLock);
+    result = *value;
+    pthread_mutex_unlock(&atomicLock);
+
+    return result;
+#endif
+}
+
+void
+LDi_atomicStorePointer(void *volatile *const value, void *const desired)
+{
+    LD_ASSERT(value);
+
+#if defined(LD_ATOMIC_BUILTINS)
+    __atomic_store_n(value, desired, __ATOMIC_SEQ_CST);
+#elif defined(LD_ATOMIC_SYNC)
+    __sync_synchronize();
+    *value = desired;
+    __sync_synchronize();
+#elif defined(LD_ATOMIC_INTERLOCKED)
+    InterlockedExchangePointer(value, desired);
+#else
+    pthread_mutex_lock(&atomicLock);
+    *value = desired;
+    pthread_mutex_unlock(&atomicLock);
+#endif
+}
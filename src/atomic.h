@@ -0,0 +1,26 @@
+/*!
+ * @file atomic.h
+ * @brief Internal API Interface for atomic operations
+ *
+ * All operations are sequentially consistent. Compiler intrinsics are used
+ * where available, otherwise the operations fall back to a single global
+ * mutex.
+ */
+
+#pragma once
+
+/** @brief Add `delta` to `value` and return the new value. */
+long
+LDi_atomicAdd(volatile long *const value, const long delta);
+
+long
+LDi_atomicLoad(volatile long *const value);
+
+void
+LDi_atomicStore(volatile long *const value, const long desired);
+
+void *
+LDi_atomicLoadPointer(void *volatile *const value);
+
+void
+LDi_atomicStorePointer(void *volatile *const value, void *const desired);
@@ -0,0 +1,432 @@
+#include <stdio.h>
+#include <string.h>
+
+#include <launchdarkly/api.h>
+
+#include "assertion.h"
+#include "bucket.h"
+#include "user.h"
+
+/* SSE2 is part of every x86-64 target, so no runtime detection is needed */
+#if defined(__SSE2__) || defined(_M_X64) || \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define LD_BUCKET_SSE2
+#include <emmintrin.h>
+#endif
+
+/* Inputs longer than this were rejected by the fixed size buffer bucketing
+used to format into. The limit is kept so no user changes bucket. */
+#define LD_BUCKET_INPUT_MAX 255
+
+/* number of inputs hashed together */
+#define LD_BUCKET_LANES 4
+
+/* a partial prefix block, the longest input, and padding */
+#define LD_BUCKET_MAX_BLOCKS ((63 + LD_BUCKET_INPUT_MAX + 9 + 63) / 64)
+
+/* The unhashed remainder of one input, padded as SHA1 requires */
+struct BucketLane
+{
+    uint32_t      state[5];
+    unsigned char blocks[LD_BUCKET_MAX_BLOCKS * 64];
+    /* 0 for an unused lane */
+    unsigned int blockCount;
+};
+
+static void
+appendText(struct LDBucketPrefix *const prefix, const char *const text)
+{
+    size_t length;
+
+    length = strlen(text);
+
+    SHA1Update(&prefix->context, (const unsigned char *)text, length);
+    SHA1Update(&prefix->context, (const unsigned char *)".", 1);
+
+    prefix->length += length + 1;
+}
+
+void
+LDi_initBucketPrefix(
+    struct LDBucketPrefix *const prefix,
+    const char *const            first,
+    const char *const            second)
+{
+    LD_ASSERT(prefix);
+    LD_ASSERT(first);
+
+    SHA1Init(&prefix->context);
+    prefix->length = 0;
+
+    appendText(prefix, first);
+
+    if (second) {
+        appendText(prefix, second);
+    }
+}
+
+/* Completes the message "prefix" "bucketable" ["." "secondary"]. Returns
+false if it is longer than bucketing accepts. */
+static LDBoolean
+prepareLane(
+    struct BucketLane *const           lane,
+    const struct LDBucketPrefix *const prefix,
+    const char *const                  bucketable,
+    const char *const                  secondary)
+{
+    size_t         buffered, used, bucketableLength, secondaryLength;
+    uint32_t       bits;
+    unsigned char *end;
+
+    bucketableLength = strlen(bucketable);
+    secondaryLength  = secondary ? strlen(secondary) : 0;
+
+    if (prefix->length + bucketableLength +
+            (secondary ? 1 + secondaryLength : 0) >
+        LD_BUCKET_INPUT_MAX)
+    {
+        return LDBooleanFalse;
+    }
+
+    /* complete blocks of the prefix are already in the state, the rest is
+    buffered in the context */
+    buffered = prefix->length % 64;
+
+    memcpy(lane->state, prefix->context.state, sizeof(lane->state));
+    memcpy(lane->blocks, prefix->context.buffer, buffered);
+
+    used = buffered;
+
+    memcpy(lane->blocks + used, bucketable, bucketableLength);
+    used += bucketableLength;
+
+    if (secondary) {
+        lane->blocks[used++] = '.';
+
+        memcpy(lane->blocks + used, secondary, secondaryLength);
+        used += secondaryLength;
+    }
+
+    bits = (uint32_t)(prefix->length + used - buffered) * 8;
+
+    lane->blocks[used++] = 0x80;
+    lane->blockCount     = (used + 8 + 63) / 64;
+
+    memset(lane->blocks + used, 0, lane->blockCount * 64 - used);
+
+    /* big endian message length, inputs are short enough for 32 bits */
+    end     = lane->blocks + lane->blockCount * 64;
+    end[-4] = (unsigned char)(bits >> 24);
+    end[-3] = (unsigned char)(bits >> 16);
+    end[-2] = (unsigned char)(bits >> 8);
+    end[-1] = (unsigned char)bits;
+
+    return LDBooleanTrue;
+}
+
+static void
+transformLane(struct BucketLane *const lane)
+{
+    unsigned int block;
+
+    for (block = 0; block < lane->blockCount; block++) {
+        SHA1Transform(lane->state, lane->blocks + block * 64);
+    }
+}
+
+#ifdef LD_BUCKET_SSE2
+
+#define LD_ROTL(x, n)                                                          \
+    _mm_or_si128(_mm_slli_epi32((x), (n)), _mm_srli_epi32((x), 32 - (n)))
+
+/* big endian message word `t` of a lane's block, 0 past its last block */
+static int
+laneWord(
+    const struct BucketLane *const lane,
+    const unsigned int             block,
+    const unsigned int             t)
+{
+    const unsigned char *word;
+
+    if (block >= lane->blockCount) {
+        return 0;
+    }
+
+    word = lane->blocks + block * 64 + t * 4;
+
+    return (int)(
+        ((uint32_t)word[0] << 24) | ((uint32_t)word[1] << 16) |
+        ((uint32_t)word[2] << 8) | (uint32_t)word[3]);
+}
+
+/* Runs the SHA1 compression of every lane at once, one lane per 32 bit
+element. A lane out of blocks keeps its state. */
+static void
+transformLanes(struct BucketLane *const lanes)
+{
+    __m128i      state[5], w[16], a, b, c, d, e, f, k, temp, mask;
+    unsigned int i, t, block, blocks;
+    uint32_t     words[LD_BUCKET_LANES];
+
+    blocks = 0;
+
+    for (i = 0; i < LD_BUCKET_LANES; i++) {
+        if (lanes[i].blockCount > blocks) {
+            blocks = lanes[i].blockCount;
+        }
+    }
+
+    for (i = 0; i < 5; i++) {
+        state[i] = _mm_set_epi32(
+            (int)lanes[3].state[i],
+            (int)lanes[2].state[i],
+            (int)lanes[1].state[i],
+            (int)lanes[0].state[i]);
+    }
+
+    for (block = 0; block < blocks; block++) {
+        mask = _mm_set_epi32(
+            block < lanes[3].blockCount ? -1 : 0,
+            block < lanes[2].blockCount ? -1 : 0,
+            block < lanes[1].blockCount ? -1 : 0,
+            block < lanes[0].blockCount ? -1 : 0);
+
+        for (t = 0; t < 16; t++) {
+            w[t] = _mm_set_epi32(
+                laneWord(&lanes[3], block, t),
+                laneWord(&lanes[2], block, t),
+                laneWord(&lanes[1], block, t),
+                laneWord(&lanes[0], block, t));
+        }
+
+        a = state[0];
+        b = state[1];
+        c = state[2];
+        d = state[3];
+        e = state[4];
+
+        for (t = 0; t < 80; t++) {
+            if (t >= 16) {
+                temp = _mm_xor_si128(
+                    _mm_xor_si128(w[(t + 13) & 15], w[(t + 8) & 15]),
+                    _mm_xor_si128(w[(t + 2) & 15], w[t & 15]));
+
+                w[t & 15] = LD_ROTL(temp, 1);
+            }
+
+            if (t < 20) {
+                f = _mm_or_si128(_mm_and_si128(b, c), _mm_andnot_si128(b, d));
+                k = _mm_set1_epi32(0x5A827999);
+            } else if (t < 40) {
+                f = _mm_xor_si128(_mm_xor_si128(b, c), d);
+                k = _mm_set1_epi32(0x6ED9EBA1);
+            } else if (t < 60) {
+                f = _mm_or_si128(
+                    _mm_and_si128(b, c), _mm_and_si128(_mm_or_si128(b, c), d));
+                k = _mm_set1_epi32((int)0x8F1BBCDCU);
+            } else {
+                f = _mm_xor_si128(_mm_xor_si128(b, c), d);
+                k = _mm_set1_epi32((int)0xCA62C1D6U);
+            }
+
+            temp = _mm_add_epi32(
+                _mm_add_epi32(LD_ROTL(a, 5), f),
+                _mm_add_epi32(_mm_add_epi32(e, k), w[t & 15]));
+
+            e = d;
+            d = c;
+            c = LD_ROTL(b, 30);
+            b = a;
+            a = temp;
+        }
+
+        temp = _mm_add_epi32(state[0], a);
+        state[0] = _mm_or_si128(
+            _mm_and_si128(mask, temp), _mm_andnot_si128(mask, state[0]));
+        temp = _mm_add_epi32(state[1], b);
+        state[1] = _mm_or_si128(
+            _mm_and_si128(mask, temp), _mm_andnot_si128(mask, state[1]));
+        temp = _mm_add_epi32(state[2], c);
+        state[2] = _mm_or_si128(
+            _mm_and_si128(mask, temp), _mm_andnot_si128(mask, state[2]));
+        temp = _mm_add_epi32(state[3], d);
+        state[3] = _mm_or_si128(
+            _mm_and_si128(mask, temp), _mm_andnot_si128(mask, state[3]));
+        temp = _mm_add_epi32(state[4], e);
+        state[4] = _mm_or_si128(
+            _mm_and_si128(mask, temp), _mm_andnot_si128(mask, state[4]));
+    }
+
+    for (i = 0; i < 5; i++) {
+        _mm_storeu_si128((__m128i *)words, state[i]);
+
+        for (t = 0; t < LD_BUCKET_LANES; t++) {
+            lanes[t].state[i] = words[t];
+        }
+    }
+}
+
+#else
+
+static void
+transformLanes(struct BucketLane *const lanes)
+{
+    unsigned int i;
+
+    for (i = 0; i < LD_BUCKET_LANES; i++) {
+        transformLane(&lanes[i]);
+    }
+}
+
+#endif
+
+/* The first 60 bits of the digest scaled to [0, 1). The value is accumulated
+a hex digit at a time in single precision, as the hexadecimal parsing this
+replaces did, because rounding differently would move users between
+buckets. */
+static float
+bucketFromState(const uint32_t *const state)
+{
+    float        acc;
+    unsigned int i;
+    const float  longScale = 1152921504606846975.0;
+
+    acc = 0;
+
+    for (i = 0; i < 15; i++) {
+        acc = (acc * 16) + ((state[i / 8] >> (28 - (i % 8) * 4)) & 0x0F);
+    }
+
+    return acc / longScale;
+}
+
+static void
+finishLanes(
+    struct BucketLane *const       lanes,
+    struct LDBucketRequest **const requests,
+    const unsigned int             count)
+{
+    unsigned int i;
+
+    if (count == 1) {
+        transformLane(&lanes[0]);
+    } else {
+        for (i = count; i < LD_BUCKET_LANES; i++) {
+            lanes[i].blockCount = 0;
+        }
+
+        transformLanes(lanes);
+    }
+
+    for (i = 0; i < count; i++) {
+        requests[i]->bucket = bucketFromState(lanes[i].state);
+        requests[i]->status = LDBooleanTrue;
+    }
+}
+
+/* NULL if the value cannot be bucketed */
+static const char *
+bucketableText(
+    const struct LDJSON *const value, char *const buffer, const size_t size)
+{
+    if (!value) {
+        return NULL;
+    } else if (LDJSONGetType(value) == LDText) {
+        return LDGetText(value);
+    } else if (LDJSONGetType(value) == LDNumber) {
+        if (snprintf(buffer, size, "%f", LDGetNumber(value)) >= 0) {
+            return buffer;
+        }
+    }
+
+    return NULL;
+}
+
+void
+LDi_bucketUserBatch(
+    const struct LDUser *const    user,
+    struct LDBucketRequest *const requests,
+    const unsigned int            count)
+{
+    struct BucketLane       lanes[LD_BUCKET_LANES];
+    struct LDBucketRequest *pending[LD_BUCKET_LANES];
+    struct LDAttributeView  view;
+    const struct LDJSON *   attributeValue;
+    const char *            attribute, *bucketable;
+    char                    bucketableBuffer[256];
+    unsigned int            i, laneCount;
+
+    LD_ASSERT(user);
+    LD_ASSERT(requests || count == 0);
+
+    attributeValue = NULL;
+    attribute      = NULL;
+    bucketable     = NULL;
+    laneCount      = 0;
+
+    for (i = 0; i < count; i++) {
+        struct LDBucketRequest *const request = &requests[i];
+
+        request->bucket = 0;
+        request->status = LDBooleanFalse;
+
+        if (!request->prefix) {
+            continue;
+        }
+
+        LD_ASSERT(request->attribute);
+
+        /* consecutive requests usually bucket by the same attribute */
+        if (!attribute || strcmp(attribute, request->attribute) != 0) {
+            attribute      = request->attribute;
+            attributeValue = LDi_viewAttribute(user, attribute, &view);
+            bucketable     = bucketableText(
+                attributeValue, bucketableBuffer, sizeof(bucketableBuffer));
+        }
+
+        if (!bucketable || !prepareLane(
+                               &lanes[laneCount],
+                               request->prefix,
+                               bucketable,
+                               user->secondary))
+        {
+            continue;
+        }
+
+        pending[laneCount++] = request;
+
+        if (laneCount == LD_BUCKET_LANES) {
+            finishLanes(lanes, pending, laneCount);
+
+            laneCount = 0;
+        }
+    }
+
+    if (laneCount > 0) {
+        finishLanes(lanes, pending, laneCount);
+    }
+}
+
+LDBoolean
+LDi_bucketUserWithPrefix(
+    const struct LDBucketPrefix *const prefix,
+    const struct LDUser *const         user,
+    const char *const                  attribute,
+    float *const                       bucket)
+{
+    struct LDBucketRequest request;
+
+    LD_ASSERT(prefix);
+    LD_ASSERT(user);
+    LD_ASSERT(attribute);
+    LD_ASSERT(bucket);
+
+    request.prefix    = prefix;
+    request.attribute = attribute;
+
+    LDi_bucketUserBatch(user, &request, 1);
+
+    *bucket = request.bucket;
+
+    return request.status;
+}
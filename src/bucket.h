@@ -0,0 +1,61 @@
+/*!
+ * @file bucket.h
+ * @brief Internal API Interface for percentage rollout bucketing
+ *
+ * A user is bucketed by hashing "prefix.value[.secondary]" with SHA1, where
+ * the prefix is "flagKey.salt." or "seed.". The prefix is constant for a
+ * rollout, so its hash state is computed once when the flag is compiled and
+ * only the user specific suffix is hashed per evaluation.
+ */
+
+#pragma once
+
+#include <launchdarkly/json.h>
+
+#include "sha1.h"
+
+struct LDUser;
+
+struct LDBucketPrefix
+{
+    /* state after absorbing the prefix, copied for every bucketing */
+    SHA1_CTX context;
+    /* length of the prefix text, including the trailing "." */
+    unsigned int length;
+};
+
+/** @brief Prepare a prefix of "first." or "first.second." when `second` is
+ * not `NULL`. */
+void
+LDi_initBucketPrefix(
+    struct LDBucketPrefix *const prefix,
+    const char *const            first,
+    const char *const            second);
+
+struct LDBucketRequest
+{
+    /* requests with a NULL prefix are skipped */
+    const struct LDBucketPrefix *prefix;
+    const char *                 attribute;
+    /* results, a bucket of 0 with a false status if the attribute is missing
+    or cannot be bucketed */
+    float     bucket;
+    LDBoolean status;
+};
+
+/** @brief Compute many buckets of one user. Inputs are hashed several at a
+ * time where the platform supports it. */
+void
+LDi_bucketUserBatch(
+    const struct LDUser *const    user,
+    struct LDBucketRequest *const requests,
+    const unsigned int            count);
+
+/** @brief Compute the bucket of a user in [0, 1). Returns false, with a
+ * bucket of 0, if the attribute is missing or cannot be bucketed. */
+LDBoolean
+LDi_bucketUserWithPrefix(
+    const struct LDBucketPrefix *const prefix,
+    const struct LDUser *const         user,
+    const char *const                  attribute,
+    float *const                       bucket);
@@ -52,6 +52,21 @@ LDClientInit(struct LDConfig *const config, const unsigned int maxwaitmilli)
         return NULL;
     }
 
+    if (config->allFlagsWorkers > 0 && !config->allFlagsExecutor) {
+        if (!(client->workers = LDi_newWorkerPool(config->allFlagsWorkers))) {
+            LD_LOG(
+                LD_LOG_WARNING,
+                "failed to start workers, LDAllFlags will run serially");
+        }
+    }
+
+    if (config->evaluationCacheCapacity > 0) {
+        if (!(client->evalCache =
+                  LDi_newEvalCache(config->evaluationCacheCapacity))) {
+            LD_LOG(LD_LOG_WARNING, "failed to allocate evaluation cache");
+        }
+    }
+
     LDi_rwlock_init(&client->lock);
 
     LDi_thread_create(&client->thread, LDi_networkthread, client);
@@ -89,6 +104,8 @@ LDClientClose(struct LDClient *const client)
         LDi_thread_join(&client->thread);
 
         /* cleanup resources */
+        LDi_freeWorkerPool(client->workers);
+        LDi_freeEvalCache(client->evalCache);
         LDi_rwlock_destroy(&client->lock);
         LDi_freeEventProcessor(client->eventProcessor);
 
@@ -282,3 +299,86 @@ LDClientFlush(struct LDClient *const client)
 
     return LDBooleanTrue;
 }
+
+LDBoolean
+LDClientGetEvaluationCacheStats(
+    struct LDClient *const               client,
+    struct LDEvaluationCacheStats *const stats)
+{
+    LD_ASSERT_API(client);
+    LD_ASSERT_API(stats);
+
+#ifdef LAUNCHDARKLY_DEFENSIVE
+    if (client == NULL) {
+        LD_LOG(LD_LOG_WARNING, "LDClientGetEvaluationCacheStats NULL client");
+
+        return LDBooleanFalse;
+    }
+
+    if (stats == NULL) {
+        LD_LOG(LD_LOG_WARNING, "LDClientGetEvaluationCacheStats NULL stats");
+
+        return LDBooleanFalse;
+    }
+#endif
+
+    if (client->evalCache) {
+        LDi_evalCacheGetStats(client->evalCache, stats);
+    } else {
+        memset(stats, 0, sizeof(struct LDEvaluationCacheStats));
+    }
+
+    return LDBooleanTrue;
+}
+
+LDBoolean
+LDClientGetEventStats(
+    struct LDClient *const client, struct LDEventStats *const stats)
+{
+    LD_ASSERT_API(client);
+    LD_ASSERT_API(stats);
+
+#ifdef LAUNCHDARKLY_DEFENSIVE
+    if (client == NULL) {
+        LD_LOG(LD_LOG_WARNING, "LDClientGetEventStats NULL client");
+
+        return LDBooleanFalse;
+    }
+
+    if (stats == NULL) {
+        LD_LOG(LD_LOG_WARNING, "LDClientGetEventStats NULL stats");
+
+        return LDBooleanFalse;
+    }
+#endif
+
+    LDi_getEventStats(client->eventProcessor, stats);
+
+    return LDBooleanTrue;
+}
+
+LDBoolean
+LDClientGetStoreCacheStats(
+    struct LDClient *const client, struct LDStoreCacheStats *const stats)
+{
+    LD_ASSERT_API(client);
+    LD_ASSERT_API(stats);
+
+#ifdef LAUNCHDARKLY_DEFENSIVE
+    if (client == NULL) {
+        LD_LOG(LD_LOG_WARNING, "LDClientGetStoreCacheStats NULL client");
+
+        return LDBooleanFalse;
+    }
+
+    if (stats == NULL) {
+        LD_LOG(LD_LOG_WARNING, "LDClientGetStoreCacheStats NULL stats");
+
+        return LDBooleanFalse;
+    }
+#endif
+
+    LDStoreGetCacheStats(client->store, stats);
+
+    return LDBooleanTrue;
+}
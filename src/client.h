@@ -3,8 +3,10 @@
 #include <launchdarkly/json.h>
 
 #include "concurrency.h"
+#include "eval_cache.h"
 #include "event_processor.h"
 #include "lru.h"
+#include "worker_pool.h"
 
 struct LDClient
 {
@@ -15,4 +17,8 @@ struct LDClient
     LDBoolean              shouldFlush;
     struct LDStore *       store;
     struct EventProcessor *eventProcessor;
+    /* evaluates LDAllFlags in parallel when no executor is configured */
+    struct LDWorkerPool *workers;
+    /* NULL unless enabled */
+    struct LDEvalCache *evalCache;
 };
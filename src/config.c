@@ -47,22 +47,28 @@ LDConfigNew(const char *const key)
         goto error;
     }
 
-    config->stream                 = LDBooleanTrue;
-    config->sendEvents             = LDBooleanTrue;
-    config->eventsCapacity         = 10000;
-    config->timeout                = 5000;
-    config->flushInterval          = 5000;
-    config->pollInterval           = 30000;
-    config->offline                = LDBooleanFalse;
-    config->useLDD                 = LDBooleanFalse;
-    config->allAttributesPrivate   = LDBooleanFalse;
-    config->inlineUsersInEvents    = LDBooleanFalse;
-    config->userKeysCapacity       = 1000;
-    config->userKeysFlushInterval  = 300000;
-    config->storeBackend           = NULL;
-    config->storeCacheMilliseconds = 30 * 1000;
-    config->wrapperName            = NULL;
-    config->wrapperVersion         = NULL;
+    config->stream                    = LDBooleanTrue;
+    config->sendEvents                = LDBooleanTrue;
+    config->eventsCapacity            = 10000;
+    config->timeout                   = 5000;
+    config->flushInterval             = 5000;
+    config->pollInterval              = 30000;
+    config->offline                   = LDBooleanFalse;
+    config->useLDD                    = LDBooleanFalse;
+    config->allAttributesPrivate      = LDBooleanFalse;
+    config->inlineUsersInEvents       = LDBooleanFalse;
+    config->userKeysCapacity          = 1000;
+    config->userKeysFlushInterval     = 300000;
+    config->storeBackend              = NULL;
+    config->storeCacheMilliseconds    = 30 * 1000;
+    config->storeMaxStaleMilliseconds = 0;
+    config->storeProactiveRefresh     = LDBooleanFalse;
+    config->allFlagsWorkers           = 0;
+    config->allFlagsExecutor          = NULL;
+    config->allFlagsExecutorContext   = NULL;
+    config->evaluationCacheCapacity   = 0;
+    config->wrapperName               = NULL;
+    config->wrapperVersion            = NULL;
 
     return config;
 
@@ -430,6 +436,99 @@ LDConfigSetFeatureStoreBackendCacheTTL(
     config->storeCacheMilliseconds = milliseconds;
 }
 
+void
+LDConfigSetFeatureStoreBackendMaxStaleness(
+    struct LDConfig *const config, const unsigned int milliseconds)
+{
+    LD_ASSERT_API(config);
+
+#ifdef LAUNCHDARKLY_DEFENSIVE
+    if (config == NULL) {
+        LD_LOG(
+            LD_LOG_WARNING,
+            "LDConfigSetFeatureStoreBackendMaxStaleness NULL config");
+
+        return;
+    }
+#endif
+
+    config->storeMaxStaleMilliseconds = milliseconds;
+}
+
+void
+LDConfigSetFeatureStoreBackendProactiveRefresh(
+    struct LDConfig *const config, const LDBoolean refresh)
+{
+    LD_ASSERT_API(config);
+
+#ifdef LAUNCHDARKLY_DEFENSIVE
+    if (config == NULL) {
+        LD_LOG(
+            LD_LOG_WARNING,
+            "LDConfigSetFeatureStoreBackendProactiveRefresh NULL config");
+
+        return;
+    }
+#endif
+
+    config->storeProactiveRefresh = refresh;
+}
+
+void
+LDConfigSetAllFlagsWorkers(
+    struct LDConfig *const config, const unsigned int workers)
+{
+    LD_ASSERT_API(config);
+
+#ifdef LAUNCHDARKLY_DEFENSIVE
+    if (config == NULL) {
+        LD_LOG(LD_LOG_WARNING, "LDConfigSetAllFlagsWorkers NULL config");
+
+        return;
+    }
+#endif
+
+    config->allFlagsWorkers = workers;
+}
+
+void
+LDConfigSetAllFlagsExecutor(
+    struct LDConfig *const config,
+    LDTaskExecutor         executor,
+    void *const            context)
+{
+    LD_ASSERT_API(config);
+
+#ifdef LAUNCHDARKLY_DEFENSIVE
+    if (config == NULL) {
+        LD_LOG(LD_LOG_WARNING, "LDConfigSetAllFlagsExecutor NULL config");
+
+        return;
+    }
+#endif
+
+    config->allFlagsExecutor        = executor;
+    config->allFlagsExecutorContext = context;
+}
+
+void
+LDConfigSetEvaluationCacheCapacity(
+    struct LDConfig *const config, const unsigned int capacity)
+{
+    LD_ASSERT_API(config);
+
+#ifdef LAUNCHDARKLY_DEFENSIVE
+    if (config == NULL) {
+        LD_LOG(
+            LD_LOG_WARNING, "LDConfigSetEvaluationCacheCapacity NULL config");
+
+        return;
+    }
+#endif
+
+    config->evaluationCacheCapacity = capacity;
+}
+
 LDBoolean
 LDConfigSetWrapperInfo(
     struct LDConfig *const config,
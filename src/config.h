@@ -1,5 +1,6 @@
 #pragma once
 
+#include <launchdarkly/config.h>
 #include <launchdarkly/json.h>
 #include <launchdarkly/store.h>
 
@@ -24,6 +25,12 @@ struct LDConfig
     unsigned int             userKeysFlushInterval;
     struct LDStoreInterface *storeBackend;
     unsigned int             storeCacheMilliseconds;
+    unsigned int             storeMaxStaleMilliseconds;
+    LDBoolean                storeProactiveRefresh;
+    unsigned int             allFlagsWorkers;
+    LDTaskExecutor           allFlagsExecutor;
+    void *                   allFlagsExecutorContext;
+    unsigned int             evaluationCacheCapacity;
     char *                   wrapperName;
     char *                   wrapperVersion;
 };
@@ -0,0 +1,92 @@
+#include <stddef.h>
+#include <string.h>
+
+#include "assertion.h"
+#include "atomic.h"
+#include "epoch.h"
+#include "utility.h"
+
+/* busy wait iterations before yielding to other threads */
+#define LD_EPOCH_SPINS 64
+
+void
+LDi_epochInit(struct LDEpoch *const epoch)
+{
+    LD_ASSERT(epoch);
+
+    memset(epoch, 0, sizeof(struct LDEpoch));
+}
+
+/* Threads have distinct stacks, so the address of a local is a cheap
+per thread identifier. */
+static struct LDEpochStripe *
+stripeForThread(struct LDEpoch *const epoch)
+{
+    unsigned long address;
+
+    address = (unsigned long)(size_t)&address;
+    address = ((address >> 12) * 2654435761UL) >> 16;
+
+    return &epoch->stripes[address % LD_EPOCH_STRIPES];
+}
+
+void
+LDi_epochEnter(struct LDEpoch *const epoch, struct LDEpochGuard *const guard)
+{
+    long parity;
+
+    LD_ASSERT(epoch);
+    LD_ASSERT(guard);
+
+    parity = LDi_atomicLoad(&epoch->current) & 1;
+
+    guard->readers = &stripeForThread(epoch)->readers[parity];
+
+    LDi_atomicAdd(guard->readers, 1);
+}
+
+void
+LDi_epochExit(struct LDEpochGuard *const guard)
+{
+    LD_ASSERT(guard);
+    LD_ASSERT(guard->readers);
+
+    LDi_atomicAdd(guard->readers, -1);
+
+    guard->readers = NULL;
+}
+
+static void
+waitForReaders(struct LDEpoch *const epoch, const long parity)
+{
+    unsigned int stripe, spins;
+
+    for (stripe = 0; stripe < LD_EPOCH_STRIPES; stripe++) {
+        volatile long *readers;
+
+        readers = &epoch->stripes[stripe].readers[parity];
+
+        for (spins = 0; LDi_atomicLoad(readers) != 0; spins++) {
+            if (spins >= LD_EPOCH_SPINS) {
+                LDi_sleepMilliseconds(0);
+            }
+        }
+    }
+}
+
+void
+LDi_epochSynchronize(struct LDEpoch *const epoch)
+{
+    long previous;
+
+    LD_ASSERT(epoch);
+
+    /* A reader may load the parity just before a flip and register against
+    it afterwards, so both parities are drained. New readers always register
+    against the parity that is not being waited on. */
+    previous = LDi_atomicAdd(&epoch->current, 1) - 1;
+    waitForReaders(epoch, previous & 1);
+
+    previous = LDi_atomicAdd(&epoch->current, 1) - 1;
+    waitForReaders(epoch, previous & 1);
+}
@@ -0,0 +1,48 @@
+/*!
+ * @file epoch.h
+ * @brief Internal API Interface for epoch based memory reclamation
+ *
+ * Readers bracket access to shared pointers with `LDi_epochEnter` and
+ * `LDi_epochExit` and never block. A writer unpublishes a pointer, calls
+ * `LDi_epochSynchronize`, and may then free the old object because every
+ * reader that could have observed it has exited. Synchronize callers must be
+ * serialized externally, and must not be inside a read section themselves.
+ */
+
+#pragma once
+
+#define LD_EPOCH_STRIPES 32
+
+/* Readers are spread over stripes to limit contention on a single counter. */
+struct LDEpochStripe
+{
+    /* active readers for each epoch parity */
+    volatile long readers[2];
+    /* keep stripes on separate cache lines */
+    char padding[64 - 2 * sizeof(long)];
+};
+
+struct LDEpoch
+{
+    volatile long        current;
+    struct LDEpochStripe stripes[LD_EPOCH_STRIPES];
+};
+
+struct LDEpochGuard
+{
+    volatile long *readers;
+};
+
+void
+LDi_epochInit(struct LDEpoch *const epoch);
+
+void
+LDi_epochEnter(struct LDEpoch *const epoch, struct LDEpochGuard *const guard);
+
+void
+LDi_epochExit(struct LDEpochGuard *const guard);
+
+/** @brief Wait until all read sections active at the time of the call have
+ * exited. */
+void
+LDi_epochSynchronize(struct LDEpoch *const epoch);
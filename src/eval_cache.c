@@ -0,0 +1,619 @@
+#include <string.h>
+
+#include <launchdarkly/api.h>
+
+#include "assertion.h"
+#include "concurrency.h"
+#include "eval_cache.h"
+#include "json_writer.h"
+#include "user.h"
+
+#include "uthash.h"
+#include "utlist.h"
+
+/* The user attributes one flag can read, in a fixed order */
+struct EvalPlan
+{
+    char *       flagKey;
+    unsigned int version;
+    /* false if results of the flag are never cached */
+    LDBoolean      cacheable;
+    char **        attributes;
+    unsigned int   attributeCount;
+    UT_hash_handle hh;
+};
+
+struct EvalCacheEntry
+{
+    /* arbitrary bytes, see `LDi_evalCacheKey` */
+    char *                 key;
+    size_t                 keyLength;
+    struct LDJSON *        value;
+    struct LDDetails       details;
+    struct EvalCacheEntry *next, *prev;
+    UT_hash_handle         hh;
+};
+
+struct LDEvalCache
+{
+    ld_mutex_t   lock;
+    unsigned int capacity;
+    unsigned int count;
+    /* the store generation every entry and plan belongs to */
+    unsigned long          generation;
+    struct EvalPlan *      plans;
+    struct EvalCacheEntry *entries;
+    /* most recently used first */
+    struct EvalCacheEntry *recent;
+    unsigned long          hits;
+    unsigned long          misses;
+};
+
+static void
+freePlan(struct EvalPlan *const plan)
+{
+    unsigned int i;
+
+    if (plan) {
+        for (i = 0; i < plan->attributeCount; i++) {
+            LDFree(plan->attributes[i]);
+        }
+
+        LDFree(plan->attributes);
+        LDFree(plan->flagKey);
+        LDFree(plan);
+    }
+}
+
+static void
+freeEntry(struct EvalCacheEntry *const entry)
+{
+    if (entry) {
+        LDDetailsClear(&entry->details);
+        LDJSONFree(entry->value);
+        LDFree(entry->key);
+        LDFree(entry);
+    }
+}
+
+/* expects lock */
+static void
+clearCache(struct LDEvalCache *const cache)
+{
+    struct EvalPlan *      plan, *planTmp;
+    struct EvalCacheEntry *entry, *entryTmp;
+
+    HASH_ITER(hh, cache->plans, plan, planTmp)
+    {
+        HASH_DEL(cache->plans, plan);
+
+        freePlan(plan);
+    }
+
+    HASH_ITER(hh, cache->entries, entry, entryTmp)
+    {
+        HASH_DEL(cache->entries, entry);
+        DL_DELETE(cache->recent, entry);
+
+        freeEntry(entry);
+    }
+
+    cache->count = 0;
+}
+
+/* Discards everything from earlier generations. Returns false if
+`generation` is itself out of date. Expects lock. */
+static LDBoolean
+enterGeneration(struct LDEvalCache *const cache, const unsigned long generation)
+{
+    if (generation < cache->generation) {
+        return LDBooleanFalse;
+    }
+
+    if (generation > cache->generation) {
+        clearCache(cache);
+
+        cache->generation = generation;
+    }
+
+    return LDBooleanTrue;
+}
+
+struct LDEvalCache *
+LDi_newEvalCache(const unsigned int capacity)
+{
+    struct LDEvalCache *cache;
+
+    if (!(cache = (struct LDEvalCache *)LDAlloc(sizeof(struct LDEvalCache)))) {
+        return NULL;
+    }
+
+    memset(cache, 0, sizeof(struct LDEvalCache));
+
+    cache->capacity = capacity;
+
+    LDi_mutex_init(&cache->lock);
+
+    return cache;
+}
+
+void
+LDi_freeEvalCache(struct LDEvalCache *const cache)
+{
+    if (cache) {
+        clearCache(cache);
+
+        LDi_mutex_destroy(&cache->lock);
+
+        LDFree(cache);
+    }
+}
+
+static LDBoolean
+addAttribute(struct EvalPlan *const plan, const char *const attribute)
+{
+    char **      attributes;
+    unsigned int i;
+
+    if (!attribute) {
+        return LDBooleanTrue;
+    }
+
+    for (i = 0; i < plan->attributeCount; i++) {
+        if (strcmp(plan->attributes[i], attribute) == 0) {
+            return LDBooleanTrue;
+        }
+    }
+
+    if (!(attributes = (char **)LDRealloc(
+              plan->attributes,
+              sizeof(char *) * (plan->attributeCount + 1))))
+    {
+        return LDBooleanFalse;
+    }
+
+    plan->attributes = attributes;
+
+    if (!(plan->attributes[plan->attributeCount] = LDStrDup(attribute))) {
+        return LDBooleanFalse;
+    }
+
+    plan->attributeCount++;
+
+    return LDBooleanTrue;
+}
+
+static LDBoolean
+addRolloutAttributes(
+    struct EvalPlan *const                   plan,
+    const struct LDVariationOrRollout *const variationOrRollout)
+{
+    if (!variationOrRollout->valid || !variationOrRollout->isRollout) {
+        return LDBooleanTrue;
+    }
+
+    /* the secondary key is part of every bucket */
+    return addAttribute(plan, variationOrRollout->bucketBy) &&
+        addAttribute(plan, "secondary");
+}
+
+static LDBoolean
+addSegmentAttributes(
+    struct EvalPlan *const        plan,
+    const struct LDSegment *const segment)
+{
+    unsigned int i, j;
+
+    /* included and excluded users */
+    if (!addAttribute(plan, "key")) {
+        return LDBooleanFalse;
+    }
+
+    for (i = 0; i < segment->ruleCount; i++) {
+        const struct LDSegmentRule *const rule = &segment->rules[i];
+
+        for (j = 0; j < rule->clauseCount; j++) {
+            if (!addAttribute(plan, rule->clauses[j].attribute)) {
+                return LDBooleanFalse;
+            }
+        }
+
+        if (rule->hasWeight) {
+            if (!addAttribute(plan, rule->bucketBy) ||
+                !addAttribute(plan, "secondary"))
+            {
+                return LDBooleanFalse;
+            }
+        }
+    }
+
+    return LDBooleanTrue;
+}
+
+static LDBoolean
+addClauseAttributes(
+    struct EvalPlan *const       plan,
+    struct LDStore *const        store,
+    const struct LDClause *const clause)
+{
+    const struct LDJSON *iter;
+
+    if (!clause->segmentMatch) {
+        return addAttribute(plan, clause->attribute);
+    }
+
+    if (!clause->values) {
+        return LDBooleanTrue;
+    }
+
+    for (iter = LDGetIter(clause->values); iter; iter = LDIterNext(iter)) {
+        const struct LDSegment *segment;
+        struct LDJSONRC *       segmentrc;
+        LDBoolean               success;
+
+        if (LDJSONGetType(iter) != LDText) {
+            continue;
+        }
+
+        if (!LDStoreGetBorrowed(
+                store, LD_SEGMENT, LDGetText(iter), &segmentrc))
+        {
+            return LDBooleanFalse;
+        }
+
+        /* a missing segment never matches */
+        if (!segmentrc) {
+            continue;
+        }
+
+        success = LDBooleanTrue;
+
+        if ((segment = LDJSONRCGetSegment(segmentrc))) {
+            success = addSegmentAttributes(plan, segment);
+        }
+
+        LDStoreReleaseBorrowed(store, segmentrc);
+
+        if (!success) {
+            return LDBooleanFalse;
+        }
+    }
+
+    return LDBooleanTrue;
+}
+
+/* Returns NULL on failure */
+static struct EvalPlan *
+makePlan(struct LDStore *const store, const struct LDFlag *const flag)
+{
+    struct EvalPlan *plan;
+    unsigned int     i, j;
+
+    if (!(plan = (struct EvalPlan *)LDAlloc(sizeof(struct EvalPlan)))) {
+        return NULL;
+    }
+
+    memset(plan, 0, sizeof(struct EvalPlan));
+
+    if (!(plan->flagKey = LDStrDup(flag->key))) {
+        goto error;
+    }
+
+    plan->version = LDi_getFeatureVersionTrusted(flag->json);
+
+    /* prerequisite events are specific to the user and the time */
+    if (flag->prerequisiteCount > 0) {
+        return plan;
+    }
+
+    plan->cacheable = LDBooleanTrue;
+
+    if (flag->targetCount > 0 && !addAttribute(plan, "key")) {
+        goto error;
+    }
+
+    for (i = 0; i < flag->ruleCount; i++) {
+        const struct LDRule *const rule = &flag->rules[i];
+
+        for (j = 0; j < rule->clauseCount; j++) {
+            if (!addClauseAttributes(plan, store, &rule->clauses[j])) {
+                goto error;
+            }
+        }
+
+        if (!addRolloutAttributes(plan, &rule->variationOrRollout)) {
+            goto error;
+        }
+    }
+
+    if (!addRolloutAttributes(plan, &flag->fallthrough)) {
+        goto error;
+    }
+
+    return plan;
+
+error:
+    freePlan(plan);
+
+    return NULL;
+}
+
+/* Appends an attribute without copying it first. A missing attribute is
+written as "~". */
+static LDBoolean
+writeAttribute(
+    struct LDTextBuffer *const buffer,
+    const struct LDUser *const user,
+    const char *const          attribute)
+{
+    struct LDAttributeView view;
+    const struct LDJSON *  value;
+
+    if ((value = LDi_viewAttribute(user, attribute, &view))) {
+        return LDi_writeJSON(buffer, value);
+    }
+
+    return LDi_writeText(buffer, "~");
+}
+
+LDBoolean
+LDi_evalCacheKey(
+    struct LDEvalCache *const  cache,
+    struct LDStore *const      store,
+    const unsigned long        generation,
+    const struct LDFlag *const flag,
+    const struct LDUser *const user,
+    struct LDTextBuffer *const key)
+{
+    struct EvalPlan *plan, *built;
+    unsigned int     version, i;
+    LDBoolean        success;
+
+    LD_ASSERT(cache);
+    LD_ASSERT(store);
+    LD_ASSERT(flag);
+    LD_ASSERT(user);
+    LD_ASSERT(key);
+
+    /* a write was in progress */
+    if (generation % 2 != 0 || !flag->valid || !flag->key) {
+        return LDBooleanFalse;
+    }
+
+    version = LDi_getFeatureVersionTrusted(flag->json);
+    built   = NULL;
+    plan    = NULL;
+
+    LDi_mutex_lock(&cache->lock);
+
+    if (enterGeneration(cache, generation)) {
+        HASH_FIND_STR(cache->plans, flag->key, plan);
+    }
+
+    /* plans are built without the lock because they read the store */
+    if (!plan || plan->version != version) {
+        LDi_mutex_unlock(&cache->lock);
+
+        if (!(plan = built = makePlan(store, flag))) {
+            return LDBooleanFalse;
+        }
+
+        LDi_mutex_lock(&cache->lock);
+    }
+
+    success = plan->cacheable;
+
+    if (success) {
+        key->length = 0;
+
+        success = LDi_writeString(key, flag->key) &&
+            LDi_writeText(key, ",") && LDi_writeNumber(key, version);
+
+        for (i = 0; success && i < plan->attributeCount; i++) {
+            success = LDi_writeText(key, ",") &&
+                writeAttribute(key, user, plan->attributes[i]);
+        }
+    }
+
+    /* only kept if nothing was written to the store while it was built */
+    if (built) {
+        struct EvalPlan *existing;
+
+        existing = NULL;
+
+        if (LDStoreGetGeneration(store) == generation &&
+            enterGeneration(cache, generation))
+        {
+            HASH_FIND_STR(cache->plans, built->flagKey, existing);
+
+            if (!existing) {
+                HASH_ADD_KEYPTR(
+                    hh,
+                    cache->plans,
+                    built->flagKey,
+                    strlen(built->flagKey),
+                    built);
+
+                built = NULL;
+            }
+        }
+    }
+
+    LDi_mutex_unlock(&cache->lock);
+
+    freePlan(built);
+
+    return success;
+}
+
+static LDBoolean
+copyDetails(struct LDDetails *const to, const struct LDDetails *const from)
+{
+    *to = *from;
+
+    if (from->reason == LD_RULE_MATCH && from->extra.rule.id) {
+        if (!(to->extra.rule.id = LDStrDup(from->extra.rule.id))) {
+            to->reason = LD_UNKNOWN;
+
+            return LDBooleanFalse;
+        }
+    } else if (
+        from->reason == LD_PREREQUISITE_FAILED && from->extra.prerequisiteKey)
+    {
+        if (!(to->extra.prerequisiteKey =
+                  LDStrDup(from->extra.prerequisiteKey))) {
+            to->reason = LD_UNKNOWN;
+
+            return LDBooleanFalse;
+        }
+    }
+
+    return LDBooleanTrue;
+}
+
+LDBoolean
+LDi_evalCacheGet(
+    struct LDEvalCache *const        cache,
+    const unsigned long              generation,
+    const struct LDTextBuffer *const key,
+    struct LDJSON **const            o_value,
+    struct LDDetails *const          o_details)
+{
+    struct EvalCacheEntry *entry;
+    struct LDJSON *        value;
+
+    LD_ASSERT(cache);
+    LD_ASSERT(key);
+    LD_ASSERT(o_value);
+    LD_ASSERT(o_details);
+
+    entry = NULL;
+    value = NULL;
+
+    LDi_mutex_lock(&cache->lock);
+
+    if (enterGeneration(cache, generation)) {
+        HASH_FIND(hh, cache->entries, key->text, key->length, entry);
+    }
+
+    if (!entry || (entry->value && !(value = LDJSONDuplicate(entry->value))))
+    {
+        cache->misses++;
+
+        LDi_mutex_unlock(&cache->lock);
+
+        return LDBooleanFalse;
+    }
+
+    LDDetailsClear(o_details);
+
+    if (!copyDetails(o_details, &entry->details)) {
+        cache->misses++;
+
+        LDi_mutex_unlock(&cache->lock);
+
+        LDJSONFree(value);
+
+        return LDBooleanFalse;
+    }
+
+    DL_DELETE(cache->recent, entry);
+    DL_PREPEND(cache->recent, entry);
+
+    cache->hits++;
+
+    LDi_mutex_unlock(&cache->lock);
+
+    *o_value = value;
+
+    return LDBooleanTrue;
+}
+
+void
+LDi_evalCachePut(
+    struct LDEvalCache *const        cache,
+    const unsigned long              generation,
+    const struct LDTextBuffer *const key,
+    const struct LDJSON *const       value,
+    const struct LDDetails *const    details)
+{
+    struct EvalCacheEntry *entry, *existing;
+
+    LD_ASSERT(cache);
+    LD_ASSERT(key);
+    LD_ASSERT(details);
+
+    if (cache->capacity == 0) {
+        return;
+    }
+
+    /* copied before taking the lock */
+    if (!(entry = (struct EvalCacheEntry *)LDAlloc(
+              sizeof(struct EvalCacheEntry))))
+    {
+        return;
+    }
+
+    memset(entry, 0, sizeof(struct EvalCacheEntry));
+
+    if (!(entry->key = (char *)LDAlloc(key->length + 1)) ||
+        (value && !(entry->value = LDJSONDuplicate(value))) ||
+        !copyDetails(&entry->details, details))
+    {
+        freeEntry(entry);
+
+        return;
+    }
+
+    memcpy(entry->key, key->text, key->length + 1);
+    entry->keyLength = key->length;
+
+    existing = NULL;
+
+    LDi_mutex_lock(&cache->lock);
+
+    if (enterGeneration(cache, generation)) {
+        HASH_FIND(hh, cache->entries, entry->key, entry->keyLength, existing);
+
+        if (!existing) {
+            if (cache->count == cache->capacity) {
+                existing = cache->recent->prev;
+
+                HASH_DEL(cache->entries, existing);
+                DL_DELETE(cache->recent, existing);
+            } else {
+                cache->count++;
+            }
+
+            HASH_ADD_KEYPTR(
+                hh, cache->entries, entry->key, entry->keyLength, entry);
+            DL_PREPEND(cache->recent, entry);
+
+            entry = NULL;
+        } else {
+            existing = NULL;
+        }
+    }
+
+    LDi_mutex_unlock(&cache->lock);
+
+    freeEntry(existing);
+    freeEntry(entry);
+}
+
+void
+LDi_evalCacheGetStats(
+    struct LDEvalCache *const            cache,
+    struct LDEvaluationCacheStats *const stats)
+{
+    LD_ASSERT(cache);
+    LD_ASSERT(stats);
+
+    LDi_mutex_lock(&cache->lock);
+
+    stats->hits    = cache->hits;
+    stats->misses  = cache->misses;
+    stats->entries = cache->count;
+
+    LDi_mutex_unlock(&cache->lock);
+}
@@ -0,0 +1,62 @@
+/*!
+ * @file eval_cache.h
+ * @brief Internal API Interface for the evaluation result cache
+ *
+ * Results are keyed by the flag key, the flag version, and the values of the
+ * user attributes that the flag and its segments can read, so users that
+ * agree on those attributes share entries. The whole cache is discarded when
+ * the store generation advances.
+ */
+
+#pragma once
+
+#include <launchdarkly/api.h>
+
+#include "flag.h"
+#include "store.h"
+
+struct LDEvalCache;
+
+/* Returns NULL on allocation failure */
+struct LDEvalCache *
+LDi_newEvalCache(const unsigned int capacity);
+
+void
+LDi_freeEvalCache(struct LDEvalCache *const cache);
+
+/* Writes the key of evaluating `flag` for `user` into `key`. `generation`
+must be read from `store` before `flag` was. Returns false if the result
+cannot be cached, e.g. because the evaluation records prerequisite events.
+Must be called inside a read section of `store`. */
+LDBoolean
+LDi_evalCacheKey(
+    struct LDEvalCache *const  cache,
+    struct LDStore *const      store,
+    const unsigned long        generation,
+    const struct LDFlag *const flag,
+    const struct LDUser *const user,
+    struct LDTextBuffer *const key);
+
+/* On a hit `o_value` and `o_details` receive copies of the cached result */
+LDBoolean
+LDi_evalCacheGet(
+    struct LDEvalCache *const        cache,
+    const unsigned long              generation,
+    const struct LDTextBuffer *const key,
+    struct LDJSON **const            o_value,
+    struct LDDetails *const          o_details);
+
+/* Stores a copy of a result evaluated while the store stayed at
+`generation`. Failures only mean the result is not cached. */
+void
+LDi_evalCachePut(
+    struct LDEvalCache *const        cache,
+    const unsigned long              generation,
+    const struct LDTextBuffer *const key,
+    const struct LDJSON *const       value,
+    const struct LDDetails *const    details);
+
+void
+LDi_evalCacheGetStats(
+    struct LDEvalCache *const            cache,
+    struct LDEvaluationCacheStats *const stats);
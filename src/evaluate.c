@@ -1,11 +1,10 @@
+#include <stdio.h>
 #include <string.h>
 
-#include "hexify.h"
-#include "sha1.h"
-
 #include <launchdarkly/api.h>
 
 #include "assertion.h"
+#include "bucket.h"
 #include "client.h"
 #include "evaluate.h"
 #include "event_processor.h"
@@ -15,104 +14,235 @@
 #include "user.h"
 #include "utility.h"
 
-static const struct LDJSON *
-lookupRequiredValueOfType(
-    const struct LDJSON *const obj,
-    const char *const          context,
-    const char *const          key,
-    const LDJSONType           expectedType)
+#include "uthash.h"
+
+LDBoolean
+LDi_isEvalError(const EvalStatus status)
 {
-    const struct LDJSON *tmp;
+    return status == EVAL_MEM || status == EVAL_SCHEMA || status == EVAL_STORE;
+}
 
-    LD_ASSERT(context);
-    LD_ASSERT(key);
-    LD_ASSERT(obj);
-    LD_ASSERT(LDJSONGetType(obj) == LDObject);
+struct LDMemoFlag
+{
+    char * key;
+    double version;
+    /* set while the flag is being evaluated, used to detect cycles */
+    LDBoolean        inProgress;
+    EvalStatus       status;
+    struct LDDetails details;
+    struct LDJSON *  value;
+    /* events of the flag's own prerequisites */
+    struct LDEventRecord *events;
+    UT_hash_handle hh;
+};
+
+struct LDMemoSegment
+{
+    char *         key;
+    double         version;
+    EvalStatus     status;
+    UT_hash_handle hh;
+};
+
+void
+LDi_initEvalMemo(struct LDEvalMemo *const memo)
+{
+    LD_ASSERT(memo);
+
+    memo->flags    = NULL;
+    memo->segments = NULL;
+}
+
+static void
+clearMemoFlagResult(struct LDMemoFlag *const entry)
+{
+    LD_ASSERT(entry);
+
+    LDDetailsClear(&entry->details);
+    LDJSONFree(entry->value);
+    LDi_freeEventRecords(entry->events);
+
+    LDDetailsInit(&entry->details);
+    entry->value  = NULL;
+    entry->events = NULL;
+}
+
+void
+LDi_clearEvalMemo(struct LDEvalMemo *const memo)
+{
+    struct LDMemoFlag *   flag, *flagTmp;
+    struct LDMemoSegment *segment, *segmentTmp;
+
+    LD_ASSERT(memo);
+
+    HASH_ITER(hh, memo->flags, flag, flagTmp)
+    {
+        HASH_DEL(memo->flags, flag);
+
+        clearMemoFlagResult(flag);
+        LDFree(flag->key);
+        LDFree(flag);
+    }
+
+    HASH_ITER(hh, memo->segments, segment, segmentTmp)
+    {
+        HASH_DEL(memo->segments, segment);
+
+        LDFree(segment->key);
+        LDFree(segment);
+    }
+}
 
-    if (!(tmp = LDObjectLookup(obj, key))) {
-        LD_LOG_2(LD_LOG_ERROR, "%s missing required field %s", context, key);
+/* versions only distinguish updates that land during a single call */
+static double
+memoVersion(const struct LDJSON *const json)
+{
+    const struct LDJSON *version;
 
-        return NULL;
+    if (!json || LDJSONGetType(json) != LDObject) {
+        return -1;
     }
 
-    if (LDJSONGetType(tmp) != expectedType) {
-        LD_LOG_2(LD_LOG_ERROR, "%s.%s unexpected type", context, key);
+    version = LDObjectLookup(json, "version");
 
-        return NULL;
+    if (!version || LDJSONGetType(version) != LDNumber) {
+        return -1;
     }
 
-    return tmp;
+    return LDGetNumber(version);
 }
 
-static LDBoolean
-lookupOptionalValueOfType(
-    const struct LDJSON *const  obj,
-    const char *const           context,
-    const char *const           key,
-    const LDJSONType            expectedType,
-    const struct LDJSON **const result)
+static EvalStatus
+evaluatePrerequisite(
+    struct LDClient *const          client,
+    const char *const               key,
+    const struct LDFlag *const      flag,
+    const struct LDUser *const      user,
+    struct LDStore *const           store,
+    const LDBoolean                 recordReason,
+    struct LDEvalMemo *const        memo,
+    const struct LDMemoFlag **const o_entry)
 {
-    const struct LDJSON *tmp;
-    LDJSONType           actualType;
+    struct LDMemoFlag *entry;
+    double             version;
 
-    LD_ASSERT(context);
     LD_ASSERT(key);
-    LD_ASSERT(obj);
-    LD_ASSERT(LDJSONGetType(obj) == LDObject);
-    LD_ASSERT(result);
+    LD_ASSERT(flag);
+    LD_ASSERT(memo);
+    LD_ASSERT(o_entry);
 
-    *result = NULL;
+    version = memoVersion(flag->json);
 
-    if (!(tmp = LDObjectLookup(obj, key))) {
-        return LDBooleanTrue;
-    }
+    HASH_FIND_STR(memo->flags, key, entry);
 
-    actualType = LDJSONGetType(tmp);
+    if (entry) {
+        if (entry->inProgress) {
+            LD_LOG_1(LD_LOG_ERROR, "prerequisite cycle through \"%s\"", key);
 
-    if (actualType == LDNull) {
-        return LDBooleanTrue;
-    }
+            return EVAL_SCHEMA;
+        }
 
-    if (actualType != expectedType) {
-        LD_LOG_2(LD_LOG_ERROR, "%s.%s unexpected type", context, key);
+        if (entry->version == version) {
+            *o_entry = entry;
 
-        return LDBooleanFalse;
+            return entry->status;
+        }
+
+        clearMemoFlagResult(entry);
+    } else {
+        if (!(entry = LDAlloc(sizeof(struct LDMemoFlag)))) {
+            return EVAL_MEM;
+        }
+
+        if (!(entry->key = LDStrDup(key))) {
+            LDFree(entry);
+
+            return EVAL_MEM;
+        }
+
+        LDDetailsInit(&entry->details);
+        entry->value  = NULL;
+        entry->events = NULL;
+
+        HASH_ADD_KEYPTR(hh, memo->flags, entry->key, strlen(key), entry);
     }
 
-    *result = tmp;
+    entry->version    = version;
+    entry->inProgress = LDBooleanTrue;
 
-    return LDBooleanTrue;
+    entry->status = LDi_evaluate(
+        client,
+        flag,
+        user,
+        store,
+        &entry->details,
+        &entry->events,
+        &entry->value,
+        recordReason,
+        memo,
+        NULL);
+
+    entry->inProgress = LDBooleanFalse;
+
+    *o_entry = entry;
+
+    return entry->status;
 }
 
-LDBoolean
-LDi_isEvalError(const EvalStatus status)
+static EvalStatus
+matchSegment(
+    const char *const             key,
+    const struct LDSegment *const segment,
+    const struct LDUser *const    user,
+    struct LDEvalMemo *const      memo)
 {
-    return status == EVAL_MEM || status == EVAL_SCHEMA || status == EVAL_STORE;
+    struct LDMemoSegment *entry;
+    double                version;
+
+    LD_ASSERT(key);
+    LD_ASSERT(segment);
+    LD_ASSERT(memo);
+
+    version = memoVersion(segment->json);
+
+    HASH_FIND_STR(memo->segments, key, entry);
+
+    if (!entry) {
+        if (!(entry = LDAlloc(sizeof(struct LDMemoSegment)))) {
+            return EVAL_MEM;
+        }
+
+        if (!(entry->key = LDStrDup(key))) {
+            LDFree(entry);
+
+            return EVAL_MEM;
+        }
+
+        HASH_ADD_KEYPTR(hh, memo->segments, entry->key, strlen(key), entry);
+    } else if (entry->version == version) {
+        return entry->status;
+    }
+
+    entry->version = version;
+    entry->status  = LDi_segmentMatchesUser(segment, user);
+
+    return entry->status;
 }
 
 static EvalStatus
-maybeNegate(const struct LDJSON *const clause, const EvalStatus status)
+maybeNegate(const struct LDClause *const clause, const EvalStatus status)
 {
-    const struct LDJSON *negate;
-
     LD_ASSERT(clause);
 
     if (LDi_isEvalError(status)) {
         return status;
     }
 
-    if (!lookupOptionalValueOfType(clause, "clause", "negate", LDBool, &negate))
-    {
-        return EVAL_SCHEMA;
-    }
-
-    if (negate) {
-        if (LDGetBool(negate)) {
-            if (status == EVAL_MATCH) {
-                return EVAL_MISS;
-            } else if (status == EVAL_MISS) {
-                return EVAL_MATCH;
-            }
+    if (clause->negate) {
+        if (status == EVAL_MATCH) {
+            return EVAL_MISS;
+        } else if (status == EVAL_MISS) {
+            return EVAL_MATCH;
         }
     }
 
@@ -121,47 +251,28 @@ maybeNegate(const struct LDJSON *const clause, const EvalStatus status)
 
 static LDBoolean
 addValue(
-    const struct LDJSON *const flag,
+    const struct LDFlag *const flag,
     struct LDJSON **           result,
     struct LDDetails *const    details,
-    const struct LDJSON *const index)
+    const int                  index)
 {
-    struct LDJSON *      variationCopy;
-    const struct LDJSON *variations, *variation;
+    struct LDJSON *variationCopy;
 
     LD_ASSERT(flag);
     LD_ASSERT(result);
     LD_ASSERT(details);
 
-    if (index == NULL) {
-        LD_LOG(LD_LOG_ERROR, "null variation index");
-
-        goto err;
-    }
-
-    details->hasVariation = LDBooleanTrue;
-
-    if (LDJSONGetType(index) != LDNumber) {
-        LD_LOG(LD_LOG_ERROR, "variation index expected number");
-
-        goto err;
-    }
-
-    details->variationIndex = LDGetNumber(index);
+    /* index is resolved against the variations when the flag is compiled */
+    if (index < 0) {
+        *result               = NULL;
+        details->hasVariation = LDBooleanFalse;
 
-    if (!(variations =
-              lookupRequiredValueOfType(flag, "flag", "variations", LDArray)))
-    {
-        goto err;
+        return LDBooleanTrue;
     }
 
-    if (!(variation = LDArrayLookup(variations, LDGetNumber(index)))) {
-        LD_LOG(LD_LOG_ERROR, "variation index outside of bounds");
-
-        goto err;
-    }
+    LD_ASSERT((unsigned int)index < flag->variationCount);
 
-    if (!(variationCopy = LDJSONDuplicate(variation))) {
+    if (!(variationCopy = LDJSONDuplicate(flag->variations[index]))) {
         LD_LOG(LD_LOG_ERROR, "failed to allocate variation");
 
         *result               = NULL;
@@ -170,47 +281,26 @@ addValue(
         return LDBooleanFalse;
     }
 
-    *result = variationCopy;
-
-    return LDBooleanTrue;
+    details->hasVariation   = LDBooleanTrue;
+    details->variationIndex = index;
 
-err:
-    *result               = NULL;
-    details->hasVariation = LDBooleanFalse;
+    *result = variationCopy;
 
     return LDBooleanTrue;
 }
 
-static const char *
-LDi_getBucketAttribute(const struct LDJSON *const obj)
-{
-    const struct LDJSON *bucketBy;
-
-    LD_ASSERT(obj);
-    LD_ASSERT(LDJSONGetType(obj) == LDObject);
-
-    if (!lookupOptionalValueOfType(
-            obj, "rollout", "bucketBy", LDText, &bucketBy)) {
-        return NULL;
-    }
-
-    if (bucketBy == NULL) {
-        return "key";
-    }
-
-    return LDGetText(bucketBy);
-}
-
 EvalStatus
 LDi_evaluate(
-    struct LDClient *const     client,
-    const struct LDJSON *const flag,
-    const struct LDUser *const user,
-    struct LDStore *const      store,
-    struct LDDetails *const    details,
-    struct LDJSON **const      o_events,
-    struct LDJSON **const      o_value,
-    const LDBoolean            recordReason)
+    struct LDClient *const              client,
+    const struct LDFlag *const          flag,
+    const struct LDUser *const          user,
+    struct LDStore *const               store,
+    struct LDDetails *const             details,
+    struct LDEventRecord **const        o_events,
+    struct LDJSON **const               o_value,
+    const LDBoolean                     recordReason,
+    struct LDEvalMemo *const            memo,
+    const struct LDBucketRequest *const bucketed)
 {
     LDBoolean inExperiment;
 
@@ -220,36 +310,27 @@ LDi_evaluate(
     LD_ASSERT(details);
     LD_ASSERT(o_events);
     LD_ASSERT(o_value);
+    LD_ASSERT(memo);
 
-    if (LDJSONGetType(flag) != LDObject) {
-        LD_LOG(LD_LOG_ERROR, "flag expected object");
-
+    if (!flag->valid) {
         return EVAL_SCHEMA;
     }
 
     /* on */
-    {
-        const struct LDJSON *on;
-
-        if (!lookupOptionalValueOfType(flag, "flag", "on", LDBool, &on)) {
-            return EVAL_SCHEMA;
-        }
-
-        if (on == NULL || !LDGetBool(on)) {
-            details->reason = LD_OFF;
+    if (!flag->onValid) {
+        return EVAL_SCHEMA;
+    }
 
-            if (!(addValue(
-                    flag,
-                    o_value,
-                    details,
-                    LDObjectLookup(flag, "offVariation")))) {
-                LD_LOG(LD_LOG_ERROR, "failed to add value");
+    if (!flag->on) {
+        details->reason = LD_OFF;
 
-                return EVAL_MEM;
-            }
+        if (!(addValue(flag, o_value, details, flag->offVariation))) {
+            LD_LOG(LD_LOG_ERROR, "failed to add value");
 
-            return EVAL_MISS;
+            return EVAL_MEM;
         }
+
+        return EVAL_MISS;
     }
 
     /* prerequisites */
@@ -267,7 +348,8 @@ LDi_evaluate(
                     store,
                     &failedKey,
                     o_events,
-                    recordReason)))
+                    recordReason,
+                    memo)))
         {
             LD_LOG(LD_LOG_ERROR, "checkPrerequisites failed");
 
@@ -286,11 +368,7 @@ LDi_evaluate(
             details->reason                = LD_PREREQUISITE_FAILED;
             details->extra.prerequisiteKey = key;
 
-            if (!(addValue(
-                    flag,
-                    o_value,
-                    details,
-                    LDObjectLookup(flag, "offVariation")))) {
+            if (!(addValue(flag, o_value, details, flag->offVariation))) {
                 LD_LOG(LD_LOG_ERROR, "failed to add value");
 
                 return EVAL_MEM;
@@ -302,147 +380,117 @@ LDi_evaluate(
 
     /* targets */
     {
-        const struct LDJSON *targets;
+        unsigned int i;
 
-        if (!lookupOptionalValueOfType(
-                flag, "flag", "targets", LDArray, &targets)) {
+        if (!flag->targetsValid) {
             return EVAL_SCHEMA;
         }
 
-        if (targets) {
-            const struct LDJSON *target;
+        for (i = 0; i < flag->targetCount; i++) {
+            const struct LDTarget *const target = &flag->targets[i];
 
-            for (target = LDGetIter(targets); target;
-                 target = LDIterNext(target)) {
-                const struct LDJSON *values = NULL;
+            if (!target->valid) {
+                return EVAL_SCHEMA;
+            }
 
-                if (LDJSONGetType(target) != LDObject) {
-                    LD_LOG(LD_LOG_ERROR, "target expected object");
+            if (LDi_keySetContains(&target->values, user->key)) {
+                details->reason = LD_TARGET_MATCH;
 
-                    return EVAL_SCHEMA;
-                }
+                if (!(addValue(flag, o_value, details, target->variation))) {
+                    LD_LOG(LD_LOG_ERROR, "failed to add value");
 
-                if (!lookupOptionalValueOfType(
-                        target, "target", "values", LDArray, &values)) {
-                    return EVAL_SCHEMA;
+                    return EVAL_MEM;
                 }
 
-                if (values && LDi_textInArray(values, user->key)) {
-                    const struct LDJSON *variation;
-
-                    if (!(variation = lookupRequiredValueOfType(
-                              target, "target", "variation", LDNumber)))
-                    {
-                        return EVAL_SCHEMA;
-                    }
-
-                    details->reason = LD_TARGET_MATCH;
-
-                    if (!(addValue(flag, o_value, details, variation))) {
-                        LD_LOG(LD_LOG_ERROR, "failed to add value");
-
-                        return EVAL_MEM;
-                    }
-
-                    return EVAL_MATCH;
-                }
+                return EVAL_MATCH;
             }
         }
     }
 
     /* rules */
     {
-        const struct LDJSON *rules;
+        unsigned int i;
 
-        if (!lookupOptionalValueOfType(flag, "flag", "rules", LDArray, &rules))
-        {
+        if (!flag->rulesValid) {
             return EVAL_SCHEMA;
         }
 
-        if (rules) {
-            unsigned int         index;
-            const struct LDJSON *rule;
+        for (i = 0; i < flag->ruleCount; i++) {
+            EvalStatus                 substatus;
+            const struct LDRule *const rule = &flag->rules[i];
 
-            index = 0;
+            if (!rule->valid) {
+                return EVAL_SCHEMA;
+            }
 
-            for (rule = LDGetIter(rules); rule; rule = LDIterNext(rule)) {
-                EvalStatus substatus;
+            if (LDi_isEvalError(
+                    substatus =
+                        LDi_ruleMatchesUser(rule, user, store, memo))) {
+                LD_LOG(LD_LOG_ERROR, "ruleMatchesUser Failed");
 
-                if (LDJSONGetType(rule) != LDObject) {
-                    LD_LOG(LD_LOG_ERROR, "rule expected object");
+                return substatus;
+            }
 
-                    return EVAL_SCHEMA;
-                }
+            if (substatus == EVAL_MATCH) {
+                int variation;
 
-                if (LDi_isEvalError(
-                        substatus = LDi_ruleMatchesUser(rule, user, store))) {
-                    LD_LOG(LD_LOG_ERROR, "ruleMatchesUser Failed");
+                variation = -1;
 
-                    return substatus;
-                }
+                details->reason               = LD_RULE_MATCH;
+                details->extra.rule.ruleIndex = i;
+                details->extra.rule.id        = NULL;
 
-                if (substatus == EVAL_MATCH) {
-                    const struct LDJSON *ruleId, *variation;
+                if (!LDi_getIndexForVariationOrRollout(
+                        flag,
+                        &rule->variationOrRollout,
+                        user,
+                        bucketed,
+                        &inExperiment,
+                        &variation))
+                {
+                    LD_LOG(LD_LOG_ERROR, "schema error");
 
-                    variation = NULL;
+                    return EVAL_SCHEMA;
+                }
 
-                    details->reason               = LD_RULE_MATCH;
-                    details->extra.rule.ruleIndex = index;
-                    details->extra.rule.id        = NULL;
+                details->extra.rule.inExperiment = inExperiment;
 
-                    if (!LDi_getIndexForVariationOrRollout(
-                            flag, rule, user, &inExperiment, &variation))
-                    {
-                        LD_LOG(LD_LOG_ERROR, "schema error");
+                if (!(addValue(flag, o_value, details, variation))) {
+                    LD_LOG(LD_LOG_ERROR, "failed to add value");
 
-                        return EVAL_SCHEMA;
-                    }
+                    return EVAL_MEM;
+                }
 
-                    details->extra.rule.inExperiment = inExperiment;
+                if (rule->id) {
+                    char *text;
 
-                    if (!(addValue(flag, o_value, details, variation))) {
-                        LD_LOG(LD_LOG_ERROR, "failed to add value");
+                    if (!(text = LDStrDup(rule->id))) {
+                        LD_LOG(LD_LOG_ERROR, "failed to duplicate rule id");
 
                         return EVAL_MEM;
                     }
 
-                    if (!lookupOptionalValueOfType(
-                            rule, "rule", "id", LDText, &ruleId)) {
-                        return EVAL_SCHEMA;
-                    }
-
-                    if (ruleId) {
-                        char *text;
-
-                        if (!(text = LDStrDup(LDGetText(ruleId)))) {
-                            LD_LOG(LD_LOG_ERROR, "failed to duplicate rule id");
-
-                            return EVAL_MEM;
-                        }
-
-                        details->extra.rule.id = text;
-                    }
-
-                    return EVAL_MATCH;
+                    details->extra.rule.id = text;
                 }
 
-                index++;
+                return EVAL_MATCH;
             }
         }
     }
 
     /* fallthrough */
     {
-        const struct LDJSON *index;
+        int index;
 
-        index = NULL;
+        index = -1;
 
         details->reason = LD_FALLTHROUGH;
 
         if (!LDi_getIndexForVariationOrRollout(
                 flag,
-                LDObjectLookup(flag, "fallthrough"),
+                &flag->fallthrough,
                 user,
+                bucketed,
                 &inExperiment,
                 &index))
         {
@@ -465,220 +513,153 @@ LDi_evaluate(
 
 EvalStatus
 LDi_checkPrerequisites(
-    struct LDClient *const     client,
-    const struct LDJSON *const flag,
-    const struct LDUser *const user,
-    struct LDStore *const      store,
-    const char **const         failedKey,
-    struct LDJSON **const      events,
-    const LDBoolean            recordReason)
+    struct LDClient *const       client,
+    const struct LDFlag *const   flag,
+    const struct LDUser *const   user,
+    struct LDStore *const        store,
+    const char **const           failedKey,
+    struct LDEventRecord **const events,
+    const LDBoolean              recordReason,
+    struct LDEvalMemo *const     memo)
 {
-    const struct LDJSON *prerequisites, *iter;
+    unsigned int i;
 
     LD_ASSERT(flag);
     LD_ASSERT(user);
     LD_ASSERT(store);
     LD_ASSERT(failedKey);
     LD_ASSERT(events);
-    LD_ASSERT(LDJSONGetType(flag) == LDObject);
+    LD_ASSERT(memo);
 
-    if (!lookupOptionalValueOfType(
-            flag, "flag", "prerequisites", LDArray, &prerequisites))
-    {
+    if (!flag->prerequisitesValid) {
         return EVAL_SCHEMA;
     }
 
-    if (!prerequisites) {
-        return EVAL_MATCH;
-    }
+    for (i = 0; i < flag->prerequisiteCount; i++) {
+        struct LDEventRecord *   event;
+        const struct LDFlag *    preflag;
+        const unsigned int *     variationNumRef;
+        EvalStatus               status;
+        const struct LDMemoFlag *result;
+        struct LDJSONRC *        preflagrc;
+        double                   now;
+
+        const struct LDPrerequisite *const prerequisite =
+            &flag->prerequisites[i];
 
-    for (iter = LDGetIter(prerequisites); iter; iter = LDIterNext(iter)) {
-        struct LDJSON *      value, *preflag, *event, *subevents;
-        const struct LDJSON *key, *variation;
-        unsigned int *       variationNumRef;
-        EvalStatus           status;
-        const char *         keyText;
-        struct LDDetails     details;
-        struct LDJSONRC *    preflagrc;
-        double               now;
-
-        value           = NULL;
         preflag         = NULL;
-        key             = NULL;
-        variation       = NULL;
         variationNumRef = NULL;
         event           = NULL;
-        subevents       = NULL;
-        keyText         = NULL;
+        result          = NULL;
         preflagrc       = NULL;
 
-        LDDetailsInit(&details);
         LDi_getUnixMilliseconds(&now);
 
-        if (LDJSONGetType(iter) != LDObject) {
-            LD_LOG(LD_LOG_ERROR, "prerequisite expected object");
-
+        if (!prerequisite->valid) {
             return EVAL_SCHEMA;
         }
 
-        if (!(key = lookupRequiredValueOfType(
-                  iter, "prerequisite", "key", LDText))) {
-            return EVAL_SCHEMA;
-        }
+        *failedKey = prerequisite->key;
 
-        if (!(variation = lookupRequiredValueOfType(
-                  iter, "prerequisite", "variation", LDNumber)))
+        if (!LDStoreGetBorrowed(
+                store, LD_FLAG, prerequisite->key, &preflagrc))
         {
-            return EVAL_SCHEMA;
-        }
-
-        keyText    = LDGetText(key);
-        *failedKey = keyText;
-
-        if (!LDStoreGet(store, LD_FLAG, keyText, &preflagrc)) {
             LD_LOG(LD_LOG_ERROR, "store lookup error");
 
             return EVAL_STORE;
         }
 
         if (preflagrc) {
-            preflag = LDJSONRCGet(preflagrc);
+            preflag = LDJSONRCGetFlag(preflagrc);
         }
 
         if (!preflag) {
             LD_LOG(LD_LOG_ERROR, "cannot find flag in store");
 
+            LDStoreReleaseBorrowed(store, preflagrc);
+
             return EVAL_MISS;
         }
 
+        /* the result is owned by the memo */
         if (LDi_isEvalError(
-                status = LDi_evaluate(
+                status = evaluatePrerequisite(
                     client,
+                    prerequisite->key,
                     preflag,
                     user,
                     store,
-                    &details,
-                    &subevents,
-                    &value,
-                    recordReason)))
+                    recordReason,
+                    memo,
+                    &result)))
         {
-            LDJSONRCDecrement(preflagrc);
-            LDJSONFree(value);
-            LDDetailsClear(&details);
-            LDJSONFree(subevents);
+            LDStoreReleaseBorrowed(store, preflagrc);
 
             return status;
         }
 
-        if (!value) {
+        if (!result->value) {
             LD_LOG(LD_LOG_ERROR, "sub error with result");
         }
 
-        if (details.hasVariation) {
-            variationNumRef = &details.variationIndex;
+        if (result->details.hasVariation) {
+            variationNumRef = &result->details.variationIndex;
         }
 
         event = LDi_newFeatureRequestEvent(
             client->eventProcessor,
-            keyText,
+            prerequisite->key,
             user,
             variationNumRef,
-            value,
+            result->value,
             NULL,
-            LDGetText(LDObjectLookup(flag, "key")),
-            preflag,
-            &details,
+            flag->key,
+            preflag->json,
+            &result->details,
             now);
 
         if (!event) {
-            LDJSONRCDecrement(preflagrc);
-            LDJSONFree(value);
-            LDDetailsClear(&details);
-            LDJSONFree(subevents);
+            LDStoreReleaseBorrowed(store, preflagrc);
 
             LD_LOG(LD_LOG_ERROR, "alloc error");
 
             return EVAL_MEM;
         }
 
-        if (!(*events)) {
-            if (!(*events = LDNewArray())) {
-                LDJSONRCDecrement(preflagrc);
-                LDJSONFree(value);
-                LDDetailsClear(&details);
-                LDJSONFree(subevents);
+        /* the events of the prerequisite stay owned by the memo */
+        if (result->events) {
+            struct LDEventRecord *subEvents;
 
-                LD_LOG(LD_LOG_ERROR, "alloc error");
-
-                return EVAL_MEM;
-            }
-        }
-
-        if (subevents) {
-            if (!LDArrayAppend(*events, subevents)) {
-                LDJSONRCDecrement(preflagrc);
-                LDJSONFree(value);
-                LDDetailsClear(&details);
-                LDJSONFree(subevents);
+            if (!(subEvents = LDi_duplicateEventRecords(result->events))) {
+                LDStoreReleaseBorrowed(store, preflagrc);
+                LDi_freeEventRecords(event);
 
                 LD_LOG(LD_LOG_ERROR, "alloc error");
 
                 return EVAL_MEM;
             }
 
-            LDJSONFree(subevents);
+            LDi_appendEventRecords(events, subEvents);
         }
 
-        if (!LDArrayPush(*events, event)) {
-            LDJSONRCDecrement(preflagrc);
-            LDJSONFree(value);
-            LDDetailsClear(&details);
-
-            LD_LOG(LD_LOG_ERROR, "alloc error");
-
-            return EVAL_MEM;
-        }
+        LDi_appendEventRecords(events, event);
 
         if (status == EVAL_MISS) {
-            LDJSONRCDecrement(preflagrc);
-            LDJSONFree(value);
-            LDDetailsClear(&details);
+            LDStoreReleaseBorrowed(store, preflagrc);
 
             return EVAL_MISS;
         }
 
+        if (!preflag->on || !result->details.hasVariation ||
+            prerequisite->variation < 0 ||
+            (int)result->details.variationIndex != prerequisite->variation)
         {
-            const struct LDJSON *on;
-            LDBoolean            variationMatch;
-
-            variationMatch = LDBooleanFalse;
-
-            if (!lookupOptionalValueOfType(preflag, "flag", "on", LDBool, &on))
-            {
-                LDJSONRCDecrement(preflagrc);
-                LDJSONFree(value);
-                LDDetailsClear(&details);
-
-                return EVAL_SCHEMA;
-            }
+            LDStoreReleaseBorrowed(store, preflagrc);
 
-            if (details.hasVariation) {
-                variationMatch =
-                    details.variationIndex == LDGetNumber(variation);
-            }
-
-            if (on == NULL || !LDGetBool(on) || !variationMatch) {
-                LDJSONRCDecrement(preflagrc);
-                LDJSONFree(value);
-                LDDetailsClear(&details);
-
-                return EVAL_MISS;
-            }
+            return EVAL_MISS;
         }
 
-        LDJSONRCDecrement(preflagrc);
-        LDJSONFree(value);
-        LDDetailsClear(&details);
+        LDStoreReleaseBorrowed(store, preflagrc);
     }
 
     return EVAL_MATCH;
@@ -686,35 +667,22 @@ LDi_checkPrerequisites(
 
 EvalStatus
 LDi_ruleMatchesUser(
-    const struct LDJSON *const rule,
+    const struct LDRule *const rule,
     const struct LDUser *const user,
-    struct LDStore *const      store)
+    struct LDStore *const      store,
+    struct LDEvalMemo *const   memo)
 {
-    const struct LDJSON *clauses, *clause;
+    unsigned int i;
 
     LD_ASSERT(rule);
     LD_ASSERT(user);
 
-    if (!lookupOptionalValueOfType(rule, "rule", "clauses", LDArray, &clauses))
-    {
-        return EVAL_SCHEMA;
-    }
-
-    if (clauses == NULL) {
-        return EVAL_MATCH;
-    }
-
-    for (clause = LDGetIter(clauses); clause; clause = LDIterNext(clause)) {
+    for (i = 0; i < rule->clauseCount; i++) {
         EvalStatus evalStatus;
 
-        if (LDJSONGetType(clause) != LDObject) {
-            LD_LOG(LD_LOG_ERROR, "clause expected object");
-
-            return EVAL_SCHEMA;
-        }
-
         if (LDi_isEvalError(
-                evalStatus = LDi_clauseMatchesUser(clause, user, store))) {
+                evalStatus = LDi_clauseMatchesUser(
+                    &rule->clauses[i], user, store, memo))) {
 
             return evalStatus;
         }
@@ -729,47 +697,36 @@ LDi_ruleMatchesUser(
 
 EvalStatus
 LDi_clauseMatchesUser(
-    const struct LDJSON *const clause,
-    const struct LDUser *const user,
-    struct LDStore *const      store)
+    const struct LDClause *const clause,
+    const struct LDUser *const   user,
+    struct LDStore *const        store,
+    struct LDEvalMemo *const     memo)
 {
-    const struct LDJSON *op;
-
     LD_ASSERT(clause);
     LD_ASSERT(user);
 
-    if (LDJSONGetType(clause) != LDObject) {
-        LD_LOG(LD_LOG_ERROR, "clause expected object");
-
-        return EVAL_SCHEMA;
-    }
-
-    if (!(op = lookupRequiredValueOfType(clause, "clause", "op", LDText))) {
+    if (!clause->valid) {
         return EVAL_SCHEMA;
     }
 
-    if (strcmp(LDGetText(op), "segmentMatch") == 0) {
-        const struct LDJSON *values, *iter;
-
-        if (!lookupOptionalValueOfType(
-                clause, "clause", "values", LDArray, &values)) {
-            return EVAL_SCHEMA;
-        }
+    if (clause->segmentMatch) {
+        const struct LDJSON *iter;
 
-        if (values == NULL) {
+        if (clause->values == NULL) {
             return maybeNegate(clause, EVAL_MISS);
         }
 
-        for (iter = LDGetIter(values); iter; iter = LDIterNext(iter)) {
+        for (iter = LDGetIter(clause->values); iter; iter = LDIterNext(iter)) {
             if (LDJSONGetType(iter) == LDText) {
-                EvalStatus       evalStatus;
-                struct LDJSON *  segment;
-                struct LDJSONRC *segmentrc;
+                EvalStatus              evalStatus;
+                const struct LDSegment *segment;
+                struct LDJSONRC *       segmentrc;
 
                 segmentrc = NULL;
                 segment   = NULL;
 
-                if (!LDStoreGet(store, LD_SEGMENT, LDGetText(iter), &segmentrc))
+                if (!LDStoreGetBorrowed(
+                        store, LD_SEGMENT, LDGetText(iter), &segmentrc))
                 {
                     LD_LOG(LD_LOG_ERROR, "store lookup error");
 
@@ -777,25 +734,28 @@ LDi_clauseMatchesUser(
                 }
 
                 if (segmentrc) {
-                    segment = LDJSONRCGet(segmentrc);
+                    segment = LDJSONRCGetSegment(segmentrc);
                 }
 
                 if (!segment) {
                     LD_LOG(LD_LOG_WARNING, "segment not found in store");
 
+                    LDStoreReleaseBorrowed(store, segmentrc);
+
                     continue;
                 }
 
                 if (LDi_isEvalError(
-                        evalStatus = LDi_segmentMatchesUser(segment, user))) {
+                        evalStatus = matchSegment(
+                            LDGetText(iter), segment, user, memo))) {
                     LD_LOG(LD_LOG_ERROR, "segmentMatchesUser error");
 
-                    LDJSONRCDecrement(segmentrc);
+                    LDStoreReleaseBorrowed(store, segmentrc);
 
                     return evalStatus;
                 }
 
-                LDJSONRCDecrement(segmentrc);
+                LDStoreReleaseBorrowed(store, segmentrc);
 
                 if (evalStatus == EVAL_MATCH) {
                     return maybeNegate(clause, EVAL_MATCH);
@@ -811,174 +771,121 @@ LDi_clauseMatchesUser(
 
 EvalStatus
 LDi_segmentMatchesUser(
-    const struct LDJSON *const segment, const struct LDUser *const user)
+    const struct LDSegment *const segment, const struct LDUser *const user)
 {
+    unsigned int i;
+
     LD_ASSERT(segment);
     LD_ASSERT(user);
 
     /* included */
-    {
-        const struct LDJSON *included;
-
-        if (!lookupOptionalValueOfType(
-                segment, "segment", "included", LDArray, &included))
-        {
-            return EVAL_SCHEMA;
-        }
+    if (!segment->includedValid) {
+        return EVAL_SCHEMA;
+    }
 
-        if (included && LDi_textInArray(included, user->key)) {
-            return EVAL_MATCH;
-        }
+    if (LDi_keySetContains(&segment->included, user->key)) {
+        return EVAL_MATCH;
     }
 
     /* excluded */
-    {
-        const struct LDJSON *excluded;
-
-        if (!lookupOptionalValueOfType(
-                segment, "segment", "excluded", LDArray, &excluded))
-        {
-            return EVAL_SCHEMA;
-        }
+    if (!segment->excludedValid) {
+        return EVAL_SCHEMA;
+    }
 
-        if (excluded && LDi_textInArray(excluded, user->key)) {
-            return EVAL_MISS;
-        }
+    if (LDi_keySetContains(&segment->excluded, user->key)) {
+        return EVAL_MISS;
     }
 
     /* rules */
-    {
-        const struct LDJSON *iter, *salt, *segmentRules, *key;
+    if (!segment->rulesValid) {
+        return EVAL_SCHEMA;
+    }
 
-        if (!lookupOptionalValueOfType(
-                segment, "segment", "rules", LDArray, &segmentRules))
-        {
-            return EVAL_SCHEMA;
-        }
+    for (i = 0; i < segment->ruleCount; i++) {
+        EvalStatus evalStatus;
 
-        if (segmentRules == NULL) {
-            return EVAL_MISS;
-        }
+        const struct LDSegmentRule *const rule = &segment->rules[i];
 
-        if (!(key =
-                  lookupRequiredValueOfType(segment, "segment", "key", LDText)))
-        {
+        if (!rule->valid) {
             return EVAL_SCHEMA;
         }
 
-        if (!(salt = lookupRequiredValueOfType(
-                  segment, "segment", "salt", LDText))) {
-            return EVAL_SCHEMA;
+        if (LDi_isEvalError(
+                evalStatus = LDi_segmentRuleMatchUser(
+                    rule, &segment->bucketPrefix, user)))
+        {
+            return evalStatus;
         }
 
-        for (iter = LDGetIter(segmentRules); iter; iter = LDIterNext(iter)) {
-            EvalStatus evalStatus;
-
-            if (LDJSONGetType(iter) != LDObject) {
-                LD_LOG(LD_LOG_ERROR, "segment rule expected object");
-
-                return EVAL_SCHEMA;
-            }
-
-            if (LDi_isEvalError(
-                    evalStatus = LDi_segmentRuleMatchUser(
-                        iter, LDGetText(key), user, LDGetText(salt))))
-            {
-                return evalStatus;
-            }
-
-            if (evalStatus == EVAL_MATCH) {
-                return EVAL_MATCH;
-            }
+        if (evalStatus == EVAL_MATCH) {
+            return EVAL_MATCH;
         }
-
-        return EVAL_MISS;
     }
+
+    return EVAL_MISS;
 }
 
 EvalStatus
 LDi_segmentRuleMatchUser(
-    const struct LDJSON *const segmentRule,
-    const char *const          segmentKey,
-    const struct LDUser *const user,
-    const char *const          salt)
+    const struct LDSegmentRule *const  segmentRule,
+    const struct LDBucketPrefix *const prefix,
+    const struct LDUser *const         user)
 {
-    const struct LDJSON *clauses;
+    unsigned int i;
+    float        bucket;
 
     LD_ASSERT(segmentRule);
-    LD_ASSERT(segmentKey);
+    LD_ASSERT(prefix);
     LD_ASSERT(user);
-    LD_ASSERT(salt);
 
-    if (!lookupOptionalValueOfType(
-            segmentRule, "segmentRule", "clauses", LDArray, &clauses))
-    {
-        return EVAL_SCHEMA;
-    }
-
-    if (clauses) {
-        const struct LDJSON *clause;
-
-        for (clause = LDGetIter(clauses); clause; clause = LDIterNext(clause)) {
-            EvalStatus evalStatus;
-
-            if (LDi_isEvalError(
-                    evalStatus = LDi_clauseMatchesUserNoSegments(clause, user)))
-            {
-                return evalStatus;
-            }
-
-            if (evalStatus == EVAL_MISS) {
-                return EVAL_MISS;
-            }
-        }
-    }
-
-    {
-        const struct LDJSON *weight;
-        float                bucket;
-        const char *         attribute;
+    for (i = 0; i < segmentRule->clauseCount; i++) {
+        EvalStatus evalStatus;
 
-        if (!lookupOptionalValueOfType(
-                segmentRule, "segmentRule", "weight", LDNumber, &weight))
+        if (LDi_isEvalError(
+                evalStatus = LDi_clauseMatchesUserNoSegments(
+                    &segmentRule->clauses[i], user)))
         {
-            return EVAL_SCHEMA;
+            return evalStatus;
         }
 
-        if (weight == NULL) {
-            return EVAL_MATCH;
+        if (evalStatus == EVAL_MISS) {
+            return EVAL_MISS;
         }
+    }
 
-        attribute = LDi_getBucketAttribute(segmentRule);
-
-        if (attribute == NULL) {
-            LD_LOG(LD_LOG_ERROR, "failed to parse bucketBy");
-
-            return EVAL_SCHEMA;
-        }
+    if (!segmentRule->hasWeight) {
+        return EVAL_MATCH;
+    }
 
-        LDi_bucketUser(user, segmentKey, attribute, salt, NULL, &bucket);
+    LDi_bucketUserWithPrefix(prefix, user, segmentRule->bucketBy, &bucket);
 
-        if (bucket < LDGetNumber(weight) / 100000) {
-            return EVAL_MATCH;
-        } else {
-            return EVAL_MISS;
-        }
+    if (bucket < segmentRule->weight / 100000) {
+        return EVAL_MATCH;
+    } else {
+        return EVAL_MISS;
     }
 }
 
 static EvalStatus
 matchAny(
-    OpFn f, const struct LDJSON *const value, const struct LDJSON *const values)
+    const struct LDClause *const clause, const struct LDJSON *const value)
 {
     const struct LDJSON *iter;
+    unsigned int         i;
 
-    LD_ASSERT(f);
+    LD_ASSERT(clause);
+    LD_ASSERT(clause->op);
     LD_ASSERT(value);
 
-    if (values) {
-        for (iter = LDGetIter(values); iter; iter = LDIterNext(iter)) {
-            if (f(value, iter)) {
+    if (clause->values) {
+        for (iter = LDGetIter(clause->values), i = 0; iter;
+             iter = LDIterNext(iter), i++)
+        {
+            if (clause->regexes) {
+                if (LDi_regexMatches(clause->regexes[i], value)) {
+                    return EVAL_MATCH;
+                }
+            } else if (clause->op(value, iter)) {
                 return EVAL_MATCH;
             }
         }
@@ -989,40 +896,30 @@ matchAny(
 
 EvalStatus
 LDi_clauseMatchesUserNoSegments(
-    const struct LDJSON *const clause, const struct LDUser *const user)
+    const struct LDClause *const clause, const struct LDUser *const user)
 {
-    OpFn                 fn;
-    struct LDJSON *      attributeValue;
-    const struct LDJSON *values, *attribute, *op;
-    LDJSONType           attributeType;
+    struct LDAttributeView view;
+    const struct LDJSON *  attributeValue;
+    LDJSONType             attributeType;
 
     LD_ASSERT(clause);
     LD_ASSERT(user);
 
     attributeValue = NULL;
 
-    if (!(op = lookupRequiredValueOfType(clause, "clause", "op", LDText))) {
+    if (!clause->valid) {
         return EVAL_SCHEMA;
     }
 
-    if (!(fn = LDi_lookupOperation(LDGetText(op)))) {
-        LD_LOG(LD_LOG_WARNING, "unknown operator");
-
+    /* segmentMatch is not a valid operator in this context */
+    if (!clause->op) {
         return EVAL_MISS;
     }
 
-    if (!(attribute =
-              lookupRequiredValueOfType(clause, "clause", "attribute", LDText)))
-    {
-        return EVAL_SCHEMA;
-    }
-
-    if (!lookupOptionalValueOfType(
-            clause, "clause", "values", LDArray, &values)) {
-        return EVAL_SCHEMA;
-    }
+    attributeValue = LDi_viewSlot(
+        user, clause->attributeSlot, clause->attribute, &view);
 
-    if (!(attributeValue = LDi_valueOfAttribute(user, LDGetText(attribute)))) {
+    if (!attributeValue) {
         LD_LOG(LD_LOG_TRACE, "attribute does not exist");
 
         return EVAL_MISS;
@@ -1042,75 +939,34 @@ LDi_clauseMatchesUserNoSegments(
                 LD_LOG(
                     LD_LOG_WARNING, "attribute value expected array or object");
 
-                LDJSONFree(attributeValue);
-
                 return EVAL_MISS;
             }
 
-            if (LDi_isEvalError(evalStatus = matchAny(fn, iter, values))) {
-
+            if (LDi_isEvalError(evalStatus = matchAny(clause, iter))) {
                 LD_LOG(LD_LOG_ERROR, "matchAny failed");
 
-                LDJSONFree(attributeValue);
-
                 return evalStatus;
             }
 
             if (evalStatus == EVAL_MATCH) {
-                LDJSONFree(attributeValue);
-
                 return maybeNegate(clause, EVAL_MATCH);
             }
         }
 
-        LDJSONFree(attributeValue);
-
         return maybeNegate(clause, EVAL_MISS);
     } else {
         EvalStatus evalStatus;
 
-        if (LDi_isEvalError(evalStatus = matchAny(fn, attributeValue, values)))
-        {
+        if (LDi_isEvalError(evalStatus = matchAny(clause, attributeValue))) {
             LD_LOG(LD_LOG_ERROR, "matchAny failed");
 
-            LDJSONFree(attributeValue);
-
             return evalStatus;
         }
 
-        LDJSONFree(attributeValue);
-
         return maybeNegate(clause, evalStatus);
     }
 }
 
-static float
-LDi_hexToDecimal(const char *const input)
-{
-    float       acc;
-    const char *i;
-
-    LD_ASSERT(input);
-
-    acc = 0;
-
-    for (i = input; *i != '\0'; i++) {
-        char charOffset;
-
-        if (*i >= 48 && *i <= 57) {
-            charOffset = *i - 48;
-        } else if (*i >= 97 && *i <= 102) {
-            charOffset = *i - 87;
-        } else {
-            return 0.0;
-        }
-
-        acc = (acc * 16) + charOffset;
-    }
-
-    return acc;
-}
-
 LDBoolean
 LDi_bucketUser(
     const struct LDUser *const user,
@@ -1120,7 +976,7 @@ LDi_bucketUser(
     const int *const           seed,
     float *const               bucket)
 {
-    struct LDJSON *attributeValue;
+    struct LDBucketPrefix prefix;
 
     LD_ASSERT(user);
     LD_ASSERT(segmentKey);
@@ -1128,244 +984,79 @@ LDi_bucketUser(
     LD_ASSERT(salt);
     LD_ASSERT(bucket);
 
-    attributeValue = NULL;
-    *bucket        = 0;
-
-    if ((attributeValue = LDi_valueOfAttribute(user, attribute))) {
-        char        raw[256], bucketableBuffer[256];
-        const char *bucketable;
-        int         snprintfStatus;
-
-        bucketable = NULL;
-
-        if (LDJSONGetType(attributeValue) == LDText) {
-            bucketable = LDGetText(attributeValue);
-        } else if (LDJSONGetType(attributeValue) == LDNumber) {
-            if (snprintf(
-                    bucketableBuffer,
-                    sizeof(bucketableBuffer),
-                    "%f",
-                    LDGetNumber(attributeValue)) >= 0)
-            {
-                bucketable = bucketableBuffer;
-            }
-        }
-
-        if (!bucketable) {
-            LDJSONFree(attributeValue);
+    if (seed) {
+        char seedText[16];
 
-            return LDBooleanFalse;
-        }
-
-        if (seed) {
-            if (user->secondary) {
-                snprintfStatus = snprintf(
-                    raw,
-                    sizeof(raw),
-                    "%d.%s.%s",
-                    *seed,
-                    bucketable,
-                    user->secondary);
-            } else {
-                snprintfStatus =
-                    snprintf(raw, sizeof(raw), "%d.%s", *seed, bucketable);
-            }
-        } else {
-            if (user->secondary) {
-                snprintfStatus = snprintf(
-                    raw,
-                    sizeof(raw),
-                    "%s.%s.%s.%s",
-                    segmentKey,
-                    salt,
-                    bucketable,
-                    user->secondary);
-            } else {
-                snprintfStatus = snprintf(
-                    raw, sizeof(raw), "%s.%s.%s", segmentKey, salt, bucketable);
-            }
-        }
-
-        if (snprintfStatus >= 0 && (size_t)snprintfStatus < sizeof(raw)) {
-            int         status;
-            char        digest[21], encoded[17];
-            const float longScale = 1152921504606846975.0;
-
-            SHA1(digest, raw, strlen(raw));
-
-            /* encodes to hex, and shortens, 16 characters in hex 8 bytes */
-            status = hexify(
-                (unsigned char *)digest,
-                sizeof(digest) - 1,
-                encoded,
-                sizeof(encoded));
-            LD_ASSERT(status == 16);
-
-            encoded[15] = 0;
-
-            *bucket = LDi_hexToDecimal(encoded) / longScale;
-
-            LDJSONFree(attributeValue);
-
-            return LDBooleanTrue;
-        }
-
-        LDJSONFree(attributeValue);
+        snprintf(seedText, sizeof(seedText), "%d", *seed);
+        LDi_initBucketPrefix(&prefix, seedText, NULL);
+    } else {
+        LDi_initBucketPrefix(&prefix, segmentKey, salt);
     }
 
-    return LDBooleanFalse;
+    return LDi_bucketUserWithPrefix(&prefix, user, attribute, bucket);
 }
 
 LDBoolean
 LDi_variationIndexForUser(
-    const struct LDJSON *const  varOrRoll,
-    const struct LDUser *const  user,
-    const char *const           key,
-    const char *const           salt,
-    LDBoolean *const            inExperiment,
-    const struct LDJSON **const index)
+    const struct LDVariationOrRollout *const varOrRoll,
+    const struct LDUser *const               user,
+    const struct LDBucketPrefix *const       prefix,
+    const struct LDBucketRequest *const      bucketed,
+    LDBoolean *const                         inExperiment,
+    int *const                               index)
 {
-    const struct LDJSON *variation, *rollout, *variations, *subVariation;
-    float                userBucket, sum;
-    LDBoolean            untrackedValue;
+    const struct LDWeightedVariation *weighted;
+    const struct LDBucketPrefix *     rolloutPrefix;
+    float                             userBucket, sum;
+    unsigned int                      i;
 
     LD_ASSERT(varOrRoll);
     LD_ASSERT(index);
     LD_ASSERT(inExperiment);
-    LD_ASSERT(salt);
+    LD_ASSERT(prefix);
     LD_ASSERT(user);
 
-    variations     = NULL;
-    userBucket     = 0;
-    sum            = 0;
-    subVariation   = NULL;
-    untrackedValue = LDBooleanFalse;
-    *inExperiment  = LDBooleanFalse;
+    userBucket    = 0;
+    sum           = 0;
+    weighted      = NULL;
+    *inExperiment = LDBooleanFalse;
 
-    /* if a specific variation */
-    {
-        const struct LDJSON *variation;
-
-        if (!lookupOptionalValueOfType(
-                varOrRoll,
-                "variationOrRollout",
-                "variation",
-                LDNumber,
-                &variation))
-        {
-            return LDBooleanFalse;
-        }
-
-        if (variation != NULL) {
-            *index = variation;
-
-            return LDBooleanTrue;
-        }
-    }
-
-    if (!(rollout = lookupRequiredValueOfType(
-              varOrRoll, "variationOrRollout", "rollout", LDObject)))
-    {
+    if (!varOrRoll->valid) {
         return LDBooleanFalse;
     }
 
-    /* rollout kind */
-    {
-        const struct LDJSON *rolloutKind;
-
-        if (!lookupOptionalValueOfType(
-                rollout, "rollout", "kind", LDText, &rolloutKind))
-        {
-            return LDBooleanFalse;
-        }
-
-        if (rolloutKind && strcmp(LDGetText(rolloutKind), "experiment") == 0) {
-            *inExperiment = LDBooleanTrue;
-        }
-    }
+    /* if a specific variation */
+    if (!varOrRoll->isRollout) {
+        *index = varOrRoll->variation;
 
-    if (!(variations = lookupRequiredValueOfType(
-              rollout, "rollout", "variations", LDArray)))
-    {
-        return LDBooleanFalse;
+        return LDBooleanTrue;
     }
 
-    if (LDCollectionGetSize(variations) == 0) {
-        LD_LOG(LD_LOG_ERROR, "rollout variations must not be empty");
+    *inExperiment = varOrRoll->experiment;
 
-        return LDBooleanFalse;
+    if (varOrRoll->hasSeed) {
+        rolloutPrefix = &varOrRoll->seedPrefix;
+    } else {
+        rolloutPrefix = prefix;
     }
 
+    /* the bucket only depends on the prefix and attribute */
+    if (bucketed && bucketed->prefix == rolloutPrefix &&
+        strcmp(bucketed->attribute, varOrRoll->bucketBy) == 0)
     {
-        const char *         attribute;
-        const struct LDJSON *seedJSON;
-        int                  seedValue, *seedValueRef;
-
-        seedValueRef = NULL;
-        attribute    = LDi_getBucketAttribute(rollout);
-
-        if (attribute == NULL) {
-            LD_LOG(LD_LOG_ERROR, "failed to parse bucketBy");
-
-            return LDBooleanFalse;
-        }
-
-        if (!lookupOptionalValueOfType(
-                rollout, "rollout", "seed", LDNumber, &seedJSON)) {
-            return LDBooleanFalse;
-        }
-
-        if (seedJSON != NULL) {
-            seedValue    = (int)LDGetNumber(seedJSON);
-            seedValueRef = &seedValue;
-        }
-
-        LDi_bucketUser(user, key, attribute, salt, seedValueRef, &userBucket);
+        userBucket = bucketed->bucket;
+    } else {
+        LDi_bucketUserWithPrefix(
+            rolloutPrefix, user, varOrRoll->bucketBy, &userBucket);
     }
 
-    for (variation = LDGetIter(variations); variation;
-         variation = LDIterNext(variation))
-    {
-        const struct LDJSON *untracked, *weight;
-
-        if (!(weight = lookupRequiredValueOfType(
-                  variation, "weightedVariation", "weight", LDNumber)))
-        {
-            return LDBooleanFalse;
-        }
-
-        sum += LDGetNumber(weight) / 100000.0;
-
-        if (!(subVariation = lookupRequiredValueOfType(
-                  variation, "weightedVariation", "variation", LDNumber)))
-        {
-            return LDBooleanFalse;
-        }
-
-        untrackedValue = LDBooleanFalse;
+    for (i = 0; i < varOrRoll->variationCount; i++) {
+        weighted = &varOrRoll->variations[i];
 
-        if (!lookupOptionalValueOfType(
-                variation,
-                "weightedVariation",
-                "untracked",
-                LDBool,
-                &untracked))
-        {
-            return LDBooleanFalse;
-        }
-
-        if (untracked != NULL) {
-            untrackedValue = LDGetBool(untracked);
-        }
+        sum += weighted->weight / 100000.0;
 
         if (userBucket < sum) {
-            *index = subVariation;
-
-            if (*inExperiment && untrackedValue) {
-                *inExperiment = LDBooleanFalse;
-            }
-
-            return LDBooleanTrue;
+            break;
         }
     }
 
@@ -1375,12 +1066,14 @@ LDi_variationIndexForUser(
     buckets that don't actually add up to 100000. Rather than returning an error
     in this case (or changing the scaling, which would potentially change the
     results for *all* users), we will simply put the user in the last bucket.
-    The loop ensures subVariation is the last element, and a size check above
-    ensures there is at least one element. */
+    The loop leaves weighted at the last element, and the flag compiler ensures
+    there is at least one element. */
+
+    LD_ASSERT(weighted);
 
-    *index = subVariation;
+    *index = weighted->variation;
 
-    if (*inExperiment && untrackedValue) {
+    if (*inExperiment && weighted->untracked) {
         *inExperiment = LDBooleanFalse;
     }
 
@@ -1389,34 +1082,29 @@ LDi_variationIndexForUser(
 
 LDBoolean
 LDi_getIndexForVariationOrRollout(
-    const struct LDJSON *const  flag,
-    const struct LDJSON *const  varOrRoll,
-    const struct LDUser *const  user,
-    LDBoolean *const            inExperiment,
-    const struct LDJSON **const result)
+    const struct LDFlag *const               flag,
+    const struct LDVariationOrRollout *const varOrRoll,
+    const struct LDUser *const               user,
+    const struct LDBucketRequest *const      bucketed,
+    LDBoolean *const                         inExperiment,
+    int *const                               result)
 {
-    const struct LDJSON *key, *salt;
-
     LD_ASSERT(flag);
     LD_ASSERT(varOrRoll);
     LD_ASSERT(inExperiment);
     LD_ASSERT(result);
 
-    *result = NULL;
-
-    if (!(key = lookupRequiredValueOfType(flag, "flag", "key", LDText))) {
-        return LDBooleanFalse;
-    }
+    *result = -1;
 
-    if (!(salt = lookupRequiredValueOfType(flag, "flag", "salt", LDText))) {
+    if (!flag->key || !flag->salt) {
         return LDBooleanFalse;
     }
 
     if (!LDi_variationIndexForUser(
             varOrRoll,
             user,
-            LDGetText(key),
-            LDGetText(salt),
+            &flag->bucketPrefix,
+            bucketed,
             inExperiment,
             result))
     {
@@ -10,6 +10,8 @@
 #include <launchdarkly/json.h>
 #include <launchdarkly/variations.h>
 
+#include "event_record.h"
+#include "flag.h"
 #include "store.h"
 
 typedef enum
@@ -24,53 +26,78 @@ typedef enum
 LDBoolean
 LDi_isEvalError(const EvalStatus status);
 
+struct LDMemoFlag;
+struct LDMemoSegment;
+
+/* Results shared by everything evaluated during one top-level call.
+ * Prerequisites are evaluated once per flag version and segments are matched
+ * once per segment version. A prerequisite that is reached again while it is
+ * still being evaluated is a cycle, and is reported as a schema error. */
+struct LDEvalMemo
+{
+    struct LDMemoFlag *   flags;
+    struct LDMemoSegment *segments;
+};
+
+void
+LDi_initEvalMemo(struct LDEvalMemo *const memo);
+
+void
+LDi_clearEvalMemo(struct LDEvalMemo *const memo);
+
+/* Prerequisites and segments are read with `LDStoreGetBorrowed`, so the
+evaluation functions below must be called inside a read section of `store`. */
 EvalStatus
 LDi_evaluate(
-    struct LDClient *const     client,
-    const struct LDJSON *const flag,
-    const struct LDUser *const user,
-    struct LDStore *const      store,
-    struct LDDetails *const    details,
-    struct LDJSON **const      o_events,
-    struct LDJSON **const      o_value,
-    const LDBoolean            recordReason);
+    struct LDClient *const              client,
+    const struct LDFlag *const          flag,
+    const struct LDUser *const          user,
+    struct LDStore *const               store,
+    struct LDDetails *const             details,
+    struct LDEventRecord **const        o_events,
+    struct LDJSON **const               o_value,
+    const LDBoolean                     recordReason,
+    struct LDEvalMemo *const            memo,
+    const struct LDBucketRequest *const bucketed);
 
 EvalStatus
 LDi_checkPrerequisites(
-    struct LDClient *const     client,
-    const struct LDJSON *const flag,
-    const struct LDUser *const user,
-    struct LDStore *const      store,
-    const char **const         failedKey,
-    struct LDJSON **const      events,
-    const LDBoolean            recordReason);
+    struct LDClient *const       client,
+    const struct LDFlag *const   flag,
+    const struct LDUser *const   user,
+    struct LDStore *const        store,
+    const char **const           failedKey,
+    struct LDEventRecord **const events,
+    const LDBoolean              recordReason,
+    struct LDEvalMemo *const     memo);
 
 EvalStatus
 LDi_ruleMatchesUser(
-    const struct LDJSON *const rule,
+    const struct LDRule *const rule,
     const struct LDUser *const user,
-    struct LDStore *const      store);
+    struct LDStore *const      store,
+    struct LDEvalMemo *const   memo);
 
 EvalStatus
 LDi_clauseMatchesUser(
-    const struct LDJSON *const clause,
-    const struct LDUser *const user,
-    struct LDStore *const      store);
+    const struct LDClause *const clause,
+    const struct LDUser *const   user,
+    struct LDStore *const        store,
+    struct LDEvalMemo *const     memo);
 
 EvalStatus
 LDi_segmentMatchesUser(
-    const struct LDJSON *const segment, const struct LDUser *const user);
+    const struct LDSegment *const segment, const struct LDUser *const user);
 
 EvalStatus
 LDi_segmentRuleMatchUser(
-    const struct LDJSON *const segmentRule,
-    const char *const          segmentKey,
-    const struct LDUser *const user,
-    const char *const          salt);
+    const struct LDSegmentRule *const  segmentRule,
+    const struct LDBucketPrefix *const prefix,
+    const struct LDUser *const         user);
 
 EvalStatus
 LDi_clauseMatchesUserNoSegments(
-    const struct LDJSON *const clause, const struct LDUser *const user);
+    const struct LDClause *const clause, const struct LDUser *const user);
 
 LDBoolean
 LDi_bucketUser(
@@ -83,17 +110,18 @@ LDi_bucketUser(
 
 LDBoolean
 LDi_variationIndexForUser(
-    const struct LDJSON *const  varOrRoll,
-    const struct LDUser *const  user,
-    const char *const           key,
-    const char *const           salt,
-    LDBoolean *const            inExperiment,
-    const struct LDJSON **const index);
+    const struct LDVariationOrRollout *const varOrRoll,
+    const struct LDUser *const               user,
+    const struct LDBucketPrefix *const       prefix,
+    const struct LDBucketRequest *const      bucketed,
+    LDBoolean *const                         inExperiment,
+    int *const                               index);
 
 LDBoolean
 LDi_getIndexForVariationOrRollout(
-    const struct LDJSON *const  flag,
-    const struct LDJSON *const  varOrRoll,
-    const struct LDUser *const  user,
-    LDBoolean *const            inExperiment,
-    const struct LDJSON **const result);
+    const struct LDFlag *const               flag,
+    const struct LDVariationOrRollout *const varOrRoll,
+    const struct LDUser *const               user,
+    const struct LDBucketRequest *const      bucketed,
+    LDBoolean *const                         inExperiment,
+    int *const                               result);
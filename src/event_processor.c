@@ -1,8 +1,11 @@
+#include <string.h>
+
 #include <launchdarkly/memory.h>
 
 #include "assertion.h"
 #include "event_processor.h"
 #include "event_processor_internal.h"
+#include "json_writer.h"
 #include "logging.h"
 #include "utility.h"
 
@@ -10,31 +13,49 @@ struct EventProcessor *
 LDi_newEventProcessor(const struct LDConfig *const config)
 {
     struct EventProcessor *context;
+    unsigned int           i, userKeysCapacity;
 
     if (!(context =
               (struct EventProcessor *)LDAlloc(sizeof(struct EventProcessor))))
     {
-        goto error;
+        return NULL;
     }
 
-    context->summaryStart     = 0;
-    context->lastUserKeyFlush = 0;
-    context->lastServerTime   = 0;
-    context->config           = config;
+    context->events         = NULL;
+    context->queue.slots    = NULL;
+    context->lastDropped    = 0;
+    context->lastServerTime = 0;
+    context->config         = config;
 
-    LDi_getMonotonicMilliseconds(&context->lastUserKeyFlush);
     LDi_mutex_init(&context->lock);
 
+    for (i = 0; i < LD_EVENT_SHARDS; i++) {
+        struct LDEventShard *const shard = &context->shards[i];
+
+        shard->summaryStart = 0;
+        shard->userKeys     = NULL;
+
+        LDi_getMonotonicMilliseconds(&shard->lastUserKeyFlush);
+        LDi_mutex_init(&shard->lock);
+        LDi_initSummary(&shard->summary);
+    }
+
     if (!(context->events = LDNewArray())) {
         goto error;
     }
 
-    if (!(context->summaryCounters = LDNewObject())) {
+    if (!LDi_eventQueueInit(&context->queue, config->eventsCapacity)) {
         goto error;
     }
 
-    if (!(context->userKeys = LDLRUInit(config->userKeysCapacity))) {
-        goto error;
+    /* each shard remembers its share of the users */
+    userKeysCapacity =
+        (config->userKeysCapacity + LD_EVENT_SHARDS - 1) / LD_EVENT_SHARDS;
+
+    for (i = 0; i < LD_EVENT_SHARDS; i++) {
+        if (!(context->shards[i].userKeys = LDLRUInit(userKeysCapacity))) {
+            goto error;
+        }
     }
 
     return context;
@@ -48,467 +69,525 @@ error:
 void
 LDi_freeEventProcessor(struct EventProcessor *const context)
 {
+    unsigned int i;
+
     if (context) {
+        for (i = 0; i < LD_EVENT_SHARDS; i++) {
+            LDi_mutex_destroy(&context->shards[i].lock);
+            LDi_freeSummary(&context->shards[i].summary);
+            LDLRUFree(context->shards[i].userKeys);
+        }
+
         LDi_mutex_destroy(&context->lock);
+        LDi_eventQueueDestroy(&context->queue);
         LDJSONFree(context->events);
-        LDJSONFree(context->summaryCounters);
-        LDLRUFree(context->userKeys);
         LDFree(context);
     }
 }
 
-LDBoolean
-LDi_processEvaluation(
-    /* required */
-    struct EventProcessor *const context,
-    /* required */
-    const struct LDUser *const user,
-    /* optional */
-    struct LDJSON *const subEvents,
-    /* required */
-    const char *const flagKey,
-    /* required */
-    const struct LDJSON *const actualValue,
-    /* required */
-    const struct LDJSON *const fallbackValue,
-    /* optional */
-    const struct LDJSON *const flag,
-    /* required */
-    const struct LDDetails *const details,
-    /* required */
-    const LDBoolean detailedEvaluation)
+static struct LDEventShard *
+shardForUser(
+    struct EventProcessor *const context, const struct LDUser *const user)
 {
-    struct LDJSON *      indexEvent, *featureEvent;
-    const struct LDJSON *evaluationValue;
-    const unsigned int * variationIndexRef;
-    double               now;
-
-    indexEvent        = NULL;
-    featureEvent      = NULL;
-    evaluationValue   = NULL;
-    variationIndexRef = NULL;
-
-    LD_ASSERT(context);
-    LD_ASSERT(details);
-
-    LDi_getUnixMilliseconds(&now);
+    const unsigned char *iter;
+    unsigned long        hash;
 
-    if (LDi_notNull(actualValue)) {
-        evaluationValue = actualValue;
-    } else {
-        evaluationValue = fallbackValue;
-    }
+    hash = 2166136261UL;
 
-    if (details->hasVariation) {
-        variationIndexRef = &details->variationIndex;
+    for (iter = (const unsigned char *)user->key; *iter; iter++) {
+        hash = ((hash ^ *iter) * 16777619UL) & 0xFFFFFFFFUL;
     }
 
-    LDi_mutex_lock(&context->lock);
+    return &context->shards[hash % LD_EVENT_SHARDS];
+}
 
-    featureEvent = LDi_newFeatureRequestEvent(
-        context,
-        flagKey,
-        user,
-        variationIndexRef,
-        evaluationValue,
-        fallbackValue,
-        NULL,
-        flag,
-        details,
-        now);
+/* Requires the shard lock. Counts one evaluation of `flagKey`, `variation`
+and `version` may be NULL. */
+static LDBoolean
+summarizeEvaluationLocked(
+    struct LDEventShard *const shard,
+    const char *const          flagKey,
+    const unsigned int *const  variation,
+    const double *const        version,
+    const struct LDJSON *const value,
+    const struct LDJSON *const defaultValue,
+    const LDBoolean            unknown)
+{
+    LD_ASSERT(shard);
+    LD_ASSERT(flagKey);
 
-    if (!featureEvent) {
-        LDi_mutex_unlock(&context->lock);
+    if (shard->summaryStart == 0) {
+        double now;
 
-        LDJSONFree(subEvents);
+        LDi_getUnixMilliseconds(&now);
 
-        return LDBooleanFalse;
+        shard->summaryStart = now;
     }
 
-    if (!LDi_maybeMakeIndexEvent(context, user, now, &indexEvent)) {
-        LDi_mutex_unlock(&context->lock);
-
-        LDJSONFree(featureEvent);
-        LDJSONFree(subEvents);
+    if (!LDi_summaryCount(
+            &shard->summary,
+            flagKey,
+            variation,
+            version,
+            value,
+            defaultValue,
+            unknown))
+    {
+        LD_LOG(LD_LOG_ERROR, "alloc error");
 
         return LDBooleanFalse;
     }
 
-    if (!LDi_summarizeEvent(context, featureEvent, !flag)) {
-        LDi_mutex_unlock(&context->lock);
+    return LDBooleanTrue;
+}
 
-        LDJSONFree(featureEvent);
-        LDJSONFree(subEvents);
+/* requires the shard lock */
+static LDBoolean
+summarizeEventLocked(
+    struct LDEventShard *const        shard,
+    const struct LDEventRecord *const event,
+    const LDBoolean                   unknown)
+{
+    LD_ASSERT(shard);
+    LD_ASSERT(event);
+    LD_ASSERT(event->key);
+
+    return summarizeEvaluationLocked(
+        shard,
+        event->key,
+        event->hasVariation ? &event->variation : NULL,
+        event->hasVersion ? &event->version : NULL,
+        event->value,
+        event->defaultValue,
+        unknown);
+}
 
-        return LDBooleanFalse;
-    }
+LDBoolean
+LDi_summarizeEvent(
+    struct EventProcessor *const      context,
+    const struct LDEventRecord *const event,
+    const LDBoolean                   unknown)
+{
+    struct LDEventShard *shard;
+    LDBoolean            success;
 
-    if (indexEvent) {
-        LDi_addEvent(context, indexEvent);
+    LD_ASSERT(context);
 
-        indexEvent = NULL;
-    }
+    shard = &context->shards[0];
 
-    if (flag) {
-        LDi_possiblyQueueEvent(context, featureEvent, now, detailedEvaluation);
+    LDi_mutex_lock(&shard->lock);
+    success = summarizeEventLocked(shard, event, unknown);
+    LDi_mutex_unlock(&shard->lock);
 
-        featureEvent = NULL;
-    }
+    return success;
+}
 
-    LDJSONFree(featureEvent);
+/* False if the evaluation only needs to be counted in the summary, which is
+true of almost every evaluation. Flags with fields of the wrong type also get
+a feature event, so that the error is reported the same way. The server time
+is checked when the event is queued. */
+static LDBoolean
+needsFeatureEvent(
+    const struct LDEvaluationRecord *const record, const double now)
+{
+    const struct LDJSON *flag, *tmp;
 
-    if (subEvents) {
-        struct LDJSON *iter;
-        /* local only sanity */
-        LD_ASSERT(LDJSONGetType(subEvents) == LDArray);
-        /* different loop to make cleanup easier */
-        for (iter = LDGetIter(subEvents); iter; iter = LDIterNext(iter)) {
-            /* should lock here */
-            if (!LDi_summarizeEvent(context, iter, LDBooleanFalse)) {
-                LD_LOG(LD_LOG_ERROR, "summary failed");
+    /* events for unknown flags are never queued */
+    if (!(flag = record->flag)) {
+        return LDBooleanFalse;
+    }
 
-                LDJSONFree(subEvents);
+    if (LDi_notNull(tmp = LDObjectLookup(flag, "version")) &&
+        LDJSONGetType(tmp) != LDNumber)
+    {
+        return LDBooleanTrue;
+    }
 
-                LDi_mutex_unlock(&context->lock);
+    if (LDi_notNull(tmp = LDObjectLookup(flag, "trackEvents")) &&
+        (LDJSONGetType(tmp) != LDBool || LDGetBool(tmp)))
+    {
+        return LDBooleanTrue;
+    }
 
-                return LDBooleanFalse;
-            }
+    if (LDi_notNull(tmp = LDObjectLookup(flag, "debugEventsUntilDate"))) {
+        if (LDJSONGetType(tmp) != LDNumber) {
+            return LDBooleanTrue;
         }
 
-        for (iter = LDGetIter(subEvents); iter;) {
-            struct LDJSON *const next = LDIterNext(iter);
+        if (now < LDGetNumber(tmp)) {
+            return LDBooleanTrue;
+        }
+    }
 
-            LDi_possiblyQueueEvent(
-                context,
-                LDCollectionDetachIter(subEvents, iter),
-                now,
-                detailedEvaluation);
+    if (LDi_notNull(tmp = LDObjectLookup(flag, "trackEventsFallthrough")) &&
+        (LDJSONGetType(tmp) != LDBool ||
+         (LDGetBool(tmp) && record->details->reason == LD_FALLTHROUGH)))
+    {
+        return LDBooleanTrue;
+    }
 
-            iter = next;
+    if (record->details->reason == LD_RULE_MATCH) {
+        if (record->details->extra.rule.inExperiment) {
+            return LDBooleanTrue;
         }
 
-        LDJSONFree(subEvents);
-    }
+        tmp = LDArrayLookup(
+            LDObjectLookup(flag, "rules"),
+            record->details->extra.rule.ruleIndex);
 
-    LDi_mutex_unlock(&context->lock);
+        if (LDi_notNull(tmp = LDObjectLookup(tmp, "trackEvents")) &&
+            LDJSONGetType(tmp) == LDBool && LDGetBool(tmp))
+        {
+            return LDBooleanTrue;
+        }
+    } else if (record->details->reason == LD_FALLTHROUGH) {
+        if (record->details->extra.fallthrough.inExperiment) {
+            return LDBooleanTrue;
+        }
+    }
 
-    return LDBooleanTrue;
+    return LDBooleanFalse;
 }
 
-LDBoolean
-LDi_summarizeEvent(
-    struct EventProcessor *const context,
-    const struct LDJSON *const   event,
-    const LDBoolean              unknown)
+/* Builds the feature event of a record if it may be queued */
+static LDBoolean
+prepareEvaluation(
+    const struct EventProcessor *const context,
+    const struct LDUser *const         user,
+    struct LDEvaluationRecord *const   record,
+    const double                       now)
 {
-    char *         keytext;
-    const char *   flagKey;
-    struct LDJSON *tmp, *entry, *flagContext, *counters;
-    LDBoolean      success;
-
-    LD_ASSERT(context);
-    LD_ASSERT(event);
+    const struct LDJSON *evaluationValue;
+    const unsigned int * variationIndexRef;
 
-    keytext     = NULL;
-    flagKey     = NULL;
-    tmp         = NULL;
-    entry       = NULL;
-    flagContext = NULL;
-    counters    = NULL;
-    success     = LDBooleanFalse;
-
-    tmp = LDObjectLookup(event, "key");
-    LD_ASSERT(tmp);
-    LD_ASSERT(LDJSONGetType(tmp) == LDText);
-    flagKey = LDGetText(tmp);
-    LD_ASSERT(flagKey);
+    LD_ASSERT(record->details);
 
-    if (!(keytext = LDi_makeSummaryKey(event))) {
-        LD_LOG(LD_LOG_ERROR, "alloc error");
+    record->featureEvent = NULL;
 
-        return LDBooleanFalse;
+    if (!needsFeatureEvent(record, now)) {
+        return LDBooleanTrue;
     }
 
-    if (context->summaryStart == 0) {
-        double now;
-
-        LDi_getUnixMilliseconds(&now);
+    variationIndexRef = NULL;
 
-        context->summaryStart = now;
+    if (LDi_notNull(record->actualValue)) {
+        evaluationValue = record->actualValue;
+    } else {
+        evaluationValue = record->fallbackValue;
     }
 
-    if (!(flagContext = LDObjectLookup(context->summaryCounters, flagKey))) {
-        if (!(flagContext = LDNewObject())) {
-            LD_LOG(LD_LOG_ERROR, "alloc error");
-
-            goto cleanup;
-        }
-
-        tmp = LDObjectLookup(event, "default");
-
-        if (LDi_notNull(tmp)) {
-            if (!(tmp = LDJSONDuplicate(tmp))) {
-                LD_LOG(LD_LOG_ERROR, "alloc error");
-
-                LDJSONFree(flagContext);
-
-                goto cleanup;
-            }
+    if (record->details->hasVariation) {
+        variationIndexRef = &record->details->variationIndex;
+    }
 
-            if (!LDObjectSetKey(flagContext, "default", tmp)) {
-                LD_LOG(LD_LOG_ERROR, "alloc error");
+    record->featureEvent = LDi_newFeatureRequestEvent(
+        context,
+        record->flagKey,
+        user,
+        variationIndexRef,
+        evaluationValue,
+        record->fallbackValue,
+        NULL,
+        record->flag,
+        record->details,
+        now);
 
-                LDJSONFree(tmp);
-                LDJSONFree(flagContext);
+    return record->featureEvent != NULL;
+}
 
-                goto cleanup;
-            }
+/* requires the shard lock */
+static LDBoolean
+summarizeRecordLocked(
+    struct LDEventShard *const             shard,
+    const struct LDEvaluationRecord *const record)
+{
+    const struct LDJSON *       evaluationValue, *version;
+    const struct LDEventRecord *iter;
+    const unsigned int *        variationIndexRef;
+    double                      versionValue;
+
+    if (record->featureEvent) {
+        if (!summarizeEventLocked(
+                shard, record->featureEvent, !record->flag))
+        {
+            return LDBooleanFalse;
         }
+    } else {
+        variationIndexRef = NULL;
+        versionValue      = 0;
 
-        if (!(tmp = LDNewObject())) {
-            LD_LOG(LD_LOG_ERROR, "alloc error");
-
-            LDJSONFree(flagContext);
-
-            goto cleanup;
+        if (LDi_notNull(record->actualValue)) {
+            evaluationValue = record->actualValue;
+        } else {
+            evaluationValue = record->fallbackValue;
         }
 
-        if (!LDObjectSetKey(flagContext, "counters", tmp)) {
-            LD_LOG(LD_LOG_ERROR, "alloc error");
-
-            LDJSONFree(tmp);
-            LDJSONFree(flagContext);
-
-            goto cleanup;
+        if (record->details->hasVariation) {
+            variationIndexRef = &record->details->variationIndex;
         }
 
-        if (!LDObjectSetKey(context->summaryCounters, flagKey, flagContext)) {
-            LD_LOG(LD_LOG_ERROR, "alloc error");
-
-            LDJSONFree(flagContext);
+        if (LDi_notNull(version = LDObjectLookup(record->flag, "version"))) {
+            versionValue = LDGetNumber(version);
+        }
 
-            goto cleanup;
+        if (!summarizeEvaluationLocked(
+                shard,
+                record->flagKey,
+                variationIndexRef,
+                LDi_notNull(version) ? &versionValue : NULL,
+                evaluationValue,
+                record->fallbackValue,
+                !record->flag))
+        {
+            return LDBooleanFalse;
         }
     }
 
-    counters = LDObjectLookup(flagContext, "counters");
-    LD_ASSERT(counters);
-    LD_ASSERT(LDJSONGetType(counters) == LDObject);
-
-    if (!(entry = LDObjectLookup(counters, keytext))) {
-        if (!(entry = LDNewObject())) {
-            LD_LOG(LD_LOG_ERROR, "alloc error");
+    for (iter = record->subEvents; iter; iter = iter->next) {
+        if (!summarizeEventLocked(shard, iter, LDBooleanFalse)) {
+            LD_LOG(LD_LOG_ERROR, "summary failed");
 
-            goto cleanup;
+            return LDBooleanFalse;
         }
+    }
 
-        if (!(tmp = LDNewNumber(1))) {
-            LD_LOG(LD_LOG_ERROR, "alloc error");
-
-            LDJSONFree(entry);
-
-            goto cleanup;
-        }
+    return LDBooleanTrue;
+}
 
-        if (!LDObjectSetKey(entry, "count", tmp)) {
-            LD_LOG(LD_LOG_ERROR, "alloc error");
+/* consumes the events of the record */
+static void
+queueRecord(
+    struct EventProcessor *const     context,
+    struct LDEvaluationRecord *const record,
+    const double                     now,
+    const LDBoolean                  detailedEvaluation)
+{
+    struct LDEventRecord *iter, *next;
 
-            LDJSONFree(tmp);
-            LDJSONFree(entry);
+    if (record->featureEvent) {
+        LDi_possiblyQueueEvent(
+            context, record->featureEvent, now, detailedEvaluation);
+    }
 
-            goto cleanup;
-        }
+    for (iter = record->subEvents; iter; iter = next) {
+        next       = iter->next;
+        iter->next = NULL;
 
-        tmp = LDObjectLookup(event, "value");
+        LDi_possiblyQueueEvent(context, iter, now, detailedEvaluation);
+    }
 
-        if (LDi_notNull(tmp)) {
-            if (!(tmp = LDJSONDuplicate(tmp))) {
-                LD_LOG(LD_LOG_ERROR, "alloc error");
+    record->featureEvent = NULL;
+    record->subEvents    = NULL;
+}
 
-                LDJSONFree(entry);
+/* Requires the shard lock. Returns whether `user` needs an index event. */
+static enum LDLRUStatus
+rememberUserLocked(
+    const struct EventProcessor *const context,
+    struct LDEventShard *const         shard,
+    const struct LDUser *const         user,
+    const double                       now)
+{
+    if (context->config->inlineUsersInEvents) {
+        return LDLRUSTATUS_EXISTED;
+    }
 
-                goto cleanup;
-            }
+    if (now >
+        shard->lastUserKeyFlush + context->config->userKeysFlushInterval) {
+        LDLRUClear(shard->userKeys);
 
-            if (!LDObjectSetKey(entry, "value", tmp)) {
-                LD_LOG(LD_LOG_ERROR, "alloc error");
+        shard->lastUserKeyFlush = now;
+    }
 
-                LDJSONFree(tmp);
-                LDJSONFree(entry);
+    return LDLRUInsert(shard->userKeys, user->key);
+}
 
-                goto cleanup;
-            }
-        }
+static struct LDEventRecord *
+newIndexEvent(
+    const struct EventProcessor *const context,
+    const struct LDUser *const         user,
+    const double                       now)
+{
+    struct LDEventRecord *event;
 
-        tmp = LDObjectLookup(event, "version");
+    if (!(event = LDi_newEventRecord(LD_EVENT_INDEX, now, 0))) {
+        LD_LOG(LD_LOG_ERROR, "alloc error");
 
-        if (LDi_notNull(tmp)) {
-            if (!(tmp = LDJSONDuplicate(tmp))) {
-                LD_LOG(LD_LOG_ERROR, "alloc error");
+        return NULL;
+    }
 
-                LDJSONFree(entry);
+    if (!(event->user = LDi_userToJSON(
+              user,
+              LDBooleanTrue,
+              context->config->allAttributesPrivate,
+              context->config->privateAttributeNames)))
+    {
+        LD_LOG(LD_LOG_ERROR, "alloc error");
 
-                goto cleanup;
-            }
+        LDi_freeEventRecords(event);
 
-            if (!LDObjectSetKey(entry, "version", tmp)) {
-                LD_LOG(LD_LOG_ERROR, "alloc error");
+        return NULL;
+    }
 
-                LDJSONFree(tmp);
-                LDJSONFree(entry);
+    return event;
+}
 
-                goto cleanup;
-            }
-        }
+LDBoolean
+LDi_processEvaluation(
+    /* required */
+    struct EventProcessor *const context,
+    /* required */
+    const struct LDUser *const user,
+    /* optional */
+    struct LDEventRecord *const subEvents,
+    /* required */
+    const char *const flagKey,
+    /* required */
+    const struct LDJSON *const actualValue,
+    /* required */
+    const struct LDJSON *const fallbackValue,
+    /* optional */
+    const struct LDJSON *const flag,
+    /* required */
+    const struct LDDetails *const details,
+    /* required */
+    const LDBoolean detailedEvaluation)
+{
+    struct LDEvaluationRecord record;
 
-        tmp = LDObjectLookup(event, "variation");
+    LD_ASSERT(context);
+    LD_ASSERT(details);
 
-        if (LDi_notNull(tmp)) {
-            if (!(tmp = LDJSONDuplicate(tmp))) {
-                LD_LOG(LD_LOG_ERROR, "alloc error");
+    record.subEvents     = subEvents;
+    record.flagKey       = flagKey;
+    record.actualValue   = actualValue;
+    record.fallbackValue = fallbackValue;
+    record.flag          = flag;
+    record.details       = details;
 
-                LDJSONFree(entry);
+    LDi_processEvaluations(context, user, &record, 1, detailedEvaluation);
 
-                goto cleanup;
-            }
+    return record.recorded;
+}
 
-            if (!LDObjectSetKey(entry, "variation", tmp)) {
-                LD_LOG(LD_LOG_ERROR, "alloc error");
+void
+LDi_processEvaluations(
+    struct EventProcessor *const     context,
+    const struct LDUser *const       user,
+    struct LDEvaluationRecord *const records,
+    const unsigned int               count,
+    const LDBoolean                  detailedEvaluation)
+{
+    struct LDEventShard * shard;
+    struct LDEventRecord *indexEvent;
+    enum LDLRUStatus      userStatus;
+    unsigned int          i;
+    double                now;
 
-                LDJSONFree(tmp);
-                LDJSONFree(entry);
+    LD_ASSERT(context);
+    LD_ASSERT(user);
+    LD_ASSERT(records || count == 0);
 
-                goto cleanup;
-            }
-        }
+    if (count == 0) {
+        return;
+    }
 
-        if (unknown) {
-            if (!(tmp = LDNewBool(LDBooleanTrue))) {
-                LD_LOG(LD_LOG_ERROR, "alloc error");
+    shard = shardForUser(context, user);
 
-                LDJSONFree(entry);
+    LDi_getUnixMilliseconds(&now);
 
-                goto cleanup;
-            }
+    /* events are built before taking any lock */
+    for (i = 0; i < count; i++) {
+        records[i].recorded =
+            prepareEvaluation(context, user, &records[i], now);
+    }
 
-            if (!LDObjectSetKey(entry, "unknown", tmp)) {
-                LD_LOG(LD_LOG_ERROR, "alloc error");
+    LDi_mutex_lock(&shard->lock);
 
-                LDJSONFree(tmp);
-                LDJSONFree(entry);
+    userStatus = rememberUserLocked(context, shard, user, now);
 
-                goto cleanup;
-            }
+    for (i = 0; i < count; i++) {
+        if (records[i].recorded) {
+            records[i].recorded = summarizeRecordLocked(shard, &records[i]);
         }
+    }
 
-        if (!LDObjectSetKey(counters, keytext, entry)) {
-            LD_LOG(LD_LOG_ERROR, "alloc error");
+    LDi_mutex_unlock(&shard->lock);
 
-            LDJSONFree(entry);
+    if (userStatus == LDLRUSTATUS_ERROR) {
+        LD_LOG(LD_LOG_ERROR, "failed to remember user");
+    } else if (userStatus == LDLRUSTATUS_NEW &&
+               (indexEvent = newIndexEvent(context, user, now)))
+    {
+        LDi_addEvent(context, indexEvent);
+    }
+
+    for (i = 0; i < count; i++) {
+        if (records[i].recorded) {
+            queueRecord(context, &records[i], now, detailedEvaluation);
+        } else {
+            LDi_freeEventRecords(records[i].featureEvent);
+            LDi_freeEventRecords(records[i].subEvents);
 
-            goto cleanup;
+            records[i].featureEvent = NULL;
+            records[i].subEvents    = NULL;
         }
-    } else {
-        LDBoolean status;
-        tmp = LDObjectLookup(entry, "count");
-        LD_ASSERT(tmp);
-        status = LDSetNumber(tmp, LDGetNumber(tmp) + 1);
-        LD_ASSERT(status);
     }
-
-    success = LDBooleanTrue;
-
-cleanup:
-    LDFree(keytext);
-
-    return success;
-}
-
-static LDBoolean
-convertToDebug(struct LDJSON *const event)
-{
-    struct LDJSON *kind;
-
-    LD_ASSERT(event);
-
-    LDObjectDeleteKey(event, "kind");
-
-    if (!(kind = LDNewText("debug"))) {
-        goto error;
-    }
-
-    if (!LDObjectSetKey(event, "kind", kind)) {
-        LDJSONFree(kind);
-
-        goto error;
-    }
-
-    return LDBooleanTrue;
-
-error:
-    return LDBooleanFalse;
-}
+}
 
 void
 LDi_possiblyQueueEvent(
     struct EventProcessor *const context,
-    struct LDJSON *              event,
+    struct LDEventRecord *       event,
     const double                 now,
     const LDBoolean              detailedEvaluation)
 {
-    LDBoolean      shouldTrack;
-    struct LDJSON *tmp;
+    LDBoolean shouldTrack;
 
     LD_ASSERT(context);
     LD_ASSERT(event);
 
     shouldTrack = LDBooleanFalse;
 
-    if ((tmp = LDObjectLookup(LDObjectLookup(event, "reason"), "inExperiment")))
-    {
-        shouldTrack = LDGetBool(tmp);
-    }
-
-    if (LDi_notNull(tmp = LDObjectLookup(event, "shouldAlwaysTrackDetails"))) {
-        if (!LDGetBool(tmp)) {
-            LDObjectDeleteKey(event, "reason");
+    if (event->hasReason) {
+        if (event->details.reason == LD_RULE_MATCH) {
+            shouldTrack = event->details.extra.rule.inExperiment;
+        } else if (event->details.reason == LD_FALLTHROUGH) {
+            shouldTrack = event->details.extra.fallthrough.inExperiment;
         }
+    }
 
-        LDJSONFree(LDCollectionDetachIter(event, tmp));
-    } else if (!detailedEvaluation) {
-        LDObjectDeleteKey(event, "reason");
+    if (!event->alwaysTrackDetails && !detailedEvaluation) {
+        event->hasReason = LDBooleanFalse;
     }
 
-    if (LDi_notNull(tmp = LDObjectLookup(event, "trackEvents"))) {
-        /* validated as Boolean by LDi_newFeatureRequestEvent */
-        if (shouldTrack == LDBooleanFalse) {
-            shouldTrack = LDGetBool(tmp);
-        }
-        /* ensure we don't send trackEvents to LD */
-        LDJSONFree(LDCollectionDetachIter(event, tmp));
+    if (event->trackEvents) {
+        shouldTrack = LDBooleanTrue;
     }
 
-    if (LDi_notNull(tmp = LDObjectLookup(event, "debugEventsUntilDate"))) {
-        /* validated as Number by LDi_newFeatureRequestEvent */
-        const double until = LDGetNumber(tmp);
-        /* ensure we don't send debugEventsUntilDate to LD */
-        LDJSONFree(LDCollectionDetachIter(event, tmp));
+    if (event->hasDebugEventsUntilDate) {
+        const double until = event->debugEventsUntilDate;
+        double       lastServerTime;
 
-        if (now < until && context->lastServerTime < until) {
-            struct LDJSON *debugEvent = NULL;
+        LDi_mutex_lock(&context->lock);
+        lastServerTime = context->lastServerTime;
+        LDi_mutex_unlock(&context->lock);
+
+        if (now < until && lastServerTime < until) {
+            struct LDEventRecord *debugEvent = NULL;
 
             if (shouldTrack) {
-                debugEvent = LDJSONDuplicate(event);
+                debugEvent = LDi_duplicateEventRecords(event);
             } else {
                 debugEvent = event;
                 event      = NULL;
             }
 
-            if (!debugEvent || !convertToDebug(debugEvent)) {
+            if (debugEvent) {
+                debugEvent->kind = LD_EVENT_DEBUG;
+
                 LDi_addEvent(context, debugEvent);
             } else {
-                LDJSONFree(debugEvent);
-
                 LD_LOG(LD_LOG_WARNING, "failed to allocate debug event");
             }
         }
@@ -521,24 +600,71 @@ LDi_possiblyQueueEvent(
     }
 
     /* consume if neither debug nor track */
-    LDJSONFree(event);
+    LDi_freeEventRecords(event);
 }
 
 void
-LDi_addEvent(struct EventProcessor *const context, struct LDJSON *const event)
+LDi_addEvent(
+    struct EventProcessor *const context, struct LDEventRecord *const event)
 {
     LD_ASSERT(context);
     LD_ASSERT(event);
 
+    /* dropped events are counted, and reported when events are bundled */
+    LDi_eventQueuePush(&context->queue, event);
+}
+
+/* requires the processor lock */
+static void
+reportDroppedLocked(struct EventProcessor *const context)
+{
+    unsigned long dropped;
+
+    dropped = LDi_eventQueueDropped(&context->queue);
+
+    if (dropped != context->lastDropped) {
+        LD_LOG_1(
+            LD_LOG_WARNING,
+            "event capacity exceeded, dropped %lu events",
+            dropped - context->lastDropped);
+
+        context->lastDropped = dropped;
+    }
+}
+
+LDBoolean
+LDi_drainEvents(struct EventProcessor *const context)
+{
+    struct LDEventRecord *event;
+    struct LDJSON *       json;
+    LDBoolean             success;
+
+    LD_ASSERT(context);
+
+    success = LDBooleanTrue;
+
+    LDi_mutex_lock(&context->lock);
+
     /* sanity check */
     LD_ASSERT(LDJSONGetType(context->events) == LDArray);
 
-    if (LDCollectionGetSize(context->events) >= context->config->eventsCapacity)
-    {
-        LD_LOG(LD_LOG_WARNING, "event capacity exceeded, dropping event");
-    } else {
-        LDArrayPush(context->events, event);
+    reportDroppedLocked(context);
+
+    while ((event = LDi_eventQueuePop(&context->queue))) {
+        if (!(json = LDi_eventRecordToJSON(event)) ||
+            !LDArrayPush(context->events, json))
+        {
+            LDJSONFree(json);
+
+            success = LDBooleanFalse;
+        }
+
+        LDi_freeEventRecords(event);
     }
+
+    LDi_mutex_unlock(&context->lock);
+
+    return success;
 }
 
 LDBoolean
@@ -546,72 +672,69 @@ LDi_maybeMakeIndexEvent(
     struct EventProcessor *const context,
     const struct LDUser *const   user,
     const double                 now,
-    struct LDJSON **const        result)
+    struct LDEventRecord **const result)
 {
-    struct LDJSON *  event, *tmp;
-    enum LDLRUStatus status;
+    struct LDEventShard *shard;
+    enum LDLRUStatus     status;
 
     LD_ASSERT(context);
     LD_ASSERT(user);
     LD_ASSERT(result);
 
-    if (context->config->inlineUsersInEvents) {
-        *result = NULL;
-
-        return LDBooleanTrue;
-    }
-
-    if (now >
-        context->lastUserKeyFlush + context->config->userKeysFlushInterval) {
-        LDLRUClear(context->userKeys);
-
-        context->lastUserKeyFlush = now;
-    }
+    *result = NULL;
+    shard   = shardForUser(context, user);
 
-    status = LDLRUInsert(context->userKeys, user->key);
+    LDi_mutex_lock(&shard->lock);
+    status = rememberUserLocked(context, shard, user, now);
+    LDi_mutex_unlock(&shard->lock);
 
     if (status == LDLRUSTATUS_ERROR) {
         return LDBooleanFalse;
     } else if (status == LDLRUSTATUS_EXISTED) {
-        *result = NULL;
-
         return LDBooleanTrue;
     }
 
-    if (!(event = LDi_newBaseEvent("index", now))) {
-        LD_LOG(LD_LOG_ERROR, "alloc error");
-
-        return LDBooleanFalse;
-    }
-
-    if (!(tmp = LDi_userToJSON(
-              user,
-              LDBooleanTrue,
-              context->config->allAttributesPrivate,
-              context->config->privateAttributeNames)))
-    {
-        LD_LOG(LD_LOG_ERROR, "alloc error");
-
-        LDJSONFree(event);
-
-        return LDBooleanFalse;
-    }
-
-    if (!(LDObjectSetKey(event, "user", tmp))) {
-        LD_LOG(LD_LOG_ERROR, "alloc error");
+    return (*result = newIndexEvent(context, user, now)) != NULL;
+}
 
-        LDJSONFree(tmp);
-        LDJSONFree(event);
+/* Sets the user of an event, inline or by key as configured. The key must
+have been counted in the string space of the record. */
+static LDBoolean
+setEventUser(
+    const struct EventProcessor *const context,
+    struct LDEventRecord *const        event,
+    const struct LDUser *const         user)
+{
+    if (context->config->inlineUsersInEvents) {
+        if (!(event->user = LDi_userToJSON(
+                  user,
+                  LDBooleanTrue,
+                  context->config->allAttributesPrivate,
+                  context->config->privateAttributeNames)))
+        {
+            LD_LOG(LD_LOG_ERROR, "alloc error");
 
-        return LDBooleanFalse;
+            return LDBooleanFalse;
+        }
+    } else {
+        event->userKey = LDi_packString(event, user->key);
     }
 
-    *result = event;
+    event->anonymous = user->anonymous;
 
     return LDBooleanTrue;
 }
 
-struct LDJSON *
+/* The string space `setEventUser` needs */
+static size_t
+eventUserLength(
+    const struct EventProcessor *const context, const struct LDUser *const user)
+{
+    return context->config->inlineUsersInEvents ? 0
+                                                : LDi_packedLength(user->key);
+}
+
+struct LDEventRecord *
 LDi_newFeatureRequestEvent(
     const struct EventProcessor *const context,
     const char *const                  key,
@@ -624,106 +747,50 @@ LDi_newFeatureRequestEvent(
     const struct LDDetails *const      details,
     const double                       now)
 {
-    struct LDJSON *tmp, *event;
-    LDBoolean      shouldTrack, shouldAlwaysDetail;
+    const struct LDJSON * tmp;
+    struct LDEventRecord *event;
+    size_t                stringSpace;
 
     LD_ASSERT(context);
     LD_ASSERT(key);
     LD_ASSERT(user);
 
-    tmp                = NULL;
-    event              = NULL;
-    shouldTrack        = LDBooleanFalse;
-    shouldAlwaysDetail = LDBooleanFalse;
+    stringSpace = LDi_packedLength(key) + LDi_packedLength(prereqOf) +
+        eventUserLength(context, user);
 
-    if (!(event = LDi_newBaseEvent("feature", now))) {
-        LD_LOG(LD_LOG_ERROR, "alloc error");
-
-        goto error;
+    if (details) {
+        stringSpace += LDi_packedDetailsLength(details);
     }
 
-    if (!LDi_addUserInfoToEvent(context, event, user)) {
+    if (!(event = LDi_newEventRecord(LD_EVENT_FEATURE, now, stringSpace))) {
         LD_LOG(LD_LOG_ERROR, "alloc error");
 
-        goto error;
+        return NULL;
     }
 
-    if (!(tmp = LDNewText(key))) {
-        LD_LOG(LD_LOG_ERROR, "alloc error");
-
+    if (!setEventUser(context, event, user)) {
         goto error;
     }
 
-    if (!LDObjectSetKey(event, "key", tmp)) {
-        LD_LOG(LD_LOG_ERROR, "alloc error");
-
-        LDJSONFree(tmp);
-
-        goto error;
-    }
+    event->key      = LDi_packString(event, key);
+    event->prereqOf = LDi_packString(event, prereqOf);
 
     if (variation) {
-        if (!(tmp = LDNewNumber(*variation))) {
-            LD_LOG(LD_LOG_ERROR, "alloc error");
-
-            goto error;
-        }
-
-        if (!LDObjectSetKey(event, "variation", tmp)) {
-            LD_LOG(LD_LOG_ERROR, "alloc error");
-
-            LDJSONFree(tmp);
-
-            goto error;
-        }
-    }
-
-    if (value) {
-        if (!(tmp = LDJSONDuplicate(value))) {
-            LD_LOG(LD_LOG_ERROR, "alloc error");
-
-            goto error;
-        }
-
-        if (!LDObjectSetKey(event, "value", tmp)) {
-            LD_LOG(LD_LOG_ERROR, "alloc error");
-
-            LDJSONFree(tmp);
-
-            goto error;
-        }
+        event->hasVariation = LDBooleanTrue;
+        event->variation    = *variation;
     }
 
-    if (defaultValue) {
-        if (!(tmp = LDJSONDuplicate(defaultValue))) {
-            LD_LOG(LD_LOG_ERROR, "alloc error");
-
-            goto error;
-        }
-
-        if (!LDObjectSetKey(event, "default", tmp)) {
-            LD_LOG(LD_LOG_ERROR, "alloc error");
-
-            LDJSONFree(tmp);
+    if (value && !(event->value = LDJSONDuplicate(value))) {
+        LD_LOG(LD_LOG_ERROR, "alloc error");
 
-            goto error;
-        }
+        goto error;
     }
 
-    if (prereqOf) {
-        if (!(tmp = LDNewText(prereqOf))) {
-            LD_LOG(LD_LOG_ERROR, "alloc error");
-
-            goto error;
-        }
-
-        if (!LDObjectSetKey(event, "prereqOf", tmp)) {
-            LD_LOG(LD_LOG_ERROR, "alloc error");
-
-            LDJSONFree(tmp);
+    if (defaultValue && !(event->defaultValue = LDJSONDuplicate(defaultValue)))
+    {
+        LD_LOG(LD_LOG_ERROR, "alloc error");
 
-            goto error;
-        }
+        goto error;
     }
 
     if (flag) {
@@ -734,19 +801,8 @@ LDi_newFeatureRequestEvent(
                 goto error;
             }
 
-            if (!(tmp = LDJSONDuplicate(tmp))) {
-                LD_LOG(LD_LOG_ERROR, "memory error");
-
-                goto error;
-            }
-
-            if (!LDObjectSetKey(event, "version", tmp)) {
-                LD_LOG(LD_LOG_ERROR, "memory error");
-
-                LDJSONFree(tmp);
-
-                goto error;
-            }
+            event->hasVersion = LDBooleanTrue;
+            event->version    = LDGetNumber(tmp);
         }
 
         if (LDi_notNull(tmp = LDObjectLookup(flag, "debugEventsUntilDate"))) {
@@ -756,19 +812,8 @@ LDi_newFeatureRequestEvent(
                 goto error;
             }
 
-            if (!(tmp = LDJSONDuplicate(tmp))) {
-                LD_LOG(LD_LOG_ERROR, "memory error");
-
-                goto error;
-            }
-
-            if (!LDObjectSetKey(event, "debugEventsUntilDate", tmp)) {
-                LD_LOG(LD_LOG_ERROR, "memory error");
-
-                LDJSONFree(tmp);
-
-                goto error;
-            }
+            event->hasDebugEventsUntilDate = LDBooleanTrue;
+            event->debugEventsUntilDate    = LDGetNumber(tmp);
         }
 
         if (LDi_notNull(tmp = LDObjectLookup(flag, "trackEvents"))) {
@@ -779,287 +824,56 @@ LDi_newFeatureRequestEvent(
             }
 
             if (LDGetBool(tmp)) {
-                shouldTrack = LDBooleanTrue;
+                event->trackEvents = LDBooleanTrue;
             }
         }
     }
 
     if (details) {
-        if (!(tmp = LDReasonToJSON(details))) {
-            LD_LOG(LD_LOG_ERROR, "memory error");
-
-            goto error;
-        }
-
-        if (!LDObjectSetKey(event, "reason", tmp)) {
-            LD_LOG(LD_LOG_ERROR, "memory error");
-
-            LDJSONFree(tmp);
-
-            goto error;
-        }
-    }
-
-    if (details && flag) {
-        if (LDi_notNull(tmp = LDObjectLookup(flag, "trackEventsFallthrough"))) {
-            if (LDJSONGetType(tmp) != LDBool) {
-                LD_LOG(LD_LOG_ERROR, "schema error");
-
-                goto error;
-            }
-
-            if (LDGetBool(tmp) && details->reason == LD_FALLTHROUGH) {
-                shouldTrack        = LDBooleanTrue;
-                shouldAlwaysDetail = LDBooleanTrue;
-            }
-        }
-
-        if (details->reason == LD_RULE_MATCH) {
-            tmp = LDArrayLookup(
-                LDObjectLookup(flag, "rules"), details->extra.rule.ruleIndex);
-
-            if (LDi_notNull(tmp = LDObjectLookup(tmp, "trackEvents")) &&
-                LDJSONGetType(tmp) == LDBool && LDGetBool(tmp) == LDBooleanTrue)
-            {
-                shouldTrack        = LDBooleanTrue;
-                shouldAlwaysDetail = LDBooleanTrue;
-            }
-        }
-    }
-
-    if (shouldTrack) {
-        if (!(tmp = LDNewBool(LDBooleanTrue))) {
-            LD_LOG(LD_LOG_ERROR, "memory error");
-
-            goto error;
-        }
-
-        if (!LDObjectSetKey(event, "trackEvents", tmp)) {
-            LD_LOG(LD_LOG_ERROR, "memory error");
-
-            LDJSONFree(tmp);
-
-            goto error;
-        }
-    }
-
-    if (shouldAlwaysDetail) {
-        if (!(tmp = LDNewBool(LDBooleanTrue))) {
-            LD_LOG(LD_LOG_ERROR, "memory error");
-
-            goto error;
-        }
-
-        if (!LDObjectSetKey(event, "shouldAlwaysTrackDetails", tmp)) {
-            LD_LOG(LD_LOG_ERROR, "memory error");
-
-            LDJSONFree(tmp);
-
-            goto error;
-        }
-    }
-
-    if (user->anonymous) {
-        if (!(tmp = LDNewText("anonymousUser"))) {
-            goto error;
-        }
-
-        if (!LDObjectSetKey(event, "contextKind", tmp)) {
-            LDJSONFree(tmp);
-
-            goto error;
-        }
-    }
-
-    return event;
-
-error:
-    LDJSONFree(event);
-
-    return NULL;
-}
-
-struct LDJSON *
-LDi_newBaseEvent(const char *const kind, const double now)
-{
-    struct LDJSON *tmp, *event;
-
-    tmp   = NULL;
-    event = NULL;
-
-    if (!(event = LDNewObject())) {
-        LD_LOG(LD_LOG_ERROR, "alloc error");
-
-        goto error;
-    }
-
-    if (!(tmp = LDNewNumber(now))) {
-        LD_LOG(LD_LOG_ERROR, "alloc error");
-
-        goto error;
-    }
-
-    if (!(LDObjectSetKey(event, "creationDate", tmp))) {
-        LD_LOG(LD_LOG_ERROR, "alloc error");
-
-        LDJSONFree(tmp);
-
-        goto error;
-    }
-
-    if (!(tmp = LDNewText(kind))) {
-        LD_LOG(LD_LOG_ERROR, "alloc error");
-
-        goto error;
-    }
-
-    if (!(LDObjectSetKey(event, "kind", tmp))) {
-        LD_LOG(LD_LOG_ERROR, "alloc error");
-
-        goto error;
-    }
-
-    return event;
-
-error:
-    LDJSONFree(event);
-
-    return NULL;
-}
-
-LDBoolean
-LDi_addUserInfoToEvent(
-    const struct EventProcessor *const context,
-    struct LDJSON *const               event,
-    const struct LDUser *const         user)
-{
-    struct LDJSON *tmp;
-
-    LD_ASSERT(context);
-    LD_ASSERT(event);
-    LD_ASSERT(user);
-
-    if (context->config->inlineUsersInEvents) {
-        if (!(tmp = LDi_userToJSON(
-                  user,
-                  LDBooleanTrue,
-                  context->config->allAttributesPrivate,
-                  context->config->privateAttributeNames)))
-        {
-            LD_LOG(LD_LOG_ERROR, "alloc error");
-
-            return LDBooleanFalse;
-        }
-
-        if (!(LDObjectSetKey(event, "user", tmp))) {
-            LD_LOG(LD_LOG_ERROR, "alloc error");
-
-            LDJSONFree(tmp);
-
-            return LDBooleanFalse;
-        }
-    } else {
-        if (!(tmp = LDNewText(user->key))) {
-            LD_LOG(LD_LOG_ERROR, "alloc error");
-
-            return LDBooleanFalse;
-        }
-
-        if (!(LDObjectSetKey(event, "userKey", tmp))) {
-            LD_LOG(LD_LOG_ERROR, "alloc error");
-
-            LDJSONFree(tmp);
-
-            return LDBooleanFalse;
-        }
-    }
-
-    return LDBooleanTrue;
-}
-
-char *
-LDi_makeSummaryKey(const struct LDJSON *const event)
-{
-    char *         keytext;
-    struct LDJSON *key, *tmp;
-
-    LD_ASSERT(event);
-
-    tmp     = NULL;
-    keytext = NULL;
-    key     = NULL;
-
-    if (!(key = LDNewObject())) {
-        LD_LOG(LD_LOG_ERROR, "alloc error");
-
-        return NULL;
-    }
-
-    tmp = LDObjectLookup(event, "variation");
-
-    if (LDi_notNull(tmp)) {
-        LD_ASSERT(LDJSONGetType(tmp) == LDNumber);
-
-        if (!(tmp = LDJSONDuplicate(tmp))) {
-            LD_LOG(LD_LOG_ERROR, "alloc error");
-
-            LDJSONFree(key);
-
-            return NULL;
-        }
-
-        if (!LDObjectSetKey(key, "variation", tmp)) {
-            LD_LOG(LD_LOG_ERROR, "alloc error");
-
-            LDJSONFree(key);
-            LDJSONFree(tmp);
-
-            return NULL;
-        }
+        LDi_packDetails(event, details);
     }
 
-    tmp = LDObjectLookup(event, "version");
-
-    if (LDi_notNull(tmp)) {
-        LD_ASSERT(LDJSONGetType(tmp) == LDNumber);
-
-        if (!(tmp = LDJSONDuplicate(tmp))) {
-            LD_LOG(LD_LOG_ERROR, "alloc error");
+    if (details && flag) {
+        if (LDi_notNull(tmp = LDObjectLookup(flag, "trackEventsFallthrough"))) {
+            if (LDJSONGetType(tmp) != LDBool) {
+                LD_LOG(LD_LOG_ERROR, "schema error");
 
-            LDJSONFree(key);
+                goto error;
+            }
 
-            return NULL;
+            if (LDGetBool(tmp) && details->reason == LD_FALLTHROUGH) {
+                event->trackEvents        = LDBooleanTrue;
+                event->alwaysTrackDetails = LDBooleanTrue;
+            }
         }
 
-        if (!LDObjectSetKey(key, "version", tmp)) {
-            LD_LOG(LD_LOG_ERROR, "alloc error");
-
-            LDJSONFree(key);
-            LDJSONFree(tmp);
+        if (details->reason == LD_RULE_MATCH) {
+            tmp = LDArrayLookup(
+                LDObjectLookup(flag, "rules"), details->extra.rule.ruleIndex);
 
-            return NULL;
+            if (LDi_notNull(tmp = LDObjectLookup(tmp, "trackEvents")) &&
+                LDJSONGetType(tmp) == LDBool && LDGetBool(tmp) == LDBooleanTrue)
+            {
+                event->trackEvents        = LDBooleanTrue;
+                event->alwaysTrackDetails = LDBooleanTrue;
+            }
         }
     }
 
-    if (!(keytext = LDJSONSerialize(key))) {
-        LD_LOG(LD_LOG_ERROR, "alloc error");
-
-        LDJSONFree(key);
-
-        return NULL;
-    }
+    return event;
 
-    LDJSONFree(key);
+error:
+    LDi_freeEventRecords(event);
 
-    return keytext;
+    return NULL;
 }
 
 LDBoolean
 LDi_identify(
     struct EventProcessor *const context, const struct LDUser *const user)
 {
-    struct LDJSON *event;
-    double         now;
+    struct LDEventRecord *event;
+    double                now;
 
     LD_ASSERT(context);
     LD_ASSERT(user);
@@ -1072,53 +886,33 @@ LDi_identify(
         return LDBooleanFalse;
     }
 
-    LDi_mutex_lock(&context->lock);
-
     LDi_addEvent(context, event);
 
-    LDi_mutex_unlock(&context->lock);
-
     return LDBooleanTrue;
 }
 
-struct LDJSON *
+struct LDEventRecord *
 LDi_newIdentifyEvent(
     const struct EventProcessor *const context,
     const struct LDUser *const         user,
     const double                       now)
 {
-    struct LDJSON *event, *tmp;
+    struct LDEventRecord *event;
 
     LD_ASSERT(context);
     LD_ASSERT(user);
 
-    event = NULL;
-    tmp   = NULL;
-
-    if (!(event = LDi_newBaseEvent("identify", now))) {
-        LD_LOG(LD_LOG_ERROR, "failed to construct base event");
-
-        return NULL;
-    }
-
-    if (!(tmp = LDNewText(user->key))) {
+    if (!(event = LDi_newEventRecord(
+              LD_EVENT_IDENTIFY, now, LDi_packedLength(user->key))))
+    {
         LD_LOG(LD_LOG_ERROR, "alloc error");
 
-        LDJSONFree(event);
-
-        return LDBooleanFalse;
+        return NULL;
     }
 
-    if (!(LDObjectSetKey(event, "key", tmp))) {
-        LD_LOG(LD_LOG_ERROR, "alloc error");
-
-        LDJSONFree(event);
-        LDJSONFree(tmp);
-
-        return LDBooleanFalse;
-    }
+    event->key = LDi_packString(event, user->key);
 
-    if (!(tmp = LDi_userToJSON(
+    if (!(event->user = LDi_userToJSON(
               user,
               LDBooleanTrue,
               context->config->allAttributesPrivate,
@@ -1126,16 +920,7 @@ LDi_newIdentifyEvent(
     {
         LD_LOG(LD_LOG_ERROR, "alloc error");
 
-        LDJSONFree(event);
-
-        return NULL;
-    }
-
-    if (!(LDObjectSetKey(event, "user", tmp))) {
-        LD_LOG(LD_LOG_ERROR, "alloc error");
-
-        LDJSONFree(tmp);
-        LDJSONFree(event);
+        LDi_freeEventRecords(event);
 
         return NULL;
     }
@@ -1143,7 +928,7 @@ LDi_newIdentifyEvent(
     return event;
 }
 
-struct LDJSON *
+struct LDEventRecord *
 LDi_newCustomEvent(
     const struct EventProcessor *const context,
     const struct LDUser *const         user,
@@ -1153,223 +938,124 @@ LDi_newCustomEvent(
     const LDBoolean                    hasMetric,
     const double                       now)
 {
-    struct LDJSON *tmp, *event;
+    struct LDEventRecord *event;
 
     LD_ASSERT(context);
     LD_ASSERT(user);
     LD_ASSERT(key);
 
-    tmp   = NULL;
-    event = NULL;
-
-    if (!(event = LDi_newBaseEvent("custom", now))) {
-        LD_LOG(LD_LOG_ERROR, "memory error");
-
-        goto error;
-    }
-
-    if (!LDi_addUserInfoToEvent(context, event, user)) {
-        LD_LOG(LD_LOG_ERROR, "alloc error");
-
-        goto error;
-    }
-
-    if (!(tmp = LDNewText(key))) {
-        LD_LOG(LD_LOG_ERROR, "memory error");
-
-        goto error;
-    }
-
-    if (!LDObjectSetKey(event, "key", tmp)) {
+    if (!(event = LDi_newEventRecord(
+              LD_EVENT_CUSTOM,
+              now,
+              LDi_packedLength(key) + eventUserLength(context, user))))
+    {
         LD_LOG(LD_LOG_ERROR, "memory error");
 
-        LDJSONFree(tmp);
-
-        goto error;
-    }
-
-    if (data) {
-        if (!LDObjectSetKey(event, "data", data)) {
-            LD_LOG(LD_LOG_ERROR, "memory error");
-
-            goto error;
-        }
+        return NULL;
     }
 
-    if (hasMetric) {
-        if (!(tmp = LDNewNumber(metric))) {
-            LD_LOG(LD_LOG_ERROR, "memory error");
-
-            goto error;
-        }
-
-        if (!LDObjectSetKey(event, "metricValue", tmp)) {
-            LD_LOG(LD_LOG_ERROR, "memory error");
+    if (!setEventUser(context, event, user)) {
+        LDi_freeEventRecords(event);
 
-            LDJSONFree(tmp);
-
-            goto error;
-        }
+        return NULL;
     }
 
-    if (user->anonymous) {
-        if (!(tmp = LDNewText("anonymousUser"))) {
-            goto error;
-        }
-
-        if (!LDObjectSetKey(event, "contextKind", tmp)) {
-            LDJSONFree(tmp);
-
-            goto error;
-        }
-    }
+    event->key       = LDi_packString(event, key);
+    event->data      = data;
+    event->hasMetric = hasMetric;
+    event->metric    = metric;
 
     return event;
-
-error:
-    LDJSONFree(event);
-
-    return NULL;
 }
 
-struct LDJSON *
-LDi_objectToArray(const struct LDJSON *const object)
+/* Merges the summary of every shard into `merged`, starting at the earliest
+shard. Clearing the shards in the same pass means no evaluation is lost
+between collecting and clearing. */
+static LDBoolean
+collectSummary(
+    struct EventProcessor *const context,
+    struct LDSummary *const      merged,
+    double *const                start,
+    const LDBoolean              clear)
 {
-    struct LDJSON *iter, *array;
+    struct LDEventShard *shard;
+    LDBoolean            success;
+    unsigned int         i;
 
-    LD_ASSERT(object);
-    LD_ASSERT(LDJSONGetType(object) == LDObject);
-
-    iter  = NULL;
-    array = NULL;
+    success = LDBooleanTrue;
+    *start  = 0;
 
-    if (!(array = LDNewArray())) {
-        LD_LOG(LD_LOG_ERROR, "alloc error");
+    for (i = 0; i < LD_EVENT_SHARDS; i++) {
+        shard = &context->shards[i];
 
-        return NULL;
-    }
+        LDi_mutex_lock(&shard->lock);
 
-    for (iter = LDGetIter(object); iter; iter = LDIterNext(iter)) {
-        struct LDJSON *dupe;
+        if (shard->summary.counterCount != 0) {
+            if (!LDi_summaryMerge(merged, &shard->summary)) {
+                success = LDBooleanFalse;
+            }
 
-        if (!(dupe = LDJSONDuplicate(iter))) {
-            LD_LOG(LD_LOG_ERROR, "alloc error");
+            if (*start == 0 || shard->summaryStart < *start) {
+                *start = shard->summaryStart;
+            }
 
-            LDJSONFree(array);
+            if (clear) {
+                LDi_clearSummary(&shard->summary);
 
-            return NULL;
+                shard->summaryStart = 0;
+            }
         }
 
-        LDArrayPush(array, dupe);
+        LDi_mutex_unlock(&shard->lock);
     }
 
-    return array;
+    return success;
+}
+
+static LDBoolean
+writeSummaryEvent(
+    struct LDTextBuffer *const    buffer,
+    const struct LDSummary *const merged,
+    const double                  start,
+    const double                  now)
+{
+    return LDi_writeText(buffer, "{\"kind\":\"summary\",\"startDate\":") &&
+        LDi_writeNumber(buffer, start) &&
+        LDi_writeText(buffer, ",\"endDate\":") &&
+        LDi_writeNumber(buffer, now) &&
+        LDi_writeText(buffer, ",\"features\":") &&
+        LDi_writeSummary(buffer, merged) && LDi_writeText(buffer, "}");
 }
 
 struct LDJSON *
 LDi_prepareSummaryEvent(struct EventProcessor *const context, const double now)
 {
-    struct LDJSON *tmp, *summary, *iter, *counters;
+    struct LDSummary    merged;
+    struct LDTextBuffer buffer;
+    struct LDJSON *     summary;
+    double              start;
 
     LD_ASSERT(context);
 
-    tmp      = NULL;
-    summary  = NULL;
-    iter     = NULL;
-    counters = NULL;
-
-    if (!(summary = LDNewObject())) {
-        LD_LOG(LD_LOG_ERROR, "alloc error");
-
-        goto error;
-    }
-
-    if (!(tmp = LDNewText("summary"))) {
-        LD_LOG(LD_LOG_ERROR, "alloc error");
-
-        goto error;
-    }
-
-    if (!(LDObjectSetKey(summary, "kind", tmp))) {
-        LD_LOG(LD_LOG_ERROR, "alloc error");
-
-        LDJSONFree(tmp);
-
-        goto error;
-    }
-
-    if (!(tmp = LDNewNumber(context->summaryStart))) {
-        LD_LOG(LD_LOG_ERROR, "alloc error");
-
-        goto error;
-    }
-
-    if (!(LDObjectSetKey(summary, "startDate", tmp))) {
-        LD_LOG(LD_LOG_ERROR, "alloc error");
-
-        LDJSONFree(tmp);
-
-        goto error;
-    }
-
-    if (!(tmp = LDNewNumber(now))) {
-        LD_LOG(LD_LOG_ERROR, "alloc error");
-
-        goto error;
-    }
-
-    if (!(LDObjectSetKey(summary, "endDate", tmp))) {
-        LD_LOG(LD_LOG_ERROR, "alloc error");
-
-        LDJSONFree(tmp);
-
-        goto error;
-    }
+    LDi_initSummary(&merged);
+    memset(&buffer, 0, sizeof(struct LDTextBuffer));
 
-    if (!(counters = LDJSONDuplicate(context->summaryCounters))) {
-        LD_LOG(LD_LOG_ERROR, "alloc error");
+    summary = NULL;
 
-        goto error;
+    if (collectSummary(context, &merged, &start, LDBooleanFalse) &&
+        writeSummaryEvent(&buffer, &merged, start, now))
+    {
+        summary = LDJSONDeserialize(buffer.text);
     }
 
-    for (iter = LDGetIter(counters); iter; iter = LDIterNext(iter)) {
-        struct LDJSON *countersObject, *countersArray;
-
-        countersObject = LDObjectDetachKey(iter, "counters");
-        LD_ASSERT(countersObject);
-
-        if (!(countersArray = LDi_objectToArray(countersObject))) {
-            LD_LOG(LD_LOG_ERROR, "alloc error");
-
-            LDJSONFree(countersObject);
-
-            goto error;
-        }
-
-        LDJSONFree(countersObject);
-
-        if (!LDObjectSetKey(iter, "counters", countersArray)) {
-            LD_LOG(LD_LOG_ERROR, "alloc error");
-
-            LDJSONFree(countersArray);
-
-            goto error;
-        }
+    if (!summary) {
+        LD_LOG(LD_LOG_ERROR, "failed to prepare summary");
     }
 
-    if (!LDObjectSetKey(summary, "features", counters)) {
-        LD_LOG(LD_LOG_ERROR, "alloc error");
-
-        goto error;
-    }
+    LDi_freeSummary(&merged);
+    LDFree(buffer.text);
 
     return summary;
-
-error:
-    LDJSONFree(summary);
-    LDJSONFree(counters);
-
-    return NULL;
 }
 
 LDBoolean
@@ -1381,21 +1067,17 @@ LDi_track(
     const double                 metric,
     const LDBoolean              hasMetric)
 {
-    struct LDJSON *event, *indexEvent;
-    double         now;
+    struct LDEventRecord *event, *indexEvent;
+    double                now;
 
     LD_ASSERT(context);
     LD_ASSERT(user);
 
     LDi_getUnixMilliseconds(&now);
 
-    LDi_mutex_lock(&context->lock);
-
     if (!LDi_maybeMakeIndexEvent(context, user, now, &indexEvent)) {
         LD_LOG(LD_LOG_ERROR, "failed to construct index event");
 
-        LDi_mutex_unlock(&context->lock);
-
         return LDBooleanFalse;
     }
 
@@ -1404,9 +1086,7 @@ LDi_track(
     {
         LD_LOG(LD_LOG_ERROR, "failed to construct custom event");
 
-        LDi_mutex_unlock(&context->lock);
-
-        LDJSONFree(indexEvent);
+        LDi_freeEventRecords(indexEvent);
 
         return LDBooleanFalse;
     }
@@ -1417,78 +1097,35 @@ LDi_track(
         LDi_addEvent(context, indexEvent);
     }
 
-    LDi_mutex_unlock(&context->lock);
-
     return LDBooleanTrue;
 }
 
-static struct LDJSON *
-contextKindString(const struct LDUser *const user)
-{
-    if (user->anonymous) {
-        return LDNewText("anonymousUser");
-    } else {
-        return LDNewText("user");
-    }
-}
-
-struct LDJSON *
+struct LDEventRecord *
 LDi_newAliasEvent(
     const struct LDUser *const currentUser,
     const struct LDUser *const previousUser,
     const double               now)
 {
-    struct LDJSON *tmp, *event;
+    struct LDEventRecord *event;
 
     LD_ASSERT(currentUser);
     LD_ASSERT(previousUser);
 
-    tmp   = NULL;
-    event = NULL;
-
-    if (!(event = LDi_newBaseEvent("alias", now))) {
-        goto error;
-    }
-
-    if (!(tmp = LDNewText(currentUser->key))) {
-        goto error;
-    }
-
-    if (!LDObjectSetKey(event, "key", tmp)) {
-        goto error;
-    }
-
-    if (!(tmp = LDNewText(previousUser->key))) {
-        goto error;
-    }
-
-    if (!LDObjectSetKey(event, "previousKey", tmp)) {
-        goto error;
-    }
-
-    if (!(tmp = contextKindString(currentUser))) {
-        goto error;
-    }
-
-    if (!LDObjectSetKey(event, "contextKind", tmp)) {
-        goto error;
-    }
-
-    if (!(tmp = contextKindString(previousUser))) {
-        goto error;
+    if (!(event = LDi_newEventRecord(
+              LD_EVENT_ALIAS,
+              now,
+              LDi_packedLength(currentUser->key) +
+                  LDi_packedLength(previousUser->key))))
+    {
+        return NULL;
     }
 
-    if (!LDObjectSetKey(event, "previousContextKind", tmp)) {
-        goto error;
-    }
+    event->key               = LDi_packString(event, currentUser->key);
+    event->previousKey       = LDi_packString(event, previousUser->key);
+    event->anonymous         = currentUser->anonymous;
+    event->previousAnonymous = previousUser->anonymous;
 
     return event;
-
-error:
-    LDJSONFree(event);
-    LDJSONFree(tmp);
-
-    return NULL;
 }
 
 LDBoolean
@@ -1497,8 +1134,8 @@ LDi_alias(
     const struct LDUser *const   currentUser,
     const struct LDUser *const   previousUser)
 {
-    struct LDJSON *event;
-    double         now;
+    struct LDEventRecord *event;
+    double                now;
 
     LD_ASSERT(context);
     LD_ASSERT(currentUser);
@@ -1512,87 +1149,102 @@ LDi_alias(
         return LDBooleanFalse;
     }
 
-    LDi_mutex_lock(&context->lock);
     LDi_addEvent(context, event);
-    LDi_mutex_unlock(&context->lock);
 
     return LDBooleanTrue;
 }
 
 LDBoolean
 LDi_bundleEventPayload(
-    struct EventProcessor *const context, struct LDJSON **const result)
+    struct EventProcessor *const context, char **const result)
 {
-    struct LDJSON *nextEvents, *nextSummaryCounters, *summaryEvent;
-    double         now;
+    struct LDTextBuffer   buffer;
+    struct LDSummary      merged;
+    struct LDEventRecord *event;
+    struct LDJSON *       iter;
+    LDBoolean             success, first;
+    double                now, start;
 
     LD_ASSERT(context);
     LD_ASSERT(result);
 
-    nextEvents          = NULL;
-    nextSummaryCounters = NULL;
-    *result             = NULL;
+    *result = NULL;
+    success = LDBooleanTrue;
+    first   = LDBooleanTrue;
+
+    memset(&buffer, 0, sizeof(struct LDTextBuffer));
 
     LDi_getUnixMilliseconds(&now);
+    LDi_initSummary(&merged);
 
     LDi_mutex_lock(&context->lock);
 
-    if (LDCollectionGetSize(context->events) == 0 &&
-        LDCollectionGetSize(context->summaryCounters) == 0)
-    {
-        LDi_mutex_unlock(&context->lock);
-
-        /* successful but no events to send */
-
-        return LDBooleanTrue;
+    /* the shards are cleared even on failure, like the events below */
+    if (!collectSummary(context, &merged, &start, LDBooleanTrue)) {
+        LD_LOG(LD_LOG_ERROR, "failed to merge summary");
     }
 
-    if (!(nextEvents = LDNewArray())) {
-        LD_LOG(LD_LOG_ERROR, "alloc error");
-
-        LDi_mutex_unlock(&context->lock);
+    reportDroppedLocked(context);
 
-        return LDBooleanFalse;
-    }
+    /* events already converted by `LDi_drainEvents` go first */
+    while ((iter = LDGetIter(context->events))) {
+        iter = LDCollectionDetachIter(context->events, iter);
 
-    if (LDCollectionGetSize(context->summaryCounters) != 0) {
-        if (!(nextSummaryCounters = LDNewObject())) {
-            LD_LOG(LD_LOG_ERROR, "alloc error");
+        success = success && LDi_writeText(&buffer, first ? "[" : ",") &&
+            LDi_writeJSON(&buffer, iter);
+        first = LDBooleanFalse;
 
-            LDi_mutex_unlock(&context->lock);
+        LDJSONFree(iter);
+    }
 
-            LDJSONFree(nextEvents);
+    /* records are written straight to the payload, the processor lock keeps
+    this the only consumer of the queue */
+    while ((event = LDi_eventQueuePop(&context->queue))) {
+        success = success && LDi_writeText(&buffer, first ? "[" : ",") &&
+            LDi_writeEventRecord(&buffer, event);
+        first = LDBooleanFalse;
 
-            return LDBooleanFalse;
-        }
+        LDi_freeEventRecords(event);
+    }
 
-        if (!(summaryEvent = LDi_prepareSummaryEvent(context, now))) {
-            LD_LOG(LD_LOG_ERROR, "failed to prepare summary");
+    LDi_mutex_unlock(&context->lock);
 
-            LDi_mutex_unlock(&context->lock);
+    if (merged.flagCount != 0) {
+        success = success && LDi_writeText(&buffer, first ? "[" : ",") &&
+            writeSummaryEvent(&buffer, &merged, start, now);
+        first = LDBooleanFalse;
+    }
 
-            LDJSONFree(nextEvents);
-            LDJSONFree(nextSummaryCounters);
+    LDi_freeSummary(&merged);
 
-            return LDBooleanFalse;
-        }
+    if (first) {
+        /* successful but no events to send */
+        return LDBooleanTrue;
+    }
 
-        LDArrayPush(context->events, summaryEvent);
+    if (!success || !LDi_writeText(&buffer, "]")) {
+        LD_LOG(LD_LOG_ERROR, "failed to write events");
 
-        LDJSONFree(context->summaryCounters);
+        LDFree(buffer.text);
 
-        context->summaryStart    = 0;
-        context->summaryCounters = nextSummaryCounters;
+        return LDBooleanFalse;
     }
 
-    *result         = context->events;
-    context->events = nextEvents;
-
-    LDi_mutex_unlock(&context->lock);
+    *result = buffer.text;
 
     return LDBooleanTrue;
 }
 
+void
+LDi_getEventStats(
+    struct EventProcessor *const context, struct LDEventStats *const stats)
+{
+    LD_ASSERT(context);
+    LD_ASSERT(stats);
+
+    stats->dropped = LDi_eventQueueDropped(&context->queue);
+}
+
 void
 LDi_setServerTime(struct EventProcessor *const context, const double serverTime)
 {
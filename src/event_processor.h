@@ -5,6 +5,7 @@
 #include <launchdarkly/variations.h>
 
 #include "config.h"
+#include "event_record.h"
 #include "user.h"
 
 struct EventProcessor;
@@ -40,8 +41,8 @@ LDi_processEvaluation(
     struct EventProcessor *const context,
     /* required */
     const struct LDUser *const user,
-    /* optional */
-    struct LDJSON *const subEvents,
+    /* optional, chained */
+    struct LDEventRecord *const subEvents,
     /* required */
     const char *const flagKey,
     /* required */
@@ -55,11 +56,50 @@ LDi_processEvaluation(
     /* required */
     const LDBoolean detailedEvaluation);
 
+/* One evaluation handed to `LDi_processEvaluations`, with the same meaning as
+ * the arguments of `LDi_processEvaluation` */
+struct LDEvaluationRecord
+{
+    /* optional, chained, consumed */
+    struct LDEventRecord *subEvents;
+    /* required */
+    const char *flagKey;
+    /* required */
+    const struct LDJSON *actualValue;
+    /* required */
+    const struct LDJSON *fallbackValue;
+    /* optional */
+    const struct LDJSON *flag;
+    /* required */
+    const struct LDDetails *details;
+    /* output, false if the events could not be recorded */
+    LDBoolean recorded;
+    /* internal, the feature event if one may be queued */
+    struct LDEventRecord *featureEvent;
+};
+
+/* Records several evaluations for one user. They are summarized under a
+ * single acquisition of the lock of the user's shard, and their events are
+ * queued without taking the processor lock. */
+void
+LDi_processEvaluations(
+    struct EventProcessor *const     context,
+    const struct LDUser *const       user,
+    struct LDEvaluationRecord *const records,
+    const unsigned int               count,
+    const LDBoolean                  detailedEvaluation);
+
+/* Writes the queued events and the summary as the JSON text of one payload,
+ * to be freed with `LDFree`. The result is NULL if there is nothing to send. */
 LDBoolean
 LDi_bundleEventPayload(
-    struct EventProcessor *const context, struct LDJSON **const result);
+    struct EventProcessor *const context, char **const result);
+
+void
+LDi_getEventStats(
+    struct EventProcessor *const context, struct LDEventStats *const stats);
 
-struct LDJSON *
+struct LDEventRecord *
 LDi_newFeatureRequestEvent(
     const struct EventProcessor *const context,
     const char *const                  key,
@@ -3,50 +3,62 @@
 /* exposed for testing */
 
 #include "concurrency.h"
+#include "event_queue.h"
 #include "lru.h"
+#include "summary.h"
 
 #include "event_processor.h"
 
+/* Evaluations are summarized, and users remembered for index events, in one
+of several shards picked by the user key. Events are pushed onto `queue`
+without taking `lock`. Shards are merged when events are bundled. */
+#define LD_EVENT_SHARDS 8
+
+struct LDEventShard
+{
+    ld_mutex_t       lock;
+    struct LDSummary summary;
+    double           summaryStart;
+    struct LDLRU *   userKeys;
+    double           lastUserKeyFlush;
+};
+
 struct EventProcessor
 {
+    /* serializes draining `queue`, and protects `events`, `lastDropped` and
+    `lastServerTime` */
     ld_mutex_t             lock;
-    struct LDJSON *        events;          /* Array of Objects */
-    struct LDJSON *        summaryCounters; /* Object */
-    double                 summaryStart;
-    struct LDLRU *         userKeys;
-    double                 lastUserKeyFlush;
+    struct LDEventQueue    queue;
+    struct LDJSON *        events; /* Array of Objects, see `LDi_drainEvents` */
+    unsigned long          lastDropped;
+    struct LDEventShard    shards[LD_EVENT_SHARDS];
     double                 lastServerTime;
     const struct LDConfig *config;
 };
 
 LDBoolean
 LDi_summarizeEvent(
-    struct EventProcessor *const context,
-    const struct LDJSON *const   event,
-    const LDBoolean              unknown);
+    struct EventProcessor *const      context,
+    const struct LDEventRecord *const event,
+    const LDBoolean                   unknown);
 
+/* does not require the processor lock, consumes `event` */
 void
-LDi_addEvent(struct EventProcessor *const context, struct LDJSON *const event);
-
-struct LDJSON *
-LDi_newBaseEvent(const char *const kind, const double now);
+LDi_addEvent(
+    struct EventProcessor *const context, struct LDEventRecord *const event);
 
+/* Converts the queued events to JSON onto `events`, for tests to inspect.
+They are sent ahead of the queue when events are next bundled. */
 LDBoolean
-LDi_addUserInfoToEvent(
-    const struct EventProcessor *const context,
-    struct LDJSON *const               event,
-    const struct LDUser *const         user);
-
-char *
-LDi_makeSummaryKey(const struct LDJSON *const event);
+LDi_drainEvents(struct EventProcessor *const context);
 
-struct LDJSON *
+struct LDEventRecord *
 LDi_newIdentifyEvent(
     const struct EventProcessor *const context,
     const struct LDUser *const         user,
     const double                       now);
 
-struct LDJSON *
+struct LDEventRecord *
 LDi_newCustomEvent(
     const struct EventProcessor *const context,
     const struct LDUser *const         user,
@@ -56,7 +68,7 @@ LDi_newCustomEvent(
     const LDBoolean                    hasMetric,
     const double                       now);
 
-struct LDJSON *
+struct LDEventRecord *
 LDi_newAliasEvent(
     const struct LDUser *const currentUser,
     const struct LDUser *const previousUser,
@@ -65,7 +77,7 @@ LDi_newAliasEvent(
 void
 LDi_possiblyQueueEvent(
     struct EventProcessor *const context,
-    struct LDJSON *              event,
+    struct LDEventRecord *       event,
     const double                 now,
     const LDBoolean              detailedEvaluation);
 
@@ -74,10 +86,7 @@ LDi_maybeMakeIndexEvent(
     struct EventProcessor *const context,
     const struct LDUser *const   user,
     const double                 now,
-    struct LDJSON **const        result);
-
-struct LDJSON *
-LDi_objectToArray(const struct LDJSON *const object);
+    struct LDEventRecord **const result);
 
 struct LDJSON *
 LDi_prepareSummaryEvent(struct EventProcessor *const context, const double now);
@@ -0,0 +1,118 @@
+#include <string.h>
+
+#include <launchdarkly/api.h>
+
+#include "assertion.h"
+#include "atomic.h"
+#include "event_queue.h"
+
+LDBoolean
+LDi_eventQueueInit(
+    struct LDEventQueue *const queue, const unsigned int capacity)
+{
+    unsigned long slotCount;
+
+    LD_ASSERT(queue);
+
+    /* slots are found by masking the ticket, which stays correct when the
+    ticket wraps */
+    for (slotCount = 1; slotCount < capacity; slotCount *= 2) {
+        if (slotCount > ((size_t)-1) / (sizeof(void *) * 2)) {
+            return LDBooleanFalse;
+        }
+    }
+
+    if (!(queue->slots =
+              (void *volatile *)LDAlloc(sizeof(void *) * slotCount)))
+    {
+        return LDBooleanFalse;
+    }
+
+    memset((void *)queue->slots, 0, sizeof(void *) * slotCount);
+
+    queue->slotCount = slotCount;
+    queue->capacity  = capacity;
+    queue->size      = 0;
+    queue->tail      = 0;
+    queue->dropped   = 0;
+    queue->head      = 0;
+
+    return LDBooleanTrue;
+}
+
+void
+LDi_eventQueueDestroy(struct LDEventQueue *const queue)
+{
+    unsigned long i;
+
+    if (queue && queue->slots) {
+        for (i = 0; i < queue->slotCount; i++) {
+            LDi_freeEventRecords((struct LDEventRecord *)queue->slots[i]);
+        }
+
+        LDFree((void *)queue->slots);
+
+        queue->slots = NULL;
+    }
+}
+
+LDBoolean
+LDi_eventQueuePush(
+    struct LDEventQueue *const queue, struct LDEventRecord *const event)
+{
+    unsigned long ticket;
+
+    LD_ASSERT(queue);
+    LD_ASSERT(event);
+    LD_ASSERT(!event->next);
+
+    if ((unsigned long)LDi_atomicAdd(&queue->size, 1) > queue->capacity) {
+        LDi_atomicAdd(&queue->size, -1);
+        LDi_atomicAdd(&queue->dropped, 1);
+
+        LDi_freeEventRecords(event);
+
+        return LDBooleanFalse;
+    }
+
+    /* At most `capacity` tickets are reserved and not drained, so the slot
+    of this ticket was already emptied by the consumer */
+    ticket = (unsigned long)LDi_atomicAdd(&queue->tail, 1) - 1;
+
+    LDi_atomicStorePointer(
+        &queue->slots[ticket & (queue->slotCount - 1)], event);
+
+    return LDBooleanTrue;
+}
+
+struct LDEventRecord *
+LDi_eventQueuePop(struct LDEventQueue *const queue)
+{
+    void *volatile *      slot;
+    struct LDEventRecord *event;
+
+    LD_ASSERT(queue);
+
+    slot = &queue->slots[queue->head & (queue->slotCount - 1)];
+
+    /* empty, or the next ticket is not published yet */
+    if (!(event = (struct LDEventRecord *)LDi_atomicLoadPointer(slot))) {
+        return NULL;
+    }
+
+    LDi_atomicStorePointer(slot, NULL);
+
+    queue->head++;
+
+    LDi_atomicAdd(&queue->size, -1);
+
+    return event;
+}
+
+unsigned long
+LDi_eventQueueDropped(struct LDEventQueue *const queue)
+{
+    LD_ASSERT(queue);
+
+    return (unsigned long)LDi_atomicLoad(&queue->dropped);
+}
@@ -0,0 +1,51 @@
+/*!
+ * @file event_queue.h
+ * @brief Internal API Interface for the bounded queue of analytics events
+ *
+ * Any number of threads may push events without blocking, while a single
+ * consumer at a time pops them. Pushing reserves room with one atomic add,
+ * takes a ticket with another, and publishes the event into the slot of its
+ * ticket. The consumer takes events in ticket order, and stops at a slot that
+ * was reserved but not yet published, leaving it for the next drain.
+ */
+
+#pragma once
+
+#include "event_record.h"
+
+struct LDEventQueue
+{
+    /* a power of two no smaller than `capacity` */
+    void *volatile *slots;
+    unsigned long   slotCount;
+    unsigned long   capacity;
+    /* events pushed but not yet drained, including reservations */
+    volatile long size;
+    volatile long tail;
+    volatile long dropped;
+    /* only touched by the consumer */
+    unsigned long head;
+};
+
+LDBoolean
+LDi_eventQueueInit(
+    struct LDEventQueue *const queue, const unsigned int capacity);
+
+/* Frees any events still queued */
+void
+LDi_eventQueueDestroy(struct LDEventQueue *const queue);
+
+/* Takes ownership of `event`, which must not be chained. When the queue is
+full the event is freed and counted as dropped, and false is returned. */
+LDBoolean
+LDi_eventQueuePush(
+    struct LDEventQueue *const queue, struct LDEventRecord *const event);
+
+/* Requires that no other thread pops from the queue. Returns the oldest
+published event, or NULL if there is none. */
+struct LDEventRecord *
+LDi_eventQueuePop(struct LDEventQueue *const queue);
+
+/* The number of events dropped since the queue was created */
+unsigned long
+LDi_eventQueueDropped(struct LDEventQueue *const queue);
@@ -0,0 +1,345 @@
+#include <string.h>
+
+#include <launchdarkly/api.h>
+
+#include "assertion.h"
+#include "event_record.h"
+#include "json_writer.h"
+
+size_t
+LDi_packedLength(const char *const text)
+{
+    return text ? strlen(text) + 1 : 0;
+}
+
+size_t
+LDi_packedDetailsLength(const struct LDDetails *const details)
+{
+    LD_ASSERT(details);
+
+    if (details->reason == LD_PREREQUISITE_FAILED) {
+        return LDi_packedLength(details->extra.prerequisiteKey);
+    } else if (details->reason == LD_RULE_MATCH) {
+        return LDi_packedLength(details->extra.rule.id);
+    }
+
+    return 0;
+}
+
+struct LDEventRecord *
+LDi_newEventRecord(
+    const enum LDEventKind kind,
+    const double           creationDate,
+    const size_t           stringSpace)
+{
+    struct LDEventRecord *record;
+
+    if (!(record = (struct LDEventRecord *)LDAlloc(
+              sizeof(struct LDEventRecord) + stringSpace)))
+    {
+        return NULL;
+    }
+
+    memset(record, 0, sizeof(struct LDEventRecord));
+
+    record->kind         = kind;
+    record->creationDate = creationDate;
+    record->size         = sizeof(struct LDEventRecord) + stringSpace;
+    record->used         = sizeof(struct LDEventRecord);
+
+    return record;
+}
+
+const char *
+LDi_packString(struct LDEventRecord *const record, const char *const text)
+{
+    char * packed;
+    size_t length;
+
+    LD_ASSERT(record);
+
+    if (!text) {
+        return NULL;
+    }
+
+    length = strlen(text) + 1;
+
+    LD_ASSERT(record->used + length <= record->size);
+
+    packed = (char *)record + record->used;
+
+    memcpy(packed, text, length);
+
+    record->used += length;
+
+    return packed;
+}
+
+void
+LDi_packDetails(
+    struct LDEventRecord *const record, const struct LDDetails *const details)
+{
+    LD_ASSERT(record);
+    LD_ASSERT(details);
+
+    record->details   = *details;
+    record->hasReason = LDBooleanTrue;
+
+    if (details->reason == LD_PREREQUISITE_FAILED) {
+        record->details.extra.prerequisiteKey =
+            (char *)LDi_packString(record, details->extra.prerequisiteKey);
+    } else if (details->reason == LD_RULE_MATCH) {
+        record->details.extra.rule.id =
+            (char *)LDi_packString(record, details->extra.rule.id);
+    }
+}
+
+void
+LDi_freeEventRecords(struct LDEventRecord *const records)
+{
+    struct LDEventRecord *record, *next;
+
+    for (record = records; record; record = next) {
+        next = record->next;
+
+        LDJSONFree(record->user);
+        LDJSONFree(record->value);
+        LDJSONFree(record->defaultValue);
+        LDJSONFree(record->data);
+        LDFree(record);
+    }
+}
+
+/* The address of `text` within `to`, given its address within `from` */
+static const char *
+rebase(
+    const char *const                 text,
+    const struct LDEventRecord *const from,
+    const struct LDEventRecord *const to)
+{
+    if (!text) {
+        return NULL;
+    }
+
+    return (const char *)to + (text - (const char *)from);
+}
+
+static struct LDEventRecord *
+duplicateRecord(const struct LDEventRecord *const record)
+{
+    struct LDEventRecord *copy;
+
+    if (!(copy = (struct LDEventRecord *)LDAlloc(record->size))) {
+        return NULL;
+    }
+
+    memcpy(copy, record, record->size);
+
+    copy->next         = NULL;
+    copy->user         = NULL;
+    copy->value        = NULL;
+    copy->defaultValue = NULL;
+    copy->data         = NULL;
+
+    copy->key         = rebase(record->key, record, copy);
+    copy->userKey     = rebase(record->userKey, record, copy);
+    copy->prereqOf    = rebase(record->prereqOf, record, copy);
+    copy->previousKey = rebase(record->previousKey, record, copy);
+
+    if (record->hasReason) {
+        if (record->details.reason == LD_PREREQUISITE_FAILED) {
+            copy->details.extra.prerequisiteKey = (char *)rebase(
+                record->details.extra.prerequisiteKey, record, copy);
+        } else if (record->details.reason == LD_RULE_MATCH) {
+            copy->details.extra.rule.id =
+                (char *)rebase(record->details.extra.rule.id, record, copy);
+        }
+    }
+
+    if ((record->user && !(copy->user = LDJSONDuplicate(record->user))) ||
+        (record->value && !(copy->value = LDJSONDuplicate(record->value))) ||
+        (record->defaultValue &&
+         !(copy->defaultValue = LDJSONDuplicate(record->defaultValue))) ||
+        (record->data && !(copy->data = LDJSONDuplicate(record->data))))
+    {
+        LDi_freeEventRecords(copy);
+
+        return NULL;
+    }
+
+    return copy;
+}
+
+struct LDEventRecord *
+LDi_duplicateEventRecords(const struct LDEventRecord *const records)
+{
+    const struct LDEventRecord *record;
+    struct LDEventRecord *      result, **tail;
+
+    result = NULL;
+    tail   = &result;
+
+    for (record = records; record; record = record->next) {
+        if (!(*tail = duplicateRecord(record))) {
+            LDi_freeEventRecords(result);
+
+            return NULL;
+        }
+
+        tail = &(*tail)->next;
+    }
+
+    return result;
+}
+
+void
+LDi_appendEventRecords(
+    struct LDEventRecord **const list, struct LDEventRecord *const records)
+{
+    struct LDEventRecord **tail;
+
+    LD_ASSERT(list);
+
+    for (tail = list; *tail; tail = &(*tail)->next)
+        ;
+
+    *tail = records;
+}
+
+static const char *
+contextKind(const LDBoolean anonymous)
+{
+    return anonymous ? "\"anonymousUser\"" : "\"user\"";
+}
+
+LDBoolean
+LDi_writeEventRecord(
+    struct LDTextBuffer *const         buffer,
+    const struct LDEventRecord *const record)
+{
+    static const char *const kinds[] = {
+        "feature", "debug", "index", "identify", "custom", "alias"};
+
+    LD_ASSERT(buffer);
+    LD_ASSERT(record);
+    LD_ASSERT(record->kind <= LD_EVENT_ALIAS);
+
+    if (!LDi_writeText(buffer, "{\"kind\":") ||
+        !LDi_writeString(buffer, kinds[record->kind]) ||
+        !LDi_writeText(buffer, ",\"creationDate\":") ||
+        !LDi_writeNumber(buffer, record->creationDate))
+    {
+        return LDBooleanFalse;
+    }
+
+    if (record->key && (!LDi_writeText(buffer, ",\"key\":") ||
+                        !LDi_writeString(buffer, record->key)))
+    {
+        return LDBooleanFalse;
+    }
+
+    if (record->userKey && (!LDi_writeText(buffer, ",\"userKey\":") ||
+                            !LDi_writeString(buffer, record->userKey)))
+    {
+        return LDBooleanFalse;
+    }
+
+    if (record->user && (!LDi_writeText(buffer, ",\"user\":") ||
+                         !LDi_writeJSON(buffer, record->user)))
+    {
+        return LDBooleanFalse;
+    }
+
+    if (record->hasVariation && (!LDi_writeText(buffer, ",\"variation\":") ||
+                                 !LDi_writeNumber(buffer, record->variation)))
+    {
+        return LDBooleanFalse;
+    }
+
+    if (record->value && (!LDi_writeText(buffer, ",\"value\":") ||
+                          !LDi_writeJSON(buffer, record->value)))
+    {
+        return LDBooleanFalse;
+    }
+
+    if (record->defaultValue &&
+        (!LDi_writeText(buffer, ",\"default\":") ||
+         !LDi_writeJSON(buffer, record->defaultValue)))
+    {
+        return LDBooleanFalse;
+    }
+
+    if (record->prereqOf && (!LDi_writeText(buffer, ",\"prereqOf\":") ||
+                             !LDi_writeString(buffer, record->prereqOf)))
+    {
+        return LDBooleanFalse;
+    }
+
+    if (record->hasVersion && (!LDi_writeText(buffer, ",\"version\":") ||
+                               !LDi_writeNumber(buffer, record->version)))
+    {
+        return LDBooleanFalse;
+    }
+
+    if (record->hasReason && (!LDi_writeText(buffer, ",\"reason\":") ||
+                              !LDi_writeReason(buffer, &record->details)))
+    {
+        return LDBooleanFalse;
+    }
+
+    if (record->data && (!LDi_writeText(buffer, ",\"data\":") ||
+                         !LDi_writeJSON(buffer, record->data)))
+    {
+        return LDBooleanFalse;
+    }
+
+    if (record->hasMetric && (!LDi_writeText(buffer, ",\"metricValue\":") ||
+                              !LDi_writeNumber(buffer, record->metric)))
+    {
+        return LDBooleanFalse;
+    }
+
+    if (record->previousKey && (!LDi_writeText(buffer, ",\"previousKey\":") ||
+                                !LDi_writeString(buffer, record->previousKey)))
+    {
+        return LDBooleanFalse;
+    }
+
+    /* alias events always name both kinds, others only anonymous users */
+    if ((record->kind == LD_EVENT_ALIAS || record->anonymous) &&
+        (!LDi_writeText(buffer, ",\"contextKind\":") ||
+         !LDi_writeText(buffer, contextKind(record->anonymous))))
+    {
+        return LDBooleanFalse;
+    }
+
+    if (record->kind == LD_EVENT_ALIAS &&
+        (!LDi_writeText(buffer, ",\"previousContextKind\":") ||
+         !LDi_writeText(buffer, contextKind(record->previousAnonymous))))
+    {
+        return LDBooleanFalse;
+    }
+
+    return LDi_writeText(buffer, "}");
+}
+
+struct LDJSON *
+LDi_eventRecordToJSON(const struct LDEventRecord *const record)
+{
+    struct LDTextBuffer buffer;
+    struct LDJSON *     result;
+
+    LD_ASSERT(record);
+
+    memset(&buffer, 0, sizeof(struct LDTextBuffer));
+
+    result = NULL;
+
+    if (LDi_writeEventRecord(&buffer, record)) {
+        result = LDJSONDeserialize(buffer.text);
+    }
+
+    LDFree(buffer.text);
+
+    return result;
+}
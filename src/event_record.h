@@ -0,0 +1,113 @@
+/*!
+ * @file event_record.h
+ * @brief Internal API Interface for compact analytics event records
+ *
+ * An event is a fixed layout record, allocated together with copies of the
+ * strings it refers to, and is only written as JSON text when events are
+ * sent. Values and users remain JSON. Records can be chained with `next`,
+ * which is how the prerequisite events of an evaluation are kept.
+ */
+
+#pragma once
+
+#include <stddef.h>
+
+#include <launchdarkly/boolean.h>
+#include <launchdarkly/json.h>
+#include <launchdarkly/variations.h>
+
+enum LDEventKind
+{
+    LD_EVENT_FEATURE,
+    LD_EVENT_DEBUG,
+    LD_EVENT_INDEX,
+    LD_EVENT_IDENTIFY,
+    LD_EVENT_CUSTOM,
+    LD_EVENT_ALIAS
+};
+
+struct LDEventRecord
+{
+    struct LDEventRecord *next;
+    enum LDEventKind      kind;
+    double                creationDate;
+    /* strings point into the allocation of the record, NULL when absent */
+    const char *key;
+    const char *userKey; /* when the user is not inlined */
+    const char *prereqOf;
+    const char *previousKey;
+    /* owned JSON, NULL when absent */
+    struct LDJSON *user;
+    struct LDJSON *value;
+    struct LDJSON *defaultValue;
+    struct LDJSON *data;
+    /* only read when `hasReason`, its strings are packed like the others */
+    struct LDDetails details;
+    LDBoolean        hasReason;
+    LDBoolean        hasVariation;
+    unsigned int     variation;
+    LDBoolean        hasVersion;
+    double           version;
+    LDBoolean        hasMetric;
+    double           metric;
+    LDBoolean        anonymous;
+    LDBoolean        previousAnonymous;
+    /* feature events only, decide whether the event is sent */
+    LDBoolean trackEvents;
+    LDBoolean alwaysTrackDetails;
+    LDBoolean hasDebugEventsUntilDate;
+    double    debugEventsUntilDate;
+    /* bytes allocated, and used so far, for the record and its strings */
+    size_t size;
+    size_t used;
+};
+
+/* The bytes needed to pack `text`, zero for NULL */
+size_t
+LDi_packedLength(const char *const text);
+
+/* The bytes needed to pack the strings of `details` */
+size_t
+LDi_packedDetailsLength(const struct LDDetails *const details);
+
+/* Returns a zeroed record with room for `stringSpace` bytes of strings, NULL
+on allocation failure */
+struct LDEventRecord *
+LDi_newEventRecord(
+    const enum LDEventKind kind,
+    const double           creationDate,
+    const size_t           stringSpace);
+
+/* Copies `text` into the room reserved by `LDi_newEventRecord`. Returns
+NULL for NULL. */
+const char *
+LDi_packString(struct LDEventRecord *const record, const char *const text);
+
+/* Copies `details` into `record->details` and sets `hasReason` */
+void
+LDi_packDetails(
+    struct LDEventRecord *const record, const struct LDDetails *const details);
+
+/* Frees `records` and every record chained after it, may be NULL */
+void
+LDi_freeEventRecords(struct LDEventRecord *const records);
+
+/* Deep copies `records` and every record chained after it. Returns NULL on
+allocation failure. */
+struct LDEventRecord *
+LDi_duplicateEventRecords(const struct LDEventRecord *const records);
+
+/* Chains `records` after the last record of `*list` */
+void
+LDi_appendEventRecords(
+    struct LDEventRecord **const list, struct LDEventRecord *const records);
+
+/* Appends one event as a JSON object, ignoring `next` */
+LDBoolean
+LDi_writeEventRecord(
+    struct LDTextBuffer *const         buffer,
+    const struct LDEventRecord *const record);
+
+/* The JSON object written by `LDi_writeEventRecord`, NULL on failure */
+struct LDJSON *
+LDi_eventRecordToJSON(const struct LDEventRecord *const record);
@@ -236,10 +236,6 @@ poll(struct LDClient *const client, void *const rawcontext)
     }
 
     if (!lastFailed) {
-        struct LDJSON *events;
-
-        events = NULL;
-
         LDi_rwlock_rdlock(&client->lock);
         shouldFlush = client->shouldFlush;
         LDi_rwlock_rdunlock(&client->lock);
@@ -255,13 +251,15 @@ poll(struct LDClient *const client, void *const rawcontext)
             }
         }
 
-        if (!LDi_bundleEventPayload(client->eventProcessor, &events)) {
+        if (!LDi_bundleEventPayload(
+                client->eventProcessor, &context->buffer))
+        {
             LD_LOG(LD_LOG_ERROR, "failed bundling events");
 
             return NULL;
         }
 
-        if (!events) {
+        if (!context->buffer) {
             /* no events to send */
             LDi_rwlock_wrlock(&client->lock);
             shouldFlush = LDBooleanFalse;
@@ -270,16 +268,6 @@ poll(struct LDClient *const client, void *const rawcontext)
             return NULL;
         }
 
-        if (!(context->buffer = LDJSONSerialize(events))) {
-            LD_LOG(LD_LOG_ERROR, "alloc error");
-
-            LDJSONFree(events);
-
-            return NULL;
-        }
-
-        LDJSONFree(events);
-
         /* Only generate a UUID once per payload. We want the header to remain
         the same during a retry */
         context->payloadId[LD_UUID_SIZE] = 0;
@@ -0,0 +1,997 @@
+#include <limits.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "uthash.h"
+
+#include <launchdarkly/api.h>
+
+#include "assertion.h"
+#include "flag.h"
+#include "utility.h"
+
+static const struct LDJSON *
+lookupRequiredValueOfType(
+    const struct LDJSON *const obj,
+    const char *const          context,
+    const char *const          key,
+    const LDJSONType           expectedType)
+{
+    const struct LDJSON *tmp;
+
+    LD_ASSERT(context);
+    LD_ASSERT(key);
+    LD_ASSERT(obj);
+    LD_ASSERT(LDJSONGetType(obj) == LDObject);
+
+    if (!(tmp = LDObjectLookup(obj, key))) {
+        LD_LOG_2(LD_LOG_ERROR, "%s missing required field %s", context, key);
+
+        return NULL;
+    }
+
+    if (LDJSONGetType(tmp) != expectedType) {
+        LD_LOG_2(LD_LOG_ERROR, "%s.%s unexpected type", context, key);
+
+        return NULL;
+    }
+
+    return tmp;
+}
+
+static LDBoolean
+lookupOptionalValueOfType(
+    const struct LDJSON *const  obj,
+    const char *const           context,
+    const char *const           key,
+    const LDJSONType            expectedType,
+    const struct LDJSON **const result)
+{
+    const struct LDJSON *tmp;
+    LDJSONType           actualType;
+
+    LD_ASSERT(context);
+    LD_ASSERT(key);
+    LD_ASSERT(obj);
+    LD_ASSERT(LDJSONGetType(obj) == LDObject);
+    LD_ASSERT(result);
+
+    *result = NULL;
+
+    if (!(tmp = LDObjectLookup(obj, key))) {
+        return LDBooleanTrue;
+    }
+
+    actualType = LDJSONGetType(tmp);
+
+    if (actualType == LDNull) {
+        return LDBooleanTrue;
+    }
+
+    if (actualType != expectedType) {
+        LD_LOG_2(LD_LOG_ERROR, "%s.%s unexpected type", context, key);
+
+        return LDBooleanFalse;
+    }
+
+    *result = tmp;
+
+    return LDBooleanTrue;
+}
+
+struct LDKeySetItem
+{
+    const char *   key;
+    UT_hash_handle hh;
+};
+
+/* Non text entries can never match a user key and are skipped. Returns false
+only on allocation failure. */
+static LDBoolean
+buildKeySet(const struct LDJSON *const array, struct LDKeySet *const set)
+{
+    const struct LDJSON *iter;
+    struct LDKeySetItem *item;
+
+    LD_ASSERT(set);
+
+    set->items = NULL;
+    set->index = NULL;
+
+    if (array == NULL || LDCollectionGetSize(array) == 0) {
+        return LDBooleanTrue;
+    }
+
+    if (!(set->items = (struct LDKeySetItem *)LDAlloc(
+              sizeof(struct LDKeySetItem) * LDCollectionGetSize(array))))
+    {
+        return LDBooleanFalse;
+    }
+
+    item = set->items;
+
+    for (iter = LDGetIter(array); iter; iter = LDIterNext(iter)) {
+        if (LDJSONGetType(iter) == LDText) {
+            item->key = LDGetText(iter);
+
+            HASH_ADD_KEYPTR(hh, set->index, item->key, strlen(item->key), item);
+
+            item++;
+        }
+    }
+
+    return LDBooleanTrue;
+}
+
+static void
+freeKeySet(struct LDKeySet *const set)
+{
+    LD_ASSERT(set);
+
+    HASH_CLEAR(hh, set->index);
+    LDFree(set->items);
+
+    set->items = NULL;
+}
+
+LDBoolean
+LDi_keySetContains(const struct LDKeySet *const set, const char *const key)
+{
+    struct LDKeySetItem *item;
+
+    LD_ASSERT(set);
+    LD_ASSERT(key);
+
+    if (!set->index) {
+        return LDBooleanFalse;
+    }
+
+    HASH_FIND_STR(set->index, key, item);
+
+    return item != NULL;
+}
+
+/* returns NULL on failure, "key" if not specified */
+static const char *
+getBucketAttribute(const struct LDJSON *const obj, const char *const context)
+{
+    const struct LDJSON *bucketBy;
+
+    LD_ASSERT(obj);
+    LD_ASSERT(LDJSONGetType(obj) == LDObject);
+
+    if (!lookupOptionalValueOfType(obj, context, "bucketBy", LDText, &bucketBy))
+    {
+        return NULL;
+    }
+
+    if (bucketBy == NULL) {
+        return "key";
+    }
+
+    return LDGetText(bucketBy);
+}
+
+/* An index that does not refer to a variation of the flag is not a schema
+error, it is resolved to -1 and the evaluation produces no value. */
+static int
+resolveVariationIndex(
+    const struct LDFlag *const flag, const struct LDJSON *const index)
+{
+    double number;
+
+    LD_ASSERT(flag);
+
+    if (index == NULL || LDJSONGetType(index) != LDNumber) {
+        return -1;
+    }
+
+    number = LDGetNumber(index);
+
+    if (number < 0 || number >= flag->variationCount) {
+        return -1;
+    }
+
+    return (int)number;
+}
+
+/* The variation a prerequisite requires is an index into another flag, so it
+can only be checked to be a whole number. Anything else never matches, which
+is resolved to -1. */
+static int
+resolvePrerequisiteVariation(const struct LDJSON *const index)
+{
+    double number;
+
+    LD_ASSERT(index);
+
+    number = LDGetNumber(index);
+
+    if (number < 0 || number > INT_MAX || number != (double)(int)number) {
+        return -1;
+    }
+
+    return (int)number;
+}
+
+static LDBoolean
+compileRegexes(struct LDClause *const clause)
+{
+    const struct LDJSON *iter;
+    struct LDRegex **    regex;
+
+    LD_ASSERT(clause);
+
+    if (clause->values == NULL || LDCollectionGetSize(clause->values) == 0) {
+        return LDBooleanTrue;
+    }
+
+    if (!(clause->regexes = (struct LDRegex **)LDAlloc(
+              sizeof(struct LDRegex *) * LDCollectionGetSize(clause->values))))
+    {
+        return LDBooleanFalse;
+    }
+
+    memset(
+        clause->regexes,
+        0,
+        sizeof(struct LDRegex *) * LDCollectionGetSize(clause->values));
+
+    regex = clause->regexes;
+
+    for (iter = LDGetIter(clause->values); iter; iter = LDIterNext(iter)) {
+        if (LDJSONGetType(iter) == LDText) {
+            if (!LDi_compileRegex(LDGetText(iter), regex)) {
+                return LDBooleanFalse;
+            }
+        }
+
+        regex++;
+    }
+
+    return LDBooleanTrue;
+}
+
+/* returns false only on allocation failure */
+static LDBoolean
+compileClause(const struct LDJSON *const json, struct LDClause *const clause)
+{
+    const struct LDJSON *op, *attribute, *negate;
+
+    LD_ASSERT(json);
+    LD_ASSERT(clause);
+
+    memset(clause, 0, sizeof(struct LDClause));
+
+    if (LDJSONGetType(json) != LDObject) {
+        LD_LOG(LD_LOG_ERROR, "clause expected object");
+
+        return LDBooleanTrue;
+    }
+
+    if (!(op = lookupRequiredValueOfType(json, "clause", "op", LDText))) {
+        return LDBooleanTrue;
+    }
+
+    if (strcmp(LDGetText(op), "segmentMatch") == 0) {
+        clause->segmentMatch = LDBooleanTrue;
+    } else if (!(clause->op = LDi_lookupOperation(LDGetText(op)))) {
+        LD_LOG(LD_LOG_WARNING, "unknown operator");
+
+        /* an unknown operator never matches, nothing else is inspected */
+        clause->valid = LDBooleanTrue;
+
+        return LDBooleanTrue;
+    }
+
+    if (!clause->segmentMatch) {
+        if (!(attribute = lookupRequiredValueOfType(
+                  json, "clause", "attribute", LDText))) {
+            return LDBooleanTrue;
+        }
+
+        clause->attribute     = LDGetText(attribute);
+        clause->attributeSlot = LDi_attributeSlot(clause->attribute);
+    }
+
+    if (!lookupOptionalValueOfType(
+            json, "clause", "values", LDArray, &clause->values)) {
+        return LDBooleanTrue;
+    }
+
+    if (!lookupOptionalValueOfType(json, "clause", "negate", LDBool, &negate)) {
+        return LDBooleanTrue;
+    }
+
+    clause->negate = negate && LDGetBool(negate);
+    clause->valid  = LDBooleanTrue;
+
+    if (strcmp(LDGetText(op), "matches") == 0) {
+        return compileRegexes(clause);
+    }
+
+    return LDBooleanTrue;
+}
+
+static void
+freeClauses(struct LDClause *const clauses, const unsigned int count)
+{
+    unsigned int i, j;
+
+    if (clauses) {
+        for (i = 0; i < count; i++) {
+            if (clauses[i].regexes) {
+                for (j = 0; j < LDCollectionGetSize(clauses[i].values); j++) {
+                    LDi_freeRegex(clauses[i].regexes[j]);
+                }
+
+                LDFree(clauses[i].regexes);
+            }
+        }
+
+        LDFree(clauses);
+    }
+}
+
+static LDBoolean
+compileClauses(
+    const struct LDJSON *const clauses,
+    struct LDClause **const    result,
+    unsigned int *const        count)
+{
+    const struct LDJSON *iter;
+    struct LDClause *    clause;
+
+    LD_ASSERT(result);
+    LD_ASSERT(count);
+
+    *result = NULL;
+    *count  = 0;
+
+    if (clauses == NULL || LDCollectionGetSize(clauses) == 0) {
+        return LDBooleanTrue;
+    }
+
+    if (!(*result = (struct LDClause *)LDAlloc(
+              sizeof(struct LDClause) * LDCollectionGetSize(clauses))))
+    {
+        return LDBooleanFalse;
+    }
+
+    memset(*result, 0, sizeof(struct LDClause) * LDCollectionGetSize(clauses));
+
+    *count = LDCollectionGetSize(clauses);
+
+    clause = *result;
+
+    for (iter = LDGetIter(clauses); iter; iter = LDIterNext(iter)) {
+        if (!compileClause(iter, clause)) {
+            return LDBooleanFalse;
+        }
+
+        clause++;
+    }
+
+    return LDBooleanTrue;
+}
+
+static LDBoolean
+compileRollout(
+    const struct LDFlag *const         flag,
+    const struct LDJSON *const         rollout,
+    struct LDVariationOrRollout *const result)
+{
+    const struct LDJSON *kind, *variations, *seed, *iter;
+    struct LDWeightedVariation *weighted;
+
+    LD_ASSERT(flag);
+    LD_ASSERT(rollout);
+    LD_ASSERT(result);
+
+    result->isRollout = LDBooleanTrue;
+
+    if (!lookupOptionalValueOfType(rollout, "rollout", "kind", LDText, &kind)) {
+        return LDBooleanTrue;
+    }
+
+    result->experiment =
+        kind != NULL && strcmp(LDGetText(kind), "experiment") == 0;
+
+    if (!(variations = lookupRequiredValueOfType(
+              rollout, "rollout", "variations", LDArray)))
+    {
+        return LDBooleanTrue;
+    }
+
+    if (LDCollectionGetSize(variations) == 0) {
+        LD_LOG(LD_LOG_ERROR, "rollout variations must not be empty");
+
+        return LDBooleanTrue;
+    }
+
+    if (!(result->bucketBy = getBucketAttribute(rollout, "rollout"))) {
+        LD_LOG(LD_LOG_ERROR, "failed to parse bucketBy");
+
+        return LDBooleanTrue;
+    }
+
+    if (!lookupOptionalValueOfType(rollout, "rollout", "seed", LDNumber, &seed))
+    {
+        return LDBooleanTrue;
+    }
+
+    if (seed != NULL) {
+        char seedText[16];
+
+        result->hasSeed = LDBooleanTrue;
+        result->seed    = (int)LDGetNumber(seed);
+
+        snprintf(seedText, sizeof(seedText), "%d", result->seed);
+        LDi_initBucketPrefix(&result->seedPrefix, seedText, NULL);
+    }
+
+    if (!(result->variations = (struct LDWeightedVariation *)LDAlloc(
+              sizeof(struct LDWeightedVariation) *
+              LDCollectionGetSize(variations))))
+    {
+        return LDBooleanFalse;
+    }
+
+    weighted = result->variations;
+
+    for (iter = LDGetIter(variations); iter; iter = LDIterNext(iter)) {
+        const struct LDJSON *weight, *variation, *untracked;
+
+        if (LDJSONGetType(iter) != LDObject) {
+            LD_LOG(LD_LOG_ERROR, "weightedVariation expected object");
+
+            return LDBooleanTrue;
+        }
+
+        if (!(weight = lookupRequiredValueOfType(
+                  iter, "weightedVariation", "weight", LDNumber))) {
+            return LDBooleanTrue;
+        }
+
+        if (!(variation = lookupRequiredValueOfType(
+                  iter, "weightedVariation", "variation", LDNumber))) {
+            return LDBooleanTrue;
+        }
+
+        if (!lookupOptionalValueOfType(
+                iter, "weightedVariation", "untracked", LDBool, &untracked)) {
+            return LDBooleanTrue;
+        }
+
+        weighted->weight    = LDGetNumber(weight);
+        weighted->variation = resolveVariationIndex(flag, variation);
+        weighted->untracked = untracked != NULL && LDGetBool(untracked);
+
+        weighted++;
+        result->variationCount++;
+    }
+
+    result->valid = LDBooleanTrue;
+
+    return LDBooleanTrue;
+}
+
+/* returns false only on allocation failure */
+static LDBoolean
+compileVariationOrRollout(
+    const struct LDFlag *const         flag,
+    const struct LDJSON *const         json,
+    struct LDVariationOrRollout *const result)
+{
+    const struct LDJSON *variation, *rollout;
+
+    LD_ASSERT(flag);
+    LD_ASSERT(result);
+
+    memset(result, 0, sizeof(struct LDVariationOrRollout));
+
+    result->variation = -1;
+
+    if (json == NULL || LDJSONGetType(json) != LDObject) {
+        LD_LOG(LD_LOG_ERROR, "variationOrRollout expected object");
+
+        return LDBooleanTrue;
+    }
+
+    if (!lookupOptionalValueOfType(
+            json, "variationOrRollout", "variation", LDNumber, &variation))
+    {
+        return LDBooleanTrue;
+    }
+
+    if (variation != NULL) {
+        result->variation = resolveVariationIndex(flag, variation);
+        result->valid     = LDBooleanTrue;
+
+        return LDBooleanTrue;
+    }
+
+    if (!(rollout = lookupRequiredValueOfType(
+              json, "variationOrRollout", "rollout", LDObject)))
+    {
+        return LDBooleanTrue;
+    }
+
+    return compileRollout(flag, rollout, result);
+}
+
+static void
+freeVariationOrRollout(struct LDVariationOrRollout *const variationOrRollout)
+{
+    LDFree(variationOrRollout->variations);
+}
+
+static LDBoolean
+compileVariations(struct LDFlag *const flag)
+{
+    const struct LDJSON * variations, *iter;
+    const struct LDJSON **variation;
+
+    LD_ASSERT(flag);
+
+    if (!lookupOptionalValueOfType(
+            flag->json, "flag", "variations", LDArray, &variations)) {
+        return LDBooleanTrue;
+    }
+
+    if (variations == NULL || LDCollectionGetSize(variations) == 0) {
+        return LDBooleanTrue;
+    }
+
+    if (!(flag->variations = (const struct LDJSON **)LDAlloc(
+              sizeof(struct LDJSON *) * LDCollectionGetSize(variations))))
+    {
+        return LDBooleanFalse;
+    }
+
+    variation = flag->variations;
+
+    for (iter = LDGetIter(variations); iter; iter = LDIterNext(iter)) {
+        *variation = iter;
+        variation++;
+    }
+
+    flag->variationCount = LDCollectionGetSize(variations);
+
+    return LDBooleanTrue;
+}
+
+static LDBoolean
+compilePrerequisites(struct LDFlag *const flag)
+{
+    const struct LDJSON *  prerequisites, *iter;
+    struct LDPrerequisite *prerequisite;
+
+    LD_ASSERT(flag);
+
+    if (!lookupOptionalValueOfType(
+            flag->json, "flag", "prerequisites", LDArray, &prerequisites))
+    {
+        return LDBooleanTrue;
+    }
+
+    flag->prerequisitesValid = LDBooleanTrue;
+
+    if (prerequisites == NULL || LDCollectionGetSize(prerequisites) == 0) {
+        return LDBooleanTrue;
+    }
+
+    if (!(flag->prerequisites = (struct LDPrerequisite *)LDAlloc(
+              sizeof(struct LDPrerequisite) *
+              LDCollectionGetSize(prerequisites))))
+    {
+        return LDBooleanFalse;
+    }
+
+    memset(
+        flag->prerequisites,
+        0,
+        sizeof(struct LDPrerequisite) * LDCollectionGetSize(prerequisites));
+
+    flag->prerequisiteCount = LDCollectionGetSize(prerequisites);
+
+    prerequisite = flag->prerequisites;
+
+    for (iter = LDGetIter(prerequisites); iter; iter = LDIterNext(iter)) {
+        const struct LDJSON *key, *variation;
+
+        if (LDJSONGetType(iter) != LDObject) {
+            LD_LOG(LD_LOG_ERROR, "prerequisite expected object");
+        } else if (
+            (key = lookupRequiredValueOfType(
+                 iter, "prerequisite", "key", LDText)) &&
+            (variation = lookupRequiredValueOfType(
+                 iter, "prerequisite", "variation", LDNumber)))
+        {
+            prerequisite->key       = LDGetText(key);
+            prerequisite->variation = resolvePrerequisiteVariation(variation);
+            prerequisite->valid     = LDBooleanTrue;
+        }
+
+        prerequisite++;
+    }
+
+    return LDBooleanTrue;
+}
+
+static LDBoolean
+compileTargets(struct LDFlag *const flag)
+{
+    const struct LDJSON *targets, *iter;
+    struct LDTarget *    target;
+
+    LD_ASSERT(flag);
+
+    if (!lookupOptionalValueOfType(
+            flag->json, "flag", "targets", LDArray, &targets)) {
+        return LDBooleanTrue;
+    }
+
+    flag->targetsValid = LDBooleanTrue;
+
+    if (targets == NULL || LDCollectionGetSize(targets) == 0) {
+        return LDBooleanTrue;
+    }
+
+    if (!(flag->targets = (struct LDTarget *)LDAlloc(
+              sizeof(struct LDTarget) * LDCollectionGetSize(targets))))
+    {
+        return LDBooleanFalse;
+    }
+
+    memset(
+        flag->targets, 0, sizeof(struct LDTarget) * LDCollectionGetSize(targets));
+
+    flag->targetCount = LDCollectionGetSize(targets);
+
+    target = flag->targets;
+
+    for (iter = LDGetIter(targets); iter; iter = LDIterNext(iter)) {
+        const struct LDJSON *values, *variation;
+
+        if (LDJSONGetType(iter) != LDObject) {
+            LD_LOG(LD_LOG_ERROR, "target expected object");
+        } else if (
+            lookupOptionalValueOfType(
+                iter, "target", "values", LDArray, &values) &&
+            (variation = lookupRequiredValueOfType(
+                 iter, "target", "variation", LDNumber)))
+        {
+            if (!buildKeySet(values, &target->values)) {
+                return LDBooleanFalse;
+            }
+
+            target->variation = resolveVariationIndex(flag, variation);
+            target->valid     = LDBooleanTrue;
+        }
+
+        target++;
+    }
+
+    return LDBooleanTrue;
+}
+
+static LDBoolean
+compileRules(struct LDFlag *const flag)
+{
+    const struct LDJSON *rules, *iter;
+    struct LDRule *      rule;
+
+    LD_ASSERT(flag);
+
+    if (!lookupOptionalValueOfType(flag->json, "flag", "rules", LDArray, &rules))
+    {
+        return LDBooleanTrue;
+    }
+
+    flag->rulesValid = LDBooleanTrue;
+
+    if (rules == NULL || LDCollectionGetSize(rules) == 0) {
+        return LDBooleanTrue;
+    }
+
+    if (!(flag->rules = (struct LDRule *)LDAlloc(
+              sizeof(struct LDRule) * LDCollectionGetSize(rules))))
+    {
+        return LDBooleanFalse;
+    }
+
+    memset(flag->rules, 0, sizeof(struct LDRule) * LDCollectionGetSize(rules));
+
+    flag->ruleCount = LDCollectionGetSize(rules);
+
+    rule = flag->rules;
+
+    for (iter = LDGetIter(rules); iter; iter = LDIterNext(iter)) {
+        const struct LDJSON *clauses, *id;
+
+        rule->variationOrRollout.variation = -1;
+
+        if (LDJSONGetType(iter) != LDObject) {
+            LD_LOG(LD_LOG_ERROR, "rule expected object");
+        } else if (
+            lookupOptionalValueOfType(
+                iter, "rule", "clauses", LDArray, &clauses) &&
+            lookupOptionalValueOfType(iter, "rule", "id", LDText, &id))
+        {
+            if (!compileClauses(clauses, &rule->clauses, &rule->clauseCount)) {
+                return LDBooleanFalse;
+            }
+
+            if (!compileVariationOrRollout(
+                    flag, iter, &rule->variationOrRollout)) {
+                return LDBooleanFalse;
+            }
+
+            rule->id    = id ? LDGetText(id) : NULL;
+            rule->valid = LDBooleanTrue;
+        }
+
+        rule++;
+    }
+
+    return LDBooleanTrue;
+}
+
+struct LDFlag *
+LDi_newFlag(const struct LDJSON *const json)
+{
+    struct LDFlag *      flag;
+    const struct LDJSON *tmp;
+
+    LD_ASSERT(json);
+
+    if (!(flag = (struct LDFlag *)LDAlloc(sizeof(struct LDFlag)))) {
+        return NULL;
+    }
+
+    memset(flag, 0, sizeof(struct LDFlag));
+
+    flag->json                  = json;
+    flag->offVariation          = -1;
+    flag->fallthrough.variation = -1;
+
+    if (LDJSONGetType(json) != LDObject) {
+        LD_LOG(LD_LOG_ERROR, "flag expected object");
+
+        return flag;
+    }
+
+    flag->valid = LDBooleanTrue;
+
+    if ((tmp = lookupRequiredValueOfType(json, "flag", "key", LDText))) {
+        flag->key = LDGetText(tmp);
+    }
+
+    if ((tmp = lookupRequiredValueOfType(json, "flag", "salt", LDText))) {
+        flag->salt = LDGetText(tmp);
+    }
+
+    if (flag->key && flag->salt) {
+        LDi_initBucketPrefix(&flag->bucketPrefix, flag->key, flag->salt);
+    }
+
+    if (lookupOptionalValueOfType(json, "flag", "on", LDBool, &tmp)) {
+        flag->onValid = LDBooleanTrue;
+        flag->on      = tmp != NULL && LDGetBool(tmp);
+    }
+
+    if (!compileVariations(flag)) {
+        goto error;
+    }
+
+    flag->offVariation =
+        resolveVariationIndex(flag, LDObjectLookup(json, "offVariation"));
+
+    if (!compilePrerequisites(flag)) {
+        goto error;
+    }
+
+    if (!compileTargets(flag)) {
+        goto error;
+    }
+
+    if (!compileRules(flag)) {
+        goto error;
+    }
+
+    if (!compileVariationOrRollout(
+            flag, LDObjectLookup(json, "fallthrough"), &flag->fallthrough))
+    {
+        goto error;
+    }
+
+    return flag;
+
+error:
+    LD_LOG(LD_LOG_ERROR, "failed to allocate compiled flag");
+
+    LDi_freeFlag(flag);
+
+    return NULL;
+}
+
+void
+LDi_freeFlag(struct LDFlag *const flag)
+{
+    if (flag) {
+        unsigned int i;
+
+        for (i = 0; i < flag->targetCount; i++) {
+            freeKeySet(&flag->targets[i].values);
+        }
+
+        for (i = 0; i < flag->ruleCount; i++) {
+            freeClauses(flag->rules[i].clauses, flag->rules[i].clauseCount);
+            freeVariationOrRollout(&flag->rules[i].variationOrRollout);
+        }
+
+        freeVariationOrRollout(&flag->fallthrough);
+
+        LDFree(flag->rules);
+        LDFree(flag->targets);
+        LDFree(flag->prerequisites);
+        LDFree((void *)flag->variations);
+        LDFree(flag);
+    }
+}
+
+static LDBoolean
+compileSegmentRules(
+    struct LDSegment *const segment, const struct LDJSON *const rules)
+{
+    const struct LDJSON * iter;
+    struct LDSegmentRule *rule;
+
+    LD_ASSERT(segment);
+    LD_ASSERT(rules);
+
+    if (!(segment->rules = (struct LDSegmentRule *)LDAlloc(
+              sizeof(struct LDSegmentRule) * LDCollectionGetSize(rules))))
+    {
+        return LDBooleanFalse;
+    }
+
+    memset(
+        segment->rules,
+        0,
+        sizeof(struct LDSegmentRule) * LDCollectionGetSize(rules));
+
+    segment->ruleCount = LDCollectionGetSize(rules);
+
+    rule = segment->rules;
+
+    for (iter = LDGetIter(rules); iter; iter = LDIterNext(iter)) {
+        const struct LDJSON *clauses, *weight;
+
+        if (LDJSONGetType(iter) != LDObject) {
+            LD_LOG(LD_LOG_ERROR, "segment rule expected object");
+        } else if (
+            lookupOptionalValueOfType(
+                iter, "segmentRule", "clauses", LDArray, &clauses) &&
+            lookupOptionalValueOfType(
+                iter, "segmentRule", "weight", LDNumber, &weight))
+        {
+            if (!compileClauses(clauses, &rule->clauses, &rule->clauseCount)) {
+                return LDBooleanFalse;
+            }
+
+            if (weight) {
+                rule->hasWeight = LDBooleanTrue;
+                rule->weight    = LDGetNumber(weight);
+            }
+
+            if ((rule->bucketBy = getBucketAttribute(iter, "segmentRule"))) {
+                rule->valid = LDBooleanTrue;
+            } else {
+                LD_LOG(LD_LOG_ERROR, "failed to parse bucketBy");
+            }
+        }
+
+        rule++;
+    }
+
+    return LDBooleanTrue;
+}
+
+struct LDSegment *
+LDi_newSegment(const struct LDJSON *const json)
+{
+    struct LDSegment *   segment;
+    const struct LDJSON *tmp, *rules;
+
+    LD_ASSERT(json);
+
+    if (!(segment = (struct LDSegment *)LDAlloc(sizeof(struct LDSegment)))) {
+        return NULL;
+    }
+
+    memset(segment, 0, sizeof(struct LDSegment));
+
+    segment->json = json;
+
+    if (LDJSONGetType(json) != LDObject) {
+        LD_LOG(LD_LOG_ERROR, "segment expected object");
+
+        return segment;
+    }
+
+    if (lookupOptionalValueOfType(json, "segment", "included", LDArray, &tmp)) {
+        if (!buildKeySet(tmp, &segment->included)) {
+            goto error;
+        }
+
+        segment->includedValid = LDBooleanTrue;
+    }
+
+    if (lookupOptionalValueOfType(json, "segment", "excluded", LDArray, &tmp)) {
+        if (!buildKeySet(tmp, &segment->excluded)) {
+            goto error;
+        }
+
+        segment->excludedValid = LDBooleanTrue;
+    }
+
+    if (!lookupOptionalValueOfType(json, "segment", "rules", LDArray, &rules)) {
+        return segment;
+    }
+
+    if (rules == NULL || LDCollectionGetSize(rules) == 0) {
+        segment->rulesValid = LDBooleanTrue;
+
+        return segment;
+    }
+
+    /* key and salt are only required for bucketing by a rule */
+    if (!(tmp = lookupRequiredValueOfType(json, "segment", "key", LDText))) {
+        return segment;
+    }
+
+    segment->key = LDGetText(tmp);
+
+    if (!(tmp = lookupRequiredValueOfType(json, "segment", "salt", LDText))) {
+        return segment;
+    }
+
+    segment->salt = LDGetText(tmp);
+
+    LDi_initBucketPrefix(&segment->bucketPrefix, segment->key, segment->salt);
+
+    if (!compileSegmentRules(segment, rules)) {
+        goto error;
+    }
+
+    segment->rulesValid = LDBooleanTrue;
+
+    return segment;
+
+error:
+    LD_LOG(LD_LOG_ERROR, "failed to allocate compiled segment");
+
+    LDi_freeSegment(segment);
+
+    return NULL;
+}
+
+void
+LDi_freeSegment(struct LDSegment *const segment)
+{
+    if (segment) {
+        unsigned int i;
+
+        for (i = 0; i < segment->ruleCount; i++) {
+            freeClauses(
+                segment->rules[i].clauses, segment->rules[i].clauseCount);
+        }
+
+        freeKeySet(&segment->included);
+        freeKeySet(&segment->excluded);
+        LDFree(segment->rules);
+        LDFree(segment);
+    }
+}
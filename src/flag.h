@@ -0,0 +1,174 @@
+/*!
+ * @file flag.h
+ * @brief Internal API Interface for compiled flags and segments
+ *
+ * Flags and segments are compiled from their JSON representation once, when
+ * they enter the store. The evaluator only ever reads the compiled form.
+ * Compiled structures borrow strings and arrays from the JSON they were built
+ * from, so the JSON must outlive them.
+ */
+
+#pragma once
+
+#include <launchdarkly/json.h>
+
+#include "bucket.h"
+#include "operators.h"
+#include "user.h"
+
+struct LDKeySetItem;
+
+/* A hashed set of user keys. Keys are borrowed from the JSON array the set
+was built from. */
+struct LDKeySet
+{
+    /* contiguous storage for every entry */
+    struct LDKeySetItem *items;
+    /* uthash head */
+    struct LDKeySetItem *index;
+};
+
+LDBoolean
+LDi_keySetContains(const struct LDKeySet *const set, const char *const key);
+
+struct LDWeightedVariation
+{
+    /* index into the flag variations, -1 if invalid */
+    int       variation;
+    double    weight;
+    LDBoolean untracked;
+};
+
+struct LDVariationOrRollout
+{
+    /* false if the JSON did not match the schema */
+    LDBoolean valid;
+    LDBoolean isRollout;
+    /* fixed variation index, -1 if invalid */
+    int variation;
+    /* rollout fields */
+    LDBoolean                   experiment;
+    const char *                bucketBy;
+    LDBoolean                   hasSeed;
+    int                         seed;
+    /* "seed.", only set if hasSeed */
+    struct LDBucketPrefix seedPrefix;
+    struct LDWeightedVariation *variations;
+    unsigned int                variationCount;
+};
+
+struct LDClause
+{
+    LDBoolean valid;
+    /* "segmentMatch" is handled by the evaluator and has no `op` */
+    LDBoolean segmentMatch;
+    /* NULL for an operator this SDK does not know about */
+    OpFn                 op;
+    const char *         attribute;
+    LDAttributeSlot      attributeSlot;
+    const struct LDJSON *values;
+    LDBoolean            negate;
+    /* for "matches" one precompiled pattern per value, NULL entries never
+    match */
+    struct LDRegex **regexes;
+};
+
+struct LDTarget
+{
+    LDBoolean       valid;
+    struct LDKeySet values;
+    int             variation;
+};
+
+struct LDPrerequisite
+{
+    LDBoolean   valid;
+    const char *key;
+    /* index into the variations of `key`, -1 if it can never match */
+    int variation;
+};
+
+struct LDRule
+{
+    LDBoolean                   valid;
+    const char *                id;
+    struct LDClause *           clauses;
+    unsigned int                clauseCount;
+    struct LDVariationOrRollout variationOrRollout;
+};
+
+struct LDFlag
+{
+    /* the JSON this flag was compiled from, used for events */
+    const struct LDJSON *json;
+    /* false if `json` is not an object */
+    LDBoolean   valid;
+    const char *key;
+    const char *salt;
+    /* "key.salt.", only set if both are */
+    struct LDBucketPrefix bucketPrefix;
+    LDBoolean             onValid;
+    LDBoolean             on;
+    int                   offVariation;
+
+    const struct LDJSON **variations;
+    unsigned int          variationCount;
+
+    LDBoolean              prerequisitesValid;
+    struct LDPrerequisite *prerequisites;
+    unsigned int           prerequisiteCount;
+
+    LDBoolean        targetsValid;
+    struct LDTarget *targets;
+    unsigned int     targetCount;
+
+    LDBoolean      rulesValid;
+    struct LDRule *rules;
+    unsigned int   ruleCount;
+
+    struct LDVariationOrRollout fallthrough;
+};
+
+struct LDSegmentRule
+{
+    LDBoolean        valid;
+    struct LDClause *clauses;
+    unsigned int     clauseCount;
+    LDBoolean        hasWeight;
+    double           weight;
+    const char *     bucketBy;
+};
+
+struct LDSegment
+{
+    const struct LDJSON *json;
+    const char *         key;
+    const char *         salt;
+    /* "key.salt.", only set if rulesValid */
+    struct LDBucketPrefix bucketPrefix;
+
+    LDBoolean       includedValid;
+    struct LDKeySet included;
+    LDBoolean       excludedValid;
+    struct LDKeySet excluded;
+
+    LDBoolean             rulesValid;
+    struct LDSegmentRule *rules;
+    unsigned int          ruleCount;
+};
+
+/** @brief Compile a flag. Schema errors are logged and recorded in the
+ * result. Returns NULL only on allocation failure. */
+struct LDFlag *
+LDi_newFlag(const struct LDJSON *const json);
+
+void
+LDi_freeFlag(struct LDFlag *const flag);
+
+/** @brief Compile a segment. Schema errors are logged and recorded in the
+ * result. Returns NULL only on allocation failure. */
+struct LDSegment *
+LDi_newSegment(const struct LDJSON *const json);
+
+void
+LDi_freeSegment(struct LDSegment *const segment);
@@ -0,0 +1,281 @@
+#include <stdio.h>
+#include <string.h>
+
+#include <launchdarkly/api.h>
+
+#include "assertion.h"
+#include "json_writer.h"
+
+/* Ensures room for `length` more bytes and the terminator */
+static LDBoolean
+reserve(struct LDTextBuffer *const buffer, const size_t length)
+{
+    size_t capacity;
+    char * text;
+
+    LD_ASSERT(buffer);
+
+    if (buffer->length + length < buffer->capacity) {
+        return LDBooleanTrue;
+    }
+
+    capacity = buffer->capacity ? buffer->capacity * 2 : 256;
+
+    while (capacity <= buffer->length + length) {
+        capacity *= 2;
+    }
+
+    if (!(text = (char *)LDRealloc(buffer->text, capacity))) {
+        return LDBooleanFalse;
+    }
+
+    buffer->text     = text;
+    buffer->capacity = capacity;
+
+    return LDBooleanTrue;
+}
+
+LDBoolean
+LDi_writeRaw(
+    struct LDTextBuffer *const buffer,
+    const char *const          text,
+    const size_t               length)
+{
+    LD_ASSERT(buffer);
+    LD_ASSERT(text);
+
+    if (!reserve(buffer, length)) {
+        return LDBooleanFalse;
+    }
+
+    memcpy(buffer->text + buffer->length, text, length);
+
+    buffer->length += length;
+    buffer->text[buffer->length] = '\0';
+
+    return LDBooleanTrue;
+}
+
+LDBoolean
+LDi_writeText(struct LDTextBuffer *const buffer, const char *const text)
+{
+    LD_ASSERT(text);
+
+    return LDi_writeRaw(buffer, text, strlen(text));
+}
+
+LDBoolean
+LDi_writeString(struct LDTextBuffer *const buffer, const char *const text)
+{
+    const unsigned char *iter, *run;
+    char                 escape[8];
+
+    LD_ASSERT(buffer);
+    LD_ASSERT(text);
+
+    if (!LDi_writeRaw(buffer, "\"", 1)) {
+        return LDBooleanFalse;
+    }
+
+    /* characters that need no escaping are copied in runs */
+    for (iter = run = (const unsigned char *)text; *iter; iter++) {
+        if (*iter >= 32 && *iter != '"' && *iter != '\\') {
+            continue;
+        }
+
+        if (!LDi_writeRaw(buffer, (const char *)run, (size_t)(iter - run))) {
+            return LDBooleanFalse;
+        }
+
+        switch (*iter) {
+        case '"':
+            strcpy(escape, "\\\"");
+            break;
+        case '\\':
+            strcpy(escape, "\\\\");
+            break;
+        case '\b':
+            strcpy(escape, "\\b");
+            break;
+        case '\f':
+            strcpy(escape, "\\f");
+            break;
+        case '\n':
+            strcpy(escape, "\\n");
+            break;
+        case '\r':
+            strcpy(escape, "\\r");
+            break;
+        case '\t':
+            strcpy(escape, "\\t");
+            break;
+        default:
+            sprintf(escape, "\\u%04x", (unsigned int)*iter);
+            break;
+        }
+
+        if (!LDi_writeText(buffer, escape)) {
+            return LDBooleanFalse;
+        }
+
+        run = iter + 1;
+    }
+
+    return LDi_writeRaw(buffer, (const char *)run, (size_t)(iter - run)) &&
+        LDi_writeRaw(buffer, "\"", 1);
+}
+
+LDBoolean
+LDi_writeNumber(struct LDTextBuffer *const buffer, const double number)
+{
+    char   text[32];
+    double parsed;
+    size_t i;
+
+    /* NaN and infinity */
+    if ((number * 0) != 0) {
+        return LDi_writeRaw(buffer, "null", 4);
+    }
+
+    /* the shortest of these that round trips, as cJSON does */
+    sprintf(text, "%1.15g", number);
+
+    if (sscanf(text, "%lg", &parsed) != 1 || parsed != number) {
+        sprintf(text, "%1.17g", number);
+    }
+
+    /* the decimal point depends on the locale */
+    for (i = 0; text[i]; i++) {
+        if (!strchr("0123456789-+e", text[i])) {
+            text[i] = '.';
+        }
+    }
+
+    return LDi_writeRaw(buffer, text, i);
+}
+
+LDBoolean
+LDi_writeJSON(
+    struct LDTextBuffer *const buffer, const struct LDJSON *const json)
+{
+    const struct LDJSON *iter;
+
+    LD_ASSERT(buffer);
+    LD_ASSERT(json);
+
+    switch (LDJSONGetType(json)) {
+    case LDNull:
+        return LDi_writeRaw(buffer, "null", 4);
+    case LDBool:
+        return LDGetBool(json) ? LDi_writeRaw(buffer, "true", 4)
+                               : LDi_writeRaw(buffer, "false", 5);
+    case LDNumber:
+        return LDi_writeNumber(buffer, LDGetNumber(json));
+    case LDText:
+        return LDi_writeString(buffer, LDGetText(json));
+    case LDArray:
+        if (!LDi_writeRaw(buffer, "[", 1)) {
+            return LDBooleanFalse;
+        }
+
+        for (iter = LDGetIter(json); iter; iter = LDIterNext(iter)) {
+            if ((iter != LDGetIter(json) && !LDi_writeRaw(buffer, ",", 1)) ||
+                !LDi_writeJSON(buffer, iter))
+            {
+                return LDBooleanFalse;
+            }
+        }
+
+        return LDi_writeRaw(buffer, "]", 1);
+    case LDObject:
+        if (!LDi_writeRaw(buffer, "{", 1)) {
+            return LDBooleanFalse;
+        }
+
+        for (iter = LDGetIter(json); iter; iter = LDIterNext(iter)) {
+            if ((iter != LDGetIter(json) && !LDi_writeRaw(buffer, ",", 1)) ||
+                !LDi_writeString(buffer, LDIterKey(iter)) ||
+                !LDi_writeRaw(buffer, ":", 1) || !LDi_writeJSON(buffer, iter))
+            {
+                return LDBooleanFalse;
+            }
+        }
+
+        return LDi_writeRaw(buffer, "}", 1);
+    }
+
+    LD_LOG(LD_LOG_CRITICAL, "LDi_writeJSON unknown type");
+
+    return LDBooleanFalse;
+}
+
+LDBoolean
+LDi_writeReason(
+    struct LDTextBuffer *const buffer, const struct LDDetails *const details)
+{
+    const char *kind;
+
+    LD_ASSERT(buffer);
+    LD_ASSERT(details);
+
+    if (!(kind = LDEvalReasonKindToString(details->reason))) {
+        LD_LOG(LD_LOG_ERROR, "cannot find kind");
+
+        return LDBooleanFalse;
+    }
+
+    if (!LDi_writeText(buffer, "{\"kind\":") || !LDi_writeString(buffer, kind))
+    {
+        return LDBooleanFalse;
+    }
+
+    if (details->reason == LD_ERROR) {
+        if (!(kind = LDEvalErrorKindToString(details->extra.errorKind))) {
+            LD_LOG(LD_LOG_ERROR, "cannot find kind");
+
+            return LDBooleanFalse;
+        }
+
+        if (!LDi_writeText(buffer, ",\"errorKind\":") ||
+            !LDi_writeString(buffer, kind))
+        {
+            return LDBooleanFalse;
+        }
+    } else if (
+        details->reason == LD_PREREQUISITE_FAILED &&
+        details->extra.prerequisiteKey)
+    {
+        if (!LDi_writeText(buffer, ",\"prerequisiteKey\":") ||
+            !LDi_writeString(buffer, details->extra.prerequisiteKey))
+        {
+            return LDBooleanFalse;
+        }
+    } else if (details->reason == LD_RULE_MATCH) {
+        if (details->extra.rule.id &&
+            (!LDi_writeText(buffer, ",\"ruleId\":") ||
+             !LDi_writeString(buffer, details->extra.rule.id)))
+        {
+            return LDBooleanFalse;
+        }
+
+        if (!LDi_writeText(buffer, ",\"ruleIndex\":") ||
+            !LDi_writeNumber(buffer, details->extra.rule.ruleIndex))
+        {
+            return LDBooleanFalse;
+        }
+
+        if (details->extra.rule.inExperiment &&
+            !LDi_writeText(buffer, ",\"inExperiment\":true"))
+        {
+            return LDBooleanFalse;
+        }
+    } else if (details->reason == LD_FALLTHROUGH) {
+        if (details->extra.fallthrough.inExperiment &&
+            !LDi_writeText(buffer, ",\"inExperiment\":true"))
+        {
+            return LDBooleanFalse;
+        }
+    }
+
+    return LDi_writeText(buffer, "}");
+}
@@ -0,0 +1,45 @@
+/*!
+ * @file json_writer.h
+ * @brief Internal API Interface for writing JSON text without building a tree
+ *
+ * Every function appends to a `struct LDTextBuffer`, growing it as needed,
+ * and keeps the text NUL terminated. They return false if memory was
+ * exhausted, in which case the buffer may hold a partial write.
+ */
+
+#pragma once
+
+#include <stddef.h>
+
+#include <launchdarkly/boolean.h>
+#include <launchdarkly/json.h>
+#include <launchdarkly/variations.h>
+
+/* Appends `length` bytes of `text` verbatim */
+LDBoolean
+LDi_writeRaw(
+    struct LDTextBuffer *const buffer,
+    const char *const          text,
+    const size_t               length);
+
+/* Appends a NUL terminated string verbatim, e.g. punctuation */
+LDBoolean
+LDi_writeText(struct LDTextBuffer *const buffer, const char *const text);
+
+/* Appends `text` as a quoted and escaped JSON string */
+LDBoolean
+LDi_writeString(struct LDTextBuffer *const buffer, const char *const text);
+
+/* Appends a number formatted the same way as `LDJSONSerialize` */
+LDBoolean
+LDi_writeNumber(struct LDTextBuffer *const buffer, const double number);
+
+/* Appends the serialization of `json`, equivalent to `LDJSONSerialize` */
+LDBoolean
+LDi_writeJSON(
+    struct LDTextBuffer *const buffer, const struct LDJSON *const json);
+
+/* Appends `details` as the object `LDReasonToJSON` would return */
+LDBoolean
+LDi_writeReason(
+    struct LDTextBuffer *const buffer, const struct LDDetails *const details);
@@ -7,6 +7,7 @@
 #include "client.h"
 #include "config.h"
 #include "network.h"
+#include "store.h"
 #include "utility.h"
 
 #define LD_USER_AGENT "User-Agent: CServerClient/" LD_SDK_VERSION
@@ -176,6 +177,31 @@ LDi_removeAndFreeHandle(CURLM *const multi, CURL *const handle)
     return LDBooleanTrue;
 }
 
+/* In daemon mode the backend is the only source of data. Reloading it at half
+the cache TTL keeps evaluations from ever finding an expired entry. */
+static void
+refreshStore(struct LDClient *const client, double *const lastRefresh)
+{
+    double now;
+
+    LD_ASSERT(client);
+    LD_ASSERT(lastRefresh);
+
+    if (!LDi_getMonotonicMilliseconds(&now)) {
+        return;
+    }
+
+    if (now - *lastRefresh < client->config->storeCacheMilliseconds / 2.0) {
+        return;
+    }
+
+    if (!LDStoreRefresh(client->store)) {
+        LD_LOG(LD_LOG_WARNING, "failed to refresh store from backend");
+    }
+
+    *lastRefresh = now;
+}
+
 THREAD_RETURN
 LDi_networkthread(void *const clientref)
 {
@@ -185,11 +211,17 @@ LDi_networkthread(void *const clientref)
     struct NetworkInterface *interfaces[3];
     /* record how many threads are actually running */
     size_t interfacecount = 0;
+    /* proactive refresh of the store cache */
+    LDBoolean refresh;
+    double    lastRefresh = 0;
 
     CURLM *multihandle;
 
     LD_ASSERT(client);
 
+    refresh = client->config->useLDD && client->config->storeProactiveRefresh &&
+              client->config->storeCacheMilliseconds > 0;
+
     if (!(multihandle = curl_multi_init())) {
         LD_LOG(LD_LOG_ERROR, "failed to construct multihandle");
 
@@ -239,6 +271,10 @@ LDi_networkthread(void *const clientref)
 
         curl_multi_perform(multihandle, &running_handles);
 
+        if (refresh) {
+            refreshStore(client, &lastRefresh);
+        }
+
         if (!offline) {
             for (i = 0; i < interfacecount; i++) {
                 CURL *handle;
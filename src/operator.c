@@ -109,6 +109,104 @@ operatorMatchesFn(
     return matches;
 }
 
+struct LDRegex
+{
+    pcre *      code;
+    pcre_extra *extra;
+};
+
+LDBoolean
+LDi_compileRegex(const char *const pattern, struct LDRegex **const result)
+{
+    struct LDRegex *regex;
+    const char *    error;
+    int             errorOffset, studyOptions;
+
+    LD_ASSERT(pattern);
+    LD_ASSERT(result);
+
+    *result      = NULL;
+    error        = NULL;
+    errorOffset  = 0;
+    studyOptions = 0;
+
+    if (!(regex = (struct LDRegex *)LDAlloc(sizeof(struct LDRegex)))) {
+        return LDBooleanFalse;
+    }
+
+    regex->extra = NULL;
+    regex->code  = pcre_compile(
+        pattern, PCRE_JAVASCRIPT_COMPAT, &error, &errorOffset, NULL);
+
+    if (!regex->code) {
+        LD_LOG_3(
+            LD_LOG_ERROR,
+            "failed to compile regex '%s' got error '%s' with offset %d",
+            pattern,
+            error,
+            errorOffset);
+
+        LDFree(regex);
+
+        /* an invalid pattern is cached as a regex that never matches */
+        return LDBooleanTrue;
+    }
+
+#ifdef PCRE_STUDY_JIT_COMPILE
+    studyOptions = PCRE_STUDY_JIT_COMPILE;
+#endif
+
+    /* studying is an optimization, on failure the pattern is used as is */
+    regex->extra = pcre_study(regex->code, studyOptions, &error);
+
+    *result = regex;
+
+    return LDBooleanTrue;
+}
+
+LDBoolean
+LDi_regexMatches(
+    const struct LDRegex *const regex, const struct LDJSON *const uvalue)
+{
+    const char *subject;
+
+    LD_ASSERT(uvalue);
+
+    if (!regex || LDJSONGetType(uvalue) != LDText) {
+        return LDBooleanFalse;
+    }
+
+    subject = LDGetText(uvalue);
+    LD_ASSERT(subject);
+
+    return pcre_exec(
+               regex->code,
+               regex->extra,
+               subject,
+               strlen(subject),
+               0,
+               0,
+               NULL,
+               0) >= 0;
+}
+
+void
+LDi_freeRegex(struct LDRegex *const regex)
+{
+    if (regex) {
+        if (regex->extra) {
+#ifdef PCRE_STUDY_JIT_COMPILE
+            pcre_free_study(regex->extra);
+#else
+            pcre_free(regex->extra);
+#endif
+        }
+
+        pcre_free(regex->code);
+        LDFree(regex);
+    }
+}
+
 static LDBoolean
 operatorContainsFn(
     const struct LDJSON *const uvalue, const struct LDJSON *const cvalue)
@@ -17,5 +17,21 @@ typedef LDBoolean (*OpFn)(
 OpFn
 LDi_lookupOperation(const char *const operation);
 
+/* A precompiled pattern for the "matches" operator */
+struct LDRegex;
+
+/** @brief Compile a pattern for `LDi_regexMatches`. Returns false only on
+ * allocation failure. An invalid pattern produces a NULL result, which never
+ * matches. */
+LDBoolean
+LDi_compileRegex(const char *const pattern, struct LDRegex **const result);
+
+LDBoolean
+LDi_regexMatches(
+    const struct LDRegex *const regex, const struct LDJSON *const uvalue);
+
+void
+LDi_freeRegex(struct LDRegex *const regex);
+
 LDBoolean
 LDi_parseTime(const struct LDJSON *const json, timestamp_t *result);
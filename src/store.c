@@ -1,14 +1,18 @@
 #include <stdio.h>
-
-#include "uthash.h"
+#include <string.h>
 
 #include <launchdarkly/api.h>
 
 #include "assertion.h"
+#include "atomic.h"
 #include "concurrency.h"
+#include "epoch.h"
+#include "flag.h"
 #include "store.h"
 #include "utility.h"
 
+#include "utlist.h"
+
 /* **** Forward Declarations **** */
 
 struct MemoryContext;
@@ -16,10 +20,9 @@ struct CacheItem;
 
 static const char *const LD_SS_FEATURES   = "features";
 static const char *const LD_SS_SEGMENTS   = "segments";
-static const char *const INIT_CHECKED_KEY = "$initChecked";
 
 static LDBoolean
-memoryInit(struct LDStore *const context, struct LDJSON *const sets);
+memoryInit(struct LDStore *const store, struct LDJSON *const sets);
 
 static void
 memoryDestructor(struct MemoryContext *const context);
@@ -131,6 +134,23 @@ featureKindToString(const enum FeatureKind kind)
     }
 }
 
+static LDBoolean
+featureKindFromString(const char *const text, enum FeatureKind *const kind)
+{
+    LD_ASSERT(text);
+    LD_ASSERT(kind);
+
+    if (strcmp(text, LD_SS_FEATURES) == 0) {
+        *kind = LD_FLAG;
+    } else if (strcmp(text, LD_SS_SEGMENTS) == 0) {
+        *kind = LD_SEGMENT;
+    } else {
+        return LDBooleanFalse;
+    }
+
+    return LDBooleanTrue;
+}
+
 LDBoolean
 LDi_isFeatureDeleted(const struct LDJSON *const feature)
 {
@@ -209,6 +229,9 @@ struct LDStore
     struct MemoryContext *   cache;
     struct LDStoreInterface *backend;
     unsigned int             cacheMilliseconds;
+    /* how long past the TTL an entry may be served while it is refreshed in
+    the background, 0 if stale entries are never served */
+    unsigned int staleMilliseconds;
 };
 
 /* ***** Reference counting **** */
@@ -216,8 +239,10 @@ struct LDStore
 struct LDJSONRC
 {
     struct LDJSON *value;
-    ld_mutex_t     lock;
-    unsigned int   count;
+    /* compiled form of value, built when the value enters the store */
+    struct LDFlag *   flag;
+    struct LDSegment *segment;
+    volatile long     count;
 };
 
 struct LDJSONRC *
@@ -231,14 +256,11 @@ LDJSONRCNew(struct LDJSON *const json)
         return NULL;
     }
 
-    LDi_mutex_init(&result->lock);
-
-    result->value = json;
+    result->value   = json;
+    result->flag    = NULL;
+    result->segment = NULL;
 
-    /* the locking here is only to satisfy helgrind */
-    LDi_mutex_lock(&result->lock);
-    result->count = 1;
-    LDi_mutex_unlock(&result->lock);
+    LDi_atomicStore(&result->count, 1);
 
     return result;
 }
@@ -248,17 +270,16 @@ LDJSONRCIncrement(struct LDJSONRC *const rc)
 {
     LD_ASSERT(rc);
 
-    LDi_mutex_lock(&rc->lock);
-    rc->count++;
-    LDi_mutex_unlock(&rc->lock);
+    LDi_atomicAdd(&rc->count, 1);
 }
 
 static void
 destroyJSONRC(struct LDJSONRC *const rc)
 {
     if (rc) {
+        LDi_freeFlag(rc->flag);
+        LDi_freeSegment(rc->segment);
         LDJSONFree(rc->value);
-        LDi_mutex_destroy(&rc->lock);
         LDFree(rc);
     }
 }
@@ -267,16 +288,13 @@ void
 LDJSONRCDecrement(struct LDJSONRC *const rc)
 {
     if (rc) {
-        LDi_mutex_lock(&rc->lock);
-        LD_ASSERT(rc->count > 0);
-        rc->count--;
+        long remaining;
 
-        if (rc->count == 0) {
-            LDi_mutex_unlock(&rc->lock);
+        remaining = LDi_atomicAdd(&rc->count, -1);
+        LD_ASSERT(remaining >= 0);
 
+        if (remaining == 0) {
             destroyJSONRC(rc);
-        } else {
-            LDi_mutex_unlock(&rc->lock);
         }
     }
 }
@@ -289,315 +307,683 @@ LDJSONRCGet(struct LDJSONRC *const rc)
     return rc->value;
 }
 
+const struct LDFlag *
+LDJSONRCGetFlag(struct LDJSONRC *const rc)
+{
+    LD_ASSERT(rc);
+
+    return rc->flag;
+}
+
+const struct LDSegment *
+LDJSONRCGetSegment(struct LDJSONRC *const rc)
+{
+    LD_ASSERT(rc);
+
+    return rc->segment;
+}
+
+/* Wraps a feature of the given kind and compiles it for evaluation. Deleted
+placeholders are not compiled. Like `LDJSONRCNew` the feature is not consumed
+on failure. */
+static struct LDJSONRC *
+makeFeatureRC(const enum FeatureKind kind, struct LDJSON *const feature)
+{
+    struct LDJSONRC * result;
+    struct LDFlag *   flag;
+    struct LDSegment *segment;
+
+    LD_ASSERT(feature);
+
+    flag    = NULL;
+    segment = NULL;
+
+    if (!LDi_isFeatureDeleted(feature)) {
+        if (kind == LD_FLAG) {
+            if (!(flag = LDi_newFlag(feature))) {
+                return NULL;
+            }
+        } else if (kind == LD_SEGMENT) {
+            if (!(segment = LDi_newSegment(feature))) {
+                return NULL;
+            }
+        }
+    }
+
+    if (!(result = LDJSONRCNew(feature))) {
+        LDi_freeFlag(flag);
+        LDi_freeSegment(segment);
+
+        return NULL;
+    }
+
+    result->flag    = flag;
+    result->segment = segment;
+
+    return result;
+}
+
 /* **** Memory Implementation **** */
 
-/* Feature Key -> JSON */
+#define LD_FEATURE_KINDS 2
+/* initial slot count of a table, must be a power of two */
+#define LD_CACHE_TABLE_MIN 16
+
+#define LOAD_POINTER(type, location)                                           \
+    ((type)LDi_atomicLoadPointer((void *volatile *)&(location)))
+
+#define STORE_POINTER(location, value)                                         \
+    LDi_atomicStorePointer((void *volatile *)&(location), (void *)(value))
+
+/* An immutable cache entry. Updates publish a replacement entry and retire
+the original. */
 struct CacheItem
 {
-    char *           key;
+    /* NULL for markers without a value */
     struct LDJSONRC *feature;
-    UT_hash_handle   hh;
+    /* deleted placeholders are kept so stale versions are ignored */
+    LDBoolean deleted;
     /* monotonic milliseconds */
     double updatedOn;
+    /* reclamation list, only used by writers */
+    struct CacheItem *retiredNext;
 };
 
-static void
-deleteCacheItem(struct CacheItem *const item)
+/* A slot is published by storing `key` last. After that only `item` ever
+changes. */
+struct CacheSlot
 {
-    if (item) {
-        LDFree(item->key);
-        LDJSONRCDecrement(item->feature);
+    char *volatile             key;
+    unsigned int               hash;
+    struct CacheItem *volatile item;
+};
+
+/* Open addressing table of the features of a single kind. Keys are never
+removed, a removal stores a deleted placeholder. Growing publishes a new table
+that shares keys and entries with the original. */
+struct CacheTable
+{
+    unsigned int       capacity;
+    unsigned int       count;
+    struct CacheSlot * slots;
+    struct CacheTable *retiredNext;
+};
+
+/* Everything replaced by a store init */
+struct CacheState
+{
+    struct CacheTable *volatile tables[LD_FEATURE_KINDS];
+    /* all collection of each kind, NULL if not cached */
+    struct CacheItem *volatile all[LD_FEATURE_KINDS];
+    struct CacheState *retiredNext;
+};
+
+/* A backend fetch in progress. Concurrent misses for the same item wait for
+it instead of issuing an identical fetch. */
+struct InFlightFetch
+{
+    enum FeatureKind kind;
+    /* NULL for the all collection */
+    char *    key;
+    LDBoolean done;
+    LDBoolean success;
+    /* waiting to be picked up by the refresher thread */
+    LDBoolean queued;
+    /* the fetching thread and every waiter */
+    unsigned int          references;
+    struct InFlightFetch *next;
+};
+
+/* Readers take no locks. Writers are serialized by `writeLock`, and free
+anything they replace only once an epoch grace period has passed. */
+struct MemoryContext
+{
+    volatile long              initialized;
+    struct CacheState *volatile state;
+    struct LDEpoch             epoch;
+    ld_mutex_t                 writeLock;
+    /* guarded by writeLock */
+    struct CacheItem * initChecked;
+    struct CacheItem * retiredItems;
+    struct CacheTable *retiredTables;
+    struct CacheState *retiredStates;
+    /* guarded by fetchLock */
+    struct InFlightFetch *fetches;
+    ld_mutex_t            fetchLock;
+    ld_cond_t             fetchDone;
+    /* background refreshes of stale entries, guarded by fetchLock */
+    ld_thread_t refresher;
+    ld_cond_t   refreshQueued;
+    LDBoolean   refresherRunning;
+    LDBoolean   refresherStop;
+    /* statistics, updated atomically */
+    volatile long staleServes;
+    volatile long refreshes;
+    volatile long refreshFailures;
+    /* advanced when a write starts and again once it is visible to readers,
+    so it is odd while a write is in progress */
+    volatile long generation;
+};
+
+static unsigned int
+hashKey(const char *key)
+{
+    unsigned int hash;
+
+    LD_ASSERT(key);
+
+    /* FNV-1a */
+    for (hash = 2166136261U; *key; key++) {
+        hash ^= (unsigned char)*key;
+        hash *= 16777619U;
+    }
+
+    return hash;
+}
+
+static struct CacheItem *
+allocateCacheItem(struct LDJSONRC *const feature, const LDBoolean deleted)
+{
+    struct CacheItem *item;
+
+    if (!(item = (struct CacheItem *)LDAlloc(sizeof(struct CacheItem)))) {
+        return NULL;
+    }
+
+    if (!LDi_getMonotonicMilliseconds(&item->updatedOn)) {
         LDFree(item);
+
+        return NULL;
     }
+
+    item->feature     = feature;
+    item->deleted     = deleted;
+    item->retiredNext = NULL;
+
+    return item;
 }
 
 static void
-deleteAndRemoveCacheItem(
-    struct CacheItem **const collection, struct CacheItem *const item)
+deleteCacheItem(struct CacheItem *const item)
 {
-    if (collection && item) {
-        LDFree(item->key);
+    if (item) {
         LDJSONRCDecrement(item->feature);
-        HASH_DEL(*collection, item);
         LDFree(item);
     }
 }
 
+/* value may be NULL for a marker, consumed even on failure */
 static struct CacheItem *
-makeCacheItem(const char *const key, struct LDJSON *value)
+makeCacheItem(struct LDJSON *const value)
 {
-    char *            keyDupe;
-    struct CacheItem *item;
     struct LDJSONRC * valueRC;
+    struct CacheItem *item;
 
-    LD_ASSERT(key);
-
-    keyDupe = NULL;
-    item    = NULL;
     valueRC = NULL;
 
-    if (!(keyDupe = LDStrDup(key))) {
-        goto error;
-    }
-
     if (value) {
         if (!(valueRC = LDJSONRCNew(value))) {
-            goto error;
-        }
+            LDJSONFree(value);
 
-        value = NULL;
+            return NULL;
+        }
     }
 
-    if (!(item = (struct CacheItem *)LDAlloc(sizeof(struct CacheItem)))) {
-        goto error;
+    if (!(item = allocateCacheItem(valueRC, LDBooleanFalse))) {
+        LDJSONRCDecrement(valueRC);
     }
 
-    memset(item, 0, sizeof(struct CacheItem));
+    return item;
+}
+
+/* consumed even on failure */
+static struct CacheItem *
+makeFeatureCacheItem(const enum FeatureKind kind, struct LDJSON *const feature)
+{
+    struct LDJSONRC * featureRC;
+    struct CacheItem *item;
+    LDBoolean         deleted;
+
+    LD_ASSERT(feature);
 
-    if (!LDi_getMonotonicMilliseconds(&item->updatedOn)) {
-        goto error;
+    deleted = LDi_isFeatureDeleted(feature);
+
+    if (!(featureRC = makeFeatureRC(kind, feature))) {
+        LDJSONFree(feature);
+
+        return NULL;
     }
 
-    item->key     = keyDupe;
-    item->feature = valueRC;
+    if (!(item = allocateCacheItem(featureRC, deleted))) {
+        LDJSONRCDecrement(featureRC);
+    }
 
     return item;
+}
 
-error:
-    LDFree(item);
-    LDFree(keyDupe);
-    LDJSONFree(value);
+/* a copy of an item sharing its value, with a current timestamp */
+static struct CacheItem *
+copyCacheItem(const struct CacheItem *const item)
+{
+    struct CacheItem *copy;
 
-    return NULL;
+    LD_ASSERT(item);
+
+    if (!(copy = allocateCacheItem(item->feature, item->deleted))) {
+        return NULL;
+    }
+
+    if (copy->feature) {
+        LDJSONRCIncrement(copy->feature);
+    }
+
+    return copy;
 }
 
-struct MemoryContext
+/* a copy of an item that is already expired, used for testing */
+static struct CacheItem *
+makeExpiredCopy(const struct CacheItem *const item)
 {
-    LDBoolean initialized;
-    /* ut hash table */
-    struct CacheItem *items;
-    ld_rwlock_t       lock;
-};
+    struct CacheItem *copy;
+
+    if ((copy = copyCacheItem(item))) {
+        copy->updatedOn = 0;
+    }
+
+    return copy;
+}
 
-static char *
-featureStoreCacheKey(const char *const kind, const char *const key)
+static struct CacheTable *
+makeCacheTable(const unsigned int capacity)
 {
-    char *result;
-    int   bytes;
-    int   status;
+    struct CacheTable *table;
 
-    LD_ASSERT(kind);
-    LD_ASSERT(key);
+    LD_ASSERT(capacity > 0 && (capacity & (capacity - 1)) == 0);
+
+    if (!(table = (struct CacheTable *)LDAlloc(sizeof(struct CacheTable)))) {
+        return NULL;
+    }
 
-    bytes = strlen(kind) + 1 + strlen(key) + 1;
+    if (!(table->slots = (struct CacheSlot *)LDCalloc(
+              capacity, sizeof(struct CacheSlot))))
+    {
+        LDFree(table);
 
-    if (!(result = LDAlloc(bytes))) {
         return NULL;
     }
 
-    status = snprintf(result, bytes, "%s:%s", kind, key);
-    LD_ASSERT(status == bytes - 1);
+    table->capacity    = capacity;
+    table->count       = 0;
+    table->retiredNext = NULL;
 
-    return result;
+    return table;
 }
 
-static char *
-featureStoreAllCacheKey(const char *const kind)
+/* entries are only owned by the newest table sharing them */
+static void
+freeCacheTable(struct CacheTable *const table, const LDBoolean entries)
 {
-    char *result;
-    int   bytes;
-    int   status;
+    unsigned int i;
+
+    if (table) {
+        if (entries) {
+            for (i = 0; i < table->capacity; i++) {
+                if (table->slots[i].key) {
+                    LDFree(table->slots[i].key);
+                    deleteCacheItem(table->slots[i].item);
+                }
+            }
+        }
 
-    LD_ASSERT(kind);
+        LDFree(table->slots);
+        LDFree(table);
+    }
+}
 
-    bytes = 4 + strlen(kind) + 1;
+static struct CacheState *
+makeCacheState(void)
+{
+    struct CacheState *state;
 
-    if (!(result = LDAlloc(bytes))) {
+    if (!(state = (struct CacheState *)LDAlloc(sizeof(struct CacheState)))) {
         return NULL;
     }
 
-    status = snprintf(result, bytes, "all:%s", kind);
-    LD_ASSERT(status == bytes - 1);
+    memset(state, 0, sizeof(struct CacheState));
 
-    return result;
+    return state;
 }
 
-/* expects write lock */
-static LDBoolean
-upsertMemory(
-    struct LDStore *const store,
-    const char *const     kind,
-    struct LDJSON *       replacement)
+static void
+freeCacheState(struct CacheState *const state)
 {
-    LDBoolean         success;
-    struct LDJSON *   weakReplacementRef;
-    struct CacheItem *currentItem, *replacementItem, *allItems;
-    char *            cacheKey;
-    char *            allCacheKey;
-
-    LD_ASSERT(store);
-    LD_ASSERT(store->cache);
-    LD_ASSERT(kind);
-    LD_ASSERT(replacement);
+    unsigned int i;
 
-    success            = LDBooleanFalse;
-    currentItem        = NULL;
-    replacementItem    = NULL;
-    cacheKey           = NULL;
-    weakReplacementRef = replacement;
+    if (state) {
+        for (i = 0; i < LD_FEATURE_KINDS; i++) {
+            freeCacheTable(state->tables[i], LDBooleanTrue);
+            deleteCacheItem(state->all[i]);
+        }
 
-    allCacheKey = featureStoreAllCacheKey(kind);
-    LD_ASSERT(allCacheKey);
+        LDFree(state);
+    }
+}
 
-    cacheKey =
-        featureStoreCacheKey(kind, LDi_getFeatureKeyTrusted(replacement));
-    LD_ASSERT(cacheKey);
+/* safe for readers inside an epoch */
+static struct CacheSlot *
+cacheTableFind(
+    struct CacheTable *const table,
+    const char *const        key,
+    const unsigned int       hash)
+{
+    unsigned int mask, i;
 
-    HASH_FIND_STR(store->cache->items, cacheKey, currentItem);
+    LD_ASSERT(key);
 
-    if (currentItem) {
-        int            expired;
-        struct LDJSON *current;
+    if (!table) {
+        return NULL;
+    }
 
-        expired = 0;
-        current = NULL;
+    mask = table->capacity - 1;
 
-        if ((expired = isExpired(store, currentItem)) < 0) {
-            goto cleanup;
-        }
+    /* the load factor is at most one half so probing always terminates */
+    for (i = hash & mask;; i = (i + 1) & mask) {
+        struct CacheSlot *slot;
+        const char *      slotKey;
 
-        current = LDJSONRCGet(currentItem->feature);
-        LD_ASSERT(current);
+        slot = &table->slots[i];
 
-        if (expired == 0 && LDi_getFeatureVersionTrusted(current) >=
-                                LDi_getFeatureVersionTrusted(replacement))
-        {
-            success = LDBooleanTrue;
+        if (!(slotKey = LOAD_POINTER(const char *, slot->key))) {
+            return NULL;
+        }
 
-            goto cleanup;
+        if (slot->hash == hash && strcmp(slotKey, key) == 0) {
+            return slot;
         }
     }
+}
 
-    if (!(replacementItem = makeCacheItem(cacheKey, replacement))) {
-        goto cleanup;
+/* expects write lock */
+static void
+retireCacheItem(
+    struct MemoryContext *const context, struct CacheItem *const item)
+{
+    LD_ASSERT(context);
+
+    if (item) {
+        item->retiredNext     = context->retiredItems;
+        context->retiredItems = item;
     }
+}
 
-    replacement = NULL;
+static void
+memoryWriteLock(struct MemoryContext *const context)
+{
+    LD_ASSERT(context);
 
-    HASH_FIND_STR(store->cache->items, allCacheKey, allItems);
+    LDi_mutex_lock(&context->writeLock);
 
-    if (!store->backend) {
-        struct LDJSON *itemDupe;
+    LDi_atomicAdd(&context->generation, 1);
+}
 
-        itemDupe = NULL;
+/* Replaced objects may still be in use by readers that loaded them before
+they were unpublished, so they are freed after a grace period. */
+static void
+memoryWriteUnlock(struct MemoryContext *const context)
+{
+    LD_ASSERT(context);
 
-        if (!LDi_isFeatureDeleted(weakReplacementRef)) {
-            if (!(itemDupe = LDJSONDuplicate(weakReplacementRef))) {
-                goto cleanup;
-            }
-        }
+    LDi_atomicAdd(&context->generation, 1);
 
-        if (allItems) {
-            struct LDJSON *   allDupe;
-            struct CacheItem *allDupeItem;
+    if (context->retiredItems || context->retiredTables ||
+        context->retiredStates)
+    {
+        LDi_epochSynchronize(&context->epoch);
 
-            if (!(allDupe = LDJSONDuplicate(LDJSONRCGet(allItems->feature)))) {
-                goto cleanup;
-            }
+        while (context->retiredItems) {
+            struct CacheItem *next;
 
-            if (itemDupe) {
-                if (!LDObjectSetKey(
-                        allDupe,
-                        LDi_getFeatureKeyTrusted(weakReplacementRef),
-                        itemDupe))
-                {
-                    goto cleanup;
-                }
-            } else {
-                LDObjectDeleteKey(
-                    allDupe, LDi_getFeatureKeyTrusted(weakReplacementRef));
-            }
+            next = context->retiredItems->retiredNext;
+            deleteCacheItem(context->retiredItems);
+            context->retiredItems = next;
+        }
 
-            if (!(allDupeItem = makeCacheItem(allCacheKey, allDupe))) {
-                goto cleanup;
-            }
+        while (context->retiredTables) {
+            struct CacheTable *next;
 
-            deleteAndRemoveCacheItem(&store->cache->items, allItems);
+            next = context->retiredTables->retiredNext;
+            freeCacheTable(context->retiredTables, LDBooleanFalse);
+            context->retiredTables = next;
+        }
 
-            HASH_ADD_KEYPTR(
-                hh,
-                store->cache->items,
-                allDupeItem->key,
-                strlen(allDupeItem->key),
-                allDupeItem);
-        } else if (itemDupe) {
-            struct LDJSON *   singleton;
-            struct CacheItem *singletonItem;
+        while (context->retiredStates) {
+            struct CacheState *next;
 
-            if (!(singleton = LDNewObject())) {
-                goto cleanup;
-            }
+            next = context->retiredStates->retiredNext;
+            freeCacheState(context->retiredStates);
+            context->retiredStates = next;
+        }
+    }
 
-            if (!LDObjectSetKey(
-                    singleton,
-                    LDi_getFeatureKeyTrusted(weakReplacementRef),
-                    itemDupe))
-            {
-                goto cleanup;
-            }
+    LDi_mutex_unlock(&context->writeLock);
+}
 
-            if (!(singletonItem = makeCacheItem(allCacheKey, singleton))) {
-                goto cleanup;
-            }
+/* expects write lock, the key must not already be present */
+static LDBoolean
+cacheStateInsert(
+    struct MemoryContext *const context,
+    struct CacheState *const    state,
+    const enum FeatureKind      kind,
+    const char *const           key,
+    const unsigned int          hash,
+    struct CacheItem *const     item)
+{
+    struct CacheTable *table;
+    struct CacheSlot * slot;
+    char *             keyDupe;
+    unsigned int       mask, i;
 
-            HASH_ADD_KEYPTR(
-                hh,
-                store->cache->items,
-                singletonItem->key,
-                strlen(singletonItem->key),
-                singletonItem);
-        }
-    } else if (allItems) {
-        deleteAndRemoveCacheItem(&store->cache->items, allItems);
-    }
+    LD_ASSERT(context);
+    LD_ASSERT(state);
+    LD_ASSERT(key);
+    LD_ASSERT(item);
 
-    if (currentItem) {
-        deleteAndRemoveCacheItem(&store->cache->items, currentItem);
+    if (!(keyDupe = LDStrDup(key))) {
+        return LDBooleanFalse;
     }
 
-    HASH_ADD_KEYPTR(
-        hh,
-        store->cache->items,
-        replacementItem->key,
-        strlen(replacementItem->key),
-        replacementItem);
+    table = state->tables[kind];
 
-    replacementItem = NULL;
+    if (!table || (table->count + 1) * 2 > table->capacity) {
+        struct CacheTable *grown;
 
-    success = LDBooleanTrue;
+        if (!(grown = makeCacheTable(
+                  table ? table->capacity * 2 : LD_CACHE_TABLE_MIN))) {
+            LDFree(keyDupe);
 
-cleanup:
-    LDFree(allCacheKey);
-    LDFree(cacheKey);
-    LDJSONFree(replacement);
-    deleteCacheItem(replacementItem);
+            return LDBooleanFalse;
+        }
 
-    return success;
-}
+        if (table) {
+            mask = grown->capacity - 1;
 
-/* expects write lock */
-static LDBoolean
-filterAndCacheItems(
-    struct LDStore *const store,
-    const char *const     kind,
-    struct LDJSON *const  features,
-    struct LDJSON **const result)
-{
-    LDBoolean      success;
-    struct LDJSON *filteredItems, *featuresIter, *dupe, *next;
+            for (i = 0; i < table->capacity; i++) {
+                unsigned int j;
 
-    LD_ASSERT(store);
-    LD_ASSERT(kind);
+                if (!table->slots[i].key) {
+                    continue;
+                }
+
+                for (j = table->slots[i].hash & mask; grown->slots[j].key;
+                     j = (j + 1) & mask)
+                    ;
+
+                grown->slots[j] = table->slots[i];
+            }
+
+            grown->count = table->count;
+
+            table->retiredNext     = context->retiredTables;
+            context->retiredTables = table;
+        }
+
+        STORE_POINTER(state->tables[kind], grown);
+
+        table = grown;
+    }
+
+    mask = table->capacity - 1;
+
+    for (i = hash & mask; table->slots[i].key; i = (i + 1) & mask)
+        ;
+
+    slot = &table->slots[i];
+
+    slot->hash = hash;
+    STORE_POINTER(slot->item, item);
+    STORE_POINTER(slot->key, keyDupe);
+
+    table->count++;
+
+    return LDBooleanTrue;
+}
+
+/* expects write lock */
+static LDBoolean
+upsertMemory(
+    struct LDStore *const    store,
+    struct CacheState *const state,
+    const enum FeatureKind   kind,
+    struct LDJSON *          replacement,
+    const LDBoolean          fromBackend)
+{
+    LDBoolean         success;
+    struct CacheItem *currentItem, *replacementItem, *allItems;
+    struct CacheSlot *slot;
+    const char *      key;
+    unsigned int      hash;
+
+    LD_ASSERT(store);
+    LD_ASSERT(store->cache);
+    LD_ASSERT(state);
+    LD_ASSERT(replacement);
+
+    success         = LDBooleanFalse;
+    currentItem     = NULL;
+    replacementItem = NULL;
+
+    key  = LDi_getFeatureKeyTrusted(replacement);
+    hash = hashKey(key);
+
+    if ((slot = cacheTableFind(state->tables[kind], key, hash))) {
+        currentItem = slot->item;
+    }
+
+    if (currentItem) {
+        int            expired;
+        struct LDJSON *current;
+
+        expired = 0;
+        current = NULL;
+
+        if ((expired = isExpired(store, currentItem)) < 0) {
+            goto cleanup;
+        }
+
+        current = LDJSONRCGet(currentItem->feature);
+        LD_ASSERT(current);
+
+        if (expired == 0 && LDi_getFeatureVersionTrusted(current) >=
+                                LDi_getFeatureVersionTrusted(replacement))
+        {
+            /* reading the same version from the backend restarts the TTL
+            without compiling the feature again */
+            if (fromBackend && LDi_getFeatureVersionTrusted(current) ==
+                                   LDi_getFeatureVersionTrusted(replacement))
+            {
+                if (!(replacementItem = copyCacheItem(currentItem))) {
+                    goto cleanup;
+                }
+
+                STORE_POINTER(slot->item, replacementItem);
+                retireCacheItem(store->cache, currentItem);
+
+                replacementItem = NULL;
+            }
+
+            success = LDBooleanTrue;
+
+            goto cleanup;
+        }
+    }
+
+    replacementItem = makeFeatureCacheItem(kind, replacement);
+    replacement     = NULL;
+
+    if (!replacementItem) {
+        goto cleanup;
+    }
+
+    /* the all collection is rebuilt on demand */
+    if ((allItems = state->all[kind])) {
+        STORE_POINTER(state->all[kind], NULL);
+        retireCacheItem(store->cache, allItems);
+    }
+
+    if (slot) {
+        STORE_POINTER(slot->item, replacementItem);
+        retireCacheItem(store->cache, currentItem);
+    } else if (!cacheStateInsert(
+                   store->cache, state, kind, key, hash, replacementItem))
+    {
+        goto cleanup;
+    }
+
+    replacementItem = NULL;
+
+    success = LDBooleanTrue;
+
+cleanup:
+    LDJSONFree(replacement);
+    deleteCacheItem(replacementItem);
+
+    return success;
+}
+
+static LDBoolean
+memoryUpsert(
+    struct LDStore *const  store,
+    const enum FeatureKind kind,
+    struct LDJSON *const   feature)
+{
+    LDBoolean status;
+
+    LD_ASSERT(store);
+    LD_ASSERT(store->cache);
+
+    memoryWriteLock(store->cache);
+    status = upsertMemory(
+        store, store->cache->state, kind, feature, LDBooleanFalse);
+    memoryWriteUnlock(store->cache);
+
+    return status;
+}
+
+/* expects write lock */
+static LDBoolean
+filterAndCacheItems(
+    struct LDStore *const    store,
+    struct CacheState *const state,
+    const enum FeatureKind   kind,
+    struct LDJSON *const     features,
+    const LDBoolean          fromBackend,
+    struct LDJSON **const    result)
+{
+    LDBoolean      success;
+    struct LDJSON *filteredItems, *featuresIter, *dupe, *next;
+
+    LD_ASSERT(store);
+    LD_ASSERT(state);
     LD_ASSERT(features);
     LD_ASSERT(LDJSONGetType(features) == LDObject);
 
@@ -627,7 +1013,12 @@ filterAndCacheItems(
         }
 
         if (!upsertMemory(
-                store, kind, LDCollectionDetachIter(features, featuresIter))) {
+                store,
+                state,
+                kind,
+                LDCollectionDetachIter(features, featuresIter),
+                fromBackend))
+        {
             goto cleanup;
         }
     }
@@ -647,50 +1038,50 @@ cleanup:
     return success;
 }
 
-static void
-memoryCacheFlush(struct MemoryContext *const context)
-{
-    struct CacheItem *item, *itemTmp;
-
-    LD_ASSERT(context);
-
-    item    = NULL;
-    itemTmp = NULL;
-
-    HASH_ITER(hh, context->items, item, itemTmp)
-    {
-        deleteAndRemoveCacheItem(&context->items, item);
-    }
-
-    context->items = NULL;
-}
-
+/* The replacement state is built privately and published at once, so
+readers never observe a partially initialized store. On failure the previous
+contents are kept. */
 static LDBoolean
 memoryInit(struct LDStore *const store, struct LDJSON *const sets)
 {
-    struct LDJSON *iter, *next;
+    struct LDJSON *    iter, *next;
+    struct CacheState *state;
 
     LD_ASSERT(store);
     LD_ASSERT(store->cache);
     LD_ASSERT(sets);
     LD_ASSERT(LDJSONGetType(sets) == LDObject);
 
-    LDi_rwlock_wrlock(&store->cache->lock);
+    if (!(state = makeCacheState())) {
+        LDJSONFree(sets);
 
-    memoryCacheFlush(store->cache);
+        return LDBooleanFalse;
+    }
+
+    memoryWriteLock(store->cache);
 
     for (iter = LDGetIter(sets); iter; iter = next) {
+        enum FeatureKind kind;
+
         next = LDIterNext(iter);
 
+        if (!featureKindFromString(LDIterKey(iter), &kind)) {
+            LD_LOG_1(LD_LOG_WARNING, "unknown feature kind %s", LDIterKey(iter));
+
+            continue;
+        }
+
         if (!filterAndCacheItems(
                 store,
-                LDIterKey(iter),
+                state,
+                kind,
                 LDCollectionDetachIter(sets, iter),
+                LDBooleanFalse,
                 NULL))
         {
-            memoryCacheFlush(store->cache);
+            freeCacheState(state);
 
-            LDi_rwlock_wrunlock(&store->cache->lock);
+            memoryWriteUnlock(store->cache);
 
             LDJSONFree(sets);
 
@@ -698,53 +1089,28 @@ memoryInit(struct LDStore *const store, struct LDJSON *const sets)
         }
     }
 
-    if (!store->backend) {
-        store->cache->initialized = LDBooleanTrue;
-    }
+    store->cache->state->retiredNext = store->cache->retiredStates;
+    store->cache->retiredStates      = store->cache->state;
 
-    LDi_rwlock_wrunlock(&store->cache->lock);
+    STORE_POINTER(store->cache->state, state);
 
-    LDJSONFree(sets);
-
-    return LDBooleanTrue;
-}
-
-static LDBoolean
-memoryGetCollectionItem(
-    struct MemoryContext *const context,
-    const char *const           kind,
-    const char *const           key,
-    struct CacheItem **         result)
-{
-    char *            cacheKey;
-    struct CacheItem *current;
-
-    LD_ASSERT(context);
-    LD_ASSERT(kind);
-    LD_ASSERT(key);
-    LD_ASSERT(result);
-
-    cacheKey = NULL;
-    *result  = NULL;
-
-    if (!(cacheKey = featureStoreCacheKey(kind, key))) {
-        return LDBooleanFalse;
+    if (!store->backend) {
+        LDi_atomicStore(&store->cache->initialized, LDBooleanTrue);
     }
 
-    HASH_FIND_STR(context->items, cacheKey, current);
+    memoryWriteUnlock(store->cache);
 
-    LDFree(cacheKey);
-
-    *result = current;
+    LDJSONFree(sets);
 
     return LDBooleanTrue;
 }
 
-/* -1 error, 0 not expired, 1 expired */
+/* -1 error, 0 not expired, 1 expired, 2 expired but may be served while it
+is refreshed in the background */
 static int
 isExpired(const struct LDStore *const store, const struct CacheItem *const item)
 {
-    double now;
+    double now, age;
 
     LD_ASSERT(store);
     LD_ASSERT(item);
@@ -753,26 +1119,32 @@ isExpired(const struct LDStore *const store, const struct CacheItem *const item)
         return 0;
     }
 
-    if (store->cacheMilliseconds == 0) {
+    if (store->cacheMilliseconds == 0 && store->staleMilliseconds == 0) {
         return 1;
     }
 
-    if (LDi_getMonotonicMilliseconds(&now)) {
-        if ((now - item->updatedOn) > store->cacheMilliseconds) {
-            return 1;
-        } else {
-            return 0;
-        }
-    } else {
+    if (!LDi_getMonotonicMilliseconds(&now)) {
         return -1;
     }
+
+    age = now - item->updatedOn;
+
+    if (store->cacheMilliseconds != 0 && age <= store->cacheMilliseconds) {
+        return 0;
+    } else if (
+        age <= (double)store->cacheMilliseconds + store->staleMilliseconds)
+    {
+        return 2;
+    } else {
+        return 1;
+    }
 }
 
 /* if there is a backend use it to fetch all features */
 static LDBoolean
 tryGetAllBackend(
     struct LDStore *const   store,
-    const char *const       kind,
+    const enum FeatureKind  kind,
     struct LDJSONRC **const result)
 {
     LDBoolean                     success;
@@ -780,11 +1152,10 @@ tryGetAllBackend(
     unsigned int                  rawFeaturesCount, i;
     struct LDJSON *               active, *rawFeatures, *activeDupe;
     struct LDJSONRC *             activeRC;
-    char *                        cacheKey;
     struct CacheItem *            cacheItem;
+    struct CacheState *           state;
 
     LD_ASSERT(store);
-    LD_ASSERT(kind);
     LD_ASSERT(result);
 
     success          = LDBooleanFalse;
@@ -795,7 +1166,6 @@ tryGetAllBackend(
     active           = NULL;
     rawFeatures      = NULL;
     activeRC         = NULL;
-    cacheKey         = NULL;
     cacheItem        = NULL;
     activeDupe       = NULL;
 
@@ -808,7 +1178,10 @@ tryGetAllBackend(
     LD_ASSERT(store->backend->all);
 
     if (!store->backend->all(
-            store->backend->context, kind, &rawFeatureItems, &rawFeaturesCount))
+            store->backend->context,
+            featureKindToString(kind),
+            &rawFeatureItems,
+            &rawFeaturesCount))
     {
         goto cleanup;
     }
@@ -853,35 +1226,36 @@ tryGetAllBackend(
         }
     }
 
-    LDi_rwlock_wrlock(&store->cache->lock);
-    if (!filterAndCacheItems(store, kind, rawFeatures, &active)) {
-        LDi_rwlock_wrunlock(&store->cache->lock);
+    memoryWriteLock(store->cache);
+
+    state = store->cache->state;
+
+    if (!filterAndCacheItems(
+            store, state, kind, rawFeatures, LDBooleanTrue, &active))
+    {
+        memoryWriteUnlock(store->cache);
         rawFeatures = NULL;
         goto cleanup;
     }
     rawFeatures = NULL;
 
-    if (!(cacheKey = featureStoreAllCacheKey(kind))) {
-        goto cleanup;
-    }
-
     if (!(activeDupe = LDJSONDuplicate(active))) {
+        memoryWriteUnlock(store->cache);
         goto cleanup;
     }
 
-    if (!(cacheItem = makeCacheItem(cacheKey, activeDupe))) {
+    cacheItem  = makeCacheItem(activeDupe);
+    activeDupe = NULL;
+
+    if (!cacheItem) {
+        memoryWriteUnlock(store->cache);
         goto cleanup;
     }
-    activeDupe = NULL;
 
-    HASH_ADD_KEYPTR(
-        hh,
-        store->cache->items,
-        cacheItem->key,
-        strlen(cacheItem->key),
-        cacheItem);
+    retireCacheItem(store->cache, state->all[kind]);
+    STORE_POINTER(state->all[kind], cacheItem);
 
-    LDi_rwlock_wrunlock(&store->cache->lock);
+    memoryWriteUnlock(store->cache);
 
     if (!(activeRC = LDJSONRCNew(active))) {
         goto cleanup;
@@ -892,163 +1266,601 @@ tryGetAllBackend(
     success = LDBooleanTrue;
 
 cleanup:
-    LDFree(active);
-    LDFree(rawFeatures);
-    LDFree(cacheKey);
-    LDFree(activeDupe);
+    LDJSONFree(active);
+    LDJSONFree(rawFeatures);
 
     for (i = 0; i < rawFeaturesCount; i++) {
         LDFree(rawFeatureItems[i].buffer);
     }
 
-    LDFree(rawFeatureItems);
+    LDFree(rawFeatureItems);
+
+    return success;
+}
+
+/* Without a backend the all collection is not maintained by writes, it is
+rebuilt from the table by the first read after a change. */
+static LDBoolean
+rebuildAll(
+    struct LDStore *const   store,
+    const enum FeatureKind  kind,
+    struct LDJSONRC **const result)
+{
+    struct CacheState *state;
+    struct CacheTable *table;
+    struct CacheItem * item;
+    struct LDJSON *    all, *dupe;
+    unsigned int       i;
+
+    LD_ASSERT(store);
+    LD_ASSERT(result);
+
+    *result = NULL;
+
+    memoryWriteLock(store->cache);
+
+    state = store->cache->state;
+
+    /* another reader may have rebuilt it first */
+    if (!(item = state->all[kind])) {
+        if (!(all = LDNewObject())) {
+            goto error;
+        }
+
+        if ((table = state->tables[kind])) {
+            for (i = 0; i < table->capacity; i++) {
+                struct CacheSlot *slot;
+
+                slot = &table->slots[i];
+
+                if (!slot->key || slot->item->deleted) {
+                    continue;
+                }
+
+                if (!(dupe = LDJSONDuplicate(
+                          LDJSONRCGet(slot->item->feature)))) {
+                    LDJSONFree(all);
+
+                    goto error;
+                }
+
+                if (!LDObjectSetKey(all, slot->key, dupe)) {
+                    LDJSONFree(all);
+
+                    goto error;
+                }
+            }
+        }
+
+        if (!(item = makeCacheItem(all))) {
+            goto error;
+        }
+
+        STORE_POINTER(state->all[kind], item);
+    }
+
+    LDJSONRCIncrement(item->feature);
+
+    *result = item->feature;
+
+    memoryWriteUnlock(store->cache);
+
+    return LDBooleanTrue;
+
+error:
+    memoryWriteUnlock(store->cache);
+
+    return LDBooleanFalse;
+}
+
+static LDBoolean
+tryGetBackend(
+    struct LDStore *const   store,
+    const enum FeatureKind  kind,
+    const char *const       key,
+    struct LDJSONRC **const result)
+{
+    struct LDStoreCollectionItem collectionItem;
+
+    LD_ASSERT(store);
+    LD_ASSERT(key);
+    LD_ASSERT(result);
+
+    *result = NULL;
+    memset(&collectionItem, 0, sizeof(struct LDStoreCollectionItem));
+
+    if (!store->backend) {
+        return LDBooleanTrue;
+    }
+
+    LD_ASSERT(store->backend->get);
+
+    if (!store->backend->get(
+            store->backend->context,
+            featureKindToString(kind),
+            key,
+            &collectionItem))
+    {
+        return LDBooleanFalse;
+    }
+
+    if (collectionItem.buffer) {
+        struct LDJSON *  deserialized, *dupe;
+        struct LDJSONRC *deserializedRef;
+
+        if (!(deserialized =
+                  LDJSONDeserialize((const char *)collectionItem.buffer))) {
+            LD_LOG(LD_LOG_ERROR, "LDStoreGet failed to deserialize JSON");
+
+            LDFree(collectionItem.buffer);
+
+            return LDBooleanFalse;
+        }
+
+        LDFree(collectionItem.buffer);
+
+        if (!LDi_validateFeature(deserialized)) {
+            LD_LOG(LD_LOG_ERROR, "LDStoreGet invalid feature from backend");
+
+            LDJSONFree(deserialized);
+
+            return LDBooleanFalse;
+        }
+
+        if (LDi_isFeatureDeleted(deserialized)) {
+            return memoryUpsert(store, kind, deserialized);
+        } else {
+            if (!(deserializedRef = makeFeatureRC(kind, deserialized))) {
+                LDJSONFree(deserialized);
+
+                return LDBooleanFalse;
+            }
+
+            if (!(dupe = LDJSONDuplicate(deserialized))) {
+                LDJSONRCDecrement(deserializedRef);
+
+                return LDBooleanFalse;
+            }
+
+            *result = deserializedRef;
+
+            return memoryUpsert(store, kind, dupe);
+        }
+    } else {
+        struct LDJSON *placeholder;
+
+        LD_ASSERT(store->cache);
+
+        if (!(placeholder = LDi_makeDeleted(key, collectionItem.version))) {
+            return LDBooleanFalse;
+        }
+
+        return memoryUpsert(store, kind, placeholder);
+    }
+
+    return LDBooleanFalse;
+}
+
+/* Finds the cached entry of a feature, or of the all collection of a kind
+when `key` is NULL. Expects a read section, the entry is only valid until it
+exits. */
+static struct CacheItem *
+cacheLookup(
+    struct MemoryContext *const context,
+    const enum FeatureKind      kind,
+    const char *const           key)
+{
+    struct CacheState *state;
+    struct CacheSlot * slot;
+
+    LD_ASSERT(context);
+    LD_ASSERT(kind == LD_FLAG || kind == LD_SEGMENT);
+
+    state = LOAD_POINTER(struct CacheState *, context->state);
+
+    if (!key) {
+        return LOAD_POINTER(struct CacheItem *, state->all[kind]);
+    } else if ((slot = cacheTableFind(
+                    LOAD_POINTER(struct CacheTable *, state->tables[kind]),
+                    key,
+                    hashKey(key))))
+    {
+        return LOAD_POINTER(struct CacheItem *, slot->item);
+    }
+
+    return NULL;
+}
+
+/* Reads a cached feature, or the all collection of a kind when `key` is
+NULL. `*found` is false if nothing is cached. Returns the `isExpired` status of
+the entry, expired values past the stale window are only returned when
+`allowExpired` is set. */
+static int
+memoryGet(
+    struct LDStore *const   store,
+    const enum FeatureKind  kind,
+    const char *const       key,
+    const LDBoolean         allowExpired,
+    LDBoolean *const        found,
+    struct LDJSONRC **const result)
+{
+    struct LDEpochGuard guard;
+    struct CacheItem *  item;
+    int                 expired;
+
+    LD_ASSERT(store);
+    LD_ASSERT(store->cache);
+    LD_ASSERT(found);
+    LD_ASSERT(result);
+
+    expired = 0;
+    *found  = LDBooleanFalse;
+    *result = NULL;
+
+    LDi_epochEnter(&store->cache->epoch, &guard);
+
+    if ((item = cacheLookup(store->cache, kind, key))) {
+        *found = LDBooleanTrue;
+
+        expired = isExpired(store, item);
+
+        if ((expired == 0 || expired == 2 || (expired == 1 && allowExpired)) &&
+            !item->deleted)
+        {
+            LDJSONRCIncrement(item->feature);
+
+            *result = item->feature;
+        }
+    }
+
+    LDi_epochExit(&guard);
+
+    return expired;
+}
+
+static void
+releaseFetch(struct InFlightFetch *const fetch)
+{
+    LD_ASSERT(fetch->references > 0);
+
+    if (--fetch->references == 0) {
+        LDFree(fetch->key);
+        LDFree(fetch);
+    }
+}
+
+/* requires fetchLock */
+static struct InFlightFetch *
+findFetch(
+    struct MemoryContext *const context,
+    const enum FeatureKind      kind,
+    const char *const           key)
+{
+    struct InFlightFetch *iter;
+
+    LL_FOREACH(context->fetches, iter)
+    {
+        if (iter->kind == kind &&
+            (key ? iter->key && strcmp(iter->key, key) == 0 : !iter->key))
+        {
+            return iter;
+        }
+    }
+
+    return NULL;
+}
+
+/* requires fetchLock, on allocation failure the fetch is simply not shared */
+static struct InFlightFetch *
+addFetch(
+    struct MemoryContext *const context,
+    const enum FeatureKind      kind,
+    const char *const           key)
+{
+    struct InFlightFetch *fetch;
+
+    fetch = (struct InFlightFetch *)LDAlloc(sizeof(struct InFlightFetch));
+
+    if (!fetch) {
+        return NULL;
+    }
+
+    fetch->kind       = kind;
+    fetch->key        = NULL;
+    fetch->done       = LDBooleanFalse;
+    fetch->success    = LDBooleanFalse;
+    fetch->queued     = LDBooleanFalse;
+    fetch->references = 1;
+
+    if (key && !(fetch->key = LDStrDup(key))) {
+        LDFree(fetch);
+
+        return NULL;
+    }
+
+    LL_PREPEND(context->fetches, fetch);
+
+    return fetch;
+}
+
+/* Returns true if an identical fetch was already in progress, after waiting
+for it to complete and setting `*success` to its status. Otherwise the caller
+must fetch and pass `*fetch` to `fetchComplete`. */
+static LDBoolean
+fetchJoin(
+    struct MemoryContext *const  context,
+    const enum FeatureKind       kind,
+    const char *const            key,
+    struct InFlightFetch **const fetch,
+    LDBoolean *const             success)
+{
+    struct InFlightFetch *iter;
+
+    LD_ASSERT(context);
+    LD_ASSERT(fetch);
+    LD_ASSERT(success);
+
+    *fetch = NULL;
+
+    LDi_mutex_lock(&context->fetchLock);
+
+    if ((iter = findFetch(context, kind, key))) {
+        iter->references++;
+
+        while (!iter->done) {
+            LDi_cond_wait(&context->fetchDone, &context->fetchLock, 1000);
+        }
+
+        *success = iter->success;
+
+        releaseFetch(iter);
+
+        LDi_mutex_unlock(&context->fetchLock);
+
+        return LDBooleanTrue;
+    }
+
+    *fetch = addFetch(context, kind, key);
+
+    LDi_mutex_unlock(&context->fetchLock);
+
+    return LDBooleanFalse;
+}
+
+static void
+fetchComplete(
+    struct MemoryContext *const context,
+    struct InFlightFetch *const fetch,
+    const LDBoolean             success)
+{
+    LD_ASSERT(context);
+
+    if (fetch) {
+        LDi_mutex_lock(&context->fetchLock);
+
+        LL_DELETE(context->fetches, fetch);
+
+        fetch->done    = LDBooleanTrue;
+        fetch->success = success;
+
+        LDi_cond_signal(&context->fetchDone);
+
+        releaseFetch(fetch);
 
-    return success;
+        LDi_mutex_unlock(&context->fetchLock);
+    }
 }
 
+/* Fetches a feature, or the all collection of a kind when `key` is NULL, from
+the backend. Only one fetch per item is in flight at a time. */
 static LDBoolean
-tryGetBackend(
+fetchBackend(
     struct LDStore *const   store,
-    const char *const       kind,
+    const enum FeatureKind  kind,
     const char *const       key,
     struct LDJSONRC **const result)
 {
-    struct LDStoreCollectionItem collectionItem;
-    LDBoolean status;
+    struct InFlightFetch *fetch;
+    LDBoolean             success, found;
 
     LD_ASSERT(store);
-    LD_ASSERT(kind);
-    LD_ASSERT(key);
     LD_ASSERT(result);
 
     *result = NULL;
-    memset(&collectionItem, 0, sizeof(struct LDStoreCollectionItem));
 
-    if (!store->backend) {
-        return LDBooleanTrue;
-    }
+    if (fetchJoin(store->cache, kind, key, &fetch, &success)) {
+        /* the other fetch refreshed the cache, which may already be expired
+        again for short TTLs */
+        if (success &&
+            memoryGet(store, kind, key, LDBooleanTrue, &found, result) < 0) {
+            return LDBooleanFalse;
+        }
 
-    LD_ASSERT(store->backend->get);
+        return success;
+    }
 
-    if (!store->backend->get(
-            store->backend->context, kind, key, &collectionItem)) {
-        return LDBooleanFalse;
+    if (key) {
+        success = tryGetBackend(store, kind, key, result);
+    } else {
+        success = tryGetAllBackend(store, kind, result);
     }
 
-    if (collectionItem.buffer) {
-        struct LDJSON *  deserialized, *dupe;
-        struct LDJSONRC *deserializedRef;
+    fetchComplete(store->cache, fetch, success);
 
-        if (!(deserialized =
-                  LDJSONDeserialize((const char *)collectionItem.buffer))) {
-            LD_LOG(LD_LOG_ERROR, "LDStoreGet failed to deserialize JSON");
+    return success;
+}
 
-            LDFree(collectionItem.buffer);
+/* Queues a background refresh of an entry that was served stale, unless a
+fetch of it is already in flight. */
+static void
+scheduleRefresh(
+    struct LDStore *const  store,
+    const enum FeatureKind kind,
+    const char *const      key)
+{
+    struct MemoryContext *context;
+    struct InFlightFetch *fetch;
 
-            return LDBooleanFalse;
-        }
+    LD_ASSERT(store);
 
-        LDFree(collectionItem.buffer);
+    context = store->cache;
 
-        if (!LDi_validateFeature(deserialized)) {
-            LD_LOG(LD_LOG_ERROR, "LDStoreGet invalid feature from backend");
+    LDi_atomicAdd(&context->staleServes, 1);
 
-            LDJSONFree(deserialized);
+    LDi_mutex_lock(&context->fetchLock);
 
-            return LDBooleanFalse;
+    if (context->refresherRunning && !findFetch(context, kind, key)) {
+        if ((fetch = addFetch(context, kind, key))) {
+            fetch->queued = LDBooleanTrue;
+
+            LDi_cond_signal(&context->refreshQueued);
         }
+    }
 
-        if (LDi_isFeatureDeleted(deserialized)) {
-            LDi_rwlock_wrlock(&store->cache->lock);
-            status = upsertMemory(store, kind, deserialized);
-            LDi_rwlock_wrunlock(&store->cache->lock);
+    LDi_mutex_unlock(&context->fetchLock);
+}
 
-            return status;
-        } else {
-            if (!(deserializedRef = LDJSONRCNew(deserialized))) {
-                LDJSONFree(deserialized);
+/* Performs queued refreshes. Readers that find an entry past the stale window
+join the queued fetch instead of issuing their own. */
+static THREAD_RETURN
+refresherThread(void *const argument)
+{
+    struct LDStore *      store;
+    struct MemoryContext *context;
+    struct InFlightFetch *fetch, *tmp;
+    struct LDJSONRC *     result;
+    LDBoolean             success;
 
-                return LDBooleanFalse;
-            }
+    LD_ASSERT(argument);
 
-            if (!(dupe = LDJSONDuplicate(deserialized))) {
-                LDJSONRCDecrement(deserializedRef);
+    store   = (struct LDStore *)argument;
+    context = store->cache;
 
-                return LDBooleanFalse;
+    LDi_mutex_lock(&context->fetchLock);
+
+    while (!context->refresherStop) {
+        LL_FOREACH(context->fetches, fetch)
+        {
+            if (fetch->queued) {
+                break;
             }
+        }
 
-            *result = deserializedRef;
+        if (!fetch) {
+            LDi_cond_wait(&context->refreshQueued, &context->fetchLock, 1000);
+
+            continue;
+        }
+
+        fetch->queued = LDBooleanFalse;
 
-            LDi_rwlock_wrlock(&store->cache->lock);
-            status = upsertMemory(store, kind, dupe);
-            LDi_rwlock_wrunlock(&store->cache->lock);
+        LDi_mutex_unlock(&context->fetchLock);
 
-            return status;
+        result = NULL;
+
+        if (fetch->key) {
+            success = tryGetBackend(store, fetch->kind, fetch->key, &result);
+        } else {
+            success = tryGetAllBackend(store, fetch->kind, &result);
         }
-    } else {
-        struct LDJSON *placeholder;
 
-        LD_ASSERT(store->cache);
+        LDJSONRCDecrement(result);
 
-        if (!(placeholder = LDi_makeDeleted(key, collectionItem.version))) {
-            return LDBooleanFalse;
+        if (success) {
+            LDi_atomicAdd(&context->refreshes, 1);
+        } else {
+            LD_LOG(LD_LOG_WARNING, "background store refresh failed");
+
+            LDi_atomicAdd(&context->refreshFailures, 1);
         }
 
-        LDi_rwlock_wrlock(&store->cache->lock);
-        status = upsertMemory(store, kind, placeholder);
-        LDi_rwlock_wrunlock(&store->cache->lock);
+        fetchComplete(context, fetch, success);
 
-        return status;
+        LDi_mutex_lock(&context->fetchLock);
     }
 
-    return LDBooleanFalse;
-}
-
-static LDBoolean
-memoryAllCollectionItem(
-    struct MemoryContext *const context,
-    const char *const           kind,
-    struct CacheItem **const    result)
-{
-    char *            key;
-    struct CacheItem *filtered;
+    /* release anyone waiting on a refresh that will not happen */
+    LL_FOREACH_SAFE(context->fetches, fetch, tmp)
+    {
+        if (fetch->queued) {
+            LL_DELETE(context->fetches, fetch);
 
-    LD_ASSERT(context);
-    LD_ASSERT(kind);
-    LD_ASSERT(result);
+            fetch->done = LDBooleanTrue;
 
-    if (!(key = featureStoreAllCacheKey(kind))) {
-        return LDBooleanFalse;
+            releaseFetch(fetch);
+        }
     }
 
-    HASH_FIND_STR(context->items, key, filtered);
+    LDi_cond_signal(&context->fetchDone);
 
-    LDFree(key);
+    LDi_mutex_unlock(&context->fetchLock);
 
-    *result = filtered;
+    return THREAD_RETURN_DEFAULT;
+}
 
-    return LDBooleanTrue;
+void
+LDStoreGetCacheStats(
+    struct LDStore *const store, struct LDStoreCacheStats *const stats)
+{
+    LD_ASSERT(store);
+    LD_ASSERT(stats);
+
+    stats->staleServes     = LDi_atomicLoad(&store->cache->staleServes);
+    stats->refreshes       = LDi_atomicLoad(&store->cache->refreshes);
+    stats->refreshFailures = LDi_atomicLoad(&store->cache->refreshFailures);
+}
+
+unsigned long
+LDStoreGetGeneration(struct LDStore *const store)
+{
+    LD_ASSERT(store);
+
+    return (unsigned long)LDi_atomicLoad(&store->cache->generation);
 }
 
 /* used for testing */
 void
 LDi_expireAll(struct LDStore *const store)
 {
-    struct CacheItem *item, *itemTmp;
+    struct CacheState *state;
+    unsigned int       i, j;
 
     LD_ASSERT(store);
 
-    item    = NULL;
-    itemTmp = NULL;
+    memoryWriteLock(store->cache);
 
-    LD_ASSERT(LDi_rwlock_wrlock(&store->cache->lock));
+    state = store->cache->state;
 
-    HASH_ITER(hh, store->cache->items, item, itemTmp)
-    {
-        item->updatedOn = 0;
+    for (i = 0; i < LD_FEATURE_KINDS; i++) {
+        struct CacheTable *table;
+        struct CacheItem * expired;
+
+        if ((table = state->tables[i])) {
+            for (j = 0; j < table->capacity; j++) {
+                if (table->slots[j].key) {
+                    expired = makeExpiredCopy(table->slots[j].item);
+                    LD_ASSERT(expired);
+
+                    retireCacheItem(store->cache, table->slots[j].item);
+                    STORE_POINTER(table->slots[j].item, expired);
+                }
+            }
+        }
+
+        if (state->all[i]) {
+            expired = makeExpiredCopy(state->all[i]);
+            LD_ASSERT(expired);
+
+            retireCacheItem(store->cache, state->all[i]);
+            STORE_POINTER(state->all[i], expired);
+        }
+    }
+
+    if (store->cache->initChecked) {
+        store->cache->initChecked->updatedOn = 0;
     }
 
-    LD_ASSERT(LDi_rwlock_wrunlock(&store->cache->lock));
+    memoryWriteUnlock(store->cache);
 }
 
 static void
@@ -1056,9 +1868,28 @@ memoryDestructor(struct MemoryContext *const context)
 {
     LD_ASSERT(context);
 
-    memoryCacheFlush(context);
+    LDi_mutex_lock(&context->fetchLock);
+    context->refresherStop = LDBooleanTrue;
+    LDi_cond_signal(&context->refreshQueued);
+    LDi_mutex_unlock(&context->fetchLock);
+
+    if (context->refresherRunning) {
+        LDi_thread_join(&context->refresher);
+    }
+
+    /* releases anything still pending reclamation */
+    memoryWriteLock(context);
+    memoryWriteUnlock(context);
 
-    LDi_rwlock_destroy(&context->lock);
+    freeCacheState(context->state);
+    deleteCacheItem(context->initChecked);
+
+    LD_ASSERT(!context->fetches);
+
+    LDi_mutex_destroy(&context->writeLock);
+    LDi_mutex_destroy(&context->fetchLock);
+    LDi_cond_destroy(&context->fetchDone);
+    LDi_cond_destroy(&context->refreshQueued);
 
     LDFree(context);
 }
@@ -1083,14 +1914,35 @@ LDStoreNew(const struct LDConfig *const config)
         goto error;
     }
 
-    LDi_rwlock_init(&cache->lock);
+    memset(cache, 0, sizeof(struct MemoryContext));
+
+    if (!(cache->state = makeCacheState())) {
+        goto error;
+    }
+
+    LDi_epochInit(&cache->epoch);
+    LDi_mutex_init(&cache->writeLock);
+    LDi_mutex_init(&cache->fetchLock);
+    LDi_cond_init(&cache->fetchDone);
+    LDi_cond_init(&cache->refreshQueued);
 
     cache->initialized = LDBooleanFalse;
-    cache->items       = NULL;
 
     store->cache             = cache;
     store->backend           = config->storeBackend;
     store->cacheMilliseconds = config->storeCacheMilliseconds;
+    store->staleMilliseconds = 0;
+
+    if (store->backend && config->storeMaxStaleMilliseconds > 0) {
+        if (LDi_thread_create(&cache->refresher, refresherThread, store)) {
+            cache->refresherRunning  = LDBooleanTrue;
+            store->staleMilliseconds = config->storeMaxStaleMilliseconds;
+        } else {
+            LD_LOG(
+                LD_LOG_ERROR,
+                "failed to start store refresher, stale entries disabled");
+        }
+    }
 
     return store;
 
@@ -1240,7 +2092,8 @@ LDStoreGet(
     const char *const       key,
     struct LDJSONRC **const result)
 {
-    struct CacheItem *item;
+    LDBoolean found;
+    int       expired;
 
     LD_LOG(LD_LOG_TRACE, "LDStoreGet");
 
@@ -1249,58 +2102,169 @@ LDStoreGet(
     LD_ASSERT(key);
     LD_ASSERT(result);
 
-    item    = NULL;
+    expired = memoryGet(store, kind, key, LDBooleanFalse, &found, result);
+
+    if (expired < 0) {
+        return LDBooleanFalse;
+    } else if (found && expired == 0) {
+        return LDBooleanTrue;
+    } else if (found && expired == 2) {
+        scheduleRefresh(store, kind, key);
+
+        return LDBooleanTrue;
+    }
+
+    /* When there is no backend a flag will never be expired */
+    if (store->backend) {
+        return fetchBackend(store, kind, key, result);
+    } else {
+        return LDBooleanTrue;
+    }
+}
+
+void
+LDStoreReadBegin(
+    struct LDStore *const store, struct LDEpochGuard *const guard)
+{
+    LD_ASSERT(store);
+    LD_ASSERT(store->cache);
+    LD_ASSERT(guard);
+
+    /* a read may have to fetch from the backend, which writes to the cache
+    and so cannot happen inside a read section */
+    if (store->backend) {
+        guard->readers = NULL;
+    } else {
+        LDi_epochEnter(&store->cache->epoch, guard);
+    }
+}
+
+void
+LDStoreReadEnd(struct LDStore *const store, struct LDEpochGuard *const guard)
+{
+    LD_ASSERT(store);
+    LD_ASSERT(guard);
+
+    if (!store->backend) {
+        LDi_epochExit(guard);
+    }
+}
+
+LDBoolean
+LDStoreGetBorrowed(
+    struct LDStore *const   store,
+    const enum FeatureKind  kind,
+    const char *const       key,
+    struct LDJSONRC **const result)
+{
+    struct CacheItem *item;
+
+    LD_ASSERT(store);
+    LD_ASSERT(store->cache);
+    LD_ASSERT(key);
+    LD_ASSERT(result);
+
+    if (store->backend) {
+        return LDStoreGet(store, kind, key, result);
+    }
+
+    /* without a backend entries never expire, and the caller's read section
+    keeps the entry alive */
     *result = NULL;
 
-    LDi_rwlock_rdlock(&store->cache->lock);
+    if ((item = cacheLookup(store->cache, kind, key)) && !item->deleted) {
+        *result = item->feature;
+    }
 
-    if (!memoryGetCollectionItem(
-            store->cache, featureKindToString(kind), key, &item))
-    {
-        LDi_rwlock_rdunlock(&store->cache->lock);
+    return LDBooleanTrue;
+}
 
-        return LDBooleanFalse;
+void
+LDStoreReleaseBorrowed(struct LDStore *const store, struct LDJSONRC *const rc)
+{
+    LD_ASSERT(store);
+
+    if (store->backend) {
+        LDJSONRCDecrement(rc);
     }
+}
 
-    if (item) {
-        int expired;
+LDBoolean
+LDStoreGetMany(
+    struct LDStore *const    store,
+    const enum FeatureKind   kind,
+    const char *const *const keys,
+    const unsigned int       count,
+    struct LDJSONRC **const  results)
+{
+    struct LDEpochGuard guard;
+    struct CacheState * state;
+    struct CacheTable * table;
+    unsigned int        i;
 
-        expired = isExpired(store, item);
+    LD_LOG(LD_LOG_TRACE, "LDStoreGetMany");
 
-        if (expired < 0) {
-            LDi_rwlock_rdunlock(&store->cache->lock);
+    LD_ASSERT(store);
+    LD_ASSERT(store->cache);
+    LD_ASSERT(keys);
+    LD_ASSERT(results);
+    LD_ASSERT(kind == LD_FLAG || kind == LD_SEGMENT);
 
-            return LDBooleanFalse;
-        } else if (expired == 0) {
-            if (LDi_isFeatureDeleted(LDJSONRCGet(item->feature))) {
-                LDi_rwlock_rdunlock(&store->cache->lock);
+    LDi_epochEnter(&store->cache->epoch, &guard);
 
-                return LDBooleanTrue;
-            } else {
-                LDJSONRCIncrement(item->feature);
+    state = LOAD_POINTER(struct CacheState *, store->cache->state);
+    table = LOAD_POINTER(struct CacheTable *, state->tables[kind]);
 
-                *result = item->feature;
+    for (i = 0; i < count; i++) {
+        struct CacheSlot *slot;
+        struct CacheItem *item;
+        int               expired;
 
-                LDi_rwlock_rdunlock(&store->cache->lock);
+        LD_ASSERT(keys[i]);
 
-                return LDBooleanTrue;
-            }
-        } else if (expired > 0) {
-            LDi_rwlock_rdunlock(&store->cache->lock);
-            /* When there is no backend a flag will never be expired */
-            return tryGetBackend(store, featureKindToString(kind), key, result);
+        results[i] = NULL;
+
+        if (!(slot = cacheTableFind(table, keys[i], hashKey(keys[i]))) ||
+            !(item = LOAD_POINTER(struct CacheItem *, slot->item)))
+        {
+            continue;
         }
-    } else {
-        LDi_rwlock_rdunlock(&store->cache->lock);
 
-        if (store->backend) {
-            return tryGetBackend(store, featureKindToString(kind), key, result);
-        } else {
-            return LDBooleanTrue;
+        expired = isExpired(store, item);
+
+        if ((expired == 0 || expired == 2) && !item->deleted) {
+            LDJSONRCIncrement(item->feature);
+
+            results[i] = item->feature;
+        }
+
+        if (expired == 2) {
+            scheduleRefresh(store, kind, keys[i]);
         }
     }
 
-    return LDBooleanFalse;
+    LDi_epochExit(&guard);
+
+    /* without a backend the cache is authoritative, otherwise misses and
+    expired entries are resolved one at a time */
+    if (store->backend) {
+        for (i = 0; i < count; i++) {
+            if (!results[i] && !LDStoreGet(store, kind, keys[i], &results[i]))
+            {
+                unsigned int j;
+
+                for (j = 0; j < count; j++) {
+                    LDJSONRCDecrement(results[j]);
+
+                    results[j] = NULL;
+                }
+
+                return LDBooleanFalse;
+            }
+        }
+    }
+
+    return LDBooleanTrue;
 }
 
 LDBoolean
@@ -1309,7 +2273,8 @@ LDStoreAll(
     const enum FeatureKind  kind,
     struct LDJSONRC **const result)
 {
-    struct CacheItem *item;
+    LDBoolean found;
+    int       expired;
 
     LD_LOG(LD_LOG_TRACE, "LDStoreAll");
 
@@ -1317,50 +2282,52 @@ LDStoreAll(
     LD_ASSERT(store->cache);
     LD_ASSERT(result);
 
-    item    = NULL;
-    *result = NULL;
-
-    LDi_rwlock_rdlock(&store->cache->lock);
-
-    if (!memoryAllCollectionItem(
-            store->cache, featureKindToString(kind), &item)) {
-        LDi_rwlock_rdunlock(&store->cache->lock);
+    expired = memoryGet(store, kind, NULL, LDBooleanFalse, &found, result);
 
+    if (expired < 0) {
         return LDBooleanFalse;
+    } else if (found && expired == 0) {
+        return LDBooleanTrue;
+    } else if (found && expired == 2) {
+        scheduleRefresh(store, kind, NULL);
+
+        return LDBooleanTrue;
     }
 
-    if (item) {
-        int expired;
+    if (store->backend) {
+        return fetchBackend(store, kind, NULL, result);
+    } else {
+        return rebuildAll(store, kind, result);
+    }
+}
 
-        expired = isExpired(store, item);
+LDBoolean
+LDStoreRefresh(struct LDStore *const store)
+{
+    struct LDJSONRC *result;
+    unsigned int     kind;
+    LDBoolean        success;
 
-        if (expired < 0) {
-            LDi_rwlock_rdunlock(&store->cache->lock);
+    LD_LOG(LD_LOG_TRACE, "LDStoreRefresh");
 
-            return LDBooleanFalse;
-        } else if (expired == 0) {
-            LDJSONRCIncrement(item->feature);
+    LD_ASSERT(store);
+    LD_ASSERT(store->cache);
 
-            *result = item->feature;
+    if (!store->backend) {
+        return LDBooleanTrue;
+    }
 
-            LDi_rwlock_rdunlock(&store->cache->lock);
+    success = LDBooleanTrue;
 
-            return LDBooleanTrue;
-        } else if (expired > 0) {
-            LDi_rwlock_rdunlock(&store->cache->lock);
-            /* When there is no backend a flag will never be expired */
-            return tryGetAllBackend(store, featureKindToString(kind), result);
+    for (kind = 0; kind < LD_FEATURE_KINDS; kind++) {
+        if (fetchBackend(store, (enum FeatureKind)kind, NULL, &result)) {
+            LDJSONRCDecrement(result);
+        } else {
+            success = LDBooleanFalse;
         }
-    } else {
-        LDi_rwlock_rdunlock(&store->cache->lock);
-
-        return tryGetAllBackend(store, featureKindToString(kind), result);
     }
 
-    /* work around invalid warning, execution should never get here  */
-    LD_ASSERT(LDBooleanFalse);
-
-    return LDBooleanFalse;
+    return success;
 }
 
 LDBoolean
@@ -1370,7 +2337,6 @@ LDStoreRemove(
     const char *const      key,
     const unsigned int     version)
 {
-    LDBoolean      status;
     struct LDJSON *placeholder;
 
     LD_LOG(LD_LOG_TRACE, "LDStoreRemove");
@@ -1378,7 +2344,6 @@ LDStoreRemove(
     LD_ASSERT(store);
     LD_ASSERT(key);
 
-    status      = LDBooleanFalse;
     placeholder = NULL;
 
     if (store->backend) {
@@ -1401,11 +2366,7 @@ LDStoreRemove(
         return LDBooleanFalse;
     }
 
-    LDi_rwlock_wrlock(&store->cache->lock);
-    status = upsertMemory(store, featureKindToString(kind), placeholder);
-    LDi_rwlock_wrunlock(&store->cache->lock);
-
-    return status;
+    return memoryUpsert(store, kind, placeholder);
 }
 
 LDBoolean
@@ -1414,8 +2375,6 @@ LDStoreUpsert(
     const enum FeatureKind kind,
     struct LDJSON *const   feature)
 {
-    LDBoolean status;
-
     LD_ASSERT(store);
     LD_ASSERT(feature);
 
@@ -1464,11 +2423,7 @@ LDStoreUpsert(
         }
     }
 
-    LDi_rwlock_wrlock(&store->cache->lock);
-    status = upsertMemory(store, featureKindToString(kind), feature);
-    LDi_rwlock_wrunlock(&store->cache->lock);
-
-    return status;
+    return memoryUpsert(store, kind, feature);
 }
 
 LDBoolean
@@ -1481,50 +2436,43 @@ LDStoreInitialized(struct LDStore *const store)
 
     LD_LOG(LD_LOG_TRACE, "LDStoreInitialized");
 
-    LDi_rwlock_rdlock(&store->cache->lock);
-    isInitialized = store->cache->initialized;
+    isInitialized = LDi_atomicLoad(&store->cache->initialized) != 0;
 
     if (isInitialized || !store->backend) {
-        LDi_rwlock_rdunlock(&store->cache->lock);
-
         return isInitialized;
     }
 
-    HASH_FIND_STR(store->cache->items, INIT_CHECKED_KEY, item);
+    memoryWriteLock(store->cache);
 
-    if (item) {
+    if ((item = store->cache->initChecked)) {
         int expired = isExpired(store, item);
 
-        if (expired < 0) {
-            LDi_rwlock_rdunlock(&store->cache->lock);
+        if (expired <= 0) {
+            memoryWriteUnlock(store->cache);
 
             return LDBooleanFalse;
-        } else if (expired == 0) {
-            LDi_rwlock_rdunlock(&store->cache->lock);
-
-            return LDBooleanFalse;
-        } else if (expired > 0) {
-            deleteAndRemoveCacheItem(&store->cache->items, item);
         }
+
+        store->cache->initChecked = NULL;
+
+        deleteCacheItem(item);
     }
 
-    LDi_rwlock_rdunlock(&store->cache->lock);
+    memoryWriteUnlock(store->cache);
 
     isInitialized = store->backend->initialized(store->backend->context);
 
     if (isInitialized) {
-        LDi_rwlock_wrlock(&store->cache->lock);
-        store->cache->initialized = LDBooleanTrue;
-        LDi_rwlock_wrunlock(&store->cache->lock);
+        LDi_atomicStore(&store->cache->initialized, LDBooleanTrue);
     } else {
-        if (!(item = makeCacheItem(INIT_CHECKED_KEY, NULL))) {
+        if (!(item = makeCacheItem(NULL))) {
             return LDBooleanFalse;
         }
 
-        LDi_rwlock_wrlock(&store->cache->lock);
-        HASH_ADD_KEYPTR(
-            hh, store->cache->items, item->key, strlen(item->key), item);
-        LDi_rwlock_wrunlock(&store->cache->lock);
+        memoryWriteLock(store->cache);
+        deleteCacheItem(store->cache->initChecked);
+        store->cache->initChecked = item;
+        memoryWriteUnlock(store->cache);
     }
 
     return isInitialized;
@@ -3,6 +3,7 @@
 #include <launchdarkly/api.h>
 
 #include "config.h"
+#include "epoch.h"
 
 /*******************************************************************************
  * @name Reference counted wrapper for JSON
@@ -24,6 +25,17 @@ LDJSONRCDecrement(struct LDJSONRC *const rc);
 struct LDJSON *
 LDJSONRCGet(struct LDJSONRC *const rc);
 
+struct LDFlag;
+struct LDSegment;
+
+/** @brief Get the compiled form of a flag, NULL if `rc` is not a flag */
+const struct LDFlag *
+LDJSONRCGetFlag(struct LDJSONRC *const rc);
+
+/** @brief Get the compiled form of a segment, NULL if `rc` is not a segment */
+const struct LDSegment *
+LDJSONRCGetSegment(struct LDJSONRC *const rc);
+
 /*@}*/
 
 /* **** Internal Store Types *** */
@@ -56,6 +68,19 @@ LDi_getFeatureVersionTrusted(const struct LDJSON *const feature);
 void
 LDi_expireAll(struct LDStore *const store);
 
+/** @brief Read the backend cache counters, see
+ * `LDClientGetStoreCacheStats` */
+void
+LDStoreGetCacheStats(
+    struct LDStore *const store, struct LDStoreCacheStats *const stats);
+
+/** @brief A counter advanced by every change to the cached data. It is odd
+ * while a change is in progress. Anything derived from the store is
+ * consistent if the generation was even before reading it and unchanged
+ * after. */
+unsigned long
+LDStoreGetGeneration(struct LDStore *const store);
+
 /*******************************************************************************
  * @name Store convenience functions
  * Allows treating `LDStore` as more of an object
@@ -83,6 +108,47 @@ LDStoreGet(
     const char *const       key,
     struct LDJSONRC **const result);
 
+/** @brief Start a read section for `LDStoreGetBorrowed`.
+ *
+ * Sections must be short, writers wait for every section that was active when
+ * they replaced a feature. Nothing may write to the store inside a section. */
+void
+LDStoreReadBegin(
+    struct LDStore *const store, struct LDEpochGuard *const guard);
+
+/** @brief End a read section, borrowed features are invalid afterwards. */
+void
+LDStoreReadEnd(struct LDStore *const store, struct LDEpochGuard *const guard);
+
+/** @brief `LDStoreGet` inside a read section.
+ *
+ * Cached features are returned without a reference, so reads of a hot feature
+ * do not write to memory shared with other threads. The result must be passed
+ * to `LDStoreReleaseBorrowed` before the section ends, and must be
+ * referenced with `LDJSONRCIncrement` if it is used after that. */
+LDBoolean
+LDStoreGetBorrowed(
+    struct LDStore *const   store,
+    const enum FeatureKind  kind,
+    const char *const       key,
+    struct LDJSONRC **const result);
+
+/** @brief Release a feature from `LDStoreGetBorrowed`, `rc` may be NULL. */
+void
+LDStoreReleaseBorrowed(struct LDStore *const store, struct LDJSONRC *const rc);
+
+/** @brief `LDStoreGet` for several keys, read from one view of the cache.
+ *
+ * Entries that must be fetched from the backend are fetched individually
+ * afterwards. On failure no references are held in `results`. */
+LDBoolean
+LDStoreGetMany(
+    struct LDStore *const    store,
+    const enum FeatureKind   kind,
+    const char *const *const keys,
+    const unsigned int       count,
+    struct LDJSONRC **const  results);
+
 /** @brief A convenience wrapper around `store->all`. */
 LDBoolean
 LDStoreAll(
@@ -90,6 +156,11 @@ LDStoreAll(
     const enum FeatureKind  kind,
     struct LDJSONRC **const result);
 
+/** @brief Reload every collection from the backend, restarting the cache TTL
+ * of the items it contains. Does nothing without a backend. */
+LDBoolean
+LDStoreRefresh(struct LDStore *const store);
+
 /** @brief A convenience wrapper around `store->remove`. */
 LDBoolean
 LDStoreRemove(
@@ -0,0 +1,550 @@
+#include <string.h>
+
+#include <launchdarkly/api.h>
+
+#include "assertion.h"
+#include "json_writer.h"
+#include "summary.h"
+#include "utility.h"
+
+#define FNV_OFFSET_BASIS 2166136261UL
+#define FNV_PRIME 16777619UL
+
+static unsigned long
+hashBytes(
+    unsigned long hash, const unsigned char *const bytes, const size_t length)
+{
+    size_t i;
+
+    for (i = 0; i < length; i++) {
+        hash = ((hash ^ bytes[i]) * FNV_PRIME) & 0xFFFFFFFFUL;
+    }
+
+    return hash;
+}
+
+static unsigned long
+hashCounter(
+    const unsigned int        flag,
+    const unsigned int *const variation,
+    const double *const       version)
+{
+    unsigned long hash;
+    unsigned int  number;
+    double        real;
+
+    hash = hashBytes(
+        FNV_OFFSET_BASIS, (const unsigned char *)&flag, sizeof(flag));
+
+    number = variation ? *variation + 1 : 0;
+    hash   = hashBytes(hash, (const unsigned char *)&number, sizeof(number));
+
+    if (version) {
+        /* 0.0 and -0.0 compare equal so they must hash the same */
+        real = *version == 0 ? 0 : *version;
+        hash = hashBytes(hash, (const unsigned char *)&real, sizeof(real));
+    }
+
+    return hash;
+}
+
+static LDBoolean
+counterMatches(
+    const struct LDSummaryCounter *const counter,
+    const unsigned int                   flag,
+    const unsigned int *const            variation,
+    const double *const                  version)
+{
+    if (counter->flag != flag) {
+        return LDBooleanFalse;
+    }
+
+    if (variation ? !counter->hasVariation || counter->variation != *variation
+                  : counter->hasVariation)
+    {
+        return LDBooleanFalse;
+    }
+
+    if (version ? !counter->hasVersion || counter->version != *version
+                : counter->hasVersion)
+    {
+        return LDBooleanFalse;
+    }
+
+    return LDBooleanTrue;
+}
+
+static void
+insertSlot(
+    unsigned int *const slots,
+    const unsigned int  slotCount,
+    const unsigned long hash,
+    const unsigned int  index)
+{
+    unsigned int i;
+
+    for (i = hash & (slotCount - 1); slots[i]; i = (i + 1) & (slotCount - 1))
+        ;
+
+    slots[i] = index + 1;
+}
+
+/* Doubles the slots of a table, and its entries which fill at most half of
+them. Entries keep their indices. */
+static LDBoolean
+growTable(
+    void **const         entries,
+    const size_t         entrySize,
+    unsigned int **const slots,
+    unsigned int *const  slotCount)
+{
+    unsigned int  count;
+    void *        grownEntries;
+    unsigned int *grownSlots;
+
+    count = *slotCount ? *slotCount * 2 : 16;
+
+    if (!(grownEntries = LDRealloc(*entries, entrySize * (count / 2)))) {
+        return LDBooleanFalse;
+    }
+
+    *entries = grownEntries;
+
+    if (!(grownSlots = (unsigned int *)LDAlloc(sizeof(unsigned int) * count))) {
+        return LDBooleanFalse;
+    }
+
+    memset(grownSlots, 0, sizeof(unsigned int) * count);
+
+    LDFree(*slots);
+
+    *slots     = grownSlots;
+    *slotCount = count;
+
+    return LDBooleanTrue;
+}
+
+static LDBoolean
+growFlags(struct LDSummary *const summary)
+{
+    unsigned int i;
+
+    if (!growTable(
+            (void **)&summary->flags,
+            sizeof(struct LDSummaryFlag),
+            &summary->flagSlots,
+            &summary->flagSlotCount))
+    {
+        return LDBooleanFalse;
+    }
+
+    for (i = 0; i < summary->flagCount; i++) {
+        insertSlot(
+            summary->flagSlots,
+            summary->flagSlotCount,
+            summary->flags[i].hash,
+            i);
+    }
+
+    return LDBooleanTrue;
+}
+
+static LDBoolean
+growCounters(struct LDSummary *const summary)
+{
+    unsigned int i;
+
+    if (!growTable(
+            (void **)&summary->counters,
+            sizeof(struct LDSummaryCounter),
+            &summary->counterSlots,
+            &summary->counterSlotCount))
+    {
+        return LDBooleanFalse;
+    }
+
+    for (i = 0; i < summary->counterCount; i++) {
+        insertSlot(
+            summary->counterSlots,
+            summary->counterSlotCount,
+            summary->counters[i].hash,
+            i);
+    }
+
+    return LDBooleanTrue;
+}
+
+/* Returns the index of the flag, adding it if needed */
+static LDBoolean
+findFlag(
+    struct LDSummary *const    summary,
+    const char *const          flagKey,
+    const struct LDJSON *const defaultValue,
+    unsigned int *const        index)
+{
+    struct LDSummaryFlag *flag;
+    unsigned long         hash;
+    unsigned int          i;
+
+    hash = hashBytes(
+        FNV_OFFSET_BASIS, (const unsigned char *)flagKey, strlen(flagKey));
+
+    if (summary->flagSlotCount) {
+        for (i = hash & (summary->flagSlotCount - 1); summary->flagSlots[i];
+             i = (i + 1) & (summary->flagSlotCount - 1))
+        {
+            flag = &summary->flags[summary->flagSlots[i] - 1];
+
+            if (flag->hash == hash && strcmp(flag->key, flagKey) == 0) {
+                *index = summary->flagSlots[i] - 1;
+
+                return LDBooleanTrue;
+            }
+        }
+    }
+
+    if (summary->flagCount == summary->flagSlotCount / 2 &&
+        !growFlags(summary))
+    {
+        return LDBooleanFalse;
+    }
+
+    flag = &summary->flags[summary->flagCount];
+
+    flag->hash         = hash;
+    flag->defaultValue = NULL;
+
+    if (!(flag->key = LDStrDup(flagKey))) {
+        return LDBooleanFalse;
+    }
+
+    if (LDi_notNull(defaultValue) &&
+        !(flag->defaultValue = LDJSONDuplicate(defaultValue)))
+    {
+        LDFree(flag->key);
+
+        return LDBooleanFalse;
+    }
+
+    insertSlot(
+        summary->flagSlots, summary->flagSlotCount, hash, summary->flagCount);
+
+    *index = summary->flagCount++;
+
+    return LDBooleanTrue;
+}
+
+void
+LDi_initSummary(struct LDSummary *const summary)
+{
+    LD_ASSERT(summary);
+
+    memset(summary, 0, sizeof(struct LDSummary));
+}
+
+void
+LDi_clearSummary(struct LDSummary *const summary)
+{
+    unsigned int i;
+
+    LD_ASSERT(summary);
+
+    for (i = 0; i < summary->flagCount; i++) {
+        LDFree(summary->flags[i].key);
+        LDJSONFree(summary->flags[i].defaultValue);
+    }
+
+    for (i = 0; i < summary->counterCount; i++) {
+        LDJSONFree(summary->counters[i].value);
+    }
+
+    if (summary->flagSlots) {
+        memset(
+            summary->flagSlots,
+            0,
+            sizeof(unsigned int) * summary->flagSlotCount);
+    }
+
+    if (summary->counterSlots) {
+        memset(
+            summary->counterSlots,
+            0,
+            sizeof(unsigned int) * summary->counterSlotCount);
+    }
+
+    summary->flagCount    = 0;
+    summary->counterCount = 0;
+}
+
+void
+LDi_freeSummary(struct LDSummary *const summary)
+{
+    if (summary) {
+        LDi_clearSummary(summary);
+
+        LDFree(summary->flags);
+        LDFree(summary->flagSlots);
+        LDFree(summary->counters);
+        LDFree(summary->counterSlots);
+
+        LDi_initSummary(summary);
+    }
+}
+
+static LDBoolean
+addCount(
+    struct LDSummary *const    summary,
+    const char *const          flagKey,
+    const unsigned int *const  variation,
+    const double *const        version,
+    const struct LDJSON *const value,
+    const struct LDJSON *const defaultValue,
+    const LDBoolean            unknown,
+    const unsigned long        count)
+{
+    struct LDSummaryCounter *counter;
+    unsigned long            hash;
+    unsigned int             flag, i;
+
+    if (!findFlag(summary, flagKey, defaultValue, &flag)) {
+        return LDBooleanFalse;
+    }
+
+    hash = hashCounter(flag, variation, version);
+
+    if (summary->counterSlotCount) {
+        for (i = hash & (summary->counterSlotCount - 1);
+             summary->counterSlots[i];
+             i = (i + 1) & (summary->counterSlotCount - 1))
+        {
+            counter = &summary->counters[summary->counterSlots[i] - 1];
+
+            if (counter->hash == hash &&
+                counterMatches(counter, flag, variation, version))
+            {
+                counter->count += count;
+
+                return LDBooleanTrue;
+            }
+        }
+    }
+
+    if (summary->counterCount == summary->counterSlotCount / 2 &&
+        !growCounters(summary))
+    {
+        return LDBooleanFalse;
+    }
+
+    counter = &summary->counters[summary->counterCount];
+
+    counter->flag         = flag;
+    counter->hash         = hash;
+    counter->hasVariation = variation != NULL;
+    counter->variation    = variation ? *variation : 0;
+    counter->hasVersion   = version != NULL;
+    counter->version      = version ? *version : 0;
+    counter->unknown      = unknown;
+    counter->value        = NULL;
+    counter->count        = count;
+
+    if (LDi_notNull(value) && !(counter->value = LDJSONDuplicate(value))) {
+        return LDBooleanFalse;
+    }
+
+    insertSlot(
+        summary->counterSlots,
+        summary->counterSlotCount,
+        hash,
+        summary->counterCount);
+
+    summary->counterCount++;
+
+    return LDBooleanTrue;
+}
+
+LDBoolean
+LDi_summaryCount(
+    struct LDSummary *const    summary,
+    const char *const          flagKey,
+    const unsigned int *const  variation,
+    const double *const        version,
+    const struct LDJSON *const value,
+    const struct LDJSON *const defaultValue,
+    const LDBoolean            unknown)
+{
+    LD_ASSERT(summary);
+    LD_ASSERT(flagKey);
+
+    return addCount(
+        summary, flagKey, variation, version, value, defaultValue, unknown, 1);
+}
+
+LDBoolean
+LDi_summaryMerge(
+    struct LDSummary *const dest, const struct LDSummary *const source)
+{
+    const struct LDSummaryCounter *counter;
+    const struct LDSummaryFlag *   flag;
+    unsigned int                   i;
+
+    LD_ASSERT(dest);
+    LD_ASSERT(source);
+
+    for (i = 0; i < source->counterCount; i++) {
+        counter = &source->counters[i];
+        flag    = &source->flags[counter->flag];
+
+        if (!addCount(
+                dest,
+                flag->key,
+                counter->hasVariation ? &counter->variation : NULL,
+                counter->hasVersion ? &counter->version : NULL,
+                counter->value,
+                flag->defaultValue,
+                counter->unknown,
+                counter->count))
+        {
+            return LDBooleanFalse;
+        }
+    }
+
+    return LDBooleanTrue;
+}
+
+static LDBoolean
+writeCounter(
+    struct LDTextBuffer *const           buffer,
+    const struct LDSummaryCounter *const counter)
+{
+    if (!LDi_writeText(buffer, "{\"count\":") ||
+        !LDi_writeNumber(buffer, counter->count))
+    {
+        return LDBooleanFalse;
+    }
+
+    if (counter->value && (!LDi_writeText(buffer, ",\"value\":") ||
+                           !LDi_writeJSON(buffer, counter->value)))
+    {
+        return LDBooleanFalse;
+    }
+
+    if (counter->hasVersion && (!LDi_writeText(buffer, ",\"version\":") ||
+                                !LDi_writeNumber(buffer, counter->version)))
+    {
+        return LDBooleanFalse;
+    }
+
+    if (counter->hasVariation &&
+        (!LDi_writeText(buffer, ",\"variation\":") ||
+         !LDi_writeNumber(buffer, counter->variation)))
+    {
+        return LDBooleanFalse;
+    }
+
+    if (counter->unknown && !LDi_writeText(buffer, ",\"unknown\":true")) {
+        return LDBooleanFalse;
+    }
+
+    return LDi_writeText(buffer, "}");
+}
+
+LDBoolean
+LDi_writeSummary(
+    struct LDTextBuffer *const buffer, const struct LDSummary *const summary)
+{
+    const struct LDSummaryFlag *flag;
+    unsigned int *              order, *ends;
+    unsigned int                i, j, begin;
+    LDBoolean                   success;
+
+    LD_ASSERT(buffer);
+    LD_ASSERT(summary);
+
+    if (summary->flagCount == 0) {
+        return LDi_writeText(buffer, "{}");
+    }
+
+    /* The counters of each flag are contiguous in `order`, and end at
+    `ends[flag]`. Filled by counting sort, which keeps them in the order they
+    were first seen. */
+    if (!(order = (unsigned int *)LDAlloc(
+              sizeof(unsigned int) *
+              (summary->counterCount + summary->flagCount + 1))))
+    {
+        return LDBooleanFalse;
+    }
+
+    ends = order + summary->counterCount;
+
+    memset(ends, 0, sizeof(unsigned int) * (summary->flagCount + 1));
+
+    for (i = 0; i < summary->counterCount; i++) {
+        ends[summary->counters[i].flag + 1]++;
+    }
+
+    for (i = 0; i < summary->flagCount; i++) {
+        ends[i + 1] += ends[i];
+    }
+
+    for (i = 0; i < summary->counterCount; i++) {
+        order[ends[summary->counters[i].flag]++] = i;
+    }
+
+    success = LDi_writeText(buffer, "{");
+
+    for (i = 0; success && i < summary->flagCount; i++) {
+        flag = &summary->flags[i];
+
+        success = (i == 0 || LDi_writeText(buffer, ",")) &&
+            LDi_writeString(buffer, flag->key) &&
+            LDi_writeText(buffer, ":{");
+
+        if (success && flag->defaultValue) {
+            success = LDi_writeText(buffer, "\"default\":") &&
+                LDi_writeJSON(buffer, flag->defaultValue) &&
+                LDi_writeText(buffer, ",");
+        }
+
+        success = success && LDi_writeText(buffer, "\"counters\":[");
+
+        begin = i == 0 ? 0 : ends[i - 1];
+
+        for (j = begin; success && j < ends[i]; j++) {
+            success = (j == begin || LDi_writeText(buffer, ",")) &&
+                writeCounter(buffer, &summary->counters[order[j]]);
+        }
+
+        success = success && LDi_writeText(buffer, "]}");
+    }
+
+    success = success && LDi_writeText(buffer, "}");
+
+    LDFree(order);
+
+    return success;
+}
+
+struct LDJSON *
+LDi_summaryToJSON(const struct LDSummary *const summary)
+{
+    struct LDTextBuffer buffer;
+    struct LDJSON *     features;
+
+    LD_ASSERT(summary);
+
+    memset(&buffer, 0, sizeof(struct LDTextBuffer));
+
+    features = NULL;
+
+    if (LDi_writeSummary(&buffer, summary)) {
+        features = LDJSONDeserialize(buffer.text);
+    }
+
+    LDFree(buffer.text);
+
+    if (!features) {
+        LD_LOG(LD_LOG_ERROR, "alloc error");
+    }
+
+    return features;
+}
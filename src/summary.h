@@ -0,0 +1,88 @@
+/*!
+ * @file summary.h
+ * @brief Internal API Interface for evaluation summary counters
+ *
+ * Counters are kept in native open addressing tables keyed on the interned
+ * flag key, the flag version and the variation, and are only converted to
+ * JSON text when a summary event is written. Flags and counters are reported
+ * in the order they were first counted.
+ */
+
+#pragma once
+
+#include <launchdarkly/json.h>
+#include <launchdarkly/variations.h>
+
+struct LDSummaryFlag
+{
+    char *         key;
+    unsigned long  hash;
+    struct LDJSON *defaultValue; /* may be NULL */
+};
+
+struct LDSummaryCounter
+{
+    unsigned int   flag; /* index into `LDSummary::flags` */
+    unsigned long  hash;
+    LDBoolean      hasVariation;
+    unsigned int   variation;
+    LDBoolean      hasVersion;
+    double         version;
+    LDBoolean      unknown;
+    struct LDJSON *value; /* may be NULL */
+    unsigned long  count;
+};
+
+/* Each table is a dense array of entries, plus slots holding the index of an
+entry plus one, zero for an empty slot */
+struct LDSummary
+{
+    struct LDSummaryFlag *flags;
+    unsigned int          flagCount;
+    unsigned int *        flagSlots;
+    unsigned int          flagSlotCount;
+
+    struct LDSummaryCounter *counters;
+    unsigned int             counterCount;
+    unsigned int *           counterSlots;
+    unsigned int             counterSlotCount;
+};
+
+void
+LDi_initSummary(struct LDSummary *const summary);
+
+/* Removes every counter, the tables keep their capacity */
+void
+LDi_clearSummary(struct LDSummary *const summary);
+
+void
+LDi_freeSummary(struct LDSummary *const summary);
+
+/* Counts one evaluation, `variation` and `version` may be NULL. The value and
+default are copied when a counter or flag is first seen. Returns false only
+on allocation failure. */
+LDBoolean
+LDi_summaryCount(
+    struct LDSummary *const    summary,
+    const char *const          flagKey,
+    const unsigned int *const  variation,
+    const double *const        version,
+    const struct LDJSON *const value,
+    const struct LDJSON *const defaultValue,
+    const LDBoolean            unknown);
+
+/* Adds every counter of `source` to `dest`. Flags new to `dest` keep the
+order they had in `source`. Returns false only on allocation failure. */
+LDBoolean
+LDi_summaryMerge(
+    struct LDSummary *const dest, const struct LDSummary *const source);
+
+/* Appends the "features" object of a summary event */
+LDBoolean
+LDi_writeSummary(
+    struct LDTextBuffer *const buffer, const struct LDSummary *const summary);
+
+/* Returns the "features" object of a summary event, NULL on allocation
+failure */
+struct LDJSON *
+LDi_summaryToJSON(const struct LDSummary *const summary);
@@ -1,9 +1,15 @@
+#include <string.h>
+
 #include <launchdarkly/api.h>
 
 #include "assertion.h"
+#include "atomic.h"
 #include "client.h"
 #include "config.h"
+#include "eval_cache.h"
 #include "evaluate.h"
+#include "event_processor.h"
+#include "json_writer.h"
 #include "store.h"
 #include "user.h"
 #include "utility.h"
@@ -214,6 +220,106 @@ setDetailsOOM(struct LDDetails *const details)
     }
 }
 
+/* Evaluates a flag read from the store, `NULL` if it was not found, and
+reports failures in `details`. Returns false if memory was exhausted, in which
+case the evaluation should not be recorded. `o_status` may be `NULL`. */
+static LDBoolean
+evaluateStored(
+    struct LDClient *const       client,
+    const struct LDFlag *const   flag,
+    const struct LDUser *const   user,
+    struct LDDetails *const      details,
+    const LDBoolean              recordReason,
+    struct LDEvalMemo *const     memo,
+    struct LDJSON **const        o_value,
+    struct LDEventRecord **const o_subEvents,
+    EvalStatus *const            o_status)
+{
+    EvalStatus status;
+
+    LD_ASSERT(client);
+    LD_ASSERT(user);
+    LD_ASSERT(details);
+    LD_ASSERT(o_value);
+    LD_ASSERT(o_subEvents);
+
+    if (!flag) {
+        details->reason          = LD_ERROR;
+        details->extra.errorKind = LD_FLAG_NOT_FOUND;
+
+        return LDBooleanTrue;
+    }
+
+    status = LDi_evaluate(
+        client,
+        flag,
+        user,
+        client->store,
+        details,
+        o_subEvents,
+        o_value,
+        recordReason,
+        memo,
+        NULL);
+
+    if (o_status) {
+        *o_status = status;
+    }
+
+    if (status == EVAL_MEM) {
+        details->reason          = LD_ERROR;
+        details->extra.errorKind = LD_OOM;
+
+        LDi_freeEventRecords(*o_subEvents);
+        *o_subEvents = NULL;
+
+        return LDBooleanFalse;
+    } else if (status == EVAL_SCHEMA) {
+        details->reason          = LD_ERROR;
+        details->extra.errorKind = LD_MALFORMED_FLAG;
+
+        LDi_freeEventRecords(*o_subEvents);
+        *o_subEvents = NULL;
+
+        /* In this case the value will be null, so once the evaluation is
+         * recorded the fallback is selected. */
+    }
+
+    return LDBooleanTrue;
+}
+
+/* Returns the evaluated value if it has the expected type, otherwise the
+fallback. Whichever is not returned is freed. */
+static struct LDJSON *
+selectValue(
+    struct LDJSON *const value,
+    struct LDJSON *const fallback,
+    LDBoolean (*const checkType)(const LDJSONType type),
+    struct LDDetails *const details)
+{
+    LD_ASSERT(checkType);
+    LD_ASSERT(details);
+
+    if (!LDi_notNull(value)) {
+        LDJSONFree(value);
+
+        return fallback;
+    }
+
+    if (!checkType(LDJSONGetType(value))) {
+        details->reason          = LD_ERROR;
+        details->extra.errorKind = LD_WRONG_TYPE;
+
+        LDJSONFree(value);
+
+        return fallback;
+    }
+
+    LDJSONFree(fallback);
+
+    return value;
+}
+
 static struct LDJSON *
 variation(
     struct LDClient *const     client,
@@ -223,11 +329,16 @@ variation(
     LDBoolean (*const checkType)(const LDJSONType type),
     struct LDDetails *const o_details)
 {
-    struct LDStore *     store;
-    const struct LDJSON *flag;
-    struct LDJSON *      value, *subEvents;
-    struct LDDetails     details, *detailsRef;
-    struct LDJSONRC *    flagrc;
+    struct LDStore *      store;
+    const struct LDFlag * flag;
+    struct LDJSON *       value;
+    struct LDEventRecord *subEvents;
+    struct LDDetails      details, *detailsRef;
+    struct LDJSONRC *     flagrc;
+    struct LDTextBuffer   cacheKey;
+    unsigned long         generation;
+    struct LDEpochGuard   guard;
+    LDBoolean             reading;
 
     LD_ASSERT_API(client);
     LD_ASSERT_API(user);
@@ -236,12 +347,16 @@ variation(
     LD_ASSERT(fallback);
     LD_ASSERT(checkType);
 
-    flag      = NULL;
-    flagrc    = NULL;
-    value     = NULL;
-    store     = NULL;
-    value     = NULL;
-    subEvents = NULL;
+    flag       = NULL;
+    flagrc     = NULL;
+    value      = NULL;
+    store      = NULL;
+    value      = NULL;
+    subEvents  = NULL;
+    generation = 0;
+    reading    = LDBooleanFalse;
+
+    memset(&cacheKey, 0, sizeof(cacheKey));
 
     LDDetailsInit(&details);
 
@@ -287,7 +402,17 @@ variation(
     store = client->store;
     LD_ASSERT(store);
 
-    if (!LDStoreGet(store, LD_FLAG, key, &flagrc)) {
+    /* read before the flag, so cached results are never newer than it */
+    if (client->evalCache) {
+        generation = LDStoreGetGeneration(store);
+    }
+
+    /* the flag and everything it depends on are borrowed until the
+    evaluation is recorded */
+    LDStoreReadBegin(store, &guard);
+    reading = LDBooleanTrue;
+
+    if (!LDStoreGetBorrowed(store, LD_FLAG, key, &flagrc)) {
         detailsRef->reason          = LD_ERROR;
         detailsRef->extra.errorKind = LD_STORE_ERROR;
 
@@ -295,7 +420,7 @@ variation(
     }
 
     if (flagrc) {
-        flag = LDJSONRCGet(flagrc);
+        flag = LDJSONRCGetFlag(flagrc);
     }
 
     if (!flag) {
@@ -305,31 +430,52 @@ variation(
         detailsRef->reason          = LD_ERROR;
         detailsRef->extra.errorKind = LD_USER_NOT_SPECIFIED;
     } else {
-        const EvalStatus status = LDi_evaluate(
-            client,
-            flag,
-            user,
-            store,
-            detailsRef,
-            &subEvents,
-            &value,
-            o_details != NULL);
-
-        if (status == EVAL_MEM) {
-            detailsRef->reason          = LD_ERROR;
-            detailsRef->extra.errorKind = LD_OOM;
+        LDBoolean         success, cacheable;
+        struct LDEvalMemo memo;
+        EvalStatus        status;
 
-            LDJSONFree(subEvents);
+        cacheable = LDBooleanFalse;
 
-            goto error;
-        } else if (status == EVAL_SCHEMA) {
-            detailsRef->reason          = LD_ERROR;
-            detailsRef->extra.errorKind = LD_MALFORMED_FLAG;
+        if (client->evalCache) {
+            cacheable = LDi_evalCacheKey(
+                client->evalCache, store, generation, flag, user, &cacheKey);
+        }
 
-            LDJSONFree(subEvents);
+        if (!cacheable ||
+            !LDi_evalCacheGet(
+                client->evalCache, generation, &cacheKey, &value, detailsRef))
+        {
+            LDi_initEvalMemo(&memo);
+
+            success = evaluateStored(
+                client,
+                flag,
+                user,
+                detailsRef,
+                o_details != NULL,
+                &memo,
+                &value,
+                &subEvents,
+                &status);
+
+            LDi_clearEvalMemo(&memo);
+
+            if (!success) {
+                goto error;
+            }
 
-            /* In this case the value will be null, so after LDi_processEvaluation the value will be checked,
-             * and then it will move on to the error condition. */
+            /* store failures are transient, and a write during the
+            evaluation may have been seen only in part */
+            if (cacheable && status != EVAL_STORE &&
+                LDStoreGetGeneration(store) == generation)
+            {
+                LDi_evalCachePut(
+                    client->evalCache,
+                    generation,
+                    &cacheKey,
+                    value,
+                    detailsRef);
+            }
         }
     }
 
@@ -340,7 +486,7 @@ variation(
             key,
             value,
             fallback,
-            flag,
+            flag ? flag->json : NULL,
             detailsRef,
             o_details != NULL))
     {
@@ -350,29 +496,26 @@ variation(
     }
     subEvents = NULL;
 
-    if (!LDi_notNull(value)) {
-        goto error;
-    }
-
-    if (!checkType(LDJSONGetType(value))) {
-        detailsRef->reason          = LD_ERROR;
-        detailsRef->extra.errorKind = LD_WRONG_TYPE;
+    LDStoreReleaseBorrowed(store, flagrc);
+    LDStoreReadEnd(store, &guard);
 
-        goto error;
-    }
+    value = selectValue(value, fallback, checkType, detailsRef);
 
-    LDJSONFree(fallback);
     LDDetailsClear(&details);
-    LDJSONRCDecrement(flagrc);
-    LDJSONFree(subEvents);
+    LDFree(cacheKey.text);
 
     return value;
 
 error:
+    if (reading) {
+        LDStoreReleaseBorrowed(store, flagrc);
+        LDStoreReadEnd(store, &guard);
+    }
+
     LDJSONFree(value);
     LDDetailsClear(&details);
-    LDJSONRCDecrement(flagrc);
-    LDJSONFree(subEvents);
+    LDi_freeEventRecords(subEvents);
+    LDFree(cacheKey.text);
 
     return fallback;
 }
@@ -586,20 +729,849 @@ LDJSONVariation(
     return result;
 }
 
+static void
+releaseFlags(struct LDJSONRC **const flags, const unsigned int count)
+{
+    unsigned int i;
+
+    if (flags) {
+        for (i = 0; i < count; i++) {
+            LDJSONRCDecrement(flags[i]);
+        }
+
+        LDFree(flags);
+    }
+}
+
+/* indexed by `enum LDVariationType` */
+static LDBoolean (*const variationTypeChecks[])(const LDJSONType type) = {
+    isBool, isNumber, isNumber, isText, isArrayOrObject};
+
+static struct LDJSON *
+fallbackToJSON(const struct LDVariationRequest *const request)
+{
+    switch (request->type) {
+    case LD_VARIATION_BOOL:
+        return LDNewBool(request->fallback.boolean);
+    case LD_VARIATION_INT:
+        return LDNewNumber(request->fallback.integer);
+    case LD_VARIATION_DOUBLE:
+        return LDNewNumber(request->fallback.number);
+    case LD_VARIATION_STRING:
+        if (request->fallback.text) {
+            return LDNewText(request->fallback.text);
+        }
+
+        return LDNewNull();
+    case LD_VARIATION_JSON:
+        if (request->fallback.json) {
+            return LDJSONDuplicate(request->fallback.json);
+        }
+
+        return LDNewNull();
+    }
+
+    return NULL;
+}
+
+/* Converts the evaluated value, or the fallback if it is not usable, the same
+way as the typed variation functions. Both JSON values are consumed. */
+static void
+setVariationResult(
+    const struct LDVariationRequest *const request,
+    struct LDJSON *const                   value,
+    struct LDJSON *const                   fallback,
+    struct LDVariationResult *const        result)
+{
+    struct LDJSON *selected;
+
+    LD_ASSERT(fallback);
+
+    selected = selectValue(
+        value, fallback, variationTypeChecks[request->type], &result->details);
+
+    switch (request->type) {
+    case LD_VARIATION_BOOL:
+        result->value.boolean = LDGetBool(selected);
+        break;
+    case LD_VARIATION_INT:
+        result->value.integer = LDGetNumber(selected);
+        break;
+    case LD_VARIATION_DOUBLE:
+        result->value.number = LDGetNumber(selected);
+        break;
+    case LD_VARIATION_STRING:
+        result->value.text = NULL;
+
+        if (selected != fallback || request->fallback.text) {
+            const char *const text = LDGetText(selected);
+
+            if (text) {
+                result->value.text = LDStrDup(text);
+            }
+        }
+        break;
+    case LD_VARIATION_JSON:
+        if (selected != fallback || request->fallback.json) {
+            result->value.json = selected;
+
+            return;
+        }
+
+        result->value.json = NULL;
+        break;
+    }
+
+    LDJSONFree(selected);
+}
+
+/* the result when even the fallback could not be allocated */
+static void
+setVariationOOM(
+    const struct LDVariationRequest *const request,
+    struct LDVariationResult *const        result)
+{
+    result->details.reason          = LD_ERROR;
+    result->details.extra.errorKind = LD_OOM;
+
+    switch (request->type) {
+    case LD_VARIATION_BOOL:
+        result->value.boolean = request->fallback.boolean;
+        break;
+    case LD_VARIATION_INT:
+        result->value.integer = request->fallback.integer;
+        break;
+    case LD_VARIATION_DOUBLE:
+        result->value.number = request->fallback.number;
+        break;
+    case LD_VARIATION_STRING:
+        result->value.text = NULL;
+        break;
+    case LD_VARIATION_JSON:
+        result->value.json = NULL;
+        break;
+    }
+}
+
+/* per request state of LDVariations */
+struct PendingVariation
+{
+    struct LDJSON *fallback;
+    struct LDJSON *value;
+    /* whether the evaluation is passed on to the event processor */
+    LDBoolean recorded;
+    /* the request is invalid, and its result is already set */
+    LDBoolean rejected;
+};
+
+LDBoolean
+LDVariations(
+    struct LDClient *const                 client,
+    const struct LDUser *const             user,
+    const struct LDVariationRequest *const requests,
+    struct LDVariationResult *const        results,
+    const unsigned int                     count,
+    const LDBoolean                        detailed)
+{
+    const char **              keys;
+    struct LDJSONRC **         flags;
+    struct PendingVariation *  pending;
+    struct LDEvaluationRecord *records;
+    struct LDEvalMemo          memo;
+    struct LDEpochGuard        guard;
+    enum LDEvalErrorKind       failure;
+    unsigned int               i, j, recordCount, keyCount;
+
+    LD_ASSERT_API(client);
+    LD_ASSERT_API(user);
+    LD_ASSERT_API(requests || count == 0);
+    LD_ASSERT_API(results || count == 0);
+
+#ifdef LAUNCHDARKLY_DEFENSIVE
+    if (client == NULL || user == NULL || requests == NULL || results == NULL)
+    {
+        LD_LOG(LD_LOG_WARNING, "LDVariations NULL argument");
+
+        return LDBooleanFalse;
+    }
+#endif
+
+    keys        = NULL;
+    flags       = NULL;
+    pending     = NULL;
+    records     = NULL;
+    failure     = LD_OOM;
+    recordCount = 0;
+    keyCount    = 0;
+
+    for (i = 0; i < count; i++) {
+        LD_ASSERT_API(requests[i].key);
+        LD_ASSERT_API(requests[i].type <= LD_VARIATION_JSON);
+
+        results[i].type       = requests[i].type;
+        results[i].value.json = NULL;
+        LDDetailsInit(&results[i].details);
+    }
+
+    if (count == 0) {
+        return LDBooleanTrue;
+    }
+
+    if (!(keys = (const char **)LDAlloc(sizeof(const char *) * count)) ||
+        !(flags = (struct LDJSONRC **)LDAlloc(
+              sizeof(struct LDJSONRC *) * count)) ||
+        !(pending = (struct PendingVariation *)LDAlloc(
+              sizeof(struct PendingVariation) * count)) ||
+        !(records = (struct LDEvaluationRecord *)LDAlloc(
+              sizeof(struct LDEvaluationRecord) * count)))
+    {
+        LD_LOG(LD_LOG_ERROR, "alloc error");
+
+        LDFree(keys);
+        LDFree(flags);
+        LDFree(pending);
+
+        for (i = 0; i < count; i++) {
+            setVariationOOM(&requests[i], &results[i]);
+        }
+
+        return LDBooleanFalse;
+    }
+
+    for (i = 0; i < count; i++) {
+        pending[i].fallback = NULL;
+        pending[i].value    = NULL;
+        pending[i].recorded = LDBooleanFalse;
+        pending[i].rejected = LDBooleanFalse;
+
+#ifdef LAUNCHDARKLY_DEFENSIVE
+        if ((unsigned int)requests[i].type > LD_VARIATION_JSON) {
+            LD_LOG(LD_LOG_WARNING, "LDVariations invalid type");
+
+            /* there is no fallback of an unknown type to return */
+            results[i].details.reason          = LD_ERROR;
+            results[i].details.extra.errorKind = LD_WRONG_TYPE;
+            pending[i].rejected                = LDBooleanTrue;
+
+            continue;
+        } else if (requests[i].key == NULL) {
+            struct LDJSON *fallback;
+
+            LD_LOG(LD_LOG_WARNING, "LDVariations NULL key");
+
+            if ((fallback = fallbackToJSON(&requests[i]))) {
+                results[i].details.reason          = LD_ERROR;
+                results[i].details.extra.errorKind = LD_NULL_KEY;
+
+                setVariationResult(&requests[i], NULL, fallback, &results[i]);
+            } else {
+                setVariationOOM(&requests[i], &results[i]);
+            }
+
+            pending[i].rejected = LDBooleanTrue;
+
+            continue;
+        }
+#endif
+
+        keys[keyCount]      = requests[i].key;
+        flags[keyCount]     = NULL;
+        pending[i].fallback = fallbackToJSON(&requests[i]);
+        keyCount++;
+    }
+
+    if (!LDClientIsInitialized(client)) {
+        failure = LD_CLIENT_NOT_READY;
+
+        goto error;
+    }
+
+    if (!LDStoreGetMany(client->store, LD_FLAG, keys, keyCount, flags)) {
+        failure = LD_STORE_ERROR;
+
+        goto error;
+    }
+
+    /* prerequisites and segments shared between flags are evaluated once */
+    LDi_initEvalMemo(&memo);
+    LDStoreReadBegin(client->store, &guard);
+
+    /* `keys` and `flags` only hold the requests that were not rejected */
+    for (i = 0, j = 0; i < count; i++) {
+        struct LDEvaluationRecord *record;
+        const struct LDFlag *      flag;
+        struct LDJSONRC *          flagrc;
+
+        if (pending[i].rejected) {
+            continue;
+        }
+
+        flagrc = flags[j++];
+
+        if (!pending[i].fallback) {
+            continue;
+        }
+
+        flag   = flagrc ? LDJSONRCGetFlag(flagrc) : NULL;
+        record = &records[recordCount];
+
+        record->subEvents = NULL;
+
+        if (!evaluateStored(
+                client,
+                flag,
+                user,
+                &results[i].details,
+                detailed,
+                &memo,
+                &pending[i].value,
+                &record->subEvents,
+                NULL))
+        {
+            continue;
+        }
+
+        record->flagKey       = requests[i].key;
+        record->actualValue   = pending[i].value;
+        record->fallbackValue = pending[i].fallback;
+        record->flag          = flag ? flag->json : NULL;
+        record->details       = &results[i].details;
+
+        pending[i].recorded = LDBooleanTrue;
+        recordCount++;
+    }
+
+    LDStoreReadEnd(client->store, &guard);
+    LDi_clearEvalMemo(&memo);
+
+    LDi_processEvaluations(
+        client->eventProcessor, user, records, recordCount, detailed);
+
+    for (i = 0, recordCount = 0; i < count; i++) {
+        if (pending[i].rejected) {
+            continue;
+        } else if (!pending[i].fallback) {
+            setVariationOOM(&requests[i], &results[i]);
+
+            continue;
+        }
+
+        /* like a single variation, the fallback is returned if the
+        evaluation could not be recorded */
+        if (!pending[i].recorded || !records[recordCount++].recorded) {
+            LDJSONFree(pending[i].value);
+            pending[i].value = NULL;
+        }
+
+        setVariationResult(
+            &requests[i], pending[i].value, pending[i].fallback, &results[i]);
+    }
+
+    releaseFlags(flags, keyCount);
+    LDFree(keys);
+    LDFree(pending);
+    LDFree(records);
+
+    return LDBooleanTrue;
+
+error:
+    for (i = 0; i < count; i++) {
+        if (pending[i].rejected) {
+            continue;
+        } else if (pending[i].fallback) {
+            results[i].details.reason          = LD_ERROR;
+            results[i].details.extra.errorKind = failure;
+
+            setVariationResult(
+                &requests[i], NULL, pending[i].fallback, &results[i]);
+        } else {
+            setVariationOOM(&requests[i], &results[i]);
+        }
+    }
+
+    releaseFlags(flags, keyCount);
+    LDFree(keys);
+    LDFree(pending);
+    LDFree(records);
+
+    return LDBooleanFalse;
+}
+
+void
+LDVariationResultsClear(
+    struct LDVariationResult *const results, const unsigned int count)
+{
+    unsigned int i;
+
+    LD_ASSERT_API(results || count == 0);
+
+    for (i = 0; i < count; i++) {
+        if (results[i].type == LD_VARIATION_STRING) {
+            LDFree(results[i].value.text);
+
+            results[i].value.text = NULL;
+        } else if (results[i].type == LD_VARIATION_JSON) {
+            LDJSONFree(results[i].value.json);
+
+            results[i].value.json = NULL;
+        }
+
+        LDDetailsClear(&results[i].details);
+    }
+}
+
+/* LDAllFlags work is handed out in chunks of at least this many flags */
+#define LD_ALL_FLAGS_MIN_CHUNK 64
+
+/* State shared by the threads evaluating one LDAllFlags call. A task that
+starts after the call has returned only touches the counters. */
+struct AllFlagsJob
+{
+    struct LDClient *       client;
+    const struct LDUser *   user;
+    struct LDJSONRC **      flags;
+    struct LDBucketRequest *buckets;
+    struct LDJSON **        values;
+    /* NULL unless the caller wants the details */
+    struct LDDetails *details;
+    unsigned int      flagCount;
+    unsigned int      chunkSize;
+    unsigned int      chunkCount;
+    volatile long     nextChunk;
+    /* chunks that have not been evaluated yet */
+    volatile long pending;
+    /* held by the caller and by each submitted task */
+    volatile long references;
+    ld_mutex_t    lock;
+    ld_cond_t     finished;
+};
+
+static void
+releaseAllFlagsJob(struct AllFlagsJob *const job)
+{
+    if (LDi_atomicAdd(&job->references, -1) == 0) {
+        LDi_cond_destroy(&job->finished);
+        LDi_mutex_destroy(&job->lock);
+
+        LDFree(job);
+    }
+}
+
+static void
+evaluateAllFlagsChunk(struct AllFlagsJob *const job, const unsigned int chunk)
+{
+    unsigned int      start, end, i;
+    struct LDEvalMemo memo;
+
+    start = chunk * job->chunkSize;
+    end   = start + job->chunkSize;
+
+    if (end > job->flagCount) {
+        end = job->flagCount;
+    }
+
+    /* the buckets of fallthrough rollouts are computed together before
+    evaluation */
+    for (i = start; i < end; i++) {
+        const struct LDFlag *              flag;
+        const struct LDVariationOrRollout *fallthrough;
+
+        job->buckets[i].prefix = NULL;
+
+        if (!job->flags[i]) {
+            continue;
+        }
+
+        flag = LDJSONRCGetFlag(job->flags[i]);
+        LD_ASSERT(flag);
+
+        fallthrough = &flag->fallthrough;
+
+        if (flag->valid && flag->onValid && flag->on && flag->key &&
+            flag->salt && fallthrough->valid && fallthrough->isRollout)
+        {
+            if (fallthrough->hasSeed) {
+                job->buckets[i].prefix = &fallthrough->seedPrefix;
+            } else {
+                job->buckets[i].prefix = &flag->bucketPrefix;
+            }
+
+            job->buckets[i].attribute = fallthrough->bucketBy;
+        }
+    }
+
+    LDi_bucketUserBatch(job->user, &job->buckets[start], end - start);
+
+    /* prerequisites and segments shared between flags are evaluated once */
+    LDi_initEvalMemo(&memo);
+
+    for (i = start; i < end; i++) {
+        struct LDEventRecord *events;
+        struct LDDetails      scratch, *details;
+        struct LDEpochGuard   guard;
+        EvalStatus            status;
+
+        events = NULL;
+
+        if (!job->flags[i]) {
+            continue;
+        }
+
+        if (job->details) {
+            details = &job->details[i];
+        } else {
+            details = &scratch;
+
+            LDDetailsInit(details);
+        }
+
+        /* a section per flag, so that writers are not held up for the
+        whole chunk */
+        LDStoreReadBegin(job->client->store, &guard);
+
+        status = LDi_evaluate(
+            job->client,
+            LDJSONRCGetFlag(job->flags[i]),
+            job->user,
+            job->client->store,
+            details,
+            &events,
+            &job->values[i],
+            LDBooleanFalse,
+            &memo,
+            job->buckets[i].prefix ? &job->buckets[i] : NULL);
+
+        LDStoreReadEnd(job->client->store, &guard);
+
+        if (status == EVAL_MEM) {
+            details->reason          = LD_ERROR;
+            details->extra.errorKind = LD_OOM;
+        } else if (status == EVAL_SCHEMA) {
+            details->reason          = LD_ERROR;
+            details->extra.errorKind = LD_MALFORMED_FLAG;
+        }
+
+        LDi_freeEventRecords(events);
+
+        if (!job->details) {
+            LDDetailsClear(details);
+        }
+    }
+
+    LDi_clearEvalMemo(&memo);
+}
+
+static void
+runAllFlagsChunks(struct AllFlagsJob *const job)
+{
+    long chunk;
+
+    while ((chunk = LDi_atomicAdd(&job->nextChunk, 1) - 1) <
+           (long)job->chunkCount) {
+        evaluateAllFlagsChunk(job, (unsigned int)chunk);
+
+        if (LDi_atomicAdd(&job->pending, -1) == 0) {
+            LDi_mutex_lock(&job->lock);
+            LDi_cond_signal(&job->finished);
+            LDi_mutex_unlock(&job->lock);
+        }
+    }
+}
+
+static void
+allFlagsTask(void *const argument)
+{
+    struct AllFlagsJob *const job = (struct AllFlagsJob *)argument;
+
+    runAllFlagsChunks(job);
+    releaseAllFlagsJob(job);
+}
+
+/* Evaluates every flag in `job`, spreading the chunks over the configured
+workers while the calling thread takes part. */
+static void
+runAllFlagsJob(struct AllFlagsJob *const job)
+{
+    const struct LDConfig *config;
+    LDTaskExecutor         executor;
+    void *                 context;
+    unsigned int           tasks, i;
+
+    config   = job->client->config;
+    executor = config->allFlagsExecutor;
+    context  = config->allFlagsExecutorContext;
+
+    if (!executor && job->client->workers) {
+        executor = LDi_workerPoolExecutor;
+        context  = job->client->workers;
+    }
+
+    tasks = 0;
+
+    if (executor) {
+        tasks = job->chunkCount - 1;
+
+        if (tasks > config->allFlagsWorkers) {
+            tasks = config->allFlagsWorkers;
+        }
+    }
+
+    LDi_atomicAdd(&job->references, tasks);
+
+    for (i = 0; i < tasks; i++) {
+        executor(allFlagsTask, job, context);
+    }
+
+    runAllFlagsChunks(job);
+
+    LDi_mutex_lock(&job->lock);
+
+    while (LDi_atomicLoad(&job->pending) > 0) {
+        LDi_cond_wait(&job->finished, &job->lock, 1000);
+    }
+
+    LDi_mutex_unlock(&job->lock);
+}
+
+/* The flags selected by an all flags call, in store order, with their
+evaluations */
+struct AllFlagsEvaluation
+{
+    struct LDJSONRC * rawFlagsRC;
+    unsigned int      flagCount;
+    const char **     keys;
+    struct LDJSONRC **flags;
+    struct LDJSON **  values;
+    /* only allocated when metadata or reasons are requested */
+    struct LDDetails *details;
+};
+
+static void
+clearAllFlagsEvaluation(struct AllFlagsEvaluation *const evaluation)
+{
+    unsigned int i;
+
+    LD_ASSERT(evaluation);
+
+    for (i = 0; i < evaluation->flagCount; i++) {
+        if (evaluation->values) {
+            LDJSONFree(evaluation->values[i]);
+        }
+
+        if (evaluation->details) {
+            LDDetailsClear(&evaluation->details[i]);
+        }
+    }
+
+    releaseFlags(evaluation->flags, evaluation->flagCount);
+    LDFree(evaluation->values);
+    LDFree(evaluation->details);
+    LDFree(evaluation->keys);
+    LDJSONRCDecrement(evaluation->rawFlagsRC);
+}
+
+/* Whether a flag passes the filters of `LDAllFlagsState` */
+static LDBoolean
+isFlagSelected(
+    const struct LDJSON *const flag,
+    const char *const          key,
+    const unsigned int         options,
+    const char *const          keyPrefix)
+{
+    const struct LDJSON *availability, *clientSide;
+
+    if (keyPrefix && strncmp(key, keyPrefix, strlen(keyPrefix)) != 0) {
+        return LDBooleanFalse;
+    }
+
+    if (options & LD_ALLFLAGS_CLIENT_SIDE_ONLY) {
+        if (LDJSONGetType(flag) != LDObject) {
+            return LDBooleanFalse;
+        }
+
+        /* newer flag data replaces "clientSide" with this object */
+        availability = LDObjectLookup(flag, "clientSideAvailability");
+
+        if (availability && LDJSONGetType(availability) == LDObject) {
+            clientSide = LDObjectLookup(availability, "usingEnvironmentId");
+        } else {
+            clientSide = LDObjectLookup(flag, "clientSide");
+        }
+
+        if (!clientSide || LDJSONGetType(clientSide) != LDBool ||
+            !LDGetBool(clientSide))
+        {
+            return LDBooleanFalse;
+        }
+    }
+
+    return LDBooleanTrue;
+}
+
+/* Evaluates every selected flag into `evaluation`, which must be cleared
+with `clearAllFlagsEvaluation` even on failure. */
+static LDBoolean
+evaluateAllFlags(
+    struct LDClient *const           client,
+    const struct LDUser *const       user,
+    const unsigned int               options,
+    const char *const                keyPrefix,
+    struct AllFlagsEvaluation *const evaluation)
+{
+    struct LDJSON *         rawFlags, *rawFlagsIter;
+    struct LDBucketRequest *buckets;
+    struct AllFlagsJob *    job;
+    unsigned int            rawCount, flagCount, workers, i;
+
+    LD_ASSERT(client);
+    LD_ASSERT(user);
+    LD_ASSERT(evaluation);
+
+    buckets = NULL;
+    job     = NULL;
+
+    memset(evaluation, 0, sizeof(struct AllFlagsEvaluation));
+
+    if (!LDStoreAll(client->store, LD_FLAG, &evaluation->rawFlagsRC)) {
+        LD_LOG(LD_LOG_ERROR, "failed to fetch flags");
+
+        return LDBooleanFalse;
+    }
+
+    /* In this case we have read from the store without error, but there are no flags in it. */
+    if (!evaluation->rawFlagsRC) {
+        return LDBooleanTrue;
+    }
+
+    rawFlags = LDJSONRCGet(evaluation->rawFlagsRC);
+    LD_ASSERT(rawFlags);
+
+    if ((rawCount = LDCollectionGetSize(rawFlags)) == 0) {
+        return LDBooleanTrue;
+    }
+
+    /* Compiled flags are held for the whole call, so that they can be
+    evaluated in any order and on any thread. */
+    if (!(evaluation->keys =
+              (const char **)LDAlloc(sizeof(const char *) * rawCount)))
+    {
+        LD_LOG(LD_LOG_ERROR, "alloc error");
+
+        return LDBooleanFalse;
+    }
+
+    flagCount = 0;
+
+    for (rawFlagsIter = LDGetIter(rawFlags); rawFlagsIter;
+         rawFlagsIter = LDIterNext(rawFlagsIter))
+    {
+        if (isFlagSelected(
+                rawFlagsIter, LDIterKey(rawFlagsIter), options, keyPrefix))
+        {
+            evaluation->keys[flagCount++] = LDIterKey(rawFlagsIter);
+        }
+    }
+
+    if (flagCount == 0) {
+        return LDBooleanTrue;
+    }
+
+    if (!(evaluation->flags = (struct LDJSONRC **)LDAlloc(
+              sizeof(struct LDJSONRC *) * flagCount)) ||
+        !(evaluation->values =
+              (struct LDJSON **)LDCalloc(flagCount, sizeof(struct LDJSON *))) ||
+        ((options & (LD_ALLFLAGS_WITH_METADATA | LD_ALLFLAGS_WITH_REASONS)) &&
+         !(evaluation->details = (struct LDDetails *)LDAlloc(
+               sizeof(struct LDDetails) * flagCount))) ||
+        !(buckets = (struct LDBucketRequest *)LDAlloc(
+              sizeof(struct LDBucketRequest) * flagCount)) ||
+        !(job = (struct AllFlagsJob *)LDAlloc(sizeof(struct AllFlagsJob))))
+    {
+        LD_LOG(LD_LOG_ERROR, "alloc error");
+
+        LDFree(evaluation->flags);
+        LDFree(evaluation->details);
+        evaluation->flags   = NULL;
+        evaluation->details = NULL;
+
+        goto error;
+    }
+
+    /* the individual entries hold the compiled form of the flags */
+    if (!LDStoreGetMany(
+            client->store,
+            LD_FLAG,
+            evaluation->keys,
+            flagCount,
+            evaluation->flags))
+    {
+        LD_LOG(LD_LOG_ERROR, "failed to fetch flag");
+
+        LDFree(evaluation->flags);
+        evaluation->flags = NULL;
+
+        goto error;
+    }
+
+    evaluation->flagCount = flagCount;
+
+    if (evaluation->details) {
+        for (i = 0; i < flagCount; i++) {
+            LDDetailsInit(&evaluation->details[i]);
+        }
+    }
+
+    workers = client->config->allFlagsWorkers;
+
+    job->client     = client;
+    job->user       = user;
+    job->flags      = evaluation->flags;
+    job->buckets    = buckets;
+    job->values     = evaluation->values;
+    job->details    = evaluation->details;
+    job->flagCount  = flagCount;
+    job->chunkSize  = flagCount;
+    job->nextChunk  = 0;
+    job->references = 1;
+
+    if (workers > 0) {
+        job->chunkSize = flagCount / ((workers + 1) * 4);
+
+        if (job->chunkSize < LD_ALL_FLAGS_MIN_CHUNK) {
+            job->chunkSize = LD_ALL_FLAGS_MIN_CHUNK;
+        }
+    }
+
+    job->chunkCount = (flagCount + job->chunkSize - 1) / job->chunkSize;
+    job->pending    = job->chunkCount;
+
+    LDi_mutex_init(&job->lock);
+    LDi_cond_init(&job->finished);
+
+    runAllFlagsJob(job);
+
+    releaseAllFlagsJob(job);
+    LDFree(buckets);
+
+    return LDBooleanTrue;
+
+error:
+    LDFree(job);
+    LDFree(buckets);
+
+    return LDBooleanFalse;
+}
+
 struct LDJSON *
 LDAllFlags(struct LDClient *const client, const struct LDUser *const user)
 {
-    struct LDJSON *  evaluatedFlags, *rawFlags, *rawFlagsIter;
-    struct LDJSONRC *rawFlagsRC;
+    struct LDJSON *           evaluatedFlags;
+    struct AllFlagsEvaluation evaluation;
+    unsigned int              i;
 
     LD_ASSERT_API(client);
     LD_ASSERT_API(user);
 
-    rawFlags       = NULL;
-    rawFlagsIter   = NULL;
-    rawFlagsRC     = NULL;
-    evaluatedFlags = NULL;
-
 #ifdef LAUNCHDARKLY_DEFENSIVE
     if (client == NULL) {
         LD_LOG(LD_LOG_WARNING, "LDAllFlags NULL client");
@@ -632,72 +1604,246 @@ LDAllFlags(struct LDClient *const client, const struct LDUser *const user)
         return NULL;
     }
 
-    if (!LDStoreAll(client->store, LD_FLAG, &rawFlagsRC)) {
-        LD_LOG(LD_LOG_ERROR, "LDAllFlags failed to fetch flags");
+    if (!evaluateAllFlags(client, user, 0, NULL, &evaluation)) {
+        goto error;
+    }
 
-        LDJSONFree(evaluatedFlags);
+    for (i = 0; i < evaluation.flagCount; i++) {
+        if (evaluation.values[i]) {
+            if (!LDObjectSetKey(
+                    evaluatedFlags, evaluation.keys[i], evaluation.values[i]))
+            {
+                goto error;
+            }
 
-        return NULL;
+            evaluation.values[i] = NULL;
+        }
     }
 
-    /* In this case we have read from the store without error, but there are no flags in it. */
-    if (!rawFlagsRC) {
-        return evaluatedFlags;
+    clearAllFlagsEvaluation(&evaluation);
+
+    return evaluatedFlags;
+
+error:
+    clearAllFlagsEvaluation(&evaluation);
+    LDJSONFree(evaluatedFlags);
+
+    return NULL;
+}
+
+/* Writes the "$flagsState" entry of one flag */
+static LDBoolean
+writeFlagState(
+    struct LDTextBuffer *const             buffer,
+    const struct AllFlagsEvaluation *const evaluation,
+    const unsigned int                     index,
+    const LDBoolean                        withReasons)
+{
+    const struct LDFlag *flag;
+    const struct LDJSON *version, *trackEvents, *debugEventsUntilDate;
+
+    flag                 = LDJSONRCGetFlag(evaluation->flags[index]);
+    version              = NULL;
+    trackEvents          = NULL;
+    debugEventsUntilDate = NULL;
+
+    if (flag->valid) {
+        version     = LDObjectLookup(flag->json, "version");
+        trackEvents = LDObjectLookup(flag->json, "trackEvents");
+        debugEventsUntilDate =
+            LDObjectLookup(flag->json, "debugEventsUntilDate");
     }
 
-    rawFlags = LDJSONRCGet(rawFlagsRC);
-    LD_ASSERT(rawFlags);
+    if (!LDi_writeString(buffer, evaluation->keys[index]) ||
+        !LDi_writeText(buffer, ":{"))
+    {
+        return LDBooleanFalse;
+    }
 
-    for (rawFlagsIter = LDGetIter(rawFlags); rawFlagsIter;
-         rawFlagsIter = LDIterNext(rawFlagsIter))
+    /* each member is followed by a comma, the last one is removed below */
+    if (evaluation->values[index] &&
+        evaluation->details[index].hasVariation)
     {
-        struct LDJSON *  value, *events;
-        struct LDDetails details;
-        struct LDJSON *  flag;
-        const char *     key;
+        if (!LDi_writeText(buffer, "\"variation\":") ||
+            !LDi_writeNumber(
+                buffer, evaluation->details[index].variationIndex) ||
+            !LDi_writeText(buffer, ","))
+        {
+            return LDBooleanFalse;
+        }
+    }
 
-        value  = NULL;
-        events = NULL;
-        key    = NULL;
+    if (version && LDJSONGetType(version) == LDNumber) {
+        if (!LDi_writeText(buffer, "\"version\":") ||
+            !LDi_writeJSON(buffer, version) || !LDi_writeText(buffer, ","))
+        {
+            return LDBooleanFalse;
+        }
+    }
 
-        flag = rawFlagsIter;
-        LD_ASSERT(flag);
+    if (trackEvents && LDJSONGetType(trackEvents) == LDBool &&
+        LDGetBool(trackEvents))
+    {
+        if (!LDi_writeText(buffer, "\"trackEvents\":true,")) {
+            return LDBooleanFalse;
+        }
+    }
 
-        LDDetailsInit(&details);
+    if (debugEventsUntilDate &&
+        LDJSONGetType(debugEventsUntilDate) == LDNumber)
+    {
+        if (!LDi_writeText(buffer, "\"debugEventsUntilDate\":") ||
+            !LDi_writeJSON(buffer, debugEventsUntilDate) ||
+            !LDi_writeText(buffer, ","))
+        {
+            return LDBooleanFalse;
+        }
+    }
 
-        LDi_evaluate(
-            client,
-            flag,
-            user,
-            client->store,
-            &details,
-            &events,
-            &value,
-            LDBooleanFalse);
-        
-        if (value) {
-            key = LDGetText(LDObjectLookup(flag, "key"));
-            LD_ASSERT(key);
-            if (!LDObjectSetKey(evaluatedFlags, key, value)) {
-                LDJSONFree(events);
-                LDJSONFree(value);
-                LDDetailsClear(&details);
+    if (withReasons) {
+        if (!LDi_writeText(buffer, "\"reason\":") ||
+            !LDi_writeReason(buffer, &evaluation->details[index]) ||
+            !LDi_writeText(buffer, ","))
+        {
+            return LDBooleanFalse;
+        }
+    }
+
+    /* replace the trailing comma, or append to the opening brace */
+    if (buffer->text[buffer->length - 1] == ',') {
+        buffer->text[--buffer->length] = '\0';
+    }
+
+    return LDi_writeText(buffer, "}");
+}
+
+LDBoolean
+LDAllFlagsState(
+    struct LDClient *const     client,
+    const struct LDUser *const user,
+    const unsigned int         options,
+    const char *const          keyPrefix,
+    struct LDTextBuffer *const buffer)
+{
+    struct AllFlagsEvaluation evaluation;
+    size_t                    start;
+    unsigned int              i;
+    LDBoolean                 first;
+
+    LD_ASSERT_API(client);
+    LD_ASSERT_API(user);
+    LD_ASSERT_API(buffer);
+
+#ifdef LAUNCHDARKLY_DEFENSIVE
+    if (client == NULL) {
+        LD_LOG(LD_LOG_WARNING, "LDAllFlagsState NULL client");
+
+        return LDBooleanFalse;
+    }
+
+    if (user == NULL) {
+        LD_LOG(LD_LOG_WARNING, "LDAllFlagsState NULL user");
+
+        return LDBooleanFalse;
+    }
+
+    if (buffer == NULL) {
+        LD_LOG(LD_LOG_WARNING, "LDAllFlagsState NULL buffer");
+
+        return LDBooleanFalse;
+    }
+#endif
+
+    if (client->config->offline) {
+        LD_LOG(LD_LOG_WARNING, "LDAllFlagsState called when offline");
+
+        return LDBooleanFalse;
+    }
+
+    if (!LDStoreInitialized(client->store)) {
+        LD_LOG(LD_LOG_WARNING, "LDAllFlagsState not initialized");
+
+        return LDBooleanFalse;
+    }
+
+    start = buffer->length;
+
+    if (!evaluateAllFlags(client, user, options, keyPrefix, &evaluation)) {
+        goto error;
+    }
+
+    if (!LDi_writeText(buffer, "{")) {
+        goto error;
+    }
+
+    first = LDBooleanTrue;
+
+    for (i = 0; i < evaluation.flagCount; i++) {
+        if (evaluation.values[i]) {
+            if ((!first && !LDi_writeText(buffer, ",")) ||
+                !LDi_writeString(buffer, evaluation.keys[i]) ||
+                !LDi_writeText(buffer, ":") ||
+                !LDi_writeJSON(buffer, evaluation.values[i]))
+            {
+                goto error;
+            }
+
+            first = LDBooleanFalse;
+        }
+    }
+
+    if (options & (LD_ALLFLAGS_WITH_REASONS | LD_ALLFLAGS_WITH_METADATA)) {
+        if (!LDi_writeText(buffer, first ? "" : ",") ||
+            !LDi_writeText(buffer, "\"$flagsState\":{"))
+        {
+            goto error;
+        }
+
+        first = LDBooleanTrue;
 
+        for (i = 0; i < evaluation.flagCount; i++) {
+            /* deleted after it was listed, or missing from the backend */
+            if (!evaluation.flags[i]) {
+                continue;
+            }
+
+            if ((!first && !LDi_writeText(buffer, ",")) ||
+                !writeFlagState(
+                    buffer,
+                    &evaluation,
+                    i,
+                    (options & LD_ALLFLAGS_WITH_REASONS) != 0))
+            {
                 goto error;
             }
+
+            first = LDBooleanFalse;
         }
 
-        LDJSONFree(events);
-        LDDetailsClear(&details);
+        if (!LDi_writeText(buffer, "},\"$valid\":true")) {
+            goto error;
+        }
     }
 
-    LDJSONRCDecrement(rawFlagsRC);
+    if (!LDi_writeText(buffer, "}")) {
+        goto error;
+    }
 
-    return evaluatedFlags;
+    clearAllFlagsEvaluation(&evaluation);
+
+    return LDBooleanTrue;
 
 error:
-    LDJSONRCDecrement(rawFlagsRC);
-    LDJSONFree(evaluatedFlags);
+    LD_LOG(LD_LOG_ERROR, "LDAllFlagsState failed");
 
-    return NULL;
+    clearAllFlagsEvaluation(&evaluation);
+
+    /* nothing of a failed call is left in the buffer */
+    buffer->length = start;
+
+    if (buffer->text) {
+        buffer->text[start] = '\0';
+    }
+
+    return LDBooleanFalse;
 }
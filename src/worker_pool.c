@@ -0,0 +1,175 @@
+#include <launchdarkly/api.h>
+
+#include "assertion.h"
+#include "concurrency.h"
+#include "worker_pool.h"
+
+#include "utlist.h"
+
+struct WorkerTask
+{
+    void (*task)(void *argument);
+    void *             argument;
+    struct WorkerTask *next;
+};
+
+struct LDWorkerPool
+{
+    ld_mutex_t   lock;
+    ld_cond_t    queued;
+    LDBoolean    stop;
+    unsigned int threadCount;
+    ld_thread_t *threads;
+    /* first in first out */
+    struct WorkerTask *tasks;
+};
+
+static THREAD_RETURN
+workerThread(void *const argument)
+{
+    struct LDWorkerPool *pool;
+    struct WorkerTask *  task;
+
+    LD_ASSERT(argument);
+
+    pool = (struct LDWorkerPool *)argument;
+
+    LDi_mutex_lock(&pool->lock);
+
+    while (LDBooleanTrue) {
+        if (!(task = pool->tasks)) {
+            if (pool->stop) {
+                break;
+            }
+
+            LDi_cond_wait(&pool->queued, &pool->lock, 1000);
+
+            continue;
+        }
+
+        LL_DELETE(pool->tasks, task);
+
+        LDi_mutex_unlock(&pool->lock);
+
+        task->task(task->argument);
+
+        LDFree(task);
+
+        LDi_mutex_lock(&pool->lock);
+    }
+
+    LDi_mutex_unlock(&pool->lock);
+
+    return THREAD_RETURN_DEFAULT;
+}
+
+static void
+stopWorkers(struct LDWorkerPool *const pool, const unsigned int started)
+{
+    unsigned int i;
+
+    LDi_mutex_lock(&pool->lock);
+    pool->stop = LDBooleanTrue;
+    LDi_cond_signal(&pool->queued);
+    LDi_mutex_unlock(&pool->lock);
+
+    for (i = 0; i < started; i++) {
+        LDi_thread_join(&pool->threads[i]);
+    }
+}
+
+struct LDWorkerPool *
+LDi_newWorkerPool(const unsigned int threadCount)
+{
+    struct LDWorkerPool *pool;
+    unsigned int         i;
+
+    LD_ASSERT(threadCount > 0);
+
+    if (!(pool = (struct LDWorkerPool *)LDAlloc(sizeof(struct LDWorkerPool))))
+    {
+        return NULL;
+    }
+
+    if (!(pool->threads =
+              (ld_thread_t *)LDAlloc(sizeof(ld_thread_t) * threadCount)))
+    {
+        LDFree(pool);
+
+        return NULL;
+    }
+
+    pool->stop        = LDBooleanFalse;
+    pool->threadCount = threadCount;
+    pool->tasks       = NULL;
+
+    LDi_mutex_init(&pool->lock);
+    LDi_cond_init(&pool->queued);
+
+    for (i = 0; i < threadCount; i++) {
+        if (!LDi_thread_create(&pool->threads[i], workerThread, pool)) {
+            LD_LOG(LD_LOG_ERROR, "failed to start worker thread");
+
+            stopWorkers(pool, i);
+
+            LDi_cond_destroy(&pool->queued);
+            LDi_mutex_destroy(&pool->lock);
+            LDFree(pool->threads);
+            LDFree(pool);
+
+            return NULL;
+        }
+    }
+
+    return pool;
+}
+
+void
+LDi_freeWorkerPool(struct LDWorkerPool *const pool)
+{
+    if (pool) {
+        stopWorkers(pool, pool->threadCount);
+
+        LDi_cond_destroy(&pool->queued);
+        LDi_mutex_destroy(&pool->lock);
+        LDFree(pool->threads);
+        LDFree(pool);
+    }
+}
+
+LDBoolean
+LDi_workerPoolSubmit(
+    struct LDWorkerPool *const pool,
+    void (*const task)(void *argument),
+    void *const argument)
+{
+    struct WorkerTask *entry;
+
+    LD_ASSERT(pool);
+    LD_ASSERT(task);
+
+    if (!(entry = (struct WorkerTask *)LDAlloc(sizeof(struct WorkerTask)))) {
+        return LDBooleanFalse;
+    }
+
+    entry->task     = task;
+    entry->argument = argument;
+
+    LDi_mutex_lock(&pool->lock);
+    LL_APPEND(pool->tasks, entry);
+    LDi_cond_signal(&pool->queued);
+    LDi_mutex_unlock(&pool->lock);
+
+    return LDBooleanTrue;
+}
+
+void
+LDi_workerPoolExecutor(
+    void (*task)(void *argument), void *argument, void *context)
+{
+    LD_ASSERT(context);
+
+    if (!LDi_workerPoolSubmit((struct LDWorkerPool *)context, task, argument)) {
+        task(argument);
+    }
+}
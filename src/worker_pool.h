@@ -0,0 +1,31 @@
+/*!
+ * @file worker_pool.h
+ * @brief Internal API Interface for a fixed pool of worker threads
+ */
+
+#pragma once
+
+#include <launchdarkly/boolean.h>
+
+struct LDWorkerPool;
+
+/* Starts `threadCount` threads. Returns NULL if any of them fail to start. */
+struct LDWorkerPool *
+LDi_newWorkerPool(const unsigned int threadCount);
+
+/* Runs every task still queued, then stops and joins the threads */
+void
+LDi_freeWorkerPool(struct LDWorkerPool *const pool);
+
+/* Queues `task(argument)` to run once on a pool thread */
+LDBoolean
+LDi_workerPoolSubmit(
+    struct LDWorkerPool *const pool,
+    void (*const task)(void *argument),
+    void *const argument);
+
+/* An `LDTaskExecutor` that submits to the pool given as `context`. Tasks that
+cannot be queued are run on the calling thread. */
+void
+LDi_workerPoolExecutor(
+    void (*task)(void *argument), void *argument, void *context);
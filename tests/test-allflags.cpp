@@ -1,10 +1,15 @@
 #include "gtest/gtest.h"
 #include "commonfixture.h"
 
+#include <utility>
+#include <vector>
+
 extern "C" {
+#include <stdio.h>
 #include <string.h>
 
 #include <launchdarkly/api.h>
+#include "assertion.h"
 #include "client.h"
 #include "config.h"
 #include "evaluate.h"
@@ -141,3 +146,476 @@ TEST_F(AllFlagsFixture, AllFlagsNoFlagsInStore) {
     LDUserFree(user);
     LDClientClose(client);
 }
+
+static struct LDJSON *
+makeRolloutFlag(const unsigned int index) {
+    struct LDJSON *flag, *fallthrough, *rollout, *variations, *variation;
+    char key[32];
+    unsigned int i;
+
+    snprintf(key, sizeof(key), "rollout%u", index);
+
+    LD_ASSERT(flag = LDNewObject());
+    LD_ASSERT(LDObjectSetKey(flag, "key", LDNewText(key)));
+    LD_ASSERT(LDObjectSetKey(flag, "version", LDNewNumber(1)));
+    LD_ASSERT(LDObjectSetKey(flag, "on", LDNewBool(LDBooleanTrue)));
+    LD_ASSERT(LDObjectSetKey(flag, "salt", LDNewText("salt")));
+    addVariation(flag, LDNewText("a"));
+    addVariation(flag, LDNewText("b"));
+    addVariation(flag, LDNewText("c"));
+
+    LD_ASSERT(variations = LDNewArray());
+
+    for (i = 0; i < 3; i++) {
+        LD_ASSERT(variation = LDNewObject());
+        LD_ASSERT(LDObjectSetKey(variation, "variation", LDNewNumber(i)));
+        LD_ASSERT(LDObjectSetKey(variation, "weight", LDNewNumber(i == 2 ? 33334 : 33333)));
+        LD_ASSERT(LDArrayPush(variations, variation));
+    }
+
+    LD_ASSERT(rollout = LDNewObject());
+    LD_ASSERT(LDObjectSetKey(rollout, "variations", variations));
+
+    /* mix seeded rollouts and rollouts by a custom attribute */
+    if (index % 3 == 1) {
+        LD_ASSERT(LDObjectSetKey(rollout, "seed", LDNewNumber(index)));
+    } else if (index % 3 == 2) {
+        LD_ASSERT(LDObjectSetKey(rollout, "bucketBy", LDNewText("group")));
+    }
+
+    LD_ASSERT(fallthrough = LDNewObject());
+    LD_ASSERT(LDObjectSetKey(fallthrough, "rollout", rollout));
+    LD_ASSERT(LDObjectSetKey(flag, "fallthrough", fallthrough));
+
+    return flag;
+}
+
+/* Fallthrough rollouts are bucketed in batches, which must agree with
+evaluating each flag on its own. */
+TEST_F(AllFlagsFixture, AllFlagsRolloutsMatchSingleEvaluation) {
+    struct LDJSON *allFlags, *custom;
+    struct LDClient *client;
+    unsigned int i, u;
+
+    ASSERT_TRUE(client = makeTestClient());
+    ASSERT_TRUE(LDStoreInitEmpty(client->store));
+
+    for (i = 0; i < 23; i++) {
+        ASSERT_TRUE(LDStoreUpsert(client->store, LD_FLAG, makeRolloutFlag(i)));
+    }
+
+    for (u = 0; u < 20; u++) {
+        struct LDUser *user;
+        char userKey[32];
+
+        snprintf(userKey, sizeof(userKey), "user%u", u);
+
+        ASSERT_TRUE(user = LDUserNew(userKey));
+        ASSERT_TRUE(custom = LDNewObject());
+        ASSERT_TRUE(LDObjectSetKey(custom, "group", LDNewText(userKey + u % 4)));
+        LDUserSetCustom(user, custom);
+
+        ASSERT_TRUE(allFlags = LDAllFlags(client, user));
+        ASSERT_EQ(LDCollectionGetSize(allFlags), 23);
+
+        for (i = 0; i < 23; i++) {
+            char flagKey[32];
+            char *single;
+
+            snprintf(flagKey, sizeof(flagKey), "rollout%u", i);
+
+            ASSERT_TRUE(single = LDStringVariation(client, user, flagKey, "x", NULL));
+            ASSERT_STREQ(LDGetText(LDObjectLookup(allFlags, flagKey)), single);
+            LDFree(single);
+        }
+
+        LDJSONFree(allFlags);
+        LDUserFree(user);
+    }
+
+    LDClientClose(client);
+}
+
+static struct LDClient *
+makeRolloutClient(
+        const unsigned int flagCount,
+        const unsigned int workers,
+        LDTaskExecutor executor,
+        void *const context) {
+    struct LDConfig *config;
+    struct LDClient *client;
+    unsigned int i;
+
+    LD_ASSERT(config = LDConfigNew("key"));
+    LDConfigSetAllFlagsWorkers(config, workers);
+    LDConfigSetAllFlagsExecutor(config, executor, context);
+    LD_ASSERT(client = LDClientInit(config, 0));
+    LD_ASSERT(LDStoreInitEmpty(client->store));
+
+    for (i = 0; i < flagCount; i++) {
+        LD_ASSERT(LDStoreUpsert(client->store, LD_FLAG, makeRolloutFlag(i)));
+    }
+
+    return client;
+}
+
+static struct LDUser *
+makeGroupUser(const char *const key) {
+    struct LDUser *user;
+    struct LDJSON *custom;
+
+    LD_ASSERT(user = LDUserNew(key));
+    LD_ASSERT(custom = LDNewObject());
+    LD_ASSERT(LDObjectSetKey(custom, "group", LDNewText(key)));
+    LDUserSetCustom(user, custom);
+
+    return user;
+}
+
+TEST_F(AllFlagsFixture, AllFlagsWithWorkersMatchesSerial) {
+    struct LDClient *serial, *parallel;
+    struct LDJSON *expected, *actual;
+    struct LDUser *user;
+    unsigned int u;
+
+    ASSERT_TRUE(serial = makeRolloutClient(1000, 0, NULL, NULL));
+    ASSERT_TRUE(parallel = makeRolloutClient(1000, 3, NULL, NULL));
+    ASSERT_TRUE(parallel->workers);
+
+    for (u = 0; u < 10; u++) {
+        char userKey[32];
+
+        snprintf(userKey, sizeof(userKey), "user%u", u);
+
+        ASSERT_TRUE(user = makeGroupUser(userKey));
+        ASSERT_TRUE(expected = LDAllFlags(serial, user));
+        ASSERT_TRUE(actual = LDAllFlags(parallel, user));
+
+        ASSERT_EQ(LDCollectionGetSize(actual), 1000);
+        ASSERT_TRUE(LDJSONCompare(expected, actual));
+
+        LDJSONFree(expected);
+        LDJSONFree(actual);
+        LDUserFree(user);
+    }
+
+    LDClientClose(serial);
+    LDClientClose(parallel);
+}
+
+typedef std::vector<std::pair<void (*)(void *), void *>> DeferredTasks;
+
+static void
+deferTask(void (*task)(void *argument), void *argument, void *context) {
+    ((DeferredTasks *)context)->push_back(std::make_pair(task, argument));
+}
+
+/* an application pool may start tasks after LDAllFlags has returned, in which
+case the calling thread has done all of the work */
+TEST_F(AllFlagsFixture, AllFlagsExecutorTasksMayRunLate) {
+    struct LDClient *serial, *deferred;
+    struct LDJSON *expected, *actual;
+    struct LDUser *user;
+    DeferredTasks tasks;
+
+    ASSERT_TRUE(serial = makeRolloutClient(500, 0, NULL, NULL));
+    ASSERT_TRUE(deferred = makeRolloutClient(500, 4, deferTask, &tasks));
+    ASSERT_FALSE(deferred->workers);
+    ASSERT_TRUE(user = makeGroupUser("user"));
+
+    ASSERT_TRUE(expected = LDAllFlags(serial, user));
+    ASSERT_TRUE(actual = LDAllFlags(deferred, user));
+    ASSERT_TRUE(LDJSONCompare(expected, actual));
+    ASSERT_EQ(tasks.size(), 4);
+
+    for (size_t i = 0; i < tasks.size(); i++) {
+        tasks[i].first(tasks[i].second);
+    }
+
+    LDJSONFree(expected);
+    LDJSONFree(actual);
+    LDUserFree(user);
+    LDClientClose(serial);
+    LDClientClose(deferred);
+}
+
+/* without options the text is exactly the serialization of LDAllFlags */
+TEST_F(AllFlagsFixture, AllFlagsStateMatchesSerializedAllFlags) {
+    struct LDClient *client;
+    struct LDJSON *flag, *allFlags;
+    struct LDUser *user;
+    struct LDTextBuffer buffer;
+    char *expected;
+
+    ASSERT_TRUE(client = makeRolloutClient(100, 0, NULL, NULL));
+    ASSERT_TRUE(user = makeGroupUser("user"));
+
+    /* values that need escaping and careful number formatting */
+    ASSERT_TRUE(flag = LDNewObject());
+    ASSERT_TRUE(LDObjectSetKey(flag, "key", LDNewText("odd \"key\"\n")));
+    ASSERT_TRUE(LDObjectSetKey(flag, "version", LDNewNumber(1)));
+    ASSERT_TRUE(LDObjectSetKey(flag, "on", LDNewBool(LDBooleanFalse)));
+    ASSERT_TRUE(LDObjectSetKey(flag, "offVariation", LDNewNumber(0)));
+    addVariation(flag, LDJSONDeserialize(
+        "{\"a\":[0.1,-3,1e300,\"\\u0001\\\\\",null,true],\"b\":{}}"));
+    ASSERT_TRUE(LDStoreUpsert(client->store, LD_FLAG, flag));
+
+    memset(&buffer, 0, sizeof(buffer));
+
+    ASSERT_TRUE(allFlags = LDAllFlags(client, user));
+    ASSERT_TRUE(expected = LDJSONSerialize(allFlags));
+    ASSERT_TRUE(LDAllFlagsState(client, user, 0, NULL, &buffer));
+    ASSERT_STREQ(buffer.text, expected);
+    ASSERT_EQ(buffer.length, strlen(expected));
+
+    /* the buffer is reused */
+    buffer.length = 0;
+    ASSERT_TRUE(LDAllFlagsState(client, user, 0, NULL, &buffer));
+    ASSERT_STREQ(buffer.text, expected);
+
+    LDFree(expected);
+    LDFree(buffer.text);
+    LDJSONFree(allFlags);
+    LDUserFree(user);
+    LDClientClose(client);
+}
+
+TEST_F(AllFlagsFixture, AllFlagsStateFiltersAndDescribesFlags) {
+    struct LDClient *client;
+    struct LDJSON *flag, *state, *flagsState, *meta;
+    struct LDUser *user;
+    struct LDTextBuffer buffer;
+
+    ASSERT_TRUE(client = makeTestClient());
+    ASSERT_TRUE(user = LDUserNew("user"));
+    ASSERT_TRUE(LDStoreInitEmpty(client->store));
+
+    /* client side, tracked, and matched by the prefix */
+    ASSERT_TRUE(flag = LDNewObject());
+    ASSERT_TRUE(LDObjectSetKey(flag, "key", LDNewText("web-tracked")));
+    ASSERT_TRUE(LDObjectSetKey(flag, "version", LDNewNumber(7)));
+    ASSERT_TRUE(LDObjectSetKey(flag, "on", LDNewBool(LDBooleanTrue)));
+    ASSERT_TRUE(LDObjectSetKey(flag, "salt", LDNewText("abc")));
+    ASSERT_TRUE(LDObjectSetKey(flag, "clientSide", LDNewBool(LDBooleanTrue)));
+    ASSERT_TRUE(LDObjectSetKey(flag, "trackEvents", LDNewBool(LDBooleanTrue)));
+    setFallthrough(flag, 1);
+    addVariation(flag, LDNewText("a"));
+    addVariation(flag, LDNewText("b"));
+    ASSERT_TRUE(LDStoreUpsert(client->store, LD_FLAG, flag));
+
+    /* client side through the newer availability object, but off */
+    ASSERT_TRUE(flag = LDNewObject());
+    ASSERT_TRUE(LDObjectSetKey(flag, "key", LDNewText("web-off")));
+    ASSERT_TRUE(LDObjectSetKey(flag, "version", LDNewNumber(2)));
+    ASSERT_TRUE(LDObjectSetKey(flag, "on", LDNewBool(LDBooleanFalse)));
+    ASSERT_TRUE(LDObjectSetKey(flag, "offVariation", LDNewNumber(0)));
+    ASSERT_TRUE(LDObjectSetKey(flag, "clientSideAvailability",
+        LDJSONDeserialize("{\"usingEnvironmentId\":true}")));
+    addVariation(flag, LDNewNumber(3));
+    ASSERT_TRUE(LDStoreUpsert(client->store, LD_FLAG, flag));
+
+    /* server side only */
+    ASSERT_TRUE(flag = LDNewObject());
+    ASSERT_TRUE(LDObjectSetKey(flag, "key", LDNewText("web-server")));
+    ASSERT_TRUE(LDObjectSetKey(flag, "version", LDNewNumber(1)));
+    ASSERT_TRUE(LDObjectSetKey(flag, "on", LDNewBool(LDBooleanFalse)));
+    ASSERT_TRUE(LDObjectSetKey(flag, "offVariation", LDNewNumber(0)));
+    addVariation(flag, LDNewBool(LDBooleanTrue));
+    ASSERT_TRUE(LDStoreUpsert(client->store, LD_FLAG, flag));
+
+    /* client side, but not matched by the prefix */
+    ASSERT_TRUE(flag = LDNewObject());
+    ASSERT_TRUE(LDObjectSetKey(flag, "key", LDNewText("mobile")));
+    ASSERT_TRUE(LDObjectSetKey(flag, "version", LDNewNumber(1)));
+    ASSERT_TRUE(LDObjectSetKey(flag, "on", LDNewBool(LDBooleanFalse)));
+    ASSERT_TRUE(LDObjectSetKey(flag, "offVariation", LDNewNumber(0)));
+    ASSERT_TRUE(LDObjectSetKey(flag, "clientSide", LDNewBool(LDBooleanTrue)));
+    addVariation(flag, LDNewBool(LDBooleanTrue));
+    ASSERT_TRUE(LDStoreUpsert(client->store, LD_FLAG, flag));
+
+    memset(&buffer, 0, sizeof(buffer));
+
+    ASSERT_TRUE(LDAllFlagsState(client, user,
+        LD_ALLFLAGS_CLIENT_SIDE_ONLY | LD_ALLFLAGS_WITH_REASONS, "web-",
+        &buffer));
+    ASSERT_TRUE(state = LDJSONDeserialize(buffer.text));
+
+    ASSERT_EQ(LDCollectionGetSize(state), 4);
+    ASSERT_STREQ(LDGetText(LDObjectLookup(state, "web-tracked")), "b");
+    ASSERT_EQ(LDGetNumber(LDObjectLookup(state, "web-off")), 3);
+    ASSERT_TRUE(LDGetBool(LDObjectLookup(state, "$valid")));
+    ASSERT_TRUE(flagsState = LDObjectLookup(state, "$flagsState"));
+    ASSERT_EQ(LDCollectionGetSize(flagsState), 2);
+
+    ASSERT_TRUE(meta = LDObjectLookup(flagsState, "web-tracked"));
+    ASSERT_EQ(LDGetNumber(LDObjectLookup(meta, "variation")), 1);
+    ASSERT_EQ(LDGetNumber(LDObjectLookup(meta, "version")), 7);
+    ASSERT_TRUE(LDGetBool(LDObjectLookup(meta, "trackEvents")));
+    ASSERT_STREQ(LDGetText(LDObjectLookup(
+        LDObjectLookup(meta, "reason"), "kind")), "FALLTHROUGH");
+
+    ASSERT_TRUE(meta = LDObjectLookup(flagsState, "web-off"));
+    ASSERT_EQ(LDGetNumber(LDObjectLookup(meta, "variation")), 0);
+    ASSERT_EQ(LDGetNumber(LDObjectLookup(meta, "version")), 2);
+    ASSERT_FALSE(LDObjectLookup(meta, "trackEvents"));
+    ASSERT_STREQ(LDGetText(LDObjectLookup(
+        LDObjectLookup(meta, "reason"), "kind")), "OFF");
+
+    LDJSONFree(state);
+    LDFree(buffer.text);
+    LDUserFree(user);
+    LDClientClose(client);
+}
+
+static struct LDJSON *listedFlag;
+
+static LDBoolean
+mockListedInit(
+        void *const context,
+        const struct LDStoreCollectionState *collections,
+        const unsigned int collectionCount) {
+    (void) context;
+    (void) collections;
+    (void) collectionCount;
+
+    return LDBooleanTrue;
+}
+
+static void
+serializeItem(
+        const struct LDJSON *const feature,
+        struct LDStoreCollectionItem *const item) {
+    LD_ASSERT(item->buffer = LDJSONSerialize(feature));
+    item->bufferSize = strlen((char *) item->buffer) + 1;
+    item->version = LDGetNumber(LDObjectLookup(feature, "version"));
+}
+
+/* only "present" can be fetched on its own, "vanished" reads as deleted */
+static LDBoolean
+mockListedGet(
+        void *const context,
+        const char *const kind,
+        const char *const featureKey,
+        struct LDStoreCollectionItem *const result) {
+    (void) context;
+    (void) kind;
+
+    if (strcmp(featureKey, "present") == 0) {
+        serializeItem(listedFlag, result);
+    } else {
+        result->buffer = NULL;
+        result->bufferSize = 0;
+        result->version = 0;
+    }
+
+    return LDBooleanTrue;
+}
+
+/* lists "vanished" before "present" */
+static LDBoolean
+mockListedAll(
+        void *const context,
+        const char *const kind,
+        struct LDStoreCollectionItem **const result,
+        unsigned int *const resultCount) {
+    struct LDJSON *vanished;
+
+    (void) context;
+
+    *result = NULL;
+    *resultCount = 0;
+
+    if (strcmp(kind, "features") != 0) {
+        return LDBooleanTrue;
+    }
+
+    LD_ASSERT(vanished = LDJSONDuplicate(listedFlag));
+    LD_ASSERT(LDObjectSetKey(vanished, "key", LDNewText("vanished")));
+
+    LD_ASSERT(*result = static_cast<struct LDStoreCollectionItem *>(
+            LDAlloc(sizeof(struct LDStoreCollectionItem) * 2)));
+    serializeItem(vanished, &(*result)[0]);
+    serializeItem(listedFlag, &(*result)[1]);
+    *resultCount = 2;
+
+    LDJSONFree(vanished);
+
+    return LDBooleanTrue;
+}
+
+static LDBoolean
+mockListedUpsert(
+        void *const context,
+        const char *const kind,
+        const struct LDStoreCollectionItem *const feature,
+        const char *const featureKey) {
+    (void) context;
+    (void) kind;
+    (void) feature;
+    (void) featureKey;
+
+    return LDBooleanTrue;
+}
+
+static LDBoolean
+mockListedInitialized(void *const context) {
+    (void) context;
+
+    return LDBooleanTrue;
+}
+
+static void
+mockListedDestructor(void *const context) {
+    (void) context;
+}
+
+TEST_F(AllFlagsFixture, AllFlagsStateSkipsListedFlagsThatCannotBeFetched) {
+    struct LDConfig *config;
+    struct LDClient *client;
+    struct LDStoreInterface *handle;
+    struct LDJSON *state, *flagsState;
+    struct LDUser *user;
+    struct LDTextBuffer buffer;
+
+    ASSERT_TRUE(listedFlag = LDNewObject());
+    ASSERT_TRUE(LDObjectSetKey(listedFlag, "key", LDNewText("present")));
+    ASSERT_TRUE(LDObjectSetKey(listedFlag, "version", LDNewNumber(3)));
+    ASSERT_TRUE(LDObjectSetKey(listedFlag, "on", LDNewBool(LDBooleanFalse)));
+    ASSERT_TRUE(LDObjectSetKey(listedFlag, "offVariation", LDNewNumber(0)));
+    addVariation(listedFlag, LDNewText("a"));
+
+    ASSERT_TRUE(handle = static_cast<struct LDStoreInterface *>(
+            LDAlloc(sizeof(struct LDStoreInterface))));
+    handle->context = NULL;
+    handle->init = mockListedInit;
+    handle->get = mockListedGet;
+    handle->all = mockListedAll;
+    handle->upsert = mockListedUpsert;
+    handle->initialized = mockListedInitialized;
+    handle->destructor = mockListedDestructor;
+
+    /* without a TTL every flag is fetched again after it is listed */
+    ASSERT_TRUE(config = LDConfigNew("key"));
+    LDConfigSetFeatureStoreBackend(config, handle);
+    LDConfigSetFeatureStoreBackendCacheTTL(config, 0);
+    ASSERT_TRUE(client = LDClientInit(config, 0));
+    ASSERT_TRUE(user = LDUserNew("user"));
+
+    memset(&buffer, 0, sizeof(buffer));
+
+    ASSERT_TRUE(LDAllFlagsState(client, user,
+        LD_ALLFLAGS_WITH_METADATA | LD_ALLFLAGS_WITH_REASONS, NULL, &buffer));
+    ASSERT_TRUE(state = LDJSONDeserialize(buffer.text));
+
+    ASSERT_STREQ(LDGetText(LDObjectLookup(state, "present")), "a");
+    ASSERT_FALSE(LDObjectLookup(state, "vanished"));
+    ASSERT_TRUE(flagsState = LDObjectLookup(state, "$flagsState"));
+    ASSERT_EQ(LDCollectionGetSize(flagsState), 1);
+    ASSERT_TRUE(LDObjectLookup(flagsState, "present"));
+
+    LDJSONFree(state);
+    LDFree(buffer.text);
+    LDUserFree(user);
+    LDClientClose(client);
+    LDJSONFree(listedFlag);
+}
@@ -0,0 +1,234 @@
+#include "gtest/gtest.h"
+#include "commonfixture.h"
+
+extern "C" {
+#include <launchdarkly/api.h>
+
+#include "assertion.h"
+#include "client.h"
+#include "config.h"
+#include "event_processor_internal.h"
+#include "store.h"
+#include "utility.h"
+
+#include "test-utils/flags.h"
+}
+
+// Inherit from the CommonFixture to give a reasonable name for the test output.
+// Any custom setup and teardown would happen in this derived class.
+class EvalCacheFixture : public CommonFixture {
+};
+
+static struct LDClient *
+makeCachingClient(const unsigned int capacity) {
+    struct LDConfig *config;
+    struct LDClient *client;
+
+    LD_ASSERT(config = LDConfigNew("key"));
+    LDConfigSetEvaluationCacheCapacity(config, capacity);
+    LD_ASSERT(client = LDClientInit(config, 0));
+    LD_ASSERT(LDStoreInitEmpty(client->store));
+
+    return client;
+}
+
+/* serves "on" to users in `country`, "fall" to everyone else */
+static struct LDJSON *
+makeCountryFlag(
+    const char *const key, const unsigned int version,
+    const char *const country) {
+    struct LDJSON *flag, *clause, *rule, *tmp;
+
+    LD_ASSERT(clause = LDNewObject());
+    LD_ASSERT(LDObjectSetKey(clause, "attribute", LDNewText("country")));
+    LD_ASSERT(LDObjectSetKey(clause, "op", LDNewText("in")));
+    LD_ASSERT(tmp = LDNewArray());
+    LD_ASSERT(LDArrayPush(tmp, LDNewText(country)));
+    LD_ASSERT(LDObjectSetKey(clause, "values", tmp));
+
+    LD_ASSERT(rule = LDNewObject());
+    LD_ASSERT(LDObjectSetKey(rule, "id", LDNewText("rule-id")));
+    LD_ASSERT(LDObjectSetKey(rule, "variation", LDNewNumber(2)));
+    LD_ASSERT(tmp = LDNewArray());
+    LD_ASSERT(LDArrayPush(tmp, clause));
+    LD_ASSERT(LDObjectSetKey(rule, "clauses", tmp));
+
+    flag = makeMinimalFlag(key, version, LDBooleanTrue, LDBooleanTrue);
+    addVariations1(flag);
+    setFallthrough(flag, 0);
+    LD_ASSERT(tmp = LDNewArray());
+    LD_ASSERT(LDArrayPush(tmp, rule));
+    LD_ASSERT(LDObjectSetKey(flag, "rules", tmp));
+
+    return flag;
+}
+
+static struct LDUser *
+makeCountryUser(const char *const key, const char *const country) {
+    struct LDUser *user;
+
+    LD_ASSERT(user = LDUserNew(key));
+    LD_ASSERT(LDUserSetCountry(user, country));
+
+    return user;
+}
+
+static void
+expectVariation(
+    struct LDClient *const client, struct LDUser *const user,
+    const char *const expected, const enum LDEvalReason reason) {
+    struct LDDetails details;
+    char *actual;
+
+    ASSERT_TRUE(actual = LDStringVariation(client, user, "flag", "x", &details));
+    ASSERT_STREQ(actual, expected);
+    ASSERT_EQ(details.reason, reason);
+
+    if (reason == LD_RULE_MATCH) {
+        ASSERT_STREQ(details.extra.rule.id, "rule-id");
+    }
+
+    LDFree(actual);
+    LDDetailsClear(&details);
+}
+
+/* only the attributes the flag reads are part of the key */
+TEST_F(EvalCacheFixture, UsersWithSameAttributesShareResults) {
+    struct LDClient *client;
+    struct LDUser *alice, *bob, *carol;
+    struct LDEvaluationCacheStats stats;
+    struct LDJSON *summary, *counters, *iter;
+    double total;
+
+    ASSERT_TRUE(client = makeCachingClient(10));
+    ASSERT_TRUE(LDStoreUpsert(
+        client->store, LD_FLAG, makeCountryFlag("flag", 1, "us")));
+
+    ASSERT_TRUE(alice = makeCountryUser("alice", "us"));
+    ASSERT_TRUE(bob = makeCountryUser("bob", "us"));
+    ASSERT_TRUE(carol = makeCountryUser("carol", "ca"));
+
+    expectVariation(client, alice, "on", LD_RULE_MATCH);
+    expectVariation(client, bob, "on", LD_RULE_MATCH);
+    expectVariation(client, carol, "fall", LD_FALLTHROUGH);
+    expectVariation(client, carol, "fall", LD_FALLTHROUGH);
+
+    ASSERT_TRUE(LDClientGetEvaluationCacheStats(client, &stats));
+    ASSERT_EQ(stats.hits, 2);
+    ASSERT_EQ(stats.misses, 2);
+    ASSERT_EQ(stats.entries, 2);
+
+    /* every evaluation is still summarized */
+    ASSERT_TRUE(summary = LDi_prepareSummaryEvent(client->eventProcessor, 0));
+    ASSERT_TRUE(counters = LDObjectLookup(
+        LDObjectLookup(LDObjectLookup(summary, "features"), "flag"),
+        "counters"));
+
+    total = 0;
+
+    for (iter = LDGetIter(counters); iter; iter = LDIterNext(iter)) {
+        total += LDGetNumber(LDObjectLookup(iter, "count"));
+    }
+
+    ASSERT_EQ(total, 4);
+
+    LDJSONFree(summary);
+
+    LDUserFree(alice);
+    LDUserFree(bob);
+    LDUserFree(carol);
+    LDClientClose(client);
+}
+
+TEST_F(EvalCacheFixture, StoreChangesDiscardResults) {
+    struct LDClient *client;
+    struct LDUser *user;
+    struct LDEvaluationCacheStats stats;
+
+    ASSERT_TRUE(client = makeCachingClient(10));
+    ASSERT_TRUE(LDStoreUpsert(
+        client->store, LD_FLAG, makeCountryFlag("flag", 1, "us")));
+    ASSERT_TRUE(user = makeCountryUser("alice", "us"));
+
+    expectVariation(client, user, "on", LD_RULE_MATCH);
+    expectVariation(client, user, "on", LD_RULE_MATCH);
+
+    ASSERT_TRUE(LDStoreUpsert(
+        client->store, LD_FLAG, makeCountryFlag("flag", 2, "ca")));
+
+    expectVariation(client, user, "fall", LD_FALLTHROUGH);
+
+    ASSERT_TRUE(LDClientGetEvaluationCacheStats(client, &stats));
+    ASSERT_EQ(stats.hits, 1);
+    ASSERT_EQ(stats.misses, 2);
+    ASSERT_EQ(stats.entries, 1);
+
+    LDUserFree(user);
+    LDClientClose(client);
+}
+
+TEST_F(EvalCacheFixture, LeastRecentlyUsedResultIsEvicted) {
+    struct LDClient *client;
+    struct LDUser *us, *ca, *fr;
+    struct LDEvaluationCacheStats stats;
+
+    ASSERT_TRUE(client = makeCachingClient(2));
+    ASSERT_TRUE(LDStoreUpsert(
+        client->store, LD_FLAG, makeCountryFlag("flag", 1, "us")));
+
+    ASSERT_TRUE(us = makeCountryUser("a", "us"));
+    ASSERT_TRUE(ca = makeCountryUser("b", "ca"));
+    ASSERT_TRUE(fr = makeCountryUser("c", "fr"));
+
+    expectVariation(client, us, "on", LD_RULE_MATCH);
+    expectVariation(client, ca, "fall", LD_FALLTHROUGH);
+    expectVariation(client, us, "on", LD_RULE_MATCH);
+    /* evicts "ca" */
+    expectVariation(client, fr, "fall", LD_FALLTHROUGH);
+    expectVariation(client, us, "on", LD_RULE_MATCH);
+    expectVariation(client, ca, "fall", LD_FALLTHROUGH);
+
+    ASSERT_TRUE(LDClientGetEvaluationCacheStats(client, &stats));
+    ASSERT_EQ(stats.hits, 2);
+    ASSERT_EQ(stats.misses, 4);
+    ASSERT_EQ(stats.entries, 2);
+
+    LDUserFree(us);
+    LDUserFree(ca);
+    LDUserFree(fr);
+    LDClientClose(client);
+}
+
+/* prerequisite events are specific to each evaluation */
+TEST_F(EvalCacheFixture, FlagsWithPrerequisitesAreNotCached) {
+    struct LDClient *client;
+    struct LDJSON *flag, *prerequisites, *prerequisite;
+    struct LDUser *user;
+    struct LDEvaluationCacheStats stats;
+
+    ASSERT_TRUE(client = makeCachingClient(10));
+    ASSERT_TRUE(LDStoreUpsert(
+        client->store, LD_FLAG, makeCountryFlag("parent", 1, "us")));
+
+    ASSERT_TRUE(prerequisite = LDNewObject());
+    ASSERT_TRUE(LDObjectSetKey(prerequisite, "key", LDNewText("parent")));
+    ASSERT_TRUE(LDObjectSetKey(prerequisite, "variation", LDNewNumber(2)));
+    ASSERT_TRUE(prerequisites = LDNewArray());
+    ASSERT_TRUE(LDArrayPush(prerequisites, prerequisite));
+    ASSERT_TRUE(flag = makeCountryFlag("flag", 1, "us"));
+    ASSERT_TRUE(LDObjectSetKey(flag, "prerequisites", prerequisites));
+    ASSERT_TRUE(LDObjectSetKey(flag, "offVariation", LDNewNumber(1)));
+    ASSERT_TRUE(LDStoreUpsert(client->store, LD_FLAG, flag));
+
+    ASSERT_TRUE(user = makeCountryUser("alice", "us"));
+
+    expectVariation(client, user, "on", LD_RULE_MATCH);
+    expectVariation(client, user, "on", LD_RULE_MATCH);
+
+    ASSERT_TRUE(LDClientGetEvaluationCacheStats(client, &stats));
+    ASSERT_EQ(stats.hits, 0);
+    ASSERT_EQ(stats.misses, 0);
+
+    LDUserFree(user);
+    LDClientClose(client);
+}
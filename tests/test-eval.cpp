@@ -10,8 +10,11 @@ extern "C" {
 
 #include "assertion.h"
 #include "evaluate.h"
+#include "hexify.h"
+#include "sha1.h"
 #include "store.h"
 #include "test-utils/flags.h"
+#include "user.h"
 #include "utility.h"
 }
 
@@ -36,6 +39,35 @@ prepareEmptyStore() {
     return store;
 }
 
+/* compiles the flag the same way the store does before evaluating it */
+static EvalStatus
+evaluateJSON(
+        struct LDClient *const client,
+        const struct LDJSON *const json,
+        const struct LDUser *const user,
+        struct LDStore *const store,
+        struct LDDetails *const details,
+        struct LDEventRecord **const o_events,
+        struct LDJSON **const o_value,
+        const LDBoolean recordReason) {
+    struct LDFlag *flag;
+    EvalStatus status;
+    struct LDEvalMemo memo;
+
+    LD_ASSERT(flag = LDi_newFlag(json));
+
+    LDi_initEvalMemo(&memo);
+
+    status = LDi_evaluate(
+            client, flag, user, store, details, o_events, o_value, recordReason,
+            &memo, NULL);
+
+    LDi_clearEvalMemo(&memo);
+    LDi_freeFlag(flag);
+
+    return status;
+}
+
 static void
 addPrerequisite(
         struct LDJSON *const flag,
@@ -84,7 +116,8 @@ booleanFlagWithClause(struct LDJSON *const clause) {
 
 TEST_F(EvalFixture, ReturnsOffVariationIfFlagIsOff) {
     struct LDUser *user;
-    struct LDJSON *flag, *result, *events;
+    struct LDJSON *flag, *result;
+    struct LDEventRecord *events;
     struct LDDetails details;
 
     events = NULL;
@@ -104,7 +137,7 @@ TEST_F(EvalFixture, ReturnsOffVariationIfFlagIsOff) {
 
     /* run */
     ASSERT_EQ(
-            LDi_evaluate(
+            evaluateJSON(
                     NULL,
                     flag,
                     user,
@@ -129,7 +162,8 @@ TEST_F(EvalFixture, ReturnsOffVariationIfFlagIsOff) {
 
 TEST_F(EvalFixture, FlagReturnsNilIfFlagIsOffAndOffVariantIsUnspecified) {
     struct LDUser *user;
-    struct LDJSON *flag, *result, *events;
+    struct LDJSON *flag, *result;
+    struct LDEventRecord *events;
     struct LDDetails details;
 
     events = NULL;
@@ -148,7 +182,7 @@ TEST_F(EvalFixture, FlagReturnsNilIfFlagIsOffAndOffVariantIsUnspecified) {
 
     /* run */
     ASSERT_EQ(
-            LDi_evaluate(
+            evaluateJSON(
                     NULL,
                     flag,
                     user,
@@ -172,7 +206,8 @@ TEST_F(EvalFixture, FlagReturnsNilIfFlagIsOffAndOffVariantIsUnspecified) {
 
 TEST_F(EvalFixture, FlagReturnsFallthroughIfFlagIsOnAndThereAreNoRules) {
     struct LDUser *user;
-    struct LDJSON *flag, *result, *events;
+    struct LDJSON *flag, *result;
+    struct LDEventRecord *events;
     struct LDDetails details;
     struct LDClient *client;
     struct LDConfig *config;
@@ -196,7 +231,7 @@ TEST_F(EvalFixture, FlagReturnsFallthroughIfFlagIsOnAndThereAreNoRules) {
 
     /* run */
     ASSERT_EQ(
-            LDi_evaluate(
+            evaluateJSON(
                     client,
                     flag,
                     user,
@@ -222,7 +257,8 @@ TEST_F(EvalFixture, FlagReturnsFallthroughIfFlagIsOnAndThereAreNoRules) {
 
 TEST_F(EvalFixture, FlagReturnsErrorForFallthroughWithNoVariationAndNoRollout) {
     struct LDUser *user;
-    struct LDJSON *flag, *result, *events;
+    struct LDJSON *flag, *result;
+    struct LDEventRecord *events;
     struct LDDetails details;
     struct LDClient *client;
     struct LDConfig *config;
@@ -249,7 +285,7 @@ TEST_F(EvalFixture, FlagReturnsErrorForFallthroughWithNoVariationAndNoRollout) {
 
     /* run */
     ASSERT_EQ(
-            LDi_evaluate(
+            evaluateJSON(
                     client,
                     flag,
                     user,
@@ -273,7 +309,8 @@ TEST_F(EvalFixture, FlagReturnsErrorForFallthroughWithNoVariationAndNoRollout) {
 TEST_F(EvalFixture, FlagReturnsOffVariationIfPrerequisiteIsOff) {
     struct LDUser *user;
     struct LDStore *store;
-    struct LDJSON *flag1, *flag2, *result, *events, *eventsiter;
+    struct LDJSON *flag1, *flag2, *result;
+    struct LDEventRecord *events, *eventsiter;
     struct LDDetails details;
     struct LDClient *client;
     struct LDConfig *config;
@@ -310,7 +347,7 @@ TEST_F(EvalFixture, FlagReturnsOffVariationIfPrerequisiteIsOff) {
     ASSERT_TRUE(LDStoreUpsert(store, LD_FLAG, flag2));
 
     /* run */
-    ASSERT_TRUE(LDi_evaluate(
+    ASSERT_TRUE(evaluateJSON(
             client,
             flag1,
             user,
@@ -328,17 +365,17 @@ TEST_F(EvalFixture, FlagReturnsOffVariationIfPrerequisiteIsOff) {
     ASSERT_STREQ("feature1", details.extra.prerequisiteKey);
 
     ASSERT_TRUE(events);
-    ASSERT_EQ(LDCollectionGetSize(events), 1);
-    ASSERT_TRUE(eventsiter = LDGetIter(events));
-    ASSERT_STREQ("feature1", LDGetText(LDObjectLookup(eventsiter, "key")));
-    ASSERT_STREQ("go", LDGetText(LDObjectLookup(eventsiter, "value")));
-    ASSERT_EQ(LDGetNumber(LDObjectLookup(eventsiter, "version")), 3);
-    ASSERT_EQ(LDGetNumber(LDObjectLookup(eventsiter, "variation")), 1);
-    ASSERT_STREQ("feature0", LDGetText(LDObjectLookup(eventsiter, "prereqOf")));
+    ASSERT_FALSE(events->next);
+    ASSERT_TRUE(eventsiter = events);
+    ASSERT_STREQ("feature1", eventsiter->key);
+    ASSERT_STREQ("go", LDGetText(eventsiter->value));
+    ASSERT_EQ(eventsiter->version, 3);
+    ASSERT_EQ(eventsiter->variation, 1);
+    ASSERT_STREQ("feature0", eventsiter->prereqOf);
 
     LDJSONFree(flag1);
     LDJSONFree(result);
-    LDJSONFree(events);
+    LDi_freeEventRecords(events);
     LDStoreDestroy(store);
     LDUserFree(user);
     LDDetailsClear(&details);
@@ -348,7 +385,8 @@ TEST_F(EvalFixture, FlagReturnsOffVariationIfPrerequisiteIsOff) {
 TEST_F(EvalFixture, FlagReturnsOffVariationIfPrerequisiteIsNotMet) {
     struct LDUser *user;
     struct LDStore *store;
-    struct LDJSON *flag1, *flag2, *result, *events, *eventsiter;
+    struct LDJSON *flag1, *flag2, *result;
+    struct LDEventRecord *events, *eventsiter;
     struct LDDetails details;
     struct LDClient *client;
     struct LDConfig *config;
@@ -386,7 +424,7 @@ TEST_F(EvalFixture, FlagReturnsOffVariationIfPrerequisiteIsNotMet) {
     ASSERT_TRUE(LDStoreUpsert(store, LD_FLAG, flag2));
 
     /* run */
-    ASSERT_TRUE(LDi_evaluate(
+    ASSERT_TRUE(evaluateJSON(
             client,
             flag1,
             user,
@@ -403,19 +441,17 @@ TEST_F(EvalFixture, FlagReturnsOffVariationIfPrerequisiteIsNotMet) {
     ASSERT_EQ(details.reason, LD_PREREQUISITE_FAILED);
 
     ASSERT_TRUE(events);
-    ASSERT_EQ(LDCollectionGetSize(events), 1);
-    ASSERT_TRUE(eventsiter = LDGetIter(events));
-    ASSERT_STREQ("feature1", LDGetText(LDObjectLookup(eventsiter, "key")));
-    ASSERT_STREQ("nogo", LDGetText(LDObjectLookup(eventsiter, "value")));
-    ASSERT_EQ(LDGetNumber(LDObjectLookup(eventsiter, "version")), 2);
-    ASSERT_EQ(LDGetNumber(LDObjectLookup(eventsiter, "variation")), 0);
-    ASSERT_TRUE(
-            strcmp("feature0", LDGetText(LDObjectLookup(eventsiter, "prereqOf"))) ==
-            0);
+    ASSERT_FALSE(events->next);
+    ASSERT_TRUE(eventsiter = events);
+    ASSERT_STREQ("feature1", eventsiter->key);
+    ASSERT_STREQ("nogo", LDGetText(eventsiter->value));
+    ASSERT_EQ(eventsiter->version, 2);
+    ASSERT_EQ(eventsiter->variation, 0);
+    ASSERT_TRUE(strcmp("feature0", eventsiter->prereqOf) == 0);
 
     LDJSONFree(flag1);
     LDJSONFree(result);
-    LDJSONFree(events);
+    LDi_freeEventRecords(events);
     LDStoreDestroy(store);
     LDUserFree(user);
     LDDetailsClear(&details);
@@ -425,7 +461,8 @@ TEST_F(EvalFixture, FlagReturnsOffVariationIfPrerequisiteIsNotMet) {
 TEST_F(EvalFixture, FlagReturnsFallthroughVariationIfPrerequisiteIsMetAndThereAreNoRules) {
     struct LDUser *user;
     struct LDStore *store;
-    struct LDJSON *flag1, *flag2, *result, *events, *eventsiter;
+    struct LDJSON *flag1, *flag2, *result;
+    struct LDEventRecord *events, *eventsiter;
     struct LDDetails details;
     struct LDClient *client;
     struct LDConfig *config;
@@ -463,7 +500,7 @@ TEST_F(EvalFixture, FlagReturnsFallthroughVariationIfPrerequisiteIsMetAndThereAr
     ASSERT_TRUE(LDStoreUpsert(store, LD_FLAG, flag2));
 
     /* run */
-    ASSERT_TRUE(LDi_evaluate(
+    ASSERT_TRUE(evaluateJSON(
             client,
             flag1,
             user,
@@ -480,17 +517,85 @@ TEST_F(EvalFixture, FlagReturnsFallthroughVariationIfPrerequisiteIsMetAndThereAr
     ASSERT_EQ(details.reason, LD_FALLTHROUGH);
 
     ASSERT_TRUE(events);
-    ASSERT_EQ(LDCollectionGetSize(events), 1);
-    ASSERT_TRUE(eventsiter = LDGetIter(events));
-    ASSERT_STREQ("feature1", LDGetText(LDObjectLookup(eventsiter, "key")));
-    ASSERT_STREQ("go", LDGetText(LDObjectLookup(eventsiter, "value")));
-    ASSERT_EQ(LDGetNumber(LDObjectLookup(eventsiter, "version")), 3);
-    ASSERT_EQ(LDGetNumber(LDObjectLookup(eventsiter, "variation")), 1);
-    ASSERT_STREQ("feature0", LDGetText(LDObjectLookup(eventsiter, "prereqOf")));
+    ASSERT_FALSE(events->next);
+    ASSERT_TRUE(eventsiter = events);
+    ASSERT_STREQ("feature1", eventsiter->key);
+    ASSERT_STREQ("go", LDGetText(eventsiter->value));
+    ASSERT_EQ(eventsiter->version, 3);
+    ASSERT_EQ(eventsiter->variation, 1);
+    ASSERT_STREQ("feature0", eventsiter->prereqOf);
+
+    LDJSONFree(flag1);
+    LDJSONFree(result);
+    LDi_freeEventRecords(events);
+    LDStoreDestroy(store);
+    LDUserFree(user);
+    LDDetailsClear(&details);
+    LDClientClose(client);
+}
+
+TEST_F(EvalFixture, FractionalPrerequisiteVariationIsNeverMet) {
+    struct LDUser *user;
+    struct LDStore *store;
+    struct LDJSON *flag1, *flag2, *result, *prerequisite, *prerequisites;
+    struct LDEventRecord *events;
+    struct LDDetails details;
+    struct LDClient *client;
+    struct LDConfig *config;
+
+    events = NULL;
+    result = NULL;
+
+    LDDetailsInit(&details);
+    ASSERT_TRUE(config = LDConfigNew("abc"));
+    ASSERT_TRUE(client = LDClientInit(config, 0));
+    ASSERT_TRUE(user = LDUserNew("userKeyA"));
+
+    /* flag1 requires variation 1.5 of flag2, which serves variation 1 */
+    ASSERT_TRUE(flag1 = LDNewObject());
+    ASSERT_TRUE(LDObjectSetKey(flag1, "key", LDNewText("feature0")));
+    ASSERT_TRUE(LDObjectSetKey(flag1, "on", LDNewBool(LDBooleanTrue)));
+    ASSERT_TRUE(LDObjectSetKey(flag1, "offVariation", LDNewNumber(1)));
+    ASSERT_TRUE(LDObjectSetKey(flag1, "salt", LDNewText("abc")));
+    ASSERT_TRUE(prerequisite = LDNewObject());
+    ASSERT_TRUE(LDObjectSetKey(prerequisite, "key", LDNewText("feature1")));
+    ASSERT_TRUE(LDObjectSetKey(prerequisite, "variation", LDNewNumber(1.5)));
+    ASSERT_TRUE(prerequisites = LDNewArray());
+    ASSERT_TRUE(LDArrayPush(prerequisites, prerequisite));
+    ASSERT_TRUE(LDObjectSetKey(flag1, "prerequisites", prerequisites));
+    setFallthrough(flag1, 0);
+    addVariations1(flag1);
+
+    ASSERT_TRUE(flag2 = LDNewObject());
+    ASSERT_TRUE(LDObjectSetKey(flag2, "key", LDNewText("feature1")));
+    ASSERT_TRUE(LDObjectSetKey(flag2, "on", LDNewBool(LDBooleanTrue)));
+    ASSERT_TRUE(LDObjectSetKey(flag2, "version", LDNewNumber(3)));
+    ASSERT_TRUE(LDObjectSetKey(flag2, "offVariation", LDNewNumber(1)));
+    ASSERT_TRUE(LDObjectSetKey(flag2, "salt", LDNewText("abc")));
+    setFallthrough(flag2, 1);
+    addVariations2(flag2);
+
+    ASSERT_TRUE(store = prepareEmptyStore());
+    ASSERT_TRUE(LDStoreUpsert(store, LD_FLAG, flag2));
+
+    ASSERT_TRUE(evaluateJSON(
+            client,
+            flag1,
+            user,
+            store,
+            &details,
+            &events,
+            &result,
+            LDBooleanFalse));
+
+    ASSERT_STREQ(LDGetText(result), "off");
+    ASSERT_TRUE(details.hasVariation);
+    ASSERT_EQ(details.variationIndex, 1);
+    ASSERT_EQ(details.reason, LD_PREREQUISITE_FAILED);
 
     LDJSONFree(flag1);
     LDJSONFree(result);
-    LDJSONFree(events);
+    LDi_freeEventRecords(events);
     LDStoreDestroy(store);
     LDUserFree(user);
     LDDetailsClear(&details);
@@ -500,7 +605,8 @@ TEST_F(EvalFixture, FlagReturnsFallthroughVariationIfPrerequisiteIsMetAndThereAr
 TEST_F(EvalFixture, MultipleLevelsOfPrerequisiteProduceMultipleEvents) {
     struct LDUser *user;
     struct LDStore *store;
-    struct LDJSON *flag1, *flag2, *flag3, *result, *events, *eventsiter;
+    struct LDJSON *flag1, *flag2, *flag3, *result;
+    struct LDEventRecord *events, *eventsiter;
     struct LDDetails details;
     struct LDClient *client;
     struct LDConfig *config;
@@ -550,7 +656,7 @@ TEST_F(EvalFixture, MultipleLevelsOfPrerequisiteProduceMultipleEvents) {
     ASSERT_TRUE(LDStoreUpsert(store, LD_FLAG, flag3));
 
     /* run */
-    ASSERT_TRUE(LDi_evaluate(
+    ASSERT_TRUE(evaluateJSON(
             client,
             flag1,
             user,
@@ -567,24 +673,188 @@ TEST_F(EvalFixture, MultipleLevelsOfPrerequisiteProduceMultipleEvents) {
     ASSERT_EQ(details.reason, LD_FALLTHROUGH);
 
     ASSERT_TRUE(events);
-    ASSERT_TRUE(LDCollectionGetSize(events) == 2);
-
-    ASSERT_TRUE(eventsiter = LDGetIter(events));
-    ASSERT_STREQ("feature2", LDGetText(LDObjectLookup(eventsiter, "key")));
-    ASSERT_STREQ("go", LDGetText(LDObjectLookup(eventsiter, "value")));
-    ASSERT_EQ(LDGetNumber(LDObjectLookup(eventsiter, "version")), 3);
-    ASSERT_EQ(LDGetNumber(LDObjectLookup(eventsiter, "variation")), 1);
-    ASSERT_STREQ("feature1", LDGetText(LDObjectLookup(eventsiter, "prereqOf")));
-
-    ASSERT_TRUE(eventsiter = LDIterNext(eventsiter));
-    ASSERT_STREQ("feature1", LDGetText(LDObjectLookup(eventsiter, "key")));
-    ASSERT_STREQ("go", LDGetText(LDObjectLookup(eventsiter, "value")));
-    ASSERT_EQ(LDGetNumber(LDObjectLookup(eventsiter, "version")), 3);
-    ASSERT_EQ(LDGetNumber(LDObjectLookup(eventsiter, "variation")), 1);
-    ASSERT_STREQ("feature0", LDGetText(LDObjectLookup(eventsiter, "prereqOf")));
+
+    ASSERT_TRUE(eventsiter = events);
+    ASSERT_STREQ("feature2", eventsiter->key);
+    ASSERT_STREQ("go", LDGetText(eventsiter->value));
+    ASSERT_EQ(eventsiter->version, 3);
+    ASSERT_EQ(eventsiter->variation, 1);
+    ASSERT_STREQ("feature1", eventsiter->prereqOf);
+
+    ASSERT_TRUE(eventsiter = eventsiter->next);
+    ASSERT_STREQ("feature1", eventsiter->key);
+    ASSERT_STREQ("go", LDGetText(eventsiter->value));
+    ASSERT_EQ(eventsiter->version, 3);
+    ASSERT_EQ(eventsiter->variation, 1);
+    ASSERT_STREQ("feature0", eventsiter->prereqOf);
+    ASSERT_FALSE(eventsiter->next);
 
     LDJSONFree(flag1);
-    LDJSONFree(events);
+    LDi_freeEventRecords(events);
+    LDJSONFree(result);
+    LDStoreDestroy(store);
+    LDUserFree(user);
+    LDDetailsClear(&details);
+    LDClientClose(client);
+}
+
+TEST_F(EvalFixture, SharedPrerequisiteProducesEventsForEachParent) {
+    struct LDUser *user;
+    struct LDStore *store;
+    struct LDJSON *flag0, *flag1, *flag2, *flag3, *result;
+    struct LDEventRecord *events, *eventsiter;
+    struct LDDetails details;
+    struct LDClient *client;
+    struct LDConfig *config;
+
+    events = NULL;
+    result = NULL;
+
+    LDDetailsInit(&details);
+    ASSERT_TRUE(config = LDConfigNew("abc"));
+    ASSERT_TRUE(client = LDClientInit(config, 0));
+    ASSERT_TRUE(user = LDUserNew("userKeyA"));
+
+    /* feature0 requires feature1 and feature2, which both require feature3 */
+    ASSERT_TRUE(flag0 = LDNewObject());
+    ASSERT_TRUE(LDObjectSetKey(flag0, "key", LDNewText("feature0")));
+    ASSERT_TRUE(LDObjectSetKey(flag0, "on", LDNewBool(LDBooleanTrue)));
+    ASSERT_TRUE(LDObjectSetKey(flag0, "offVariation", LDNewNumber(1)));
+    ASSERT_TRUE(LDObjectSetKey(flag0, "salt", LDNewText("abc")));
+    addPrerequisite(flag0, "feature1", 1);
+    addPrerequisite(flag0, "feature2", 1);
+    setFallthrough(flag0, 0);
+    addVariations1(flag0);
+
+    ASSERT_TRUE(flag1 = LDNewObject());
+    ASSERT_TRUE(LDObjectSetKey(flag1, "key", LDNewText("feature1")));
+    ASSERT_TRUE(LDObjectSetKey(flag1, "on", LDNewBool(LDBooleanTrue)));
+    ASSERT_TRUE(LDObjectSetKey(flag1, "version", LDNewNumber(1)));
+    ASSERT_TRUE(LDObjectSetKey(flag1, "offVariation", LDNewNumber(0)));
+    ASSERT_TRUE(LDObjectSetKey(flag1, "salt", LDNewText("abc")));
+    addPrerequisite(flag1, "feature3", 1);
+    setFallthrough(flag1, 1);
+    addVariations2(flag1);
+
+    ASSERT_TRUE(flag2 = LDJSONDuplicate(flag1));
+    ASSERT_TRUE(LDObjectSetKey(flag2, "key", LDNewText("feature2")));
+
+    ASSERT_TRUE(flag3 = LDNewObject());
+    ASSERT_TRUE(LDObjectSetKey(flag3, "key", LDNewText("feature3")));
+    ASSERT_TRUE(LDObjectSetKey(flag3, "on", LDNewBool(LDBooleanTrue)));
+    ASSERT_TRUE(LDObjectSetKey(flag3, "version", LDNewNumber(5)));
+    ASSERT_TRUE(LDObjectSetKey(flag3, "offVariation", LDNewNumber(0)));
+    ASSERT_TRUE(LDObjectSetKey(flag3, "salt", LDNewText("abc")));
+    setFallthrough(flag3, 1);
+    addVariations2(flag3);
+
+    /* store */
+    ASSERT_TRUE(store = prepareEmptyStore());
+    ASSERT_TRUE(LDStoreUpsert(store, LD_FLAG, flag1));
+    ASSERT_TRUE(LDStoreUpsert(store, LD_FLAG, flag2));
+    ASSERT_TRUE(LDStoreUpsert(store, LD_FLAG, flag3));
+
+    /* run */
+    ASSERT_EQ(EVAL_MATCH, evaluateJSON(
+            client,
+            flag0,
+            user,
+            store,
+            &details,
+            &events,
+            &result,
+            LDBooleanFalse));
+
+    /* validate */
+    ASSERT_STREQ(LDGetText(result), "fall");
+    ASSERT_EQ(details.reason, LD_FALLTHROUGH);
+
+    /* feature3 is evaluated once but reported under both parents */
+    ASSERT_TRUE(events);
+
+    ASSERT_TRUE(eventsiter = events);
+    ASSERT_STREQ("feature3", eventsiter->key);
+    ASSERT_STREQ("feature1", eventsiter->prereqOf);
+
+    ASSERT_TRUE(eventsiter = eventsiter->next);
+    ASSERT_STREQ("feature1", eventsiter->key);
+    ASSERT_STREQ("feature0", eventsiter->prereqOf);
+
+    ASSERT_TRUE(eventsiter = eventsiter->next);
+    ASSERT_STREQ("feature3", eventsiter->key);
+    ASSERT_STREQ("feature2", eventsiter->prereqOf);
+    ASSERT_EQ(eventsiter->version, 5);
+
+    ASSERT_TRUE(eventsiter = eventsiter->next);
+    ASSERT_STREQ("feature2", eventsiter->key);
+    ASSERT_STREQ("feature0", eventsiter->prereqOf);
+    ASSERT_FALSE(eventsiter->next);
+
+    LDJSONFree(flag0);
+    LDi_freeEventRecords(events);
+    LDJSONFree(result);
+    LDStoreDestroy(store);
+    LDUserFree(user);
+    LDDetailsClear(&details);
+    LDClientClose(client);
+}
+
+TEST_F(EvalFixture, PrerequisiteCycleIsSchemaError) {
+    struct LDUser *user;
+    struct LDStore *store;
+    struct LDJSON *flag0, *flag1, *result;
+    struct LDEventRecord *events;
+    struct LDDetails details;
+    struct LDClient *client;
+    struct LDConfig *config;
+
+    events = NULL;
+    result = NULL;
+
+    LDDetailsInit(&details);
+    ASSERT_TRUE(config = LDConfigNew("abc"));
+    ASSERT_TRUE(client = LDClientInit(config, 0));
+    ASSERT_TRUE(user = LDUserNew("userKeyA"));
+
+    /* feature0 and feature1 require each other */
+    ASSERT_TRUE(flag0 = LDNewObject());
+    ASSERT_TRUE(LDObjectSetKey(flag0, "key", LDNewText("feature0")));
+    ASSERT_TRUE(LDObjectSetKey(flag0, "on", LDNewBool(LDBooleanTrue)));
+    ASSERT_TRUE(LDObjectSetKey(flag0, "version", LDNewNumber(1)));
+    ASSERT_TRUE(LDObjectSetKey(flag0, "offVariation", LDNewNumber(1)));
+    ASSERT_TRUE(LDObjectSetKey(flag0, "salt", LDNewText("abc")));
+    addPrerequisite(flag0, "feature1", 1);
+    setFallthrough(flag0, 0);
+    addVariations1(flag0);
+
+    ASSERT_TRUE(flag1 = LDNewObject());
+    ASSERT_TRUE(LDObjectSetKey(flag1, "key", LDNewText("feature1")));
+    ASSERT_TRUE(LDObjectSetKey(flag1, "on", LDNewBool(LDBooleanTrue)));
+    ASSERT_TRUE(LDObjectSetKey(flag1, "version", LDNewNumber(1)));
+    ASSERT_TRUE(LDObjectSetKey(flag1, "offVariation", LDNewNumber(0)));
+    ASSERT_TRUE(LDObjectSetKey(flag1, "salt", LDNewText("abc")));
+    addPrerequisite(flag1, "feature0", 0);
+    setFallthrough(flag1, 1);
+    addVariations2(flag1);
+
+    /* store */
+    ASSERT_TRUE(store = prepareEmptyStore());
+    ASSERT_TRUE(LDStoreUpsert(store, LD_FLAG, LDJSONDuplicate(flag0)));
+    ASSERT_TRUE(LDStoreUpsert(store, LD_FLAG, flag1));
+
+    /* run */
+    ASSERT_EQ(EVAL_SCHEMA, evaluateJSON(
+            client,
+            flag0,
+            user,
+            store,
+            &details,
+            &events,
+            &result,
+            LDBooleanFalse));
+
+    LDJSONFree(flag0);
+    LDi_freeEventRecords(events);
     LDJSONFree(result);
     LDStoreDestroy(store);
     LDUserFree(user);
@@ -594,7 +864,8 @@ TEST_F(EvalFixture, MultipleLevelsOfPrerequisiteProduceMultipleEvents) {
 
 TEST_F(EvalFixture, FlagMatchesUserFromTarget) {
     struct LDUser *user;
-    struct LDJSON *flag, *result, *events;
+    struct LDJSON *flag, *result;
+    struct LDEventRecord *events;
     struct LDDetails details;
 
     events = NULL;
@@ -631,7 +902,7 @@ TEST_F(EvalFixture, FlagMatchesUserFromTarget) {
     }
 
     /* run */
-    ASSERT_TRUE(LDi_evaluate(
+    ASSERT_TRUE(evaluateJSON(
             NULL,
             flag,
             user,
@@ -649,7 +920,7 @@ TEST_F(EvalFixture, FlagMatchesUserFromTarget) {
     ASSERT_FALSE(events);
 
     LDJSONFree(flag);
-    LDJSONFree(events);
+    LDi_freeEventRecords(events);
     LDJSONFree(result);
     LDUserFree(user);
     LDDetailsClear(&details);
@@ -657,7 +928,8 @@ TEST_F(EvalFixture, FlagMatchesUserFromTarget) {
 
 TEST_F(EvalFixture, FlagMatchesUserFromRules) {
     struct LDUser *user;
-    struct LDJSON *flag, *result, *variation, *events;
+    struct LDJSON *flag, *result, *variation;
+    struct LDEventRecord *events;
     struct LDDetails details;
 
     events = NULL;
@@ -672,7 +944,7 @@ TEST_F(EvalFixture, FlagMatchesUserFromRules) {
     flag = makeFlagToMatchUser("userkey", variation);
 
     /* run */
-    ASSERT_TRUE(LDi_evaluate(
+    ASSERT_TRUE(evaluateJSON(
             NULL,
             flag,
             user,
@@ -692,7 +964,7 @@ TEST_F(EvalFixture, FlagMatchesUserFromRules) {
     ASSERT_FALSE(events);
 
     LDJSONFree(flag);
-    LDJSONFree(events);
+    LDi_freeEventRecords(events);
     LDJSONFree(result);
     LDUserFree(user);
     LDDetailsClear(&details);
@@ -700,7 +972,8 @@ TEST_F(EvalFixture, FlagMatchesUserFromRules) {
 
 TEST_F(EvalFixture, ClauseCanMatchBuiltInAttribute) {
     struct LDUser *user;
-    struct LDJSON *flag, *result, *clause, *values, *events;
+    struct LDJSON *flag, *result, *clause, *values;
+    struct LDEventRecord *events;
     struct LDDetails details;
 
     events = NULL;
@@ -723,7 +996,7 @@ TEST_F(EvalFixture, ClauseCanMatchBuiltInAttribute) {
     ASSERT_TRUE(flag = booleanFlagWithClause(clause));
 
     /* run */
-    ASSERT_TRUE(LDi_evaluate(
+    ASSERT_TRUE(evaluateJSON(
             NULL,
             flag,
             user,
@@ -745,7 +1018,8 @@ TEST_F(EvalFixture, ClauseCanMatchBuiltInAttribute) {
 
 TEST_F(EvalFixture, ClauseCanMatchCustomAttribute) {
     struct LDUser *user;
-    struct LDJSON *flag, *result, *clause, *values, *custom, *events;
+    struct LDJSON *flag, *result, *clause, *values, *custom;
+    struct LDEventRecord *events;
     struct LDDetails details;
 
     events = NULL;
@@ -770,7 +1044,7 @@ TEST_F(EvalFixture, ClauseCanMatchCustomAttribute) {
     ASSERT_TRUE(flag = booleanFlagWithClause(clause));
 
     /* run */
-    ASSERT_TRUE(LDi_evaluate(
+    ASSERT_TRUE(evaluateJSON(
             NULL,
             flag,
             user,
@@ -790,9 +1064,122 @@ TEST_F(EvalFixture, ClauseCanMatchCustomAttribute) {
     LDDetailsClear(&details);
 }
 
+TEST_F(EvalFixture, ClauseCanMatchAnonymousAttribute) {
+    struct LDUser *user;
+    struct LDJSON *flag, *result, *clause, *values;
+    struct LDEventRecord *events;
+    struct LDDetails details;
+
+    events = NULL;
+    result = NULL;
+    LDDetailsInit(&details);
+
+    /* user */
+    ASSERT_TRUE(user = LDUserNew("key"));
+    LDUserSetAnonymous(user, LDBooleanTrue);
+
+    /* flag */
+    ASSERT_TRUE(values = LDNewArray());
+    ASSERT_TRUE(LDArrayPush(values, LDNewBool(LDBooleanTrue)));
+
+    ASSERT_TRUE(clause = LDNewObject());
+    ASSERT_TRUE(LDObjectSetKey(clause, "op", LDNewText("in")));
+    ASSERT_TRUE(LDObjectSetKey(clause, "values", values));
+    ASSERT_TRUE(LDObjectSetKey(clause, "attribute", LDNewText("anonymous")));
+
+    ASSERT_TRUE(flag = booleanFlagWithClause(clause));
+
+    /* run */
+    ASSERT_TRUE(evaluateJSON(
+            NULL,
+            flag,
+            user,
+            (struct LDStore *) 1,
+            &details,
+            &events,
+            &result,
+            LDBooleanFalse));
+
+    /* validate */
+    ASSERT_TRUE(LDGetBool(result));
+    ASSERT_FALSE(events);
+
+    LDJSONFree(flag);
+    LDJSONFree(result);
+    LDUserFree(user);
+    LDDetailsClear(&details);
+}
+
+TEST_F(EvalFixture, AttributeViewBorrowsFromUser) {
+    struct LDUser *user;
+    struct LDJSON *custom, *copy;
+    const struct LDJSON *view;
+    struct LDAttributeView storage;
+
+    ASSERT_TRUE(user = LDUserNew("key"));
+    ASSERT_TRUE(LDUserSetEmail(user, "bob@example.com"));
+    ASSERT_TRUE(custom = LDNewObject());
+    ASSERT_TRUE(LDObjectSetKey(custom, "legs", LDNewNumber(4)));
+    LDUserSetCustom(user, custom);
+
+    /* built in attributes point at the user's strings */
+    ASSERT_TRUE(view = LDi_viewAttribute(user, "email", &storage));
+    ASSERT_EQ(LDJSONGetType(view), LDText);
+    ASSERT_EQ(LDGetText(view), user->email);
+
+    ASSERT_TRUE(copy = LDi_valueOfAttribute(user, "email"));
+    ASSERT_TRUE(LDJSONCompare(copy, view));
+    LDJSONFree(copy);
+
+    /* custom attributes point into the custom object */
+    ASSERT_EQ(
+        LDi_viewAttribute(user, "legs", &storage),
+        LDObjectLookup(user->custom, "legs"));
+
+    ASSERT_FALSE(LDi_viewAttribute(user, "country", &storage));
+    ASSERT_FALSE(LDi_viewAttribute(user, "missing", &storage));
+
+    LDUserFree(user);
+}
+
+TEST_F(EvalFixture, PreparedUserIndexesCustomAttributes) {
+    struct LDUser *user;
+    struct LDJSON *custom;
+    struct LDAttributeView storage;
+
+    ASSERT_TRUE(user = LDUserNew("key"));
+    ASSERT_TRUE(custom = LDNewObject());
+    ASSERT_TRUE(LDObjectSetKey(custom, "legs", LDNewNumber(4)));
+    ASSERT_TRUE(LDObjectSetKey(custom, "wings", LDNewNumber(2)));
+    LDUserSetCustom(user, custom);
+
+    ASSERT_TRUE(LDUserPrepare(user));
+    ASSERT_TRUE(user->attributeIndex);
+    ASSERT_EQ(
+        LDi_viewAttribute(user, "wings", &storage),
+        LDObjectLookup(user->custom, "wings"));
+    ASSERT_FALSE(LDi_viewAttribute(user, "tail", &storage));
+
+    /* replacing the custom attributes discards the index */
+    ASSERT_TRUE(custom = LDNewObject());
+    ASSERT_TRUE(LDObjectSetKey(custom, "tail", LDNewBool(LDBooleanTrue)));
+    LDUserSetCustom(user, custom);
+
+    ASSERT_FALSE(user->attributeIndex);
+    ASSERT_FALSE(LDi_viewAttribute(user, "wings", &storage));
+    ASSERT_TRUE(LDi_viewAttribute(user, "tail", &storage));
+
+    /* built in attributes never go through the index */
+    ASSERT_EQ(LDi_attributeSlot("firstName"), LD_ATTRIBUTE_FIRST_NAME);
+    ASSERT_EQ(LDi_attributeSlot("tail"), LD_ATTRIBUTE_CUSTOM);
+
+    LDUserFree(user);
+}
+
 TEST_F(EvalFixture, ClauseReturnsFalseForMissingAttribute) {
     struct LDUser *user;
-    struct LDJSON *flag, *result, *clause, *values, *events;
+    struct LDJSON *flag, *result, *clause, *values;
+    struct LDEventRecord *events;
     struct LDDetails details;
 
     events = NULL;
@@ -815,7 +1202,7 @@ TEST_F(EvalFixture, ClauseReturnsFalseForMissingAttribute) {
     ASSERT_TRUE(flag = booleanFlagWithClause(clause));
 
     /* run */
-    ASSERT_TRUE(LDi_evaluate(
+    ASSERT_TRUE(evaluateJSON(
             NULL,
             flag,
             user,
@@ -837,7 +1224,8 @@ TEST_F(EvalFixture, ClauseReturnsFalseForMissingAttribute) {
 
 TEST_F(EvalFixture, ClauseCanBeNegated) {
     struct LDUser *user;
-    struct LDJSON *flag, *result, *clause, *values, *events;
+    struct LDJSON *flag, *result, *clause, *values;
+    struct LDEventRecord *events;
     struct LDDetails details;
 
     events = NULL;
@@ -861,7 +1249,7 @@ TEST_F(EvalFixture, ClauseCanBeNegated) {
     ASSERT_TRUE(flag = booleanFlagWithClause(clause));
 
     /* run */
-    ASSERT_TRUE(LDi_evaluate(
+    ASSERT_TRUE(evaluateJSON(
             NULL,
             flag,
             user,
@@ -883,7 +1271,8 @@ TEST_F(EvalFixture, ClauseCanBeNegated) {
 
 TEST_F(EvalFixture, ClauseForMissingAttributeIsFalseEvenIfNegate) {
     struct LDUser *user;
-    struct LDJSON *flag, *result, *clause, *values, *events;
+    struct LDJSON *flag, *result, *clause, *values;
+    struct LDEventRecord *events;
     struct LDDetails details;
 
     events = NULL;
@@ -907,7 +1296,7 @@ TEST_F(EvalFixture, ClauseForMissingAttributeIsFalseEvenIfNegate) {
     ASSERT_TRUE(flag = booleanFlagWithClause(clause));
 
     /* run */
-    ASSERT_TRUE(LDi_evaluate(
+    ASSERT_TRUE(evaluateJSON(
             NULL,
             flag,
             user,
@@ -929,7 +1318,8 @@ TEST_F(EvalFixture, ClauseForMissingAttributeIsFalseEvenIfNegate) {
 
 TEST_F(EvalFixture, ClauseWithUnknownOperatorDoesNotMatch) {
     struct LDUser *user;
-    struct LDJSON *flag, *result, *clause, *values, *events;
+    struct LDJSON *flag, *result, *clause, *values;
+    struct LDEventRecord *events;
     struct LDDetails details;
 
     result = NULL;
@@ -953,7 +1343,7 @@ TEST_F(EvalFixture, ClauseWithUnknownOperatorDoesNotMatch) {
 
     /* run */
     ASSERT_TRUE(
-            LDi_evaluate(
+            evaluateJSON(
                     NULL,
                     flag,
                     user,
@@ -976,8 +1366,8 @@ TEST_F(EvalFixture, ClauseWithUnknownOperatorDoesNotMatch) {
 TEST_F(EvalFixture, SegmentMatchClauseRetrievesSegmentFromStore) {
     struct LDUser *user;
     struct LDStore *store;
-    struct LDJSON *segment, *flag, *result, *included, *values, *clause,
-            *events;
+    struct LDJSON *segment, *flag, *result, *included, *values, *clause;
+    struct LDEventRecord *events;
     struct LDDetails details;
 
     result = NULL;
@@ -1012,7 +1402,7 @@ TEST_F(EvalFixture, SegmentMatchClauseRetrievesSegmentFromStore) {
 
     /* run */
     ASSERT_TRUE(
-            LDi_evaluate(
+            evaluateJSON(
                     NULL,
                     flag,
                     user,
@@ -1036,7 +1426,8 @@ TEST_F(EvalFixture, SegmentMatchClauseRetrievesSegmentFromStore) {
 TEST_F(EvalFixture, SegmentMatchClauseFallsThroughIfSegmentNotFound) {
     struct LDUser *user;
     struct LDStore *store;
-    struct LDJSON *flag, *result, *values, *clause, *events;
+    struct LDJSON *flag, *result, *values, *clause;
+    struct LDEventRecord *events;
     struct LDDetails details;
 
     result = NULL;
@@ -1061,7 +1452,7 @@ TEST_F(EvalFixture, SegmentMatchClauseFallsThroughIfSegmentNotFound) {
 
     /* run */
     ASSERT_TRUE(
-            LDi_evaluate(
+            evaluateJSON(
                     NULL,
                     flag,
                     user,
@@ -1085,8 +1476,8 @@ TEST_F(EvalFixture, SegmentMatchClauseFallsThroughIfSegmentNotFound) {
 TEST_F(EvalFixture, CanMatchJustOneSegmentFromList) {
     struct LDStore *store;
     struct LDUser *user;
-    struct LDJSON *segment, *flag, *result, *included, *values, *clause,
-            *events;
+    struct LDJSON *segment, *flag, *result, *included, *values, *clause;
+    struct LDEventRecord *events;
     struct LDDetails details;
 
     events = NULL;
@@ -1122,7 +1513,7 @@ TEST_F(EvalFixture, CanMatchJustOneSegmentFromList) {
 
     /* run */
     ASSERT_TRUE(
-            LDi_evaluate(
+            evaluateJSON(
                     NULL,
                     flag,
                     user,
@@ -1209,10 +1600,178 @@ TEST_F(EvalFixture, BucketUserWithSeed) {
     LDUserFree(user);
 }
 
+/* bucketing as it was computed before the prefix hash state was precomputed,
+used to show that no user changes bucket */
+static LDBoolean
+referenceBucket(
+        const char *const prefix,
+        const char *const value,
+        const char *const secondary,
+        float *const bucket) {
+    char raw[256], digest[21], encoded[17];
+    const char *iter;
+    int status;
+    float acc;
+    const float longScale = 1152921504606846975.0;
+
+    if (secondary) {
+        status = snprintf(raw, sizeof(raw), "%s%s.%s", prefix, value, secondary);
+    } else {
+        status = snprintf(raw, sizeof(raw), "%s%s", prefix, value);
+    }
+
+    if (status < 0 || (size_t) status >= sizeof(raw)) {
+        return LDBooleanFalse;
+    }
+
+    SHA1(digest, raw, strlen(raw));
+    LD_ASSERT(hexify((unsigned char *) digest, 20, encoded, sizeof(encoded)) == 16);
+    encoded[15] = 0;
+
+    acc = 0;
+
+    for (iter = encoded; *iter; iter++) {
+        char charOffset = *iter <= '9' ? *iter - '0' : *iter - 'a' + 10;
+
+        acc = (acc * 16) + charOffset;
+    }
+
+    *bucket = acc / longScale;
+
+    return LDBooleanTrue;
+}
+
+TEST_F(EvalFixture, BucketPrefixMatchesReference) {
+    struct LDJSON *json, *custom;
+    struct LDFlag *flag;
+    struct LDBucketPrefix seedPrefix;
+    char padding[261];
+    unsigned int i;
+
+    ASSERT_TRUE(json = makeMinimalFlag("hashKey", 1, LDBooleanTrue, LDBooleanFalse));
+    ASSERT_TRUE(LDObjectSetKey(json, "salt", LDNewText("saltyA")));
+    ASSERT_TRUE(flag = LDi_newFlag(json));
+
+    LDi_initBucketPrefix(&seedPrefix, "61", NULL);
+
+    memset(padding, 'x', sizeof(padding) - 1);
+    padding[sizeof(padding) - 1] = 0;
+
+    /* key lengths cross the input length limit, which must also agree */
+    for (i = 0; i < 2000; i++) {
+        struct LDUser *user;
+        char key[300], number[256];
+        const char *secondary;
+        float expected, actual;
+        LDBoolean expectedStatus;
+
+        snprintf(key, sizeof(key), "user%u%.*s", i, (int) (i % 260), padding);
+        secondary = i % 3 == 0 ? "secondaryKey" : NULL;
+
+        ASSERT_TRUE(user = LDUserNew(key));
+        if (secondary) {
+            ASSERT_TRUE(LDUserSetSecondary(user, secondary));
+        }
+        ASSERT_TRUE(custom = LDNewObject());
+        ASSERT_TRUE(LDObjectSetKey(custom, "number", LDNewNumber(i * 1.5)));
+        LDUserSetCustom(user, custom);
+
+        expectedStatus = referenceBucket("hashKey.saltyA.", key, secondary, &expected);
+        ASSERT_EQ(expectedStatus, LDi_bucketUserWithPrefix(
+                &flag->bucketPrefix, user, "key", &actual));
+        if (expectedStatus) {
+            ASSERT_EQ(0, memcmp(&expected, &actual, sizeof(float)));
+        }
+
+        expectedStatus = referenceBucket("61.", key, secondary, &expected);
+        ASSERT_EQ(expectedStatus, LDi_bucketUserWithPrefix(
+                &seedPrefix, user, "key", &actual));
+        if (expectedStatus) {
+            ASSERT_EQ(0, memcmp(&expected, &actual, sizeof(float)));
+        }
+
+        snprintf(number, sizeof(number), "%f", i * 1.5);
+        ASSERT_TRUE(referenceBucket("hashKey.saltyA.", number, secondary, &expected));
+        ASSERT_TRUE(LDi_bucketUserWithPrefix(
+                &flag->bucketPrefix, user, "number", &actual));
+        ASSERT_EQ(0, memcmp(&expected, &actual, sizeof(float)));
+
+        LDUserFree(user);
+    }
+
+    LDi_freeFlag(flag);
+    LDJSONFree(json);
+}
+
+/* Batches hash several inputs at once, including lanes that need a different
+number of blocks and requests that are skipped or fail. */
+TEST_F(EvalFixture, BucketBatchMatchesSingle) {
+    struct LDBucketPrefix prefixes[3];
+    struct LDBucketRequest requests[13];
+    const char *const attributes[] = {"key", "number", "missing"};
+    char padding[201], longPrefix[100];
+    unsigned int u, count, i;
+
+    memset(padding, 'x', sizeof(padding) - 1);
+    padding[sizeof(padding) - 1] = 0;
+    memset(longPrefix, 'p', sizeof(longPrefix) - 1);
+    longPrefix[sizeof(longPrefix) - 1] = 0;
+
+    LDi_initBucketPrefix(&prefixes[0], "hashKey", "saltyA");
+    LDi_initBucketPrefix(&prefixes[1], "61", NULL);
+    /* longer than a block, so part of it is already compressed */
+    LDi_initBucketPrefix(&prefixes[2], longPrefix, "salt");
+
+    for (u = 0; u < 40; u++) {
+        struct LDUser *user;
+        struct LDJSON *custom;
+        char key[256];
+
+        snprintf(key, sizeof(key), "user%u%.*s", u, (int) (u * 5), padding);
+
+        ASSERT_TRUE(user = LDUserNew(key));
+        if (u % 2) {
+            ASSERT_TRUE(LDUserSetSecondary(user, "secondaryKey"));
+        }
+        ASSERT_TRUE(custom = LDNewObject());
+        ASSERT_TRUE(LDObjectSetKey(custom, "number", LDNewNumber(u)));
+        LDUserSetCustom(user, custom);
+
+        for (count = 1; count <= 13; count++) {
+            for (i = 0; i < count; i++) {
+                requests[i].prefix =
+                        (i + u) % 7 == 6 ? NULL : &prefixes[(i + u) % 3];
+                requests[i].attribute = attributes[(i / 2 + u) % 3];
+            }
+
+            LDi_bucketUserBatch(user, requests, count);
+
+            for (i = 0; i < count; i++) {
+                float single;
+                LDBoolean status;
+
+                if (!requests[i].prefix) {
+                    ASSERT_FALSE(requests[i].status);
+                    continue;
+                }
+
+                status = LDi_bucketUserWithPrefix(
+                        requests[i].prefix, user, requests[i].attribute, &single);
+
+                ASSERT_EQ(status, requests[i].status);
+                ASSERT_EQ(0, memcmp(&single, &requests[i].bucket, sizeof(float)));
+            }
+        }
+
+        LDUserFree(user);
+    }
+}
+
 TEST_F(EvalFixture, InExperimentExplanation) {
     struct LDUser *user;
-    struct LDJSON *flag, *result, *events, *fallthrough, *rollout, *variations,
+    struct LDJSON *flag, *result, *fallthrough, *rollout, *variations,
             *variation;
+    struct LDEventRecord *events;
     struct LDDetails details;
 
     events = NULL;
@@ -1243,7 +1802,7 @@ TEST_F(EvalFixture, InExperimentExplanation) {
 
     /* run */
     ASSERT_TRUE(
-            LDi_evaluate(
+            evaluateJSON(
                     NULL,
                     flag,
                     user,
@@ -1269,8 +1828,9 @@ TEST_F(EvalFixture, InExperimentExplanation) {
 
 TEST_F(EvalFixture, NotInExperimentExplanation) {
     struct LDUser *user;
-    struct LDJSON *flag, *result, *events, *fallthrough, *rollout, *variations,
+    struct LDJSON *flag, *result, *fallthrough, *rollout, *variations,
             *variation;
+    struct LDEventRecord *events;
     struct LDDetails details;
 
     events = NULL;
@@ -1302,7 +1862,7 @@ TEST_F(EvalFixture, NotInExperimentExplanation) {
 
     /* run */
     ASSERT_TRUE(
-            LDi_evaluate(
+            evaluateJSON(
                     NULL,
                     flag,
                     user,
@@ -1328,8 +1888,9 @@ TEST_F(EvalFixture, NotInExperimentExplanation) {
 
 TEST_F(EvalFixture, RolloutCustomSeed) {
     struct LDUser *user;
-    struct LDJSON *flag, *result, *events, *fallthrough, *rollout, *variations,
+    struct LDJSON *flag, *result, *fallthrough, *rollout, *variations,
             *variation;
+    struct LDEventRecord *events;
     struct LDDetails details;
 
     events = NULL;
@@ -1362,7 +1923,7 @@ TEST_F(EvalFixture, RolloutCustomSeed) {
 
     /* run */
     ASSERT_EQ(
-            LDi_evaluate(
+            evaluateJSON(
                     NULL,
                     flag,
                     user,
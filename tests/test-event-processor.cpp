@@ -8,6 +8,7 @@ extern "C" {
 #include "event_processor.h"
 #include "event_processor_internal.h"
 #include "store.h"
+#include "utility.h"
 
 #include "test-utils/client.h"
 #include "test-utils/flags.h"
@@ -36,9 +37,10 @@ TEST_F(EventProcessorFixture, MakeSummaryKeyIncrementsCounters) {
     struct LDUser *user;
     struct LDConfig *config;
     struct EventProcessor *processor;
-    struct LDJSON *flag1, *flag2, *event1, *event2, *event3, *event4, *event5,
-            *summary, *features, *summaryEntry, *counterEntry, *value1, *value2,
-            *value99, *default1, *default2, *default3;
+    struct LDJSON *flag1, *flag2, *summary, *features, *summaryEntry,
+            *counterEntry, *value1, *value2, *value99, *default1, *default2,
+            *default3;
+    struct LDEventRecord *event1, *event2, *event3, *event4, *event5;
     const unsigned int variation1 = 1;
     const unsigned int variation2 = 2;
 
@@ -164,11 +166,11 @@ TEST_F(EventProcessorFixture, MakeSummaryKeyIncrementsCounters) {
 
     LDJSONFree(flag1);
     LDJSONFree(flag2);
-    LDJSONFree(event1);
-    LDJSONFree(event2);
-    LDJSONFree(event3);
-    LDJSONFree(event4);
-    LDJSONFree(event5);
+    LDi_freeEventRecords(event1);
+    LDi_freeEventRecords(event2);
+    LDi_freeEventRecords(event3);
+    LDi_freeEventRecords(event4);
+    LDi_freeEventRecords(event5);
     LDJSONFree(value1);
     LDJSONFree(value2);
     LDJSONFree(value99);
@@ -185,8 +187,9 @@ TEST_F(EventProcessorFixture, CounterForNilVariationIsDistinctFromOthers) {
     struct LDUser *user;
     struct LDConfig *config;
     struct EventProcessor *processor;
-    struct LDJSON *flag, *event1, *event2, *event3, *value1, *value2, *default1,
-            *summary, *features, *summaryEntry, *counterEntry;
+    struct LDJSON *flag, *value1, *value2, *default1, *summary, *features,
+            *summaryEntry, *counterEntry;
+    struct LDEventRecord *event1, *event2, *event3;
     const unsigned int variation1 = 1;
     const unsigned int variation2 = 2;
 
@@ -266,9 +269,9 @@ TEST_F(EventProcessorFixture, CounterForNilVariationIsDistinctFromOthers) {
     ASSERT_TRUE(LDJSONCompare(default1, LDObjectLookup(counterEntry, "value")));
 
     LDJSONFree(flag);
-    LDJSONFree(event1);
-    LDJSONFree(event2);
-    LDJSONFree(event3);
+    LDi_freeEventRecords(event1);
+    LDi_freeEventRecords(event2);
+    LDi_freeEventRecords(event3);
     LDJSONFree(value1);
     LDJSONFree(value2);
     LDJSONFree(default1);
@@ -290,6 +293,7 @@ TEST_F(EventProcessorFixture, TrackQueued) {
 
     ASSERT_TRUE(LDClientTrack(client, key, user, NULL));
 
+    ASSERT_TRUE(LDi_drainEvents(client->eventProcessor));
     ASSERT_TRUE(client->eventProcessor->events);
     ASSERT_TRUE(LDJSONGetType(client->eventProcessor->events) == LDArray);
     /* event + index */
@@ -304,6 +308,42 @@ TEST_F(EventProcessorFixture, TrackQueued) {
     LDClientClose(client);
 }
 
+TEST_F(EventProcessorFixture, DroppedEventsAreCounted) {
+    struct LDConfig *config;
+    struct LDClient *client;
+    struct LDUser *user;
+    struct LDJSON *payload;
+    char *text;
+    struct LDEventStats stats;
+
+    ASSERT_TRUE(config = LDConfigNew("api_key"));
+    LDConfigSetEventsCapacity(config, 1);
+    ASSERT_TRUE(client = LDClientInit(config, 0));
+    ASSERT_TRUE(user = LDUserNew("abc"));
+
+    /* the custom event fits, its index event does not */
+    ASSERT_TRUE(LDClientTrack(client, "key", user, NULL));
+    ASSERT_TRUE(LDClientTrack(client, "key", user, NULL));
+
+    ASSERT_TRUE(LDClientGetEventStats(client, &stats));
+    ASSERT_EQ(stats.dropped, 2);
+
+    ASSERT_TRUE(LDi_bundleEventPayload(client->eventProcessor, &text));
+    ASSERT_TRUE(payload = LDJSONDeserialize(text));
+    LDFree(text);
+    ASSERT_EQ(LDCollectionGetSize(payload), 1);
+    LDJSONFree(payload);
+
+    /* bundling makes room again */
+    ASSERT_TRUE(LDClientTrack(client, "key", user, NULL));
+
+    ASSERT_TRUE(LDClientGetEventStats(client, &stats));
+    ASSERT_EQ(stats.dropped, 2);
+
+    LDUserFree(user);
+    LDClientClose(client);
+}
+
 TEST_F(EventProcessorFixture, TrackMetricQueued) {
     double metric;
     const char *key;
@@ -318,6 +358,7 @@ TEST_F(EventProcessorFixture, TrackMetricQueued) {
 
     ASSERT_TRUE(LDClientTrackMetric(client, key, user, NULL, metric));
 
+    ASSERT_TRUE(LDi_drainEvents(client->eventProcessor));
     ASSERT_TRUE(client->eventProcessor->events);
     ASSERT_TRUE(LDJSONGetType(client->eventProcessor->events) == LDArray);
     /* event + index */
@@ -343,6 +384,7 @@ TEST_F(EventProcessorFixture, IdentifyQueued) {
 
     ASSERT_TRUE(LDClientIdentify(client, user));
 
+    ASSERT_TRUE(LDi_drainEvents(client->eventProcessor));
     ASSERT_TRUE(client->eventProcessor->events);
     ASSERT_TRUE(LDJSONGetType(client->eventProcessor->events) == LDArray);
     ASSERT_TRUE(LDCollectionGetSize(client->eventProcessor->events) == 1);
@@ -373,11 +415,13 @@ TEST_F(EventProcessorFixture, IndexEventGeneration) {
     ASSERT_TRUE(LDStoreInitEmpty(client->store));
     ASSERT_TRUE(LDStoreUpsert(client->store, LD_FLAG, flag));
 
+    ASSERT_TRUE(LDi_drainEvents(client->eventProcessor));
     ASSERT_TRUE(LDCollectionGetSize(client->eventProcessor->events) == 0);
 
     /* evaluation with new user generations index */
     ASSERT_TRUE(LDIntVariation(client, user1, "flag", 25, NULL) == 42);
 
+    ASSERT_TRUE(LDi_drainEvents(client->eventProcessor));
     ASSERT_TRUE(LDCollectionGetSize(client->eventProcessor->events) == 2);
     /* index event */
     ASSERT_TRUE(event = LDArrayLookup(client->eventProcessor->events, 0));
@@ -399,6 +443,7 @@ TEST_F(EventProcessorFixture, IndexEventGeneration) {
     /* second evaluation with same user does not generate another event */
     ASSERT_TRUE(LDIntVariation(client, user1, "flag", 25, NULL) == 42);
 
+    ASSERT_TRUE(LDi_drainEvents(client->eventProcessor));
     ASSERT_TRUE(LDCollectionGetSize(client->eventProcessor->events) == 3);
     /* feature event */
     ASSERT_TRUE(event = LDArrayLookup(client->eventProcessor->events, 2));
@@ -408,6 +453,7 @@ TEST_F(EventProcessorFixture, IndexEventGeneration) {
     /* evaluation with another user generates a new event */
     ASSERT_TRUE(LDIntVariation(client, user2, "flag", 25, NULL) == 42);
 
+    ASSERT_TRUE(LDi_drainEvents(client->eventProcessor));
     ASSERT_TRUE(LDCollectionGetSize(client->eventProcessor->events) == 5);
     ASSERT_TRUE(event = LDArrayLookup(client->eventProcessor->events, 3));
     ASSERT_STREQ(LDGetText(LDObjectLookup(event, "kind")), "index");
@@ -445,11 +491,13 @@ TEST_F(EventProcessorFixture, InlineUsersInEvents) {
 
     ASSERT_TRUE(LDStoreInitEmpty(client->store));
     ASSERT_TRUE(LDStoreUpsert(client->store, LD_FLAG, flag));
+    ASSERT_TRUE(LDi_drainEvents(client->eventProcessor));
     ASSERT_TRUE(LDCollectionGetSize(client->eventProcessor->events) == 0);
 
     /* check that user is embedded in full fidelity event */
     ASSERT_TRUE(LDIntVariation(client, user, "flag", 25, NULL) == 51);
 
+    ASSERT_TRUE(LDi_drainEvents(client->eventProcessor));
     ASSERT_TRUE(LDCollectionGetSize(client->eventProcessor->events) == 1);
     ASSERT_TRUE(event = LDArrayLookup(client->eventProcessor->events, 0));
     ASSERT_STREQ(LDGetText(LDObjectLookup(event, "kind")), "feature");
@@ -483,11 +531,13 @@ TEST_F(EventProcessorFixture, DetailsNotIncludedIfNotDetailed) {
 
     ASSERT_TRUE(LDStoreInitEmpty(client->store));
     ASSERT_TRUE(LDStoreUpsert(client->store, LD_FLAG, flag));
+    ASSERT_TRUE(LDi_drainEvents(client->eventProcessor));
     ASSERT_TRUE(LDCollectionGetSize(client->eventProcessor->events) == 0);
 
     /* check that user is embedded in full fidelity event */
     ASSERT_TRUE(LDIntVariation(client, user, "flag", 25, NULL) == 51);
 
+    ASSERT_TRUE(LDi_drainEvents(client->eventProcessor));
     ASSERT_TRUE(LDCollectionGetSize(client->eventProcessor->events) == 1);
     ASSERT_TRUE(event = LDArrayLookup(client->eventProcessor->events, 0));
     ASSERT_STREQ(LDGetText(LDObjectLookup(event, "kind")), "feature");
@@ -516,11 +566,13 @@ TEST_F(EventProcessorFixture, DetailsIncludedIfDetailed) {
 
     ASSERT_TRUE(LDStoreInitEmpty(client->store));
     ASSERT_TRUE(LDStoreUpsert(client->store, LD_FLAG, flag));
+    ASSERT_TRUE(LDi_drainEvents(client->eventProcessor));
     ASSERT_TRUE(LDCollectionGetSize(client->eventProcessor->events) == 0);
 
     /* check that user is embedded in full fidelity event */
     ASSERT_TRUE(LDIntVariation(client, user, "flag", 25, &details) == 51);
 
+    ASSERT_TRUE(LDi_drainEvents(client->eventProcessor));
     ASSERT_TRUE(LDCollectionGetSize(client->eventProcessor->events) == 1);
     ASSERT_TRUE(event = LDArrayLookup(client->eventProcessor->events, 0));
     ASSERT_STREQ(LDGetText(LDObjectLookup(event, "kind")), "feature");
@@ -554,11 +606,13 @@ TEST_F(EventProcessorFixture, ExperimentationFallthroughNonDetailed) {
 
     ASSERT_TRUE(LDStoreInitEmpty(client->store));
     ASSERT_TRUE(LDStoreUpsert(client->store, LD_FLAG, flag));
+    ASSERT_TRUE(LDi_drainEvents(client->eventProcessor));
     ASSERT_TRUE(LDCollectionGetSize(client->eventProcessor->events) == 0);
 
     /* check that user is embedded in full fidelity event */
     ASSERT_TRUE(LDIntVariation(client, user, "flag", 25, NULL) == 51);
 
+    ASSERT_TRUE(LDi_drainEvents(client->eventProcessor));
     ASSERT_TRUE(LDCollectionGetSize(client->eventProcessor->events) == 1);
     ASSERT_TRUE(event = LDArrayLookup(client->eventProcessor->events, 0));
     ASSERT_STREQ(LDGetText(LDObjectLookup(event, "kind")), "feature");
@@ -596,11 +650,13 @@ TEST_F(EventProcessorFixture, ExperimentationRuleNonDetailed) {
 
     ASSERT_TRUE(LDStoreInitEmpty(client->store));
     ASSERT_TRUE(LDStoreUpsert(client->store, LD_FLAG, flag));
+    ASSERT_TRUE(LDi_drainEvents(client->eventProcessor));
     ASSERT_TRUE(LDCollectionGetSize(client->eventProcessor->events) == 0);
 
     /* check that user is embedded in full fidelity event */
     ASSERT_TRUE(result = LDStringVariation(client, user, "feature", "a", NULL));
 
+    ASSERT_TRUE(LDi_drainEvents(client->eventProcessor));
     ASSERT_TRUE(LDCollectionGetSize(client->eventProcessor->events) == 1);
     ASSERT_TRUE(event = LDArrayLookup(client->eventProcessor->events, 0));
     ASSERT_STREQ(LDGetText(LDObjectLookup(event, "kind")), "feature");
@@ -616,8 +672,148 @@ TEST_F(EventProcessorFixture, ExperimentationRuleNonDetailed) {
     LDClientClose(client);
 }
 
+TEST_F(EventProcessorFixture, UntrackedEvaluationIsOnlySummarized) {
+    struct LDConfig *config;
+    struct LDClient *client;
+    struct LDJSON *flag, *summary, *counters, *counter;
+    struct LDUser *user;
+
+    ASSERT_TRUE(config = LDConfigNew("api_key"));
+    LDConfigInlineUsersInEvents(config, LDBooleanTrue);
+    ASSERT_TRUE(client = LDClientInit(config, 0));
+    ASSERT_TRUE(user = LDUserNew("user"));
+
+    ASSERT_TRUE(flag = makeMinimalFlag("flag", 11, LDBooleanTrue, LDBooleanFalse));
+    setFallthrough(flag, 0);
+    addVariation(flag, LDNewNumber(51));
+
+    ASSERT_TRUE(LDStoreInitEmpty(client->store));
+    ASSERT_TRUE(LDStoreUpsert(client->store, LD_FLAG, flag));
+
+    ASSERT_TRUE(LDIntVariation(client, user, "flag", 25, NULL) == 51);
+    ASSERT_TRUE(LDIntVariation(client, user, "flag", 25, NULL) == 51);
+
+    ASSERT_TRUE(LDi_drainEvents(client->eventProcessor));
+    ASSERT_EQ(LDCollectionGetSize(client->eventProcessor->events), 0);
+
+    ASSERT_TRUE(summary = LDi_prepareSummaryEvent(client->eventProcessor, 0));
+    ASSERT_TRUE(counters = LDObjectLookup(
+        LDObjectLookup(LDObjectLookup(summary, "features"), "flag"),
+        "counters"));
+    ASSERT_EQ(LDCollectionGetSize(counters), 1);
+    ASSERT_TRUE(counter = LDArrayLookup(counters, 0));
+    ASSERT_EQ(LDGetNumber(LDObjectLookup(counter, "count")), 2);
+    ASSERT_EQ(LDGetNumber(LDObjectLookup(counter, "version")), 11);
+    ASSERT_EQ(LDGetNumber(LDObjectLookup(counter, "variation")), 0);
+    ASSERT_EQ(LDGetNumber(LDObjectLookup(counter, "value")), 51);
+    ASSERT_EQ(LDGetNumber(LDObjectLookup(LDObjectLookup(LDObjectLookup(
+        summary, "features"), "flag"), "default")), 25);
+
+    LDJSONFree(summary);
+    LDUserFree(user);
+    LDClientClose(client);
+}
+
+TEST_F(EventProcessorFixture, ShardedSummariesMergeWhenBundled) {
+    struct LDConfig *config;
+    struct LDClient *client;
+    struct LDJSON *flag, *payload, *event, *counters;
+    char *text;
+    struct LDUser *user;
+    unsigned int i, indexEvents;
+    char key[32];
+
+    ASSERT_TRUE(config = LDConfigNew("api_key"));
+    ASSERT_TRUE(client = LDClientInit(config, 0));
+
+    ASSERT_TRUE(flag = makeMinimalFlag("flag", 11, LDBooleanTrue, LDBooleanFalse));
+    setFallthrough(flag, 0);
+    addVariation(flag, LDNewNumber(51));
+
+    ASSERT_TRUE(LDStoreInitEmpty(client->store));
+    ASSERT_TRUE(LDStoreUpsert(client->store, LD_FLAG, flag));
+
+    /* enough users to land in every shard, each evaluated twice */
+    for (i = 0; i < 64; i++) {
+        snprintf(key, sizeof(key), "user-%u", i);
+
+        ASSERT_TRUE(user = LDUserNew(key));
+        ASSERT_TRUE(LDIntVariation(client, user, "flag", 25, NULL) == 51);
+        ASSERT_TRUE(LDIntVariation(client, user, "flag", 25, NULL) == 51);
+        LDUserFree(user);
+    }
+
+    ASSERT_TRUE(LDi_bundleEventPayload(client->eventProcessor, &text));
+    ASSERT_TRUE(payload = LDJSONDeserialize(text));
+    LDFree(text);
+
+    indexEvents = 0;
+    counters    = NULL;
+
+    for (event = LDGetIter(payload); event; event = LDIterNext(event)) {
+        const char *const kind = LDGetText(LDObjectLookup(event, "kind"));
+
+        if (strcmp(kind, "index") == 0) {
+            indexEvents++;
+        } else if (strcmp(kind, "summary") == 0) {
+            ASSERT_FALSE(counters);
+            ASSERT_TRUE(counters = LDObjectLookup(LDObjectLookup(
+                LDObjectLookup(event, "features"), "flag"), "counters"));
+        }
+    }
+
+    ASSERT_EQ(indexEvents, 64);
+    ASSERT_TRUE(counters);
+    ASSERT_EQ(LDCollectionGetSize(counters), 1);
+    ASSERT_EQ(LDGetNumber(
+        LDObjectLookup(LDArrayLookup(counters, 0), "count")), 128);
+
+    LDJSONFree(payload);
+
+    /* the shards were cleared */
+    ASSERT_TRUE(LDi_bundleEventPayload(client->eventProcessor, &text));
+    ASSERT_FALSE(text);
+
+    LDClientClose(client);
+}
+
+TEST_F(EventProcessorFixture, DebuggedEvaluationIsQueued) {
+    struct LDConfig *config;
+    struct LDClient *client;
+    struct LDJSON *flag, *event;
+    struct LDUser *user;
+    double now;
+
+    ASSERT_TRUE(config = LDConfigNew("api_key"));
+    LDConfigInlineUsersInEvents(config, LDBooleanTrue);
+    ASSERT_TRUE(client = LDClientInit(config, 0));
+    ASSERT_TRUE(user = LDUserNew("user"));
+
+    LDi_getUnixMilliseconds(&now);
+
+    ASSERT_TRUE(flag = makeMinimalFlag("flag", 11, LDBooleanTrue, LDBooleanFalse));
+    setFallthrough(flag, 0);
+    addVariation(flag, LDNewNumber(51));
+    ASSERT_TRUE(LDObjectSetKey(
+            flag, "debugEventsUntilDate", LDNewNumber(now + 60000)));
+
+    ASSERT_TRUE(LDStoreInitEmpty(client->store));
+    ASSERT_TRUE(LDStoreUpsert(client->store, LD_FLAG, flag));
+
+    ASSERT_TRUE(LDIntVariation(client, user, "flag", 25, NULL) == 51);
+
+    ASSERT_TRUE(LDi_drainEvents(client->eventProcessor));
+    ASSERT_EQ(LDCollectionGetSize(client->eventProcessor->events), 1);
+    ASSERT_TRUE(event = LDArrayLookup(client->eventProcessor->events, 0));
+    ASSERT_STREQ(LDGetText(LDObjectLookup(event, "kind")), "debug");
+
+    LDUserFree(user);
+    LDClientClose(client);
+}
+
 TEST_F(EventProcessorFixture, ConstructAliasEvent) {
     struct LDUser *previous, *current;
+    struct LDEventRecord *event;
     struct LDJSON *result, *expected;
 
     ASSERT_TRUE(previous = LDUserNew("a"));
@@ -625,7 +821,8 @@ TEST_F(EventProcessorFixture, ConstructAliasEvent) {
 
     LDUserSetAnonymous(previous, LDBooleanTrue);
 
-    ASSERT_TRUE(result = LDi_newAliasEvent(current, previous, 52));
+    ASSERT_TRUE(event = LDi_newAliasEvent(current, previous, 52));
+    ASSERT_TRUE(result = LDi_eventRecordToJSON(event));
 
     ASSERT_TRUE(expected = LDNewObject());
     ASSERT_TRUE(LDObjectSetKey(expected, "kind", LDNewText("alias")));
@@ -640,15 +837,76 @@ TEST_F(EventProcessorFixture, ConstructAliasEvent) {
 
     LDJSONFree(expected);
     LDJSONFree(result);
+    LDi_freeEventRecords(event);
     LDUserFree(previous);
     LDUserFree(current);
 }
 
+TEST_F(EventProcessorFixture, FeatureEventWrittenInWireFormat) {
+    struct LDConfig *config;
+    struct EventProcessor *processor;
+    struct LDUser *user;
+    struct LDJSON *value, *fallback;
+    struct LDEventRecord *event;
+    struct LDDetails details;
+    struct LDTextBuffer buffer;
+    const unsigned int variation = 1;
+
+    ASSERT_TRUE(config = LDConfigNew("key"));
+    ASSERT_TRUE(processor = LDi_newEventProcessor(config));
+    ASSERT_TRUE(user = LDUserNew("abc"));
+    LDUserSetAnonymous(user, LDBooleanTrue);
+
+    ASSERT_TRUE(value = LDNewText("value1"));
+    ASSERT_TRUE(fallback = LDNewText("default1"));
+
+    LDDetailsInit(&details);
+    details.reason = LD_RULE_MATCH;
+    details.extra.rule.ruleIndex = 0;
+    details.extra.rule.inExperiment = LDBooleanTrue;
+    ASSERT_TRUE(details.extra.rule.id = LDStrDup("rule-1"));
+
+    ASSERT_TRUE(
+            event = LDi_newFeatureRequestEvent(
+                    processor,
+                    "key1",
+                    user,
+                    &variation,
+                    value,
+                    fallback,
+                    "key0",
+                    NULL,
+                    &details,
+                    52));
+
+    /* the details may go away before the event is sent */
+    LDDetailsClear(&details);
+
+    memset(&buffer, 0, sizeof(buffer));
+    ASSERT_TRUE(LDi_writeEventRecord(&buffer, event));
+    ASSERT_STREQ(buffer.text,
+            "{\"kind\":\"feature\",\"creationDate\":52,\"key\":\"key1\","
+            "\"userKey\":\"abc\",\"variation\":1,\"value\":\"value1\","
+            "\"default\":\"default1\",\"prereqOf\":\"key0\","
+            "\"reason\":{\"kind\":\"RULE_MATCH\",\"ruleId\":\"rule-1\","
+            "\"ruleIndex\":0,\"inExperiment\":true},"
+            "\"contextKind\":\"anonymousUser\"}");
+
+    LDFree(buffer.text);
+    LDi_freeEventRecords(event);
+    LDJSONFree(value);
+    LDJSONFree(fallback);
+    LDUserFree(user);
+    LDConfigFree(config);
+    LDi_freeEventProcessor(processor);
+}
+
 TEST_F(EventProcessorFixture, AliasEventIsQueued) {
     struct LDClient *client;
     double metricValue;
     const char *metricName;
     struct LDJSON *payload, *event;
+    char *text;
     struct LDUser *previous, *current;
 
     ASSERT_TRUE(previous = LDUserNew("p"));
@@ -658,7 +916,9 @@ TEST_F(EventProcessorFixture, AliasEventIsQueued) {
 
     LDClientAlias(client, current, previous);
 
-    ASSERT_TRUE(LDi_bundleEventPayload(client->eventProcessor, &payload));
+    ASSERT_TRUE(LDi_bundleEventPayload(client->eventProcessor, &text));
+    ASSERT_TRUE(payload = LDJSONDeserialize(text));
+    LDFree(text);
 
     ASSERT_TRUE(LDCollectionGetSize(payload) == 1);
     ASSERT_TRUE(event = LDArrayLookup(payload, 0));
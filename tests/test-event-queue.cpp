@@ -0,0 +1,112 @@
+#include "gtest/gtest.h"
+#include "commonfixture.h"
+
+#include <atomic>
+
+extern "C" {
+#include <launchdarkly/api.h>
+
+#include "concurrency.h"
+#include "event_queue.h"
+#include "utility.h"
+}
+
+// Inherit from the CommonFixture to give a reasonable name for the test output.
+// Any custom setup and teardown would happen in this derived class.
+class EventQueueFixture : public CommonFixture {
+};
+
+TEST_F(EventQueueFixture, DrainsInOrderAndDropsBeyondCapacity) {
+    struct LDEventQueue queue;
+    struct LDEventRecord *event;
+    unsigned int round, i;
+
+    ASSERT_TRUE(LDi_eventQueueInit(&queue, 3));
+
+    /* enough rounds for the tickets to wrap around the slots several times */
+    for (round = 0; round < 10; round++) {
+        for (i = 0; i < 5; i++) {
+            ASSERT_EQ(LDi_eventQueuePush(&queue,
+                    LDi_newEventRecord(LD_EVENT_CUSTOM, i, 0)), i < 3);
+        }
+
+        for (i = 0; i < 3; i++) {
+            ASSERT_TRUE(event = LDi_eventQueuePop(&queue));
+            ASSERT_EQ(event->creationDate, i);
+            LDi_freeEventRecords(event);
+        }
+
+        ASSERT_FALSE(LDi_eventQueuePop(&queue));
+
+        ASSERT_EQ(LDi_eventQueueDropped(&queue), (round + 1) * 2);
+    }
+
+    /* events still queued are freed with the queue */
+    ASSERT_TRUE(LDi_eventQueuePush(&queue,
+            LDi_newEventRecord(LD_EVENT_CUSTOM, 1, 0)));
+
+    LDi_eventQueueDestroy(&queue);
+}
+
+struct ConcurrentPushContext {
+    struct LDEventQueue *queue;
+    std::atomic<bool> failed;
+};
+
+static THREAD_RETURN
+concurrentPusher(void *const argument) {
+    struct ConcurrentPushContext *const context =
+            static_cast<struct ConcurrentPushContext *>(argument);
+    unsigned int i;
+
+    for (i = 0; i < 1000; i++) {
+        if (!LDi_eventQueuePush(context->queue,
+                LDi_newEventRecord(LD_EVENT_CUSTOM, i, 0))) {
+            context->failed = true;
+        }
+    }
+
+    return THREAD_RETURN_DEFAULT;
+}
+
+TEST_F(EventQueueFixture, ConcurrentProducersWithOneConsumer) {
+    struct LDEventQueue queue;
+    struct ConcurrentPushContext context;
+    struct LDEventRecord *event;
+    ld_thread_t pushers[4];
+    unsigned int i, popped;
+
+    ASSERT_TRUE(LDi_eventQueueInit(&queue, 4000));
+
+    popped = 0;
+
+    context.queue = &queue;
+    context.failed = false;
+
+    for (i = 0; i < 4; i++) {
+        ASSERT_TRUE(LDi_thread_create(&pushers[i], concurrentPusher, &context));
+    }
+
+    /* drain while the producers run */
+    for (i = 0; i < 100; i++) {
+        while ((event = LDi_eventQueuePop(&queue))) {
+            LDi_freeEventRecords(event);
+            popped++;
+        }
+    }
+
+    for (i = 0; i < 4; i++) {
+        ASSERT_TRUE(LDi_thread_join(&pushers[i]));
+    }
+
+    while ((event = LDi_eventQueuePop(&queue))) {
+        LDi_freeEventRecords(event);
+        popped++;
+    }
+
+    ASSERT_FALSE(context.failed);
+    ASSERT_EQ(popped, 4000);
+    ASSERT_EQ(LDi_eventQueueDropped(&queue), 0);
+
+    LDi_eventQueueDestroy(&queue);
+}
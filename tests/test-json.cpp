@@ -6,6 +6,7 @@ extern "C" {
 
 #include <launchdarkly/api.h>
 
+#include "json_writer.h"
 #include "utility.h"
 }
 
@@ -155,3 +156,41 @@ TEST_F(JSONFixture, Append) {
     LDJSONFree(left);
     LDJSONFree(right);
 }
+
+TEST_F(JSONFixture, WriteReasonMatchesReasonToJSON) {
+    struct LDDetails details[5];
+    struct LDTextBuffer buffer;
+    char *expected;
+    unsigned int i;
+
+    for (i = 0; i < 5; i++) {
+        LDDetailsInit(&details[i]);
+    }
+
+    details[0].reason = LD_OFF;
+    details[1].reason = LD_ERROR;
+    details[1].extra.errorKind = LD_MALFORMED_FLAG;
+    details[2].reason = LD_PREREQUISITE_FAILED;
+    details[2].extra.prerequisiteKey = (char *)"pre\"req";
+    details[3].reason = LD_RULE_MATCH;
+    details[3].extra.rule.id = (char *)"rule";
+    details[3].extra.rule.ruleIndex = 2;
+    details[3].extra.rule.inExperiment = LDBooleanTrue;
+    details[4].reason = LD_FALLTHROUGH;
+    details[4].extra.fallthrough.inExperiment = LDBooleanTrue;
+
+    for (i = 0; i < 5; i++) {
+        struct LDJSON *reason;
+
+        memset(&buffer, 0, sizeof(buffer));
+
+        ASSERT_TRUE(reason = LDReasonToJSON(&details[i]));
+        ASSERT_TRUE(expected = LDJSONSerialize(reason));
+        ASSERT_TRUE(LDi_writeReason(&buffer, &details[i]));
+        ASSERT_STREQ(buffer.text, expected);
+
+        LDFree(buffer.text);
+        LDFree(expected);
+        LDJSONFree(reason);
+    }
+}
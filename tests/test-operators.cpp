@@ -84,6 +84,17 @@ TEST_P(OperatorsFixture, VerifyOperation) {
     ASSERT_TRUE(opfn = LDi_lookupOperation(LDGetText(reinterpret_cast<const LDJSON *const>(item.op.get()))));
 
     ASSERT_TRUE(opfn(item.uvalue.get(), item.cvalue.get()) == item.expect);
+
+    /* flags store "matches" patterns precompiled, both paths must agree */
+    if (strcmp(LDGetText(item.op.get()), "matches") == 0 &&
+        LDJSONGetType(item.cvalue.get()) == LDText) {
+        struct LDRegex *regex;
+
+        ASSERT_TRUE(LDi_compileRegex(LDGetText(item.cvalue.get()), &regex));
+        ASSERT_TRUE(LDi_regexMatches(regex, item.uvalue.get()) == item.expect);
+
+        LDi_freeRegex(regex);
+    }
 }
 
 
@@ -15,6 +15,22 @@ class SegmentsFixture : public CommonFixture {
 };
 
 
+/* compiles the segment the same way the store does before matching it */
+static EvalStatus
+segmentMatchesJSON(
+        const struct LDJSON *const json, const struct LDUser *const user) {
+    struct LDSegment *segment;
+    EvalStatus status;
+
+    LD_ASSERT(segment = LDi_newSegment(json));
+
+    status = LDi_segmentMatchesUser(segment, user);
+
+    LDi_freeSegment(segment);
+
+    return status;
+}
+
 static struct LDJSON *
 makeTestSegment(struct LDJSON *const rules) {
     struct LDJSON *segment;
@@ -48,7 +64,41 @@ TEST_F(SegmentsFixture, ExplicitIncludeUser) {
     ASSERT_TRUE(LDObjectSetKey(segment, "included", tmp));
 
     /* run */
-    ASSERT_EQ(LDi_segmentMatchesUser(segment, user), EVAL_MATCH);
+    ASSERT_EQ(segmentMatchesJSON(segment, user), EVAL_MATCH);
+
+    LDJSONFree(segment);
+    LDUserFree(user);
+}
+
+TEST_F(SegmentsFixture, ExplicitIncludeUserAmongManyKeys) {
+    struct LDUser *user;
+    struct LDJSON *segment, *tmp;
+    char key[32];
+    int i;
+
+    /* user */
+    ASSERT_TRUE(user = LDUserNew("user-777"));
+
+    /* segment */
+    ASSERT_TRUE(segment = LDNewObject());
+    ASSERT_TRUE(LDObjectSetKey(segment, "key", LDNewText("test")));
+    ASSERT_TRUE(LDObjectSetKey(segment, "salt", LDNewText("abcdef")));
+    ASSERT_TRUE(LDObjectSetKey(segment, "version", LDNewNumber(1)));
+
+    ASSERT_TRUE(tmp = LDNewArray());
+    for (i = 0; i < 1000; i++) {
+        snprintf(key, sizeof(key), "user-%d", i);
+        ASSERT_TRUE(LDArrayPush(tmp, LDNewText(key)));
+    }
+    ASSERT_TRUE(LDObjectSetKey(segment, "included", tmp));
+
+    /* run */
+    ASSERT_EQ(segmentMatchesJSON(segment, user), EVAL_MATCH);
+
+    LDUserFree(user);
+    ASSERT_TRUE(user = LDUserNew("user-1000"));
+
+    ASSERT_EQ(segmentMatchesJSON(segment, user), EVAL_MISS);
 
     LDJSONFree(segment);
     LDUserFree(user);
@@ -73,7 +123,7 @@ TEST_F(SegmentsFixture, ExplicitExcludeUser) {
     ASSERT_TRUE(LDObjectSetKey(segment, "excluded", tmp));
 
     /* run */
-    ASSERT_EQ(LDi_segmentMatchesUser(segment, user), EVAL_MISS);
+    ASSERT_EQ(segmentMatchesJSON(segment, user), EVAL_MISS);
 
     LDJSONFree(segment);
     LDUserFree(user);
@@ -102,7 +152,7 @@ TEST_F(SegmentsFixture, ExplicitIncludeHasPrecedence) {
     ASSERT_TRUE(LDObjectSetKey(segment, "included", tmp));
 
     /* run */
-    ASSERT_EQ(LDi_segmentMatchesUser(segment, user), EVAL_MATCH);
+    ASSERT_EQ(segmentMatchesJSON(segment, user), EVAL_MATCH);
 
     LDJSONFree(segment);
     LDUserFree(user);
@@ -139,7 +189,7 @@ TEST_F(SegmentsFixture, MatchingRuleWithFullRollout) {
     ASSERT_TRUE(segment = makeTestSegment(rules));
 
     /* run */
-    ASSERT_EQ(LDi_segmentMatchesUser(segment, user), EVAL_MATCH);
+    ASSERT_EQ(segmentMatchesJSON(segment, user), EVAL_MATCH);
 
     LDJSONFree(segment);
     LDUserFree(user);
@@ -176,7 +226,7 @@ TEST_F(SegmentsFixture, MatchingRuleWithZeroRollout) {
     ASSERT_TRUE(segment = makeTestSegment(rules));
 
     /* run */
-    ASSERT_EQ(LDi_segmentMatchesUser(segment, user), EVAL_MISS);
+    ASSERT_EQ(segmentMatchesJSON(segment, user), EVAL_MISS);
 
     LDJSONFree(segment);
     LDUserFree(user);
@@ -224,7 +274,7 @@ TEST_F(SegmentsFixture, MatchingRuleWithMultipleClauses) {
     ASSERT_TRUE(segment = makeTestSegment(rules));
 
     /* run */
-    ASSERT_EQ(LDi_segmentMatchesUser(segment, user), EVAL_MATCH);
+    ASSERT_EQ(segmentMatchesJSON(segment, user), EVAL_MATCH);
 
     LDJSONFree(segment);
     LDUserFree(user);
@@ -272,7 +322,7 @@ TEST_F(SegmentsFixture, NonMatchingRuleWithMultipleClauses) {
     ASSERT_TRUE(segment = makeTestSegment(rules));
 
     /* run */
-    ASSERT_EQ(LDi_segmentMatchesUser(segment, user), EVAL_MISS);
+    ASSERT_EQ(segmentMatchesJSON(segment, user), EVAL_MISS);
 
     LDJSONFree(segment);
     LDUserFree(user);
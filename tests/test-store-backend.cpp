@@ -1,3 +1,5 @@
+#include <atomic>
+
 #include "gtest/gtest.h"
 #include "commonfixture.h"
 
@@ -7,6 +9,8 @@ extern "C" {
 #include <launchdarkly/api.h>
 
 #include "assertion.h"
+#include "client.h"
+#include "concurrency.h"
 #include "store.h"
 #include "utility.h"
 
@@ -459,6 +463,231 @@ TEST_F(StoreBackendFixture, GetCache) {
     LDStoreDestroy(store);
 }
 
+static std::atomic<unsigned int> slowGetCount;
+
+static LDBoolean
+mockSlowGet(
+        void *const context,
+        const char *const kind,
+        const char *const featureKey,
+        struct LDStoreCollectionItem *const result) {
+    struct LDJSON *flag;
+
+    (void) context;
+    LD_ASSERT(kind);
+    LD_ASSERT(featureKey);
+    LD_ASSERT(result);
+
+    slowGetCount++;
+
+    /* long enough for every reader to arrive while the fetch is in flight */
+    LDi_sleepMilliseconds(200);
+
+    LD_ASSERT(flag = makeMinimalFlag(featureKey, 12, LDBooleanTrue, LDBooleanTrue));
+    LD_ASSERT(result->buffer = LDJSONSerialize(flag));
+    result->bufferSize = strlen((char *) result->buffer) + 1;
+    result->version = 12;
+    LDJSONFree(flag);
+
+    return LDBooleanTrue;
+}
+
+static struct LDStore *coalescedStore;
+static std::atomic<unsigned int> coalescedFound;
+
+static THREAD_RETURN
+coalescedReader(void *const argument) {
+    struct LDJSONRC *item;
+
+    (void) argument;
+
+    LD_ASSERT(LDStoreGet(coalescedStore, LD_FLAG, "abc", &item));
+
+    if (item) {
+        coalescedFound++;
+        LDJSONRCDecrement(item);
+    }
+
+    return THREAD_RETURN_DEFAULT;
+}
+
+TEST_F(StoreBackendFixture, GetCoalescesConcurrentMisses) {
+    struct LDStoreInterface *handle;
+    ld_thread_t threads[8];
+    unsigned int i;
+
+    slowGetCount = 0;
+    coalescedFound = 0;
+
+    ASSERT_TRUE(handle = makeMockFailInterface());
+    handle->get = mockSlowGet;
+    ASSERT_TRUE(coalescedStore = prepareStore(handle));
+
+    for (i = 0; i < 8; i++) {
+        ASSERT_TRUE(LDi_thread_create(&threads[i], coalescedReader, NULL));
+    }
+
+    for (i = 0; i < 8; i++) {
+        ASSERT_TRUE(LDi_thread_join(&threads[i]));
+    }
+
+    ASSERT_EQ(slowGetCount, 1);
+    ASSERT_EQ(coalescedFound, 8);
+
+    LDStoreDestroy(coalescedStore);
+}
+
+static struct LDStore *
+prepareStaleStore(
+        struct LDStoreInterface *const handle,
+        const unsigned int ttl,
+        const unsigned int maxStaleness) {
+    struct LDStore *store;
+    struct LDConfig *config;
+
+    LD_ASSERT(config = LDConfigNew(""));
+    LDConfigSetFeatureStoreBackend(config, handle);
+    LDConfigSetFeatureStoreBackendCacheTTL(config, ttl);
+    LDConfigSetFeatureStoreBackendMaxStaleness(config, maxStaleness);
+    LD_ASSERT(store = LDStoreNew(config));
+    config->storeBackend = NULL;
+
+    LDConfigFree(config);
+
+    return store;
+}
+
+TEST_F(StoreBackendFixture, StaleServedWhileRefreshing) {
+    struct LDStore *store;
+    struct LDStoreInterface *handle;
+    struct LDStoreCacheStats stats;
+    struct LDJSONRC *item;
+    double start, end;
+    unsigned int i;
+
+    slowGetCount = 0;
+
+    ASSERT_TRUE(handle = makeMockFailInterface());
+    handle->get = mockSlowGet;
+    ASSERT_TRUE(store = prepareStaleStore(handle, 300, 60 * 1000));
+
+    ASSERT_TRUE(LDStoreGet(store, LD_FLAG, "abc", &item));
+    ASSERT_TRUE(item);
+    LDJSONRCDecrement(item);
+    ASSERT_EQ(slowGetCount, 1);
+
+    LDi_sleepMilliseconds(350);
+
+    /* the expired flag is returned without waiting for the backend */
+    ASSERT_TRUE(LDi_getMonotonicMilliseconds(&start));
+    ASSERT_TRUE(LDStoreGet(store, LD_FLAG, "abc", &item));
+    ASSERT_TRUE(LDi_getMonotonicMilliseconds(&end));
+    ASSERT_TRUE(item);
+    LDJSONRCDecrement(item);
+    ASSERT_LT(end - start, 150);
+
+    LDStoreGetCacheStats(store, &stats);
+    ASSERT_EQ(stats.staleServes, 1);
+
+    for (i = 0; i < 100 && stats.refreshes == 0; i++) {
+        LDi_sleepMilliseconds(50);
+        LDStoreGetCacheStats(store, &stats);
+    }
+
+    ASSERT_EQ(stats.refreshes, 1);
+    ASSERT_EQ(stats.refreshFailures, 0);
+    ASSERT_EQ(slowGetCount, 2);
+
+    /* the refreshed flag is fresh again */
+    ASSERT_TRUE(LDStoreGet(store, LD_FLAG, "abc", &item));
+    ASSERT_TRUE(item);
+    LDJSONRCDecrement(item);
+    ASSERT_EQ(slowGetCount, 2);
+
+    LDStoreGetCacheStats(store, &stats);
+    ASSERT_EQ(stats.staleServes, 1);
+
+    LDStoreDestroy(store);
+}
+
+TEST_F(StoreBackendFixture, StaleBoundFetchesSynchronously) {
+    struct LDStore *store;
+    struct LDStoreInterface *handle;
+    struct LDStoreCacheStats stats;
+    struct LDJSONRC *item;
+
+    ASSERT_TRUE(handle = makeMockFailInterface());
+    handle->get = mockStaticGet;
+    ASSERT_TRUE(store = prepareStaleStore(handle, 10, 10));
+
+    ASSERT_TRUE(
+            staticGetValue =
+                    makeMinimalFlag("abc", 12, LDBooleanTrue, LDBooleanTrue));
+    staticGetKey = "abc";
+    staticGetCount = 0;
+
+    ASSERT_TRUE(LDStoreGet(store, LD_FLAG, "abc", &item));
+    ASSERT_TRUE(item);
+    LDJSONRCDecrement(item);
+    ASSERT_EQ(staticGetCount, 1);
+
+    LDi_sleepMilliseconds(50);
+
+    ASSERT_TRUE(LDStoreGet(store, LD_FLAG, "abc", &item));
+    ASSERT_TRUE(item);
+    LDJSONRCDecrement(item);
+    ASSERT_EQ(staticGetCount, 2);
+
+    LDStoreGetCacheStats(store, &stats);
+    ASSERT_EQ(stats.staleServes, 0);
+
+    LDJSONFree(staticGetValue);
+    LDStoreDestroy(store);
+}
+
+TEST_F(StoreBackendFixture, ClientReportsStaleServes) {
+    struct LDConfig *config;
+    struct LDClient *client;
+    struct LDStoreInterface *handle;
+    struct LDStoreCacheStats stats;
+    struct LDJSONRC *item;
+
+    ASSERT_TRUE(handle = makeMockFailInterface());
+    handle->get = mockStaticGet;
+
+    ASSERT_TRUE(config = LDConfigNew(""));
+    LDConfigSetOffline(config, LDBooleanTrue);
+    LDConfigSetFeatureStoreBackend(config, handle);
+    LDConfigSetFeatureStoreBackendCacheTTL(config, 10);
+    LDConfigSetFeatureStoreBackendMaxStaleness(config, 60 * 1000);
+    ASSERT_TRUE(client = LDClientInit(config, 0));
+
+    ASSERT_TRUE(
+            staticGetValue =
+                    makeMinimalFlag("abc", 12, LDBooleanTrue, LDBooleanTrue));
+    staticGetKey = "abc";
+    staticGetCount = 0;
+
+    ASSERT_TRUE(LDClientGetStoreCacheStats(client, &stats));
+    ASSERT_EQ(stats.staleServes, 0);
+
+    ASSERT_TRUE(LDStoreGet(client->store, LD_FLAG, "abc", &item));
+    ASSERT_TRUE(item);
+    LDJSONRCDecrement(item);
+
+    LDi_sleepMilliseconds(50);
+
+    ASSERT_TRUE(LDStoreGet(client->store, LD_FLAG, "abc", &item));
+    ASSERT_TRUE(item);
+    LDJSONRCDecrement(item);
+
+    ASSERT_TRUE(LDClientGetStoreCacheStats(client, &stats));
+    ASSERT_EQ(stats.staleServes, 1);
+
+    LDClientClose(client);
+    LDJSONFree(staticGetValue);
+}
+
 static unsigned int staticUpsertCount;
 static struct LDJSON *staticUpsertValue;
 static char const *staticUpsertKey;
@@ -618,3 +847,62 @@ TEST_F(StoreBackendFixture, AllCache) {
 
     LDStoreDestroy(store);
 }
+
+static LDBoolean
+mockFlagsOnlyAll(
+        void *const context,
+        const char *const kind,
+        struct LDStoreCollectionItem **const result,
+        unsigned int *const resultCount) {
+    if (strcmp(kind, "features") == 0) {
+        return mockStaticAll(context, kind, result, resultCount);
+    }
+
+    *result = NULL;
+    *resultCount = 0;
+
+    return LDBooleanTrue;
+}
+
+TEST_F(StoreBackendFixture, RefreshRestartsTTL) {
+    struct LDStore *store;
+    struct LDStoreInterface *handle;
+    struct LDConfig *config;
+    struct LDJSONRC *item;
+
+    staticAllCount = 0;
+
+    ASSERT_TRUE(staticAllValue = LDNewObject());
+    ASSERT_TRUE(LDObjectSetKey(staticAllValue, "abc",
+            makeMinimalFlag("abc", 12, LDBooleanTrue, LDBooleanTrue)));
+
+    /* individual gets fail, so only cached items can be found */
+    ASSERT_TRUE(handle = makeMockFailInterface());
+    handle->all = mockFlagsOnlyAll;
+
+    ASSERT_TRUE(config = LDConfigNew(""));
+    LDConfigSetFeatureStoreBackend(config, handle);
+    LDConfigSetFeatureStoreBackendCacheTTL(config, 300);
+    ASSERT_TRUE(store = LDStoreNew(config));
+    config->storeBackend = NULL;
+    LDConfigFree(config);
+
+    ASSERT_TRUE(LDStoreRefresh(store));
+    ASSERT_EQ(staticAllCount, 1);
+
+    LDi_sleepMilliseconds(200);
+
+    ASSERT_TRUE(LDStoreRefresh(store));
+    ASSERT_EQ(staticAllCount, 2);
+
+    LDi_sleepMilliseconds(200);
+
+    /* older than the TTL since the first load, but not since the refresh */
+    ASSERT_TRUE(LDStoreGet(store, LD_FLAG, "abc", &item));
+    ASSERT_TRUE(item);
+    LDJSONRCDecrement(item);
+
+    LDJSONFree(staticAllValue);
+    staticAllValue = NULL;
+    LDStoreDestroy(store);
+}
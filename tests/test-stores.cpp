@@ -1,3 +1,5 @@
+#include <atomic>
+
 #include "gtest/gtest.h"
 #include "commonfixture.h"
 
@@ -5,6 +7,7 @@ extern "C" {
 #include <launchdarkly/api.h>
 
 #include "assertion.h"
+#include "concurrency.h"
 #include "utility.h"
 
 #include "store.h"
@@ -313,6 +316,134 @@ TEST_P(CommonStoreFixture, ConflictDifferentNamespace) {
     LDJSONFree(feature2Copy);
 }
 
+TEST_P(CommonStoreFixture, UpsertCompilesFeature) {
+    struct LDJSONRC *lookup;
+
+    ASSERT_TRUE(LDStoreInitEmpty(store));
+
+    ASSERT_TRUE(LDStoreUpsert(store, LD_SEGMENT, makeVersioned("my-heap-key", 3)));
+    ASSERT_TRUE(LDStoreUpsert(store, LD_FLAG, makeVersioned("my-heap-key", 3)));
+
+    ASSERT_TRUE(LDStoreGet(store, LD_SEGMENT, "my-heap-key", &lookup));
+    ASSERT_TRUE(lookup);
+    ASSERT_TRUE(LDJSONRCGetSegment(lookup));
+    ASSERT_FALSE(LDJSONRCGetFlag(lookup));
+    LDJSONRCDecrement(lookup);
+
+    ASSERT_TRUE(LDStoreGet(store, LD_FLAG, "my-heap-key", &lookup));
+    ASSERT_TRUE(lookup);
+    ASSERT_TRUE(LDJSONRCGetFlag(lookup));
+    ASSERT_FALSE(LDJSONRCGetSegment(lookup));
+    LDJSONRCDecrement(lookup);
+}
+
+TEST_P(CommonStoreFixture, GetBorrowed) {
+    struct LDJSON *feature, *featureCopy;
+    struct LDJSONRC *lookup, *missing;
+    struct LDEpochGuard guard;
+
+    ASSERT_TRUE(LDStoreInitEmpty(store));
+
+    ASSERT_TRUE(feature = makeVersioned("my-heap-key", 3));
+    ASSERT_TRUE(featureCopy = LDJSONDuplicate(feature));
+    ASSERT_TRUE(LDStoreUpsert(store, LD_FLAG, feature));
+
+    LDStoreReadBegin(store, &guard);
+
+    EXPECT_TRUE(LDStoreGetBorrowed(store, LD_FLAG, "my-heap-key", &lookup));
+    EXPECT_TRUE(lookup);
+    EXPECT_TRUE(LDJSONCompare(LDJSONRCGet(lookup), featureCopy));
+    LDStoreReleaseBorrowed(store, lookup);
+
+    EXPECT_TRUE(LDStoreGetBorrowed(store, LD_FLAG, "other-key", &missing));
+    EXPECT_FALSE(missing);
+    LDStoreReleaseBorrowed(store, missing);
+
+    LDStoreReadEnd(store, &guard);
+
+    /* the replaced feature is freed, which leaks if the borrow was counted */
+    ASSERT_TRUE(LDStoreUpsert(store, LD_FLAG, makeVersioned("my-heap-key", 5)));
+
+    LDJSONFree(featureCopy);
+}
+
+struct ConcurrentReadContext {
+    struct LDStore *store;
+    std::atomic<bool> done;
+    std::atomic<bool> failed;
+};
+
+static THREAD_RETURN
+concurrentReader(void *const argument) {
+    struct ConcurrentReadContext *const context =
+            static_cast<struct ConcurrentReadContext *>(argument);
+    char key[32];
+    unsigned int i;
+
+    for (i = 0; !context->done; i++) {
+        struct LDJSONRC *lookup;
+
+        snprintf(key, sizeof(key), "key-%u", i % 64);
+
+        if (!LDStoreGet(context->store, LD_FLAG, key, &lookup)) {
+            context->failed = true;
+        } else if (lookup) {
+            if (strcmp(LDGetText(LDObjectLookup(LDJSONRCGet(lookup), "key")), key) != 0) {
+                context->failed = true;
+            }
+
+            LDJSONRCDecrement(lookup);
+        }
+
+        if (!LDStoreAll(context->store, LD_FLAG, &lookup)) {
+            context->failed = true;
+        }
+
+        LDJSONRCDecrement(lookup);
+    }
+
+    return THREAD_RETURN_DEFAULT;
+}
+
+TEST_P(CommonStoreFixture, ConcurrentReadsDuringWrites) {
+    struct ConcurrentReadContext context;
+    ld_thread_t readers[4];
+    unsigned int i;
+    char key[32];
+
+    ASSERT_TRUE(LDStoreInitEmpty(store));
+
+    context.store = store;
+    context.done = false;
+    context.failed = false;
+
+    for (i = 0; i < 4; i++) {
+        ASSERT_TRUE(LDi_thread_create(&readers[i], concurrentReader, &context));
+    }
+
+    for (i = 0; i < 256; i++) {
+        snprintf(key, sizeof(key), "key-%u", i % 64);
+
+        if (i % 5 == 4) {
+            ASSERT_TRUE(LDStoreRemove(store, LD_FLAG, key, i + 1));
+        } else {
+            ASSERT_TRUE(LDStoreUpsert(store, LD_FLAG, makeVersioned(key, i + 1)));
+        }
+
+        if (i == 128) {
+            ASSERT_TRUE(LDStoreInitEmpty(store));
+        }
+    }
+
+    context.done = true;
+
+    for (i = 0; i < 4; i++) {
+        ASSERT_TRUE(LDi_thread_join(&readers[i]));
+    }
+
+    ASSERT_FALSE(context.failed);
+}
+
 TEST_P(CommonStoreFixture, UpsertFeatureNotAnObject) {
     struct LDJSON *feature;
     struct LDJSONRC *lookup;
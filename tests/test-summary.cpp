@@ -0,0 +1,105 @@
+#include "gtest/gtest.h"
+#include "commonfixture.h"
+
+extern "C" {
+#include <stdio.h>
+
+#include <launchdarkly/api.h>
+
+#include "summary.h"
+#include "utility.h"
+}
+
+// Inherit from the CommonFixture to give a reasonable name for the test output.
+// Any custom setup and teardown would happen in this derived class.
+class SummaryFixture : public CommonFixture {
+};
+
+TEST_F(SummaryFixture, CountsAcrossGrowthInFirstSeenOrder) {
+    struct LDSummary summary;
+    struct LDJSON *features, *flag, *counter;
+    char key[32];
+    unsigned int i, variation;
+    double version;
+
+    LDi_initSummary(&summary);
+
+    /* enough flags and counters to grow both tables several times */
+    for (i = 0; i < 100; i++) {
+        snprintf(key, sizeof(key), "flag-%u", i);
+
+        for (variation = 0; variation < 3; variation++) {
+            version = i;
+
+            ASSERT_TRUE(LDi_summaryCount(
+                &summary, key, &variation, &version, NULL, NULL,
+                LDBooleanFalse));
+            ASSERT_TRUE(LDi_summaryCount(
+                &summary, key, &variation, &version, NULL, NULL,
+                LDBooleanFalse));
+        }
+    }
+
+    ASSERT_EQ(summary.flagCount, 100);
+    ASSERT_EQ(summary.counterCount, 300);
+
+    ASSERT_TRUE(features = LDi_summaryToJSON(&summary));
+    ASSERT_EQ(LDCollectionGetSize(features), 100);
+    ASSERT_STREQ(LDIterKey(LDGetIter(features)), "flag-0");
+
+    ASSERT_TRUE(flag = LDObjectLookup(features, "flag-42"));
+    ASSERT_EQ(LDCollectionGetSize(LDObjectLookup(flag, "counters")), 3);
+    ASSERT_TRUE(counter = LDArrayLookup(LDObjectLookup(flag, "counters"), 2));
+    ASSERT_EQ(LDGetNumber(LDObjectLookup(counter, "count")), 2);
+    ASSERT_EQ(LDGetNumber(LDObjectLookup(counter, "variation")), 2);
+    ASSERT_EQ(LDGetNumber(LDObjectLookup(counter, "version")), 42);
+
+    LDJSONFree(features);
+    LDi_freeSummary(&summary);
+}
+
+TEST_F(SummaryFixture, MissingVariationAndVersionAreDistinct) {
+    struct LDSummary summary;
+    struct LDJSON *features, *value, *counters;
+    unsigned int variation;
+    double version;
+
+    LDi_initSummary(&summary);
+
+    variation = 0;
+    version   = 0;
+
+    ASSERT_TRUE(value = LDNewText("value"));
+
+    ASSERT_TRUE(LDi_summaryCount(
+        &summary, "flag", &variation, &version, value, NULL, LDBooleanFalse));
+    ASSERT_TRUE(LDi_summaryCount(
+        &summary, "flag", NULL, &version, value, NULL, LDBooleanFalse));
+    ASSERT_TRUE(LDi_summaryCount(
+        &summary, "flag", &variation, NULL, value, NULL, LDBooleanFalse));
+    ASSERT_TRUE(LDi_summaryCount(
+        &summary, "flag", NULL, NULL, value, NULL, LDBooleanTrue));
+
+    ASSERT_TRUE(features = LDi_summaryToJSON(&summary));
+    ASSERT_TRUE(counters = LDObjectLookup(
+        LDObjectLookup(features, "flag"), "counters"));
+    ASSERT_EQ(LDCollectionGetSize(counters), 4);
+    ASSERT_FALSE(LDObjectLookup(LDArrayLookup(counters, 1), "variation"));
+    ASSERT_FALSE(LDObjectLookup(LDArrayLookup(counters, 2), "version"));
+    ASSERT_TRUE(LDGetBool(
+        LDObjectLookup(LDArrayLookup(counters, 3), "unknown")));
+    LDJSONFree(features);
+
+    /* a cleared summary is empty and can be reused */
+    LDi_clearSummary(&summary);
+    ASSERT_TRUE(features = LDi_summaryToJSON(&summary));
+    ASSERT_EQ(LDCollectionGetSize(features), 0);
+    LDJSONFree(features);
+
+    ASSERT_TRUE(LDi_summaryCount(
+        &summary, "flag", NULL, NULL, NULL, value, LDBooleanFalse));
+    ASSERT_EQ(summary.counterCount, 1);
+
+    LDJSONFree(value);
+    LDi_freeSummary(&summary);
+}
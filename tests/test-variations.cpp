@@ -8,6 +8,7 @@ extern "C" {
 
 #include <launchdarkly/api.h>
 
+#include "assertion.h"
 #include "client.h"
 #include "config.h"
 #include "evaluate.h"
@@ -314,3 +315,320 @@ TEST_F(VariationsFixture, FallthroughWithNoVariationOrRollout) {
     LDClientClose(client);
     LDDetailsClear(&details);
 }
+
+/* counts allocations made by the current thread, so that background client
+threads do not interfere */
+static thread_local unsigned int allocations = 0;
+
+static void *
+countingAlloc(const size_t bytes) {
+    allocations++;
+    return malloc(bytes);
+}
+
+static void *
+countingRealloc(void *const buffer, const size_t bytes) {
+    allocations++;
+    return realloc(buffer, bytes);
+}
+
+static char *
+countingStrDup(const char *const string) {
+    allocations++;
+    return strdup(string);
+}
+
+static void *
+countingCalloc(const size_t nmemb, const size_t size) {
+    allocations++;
+    return calloc(nmemb, size);
+}
+
+static char *
+countingStrNDup(const char *const string, const size_t n) {
+    allocations++;
+    return strndup(string, n);
+}
+
+static void
+freeWrapper(void *const buffer) {
+    free(buffer);
+}
+
+static struct LDJSON *
+makeFlagWithClause(const char *const key, struct LDJSON *const clause) {
+    struct LDJSON *flag, *rule, *tmp;
+
+    LD_ASSERT(rule = LDNewObject());
+    LD_ASSERT(LDObjectSetKey(rule, "id", LDNewText("rule-id")));
+    LD_ASSERT(LDObjectSetKey(rule, "variation", LDNewNumber(1)));
+    LD_ASSERT(tmp = LDNewArray());
+    LD_ASSERT(LDArrayPush(tmp, clause));
+    LD_ASSERT(LDObjectSetKey(rule, "clauses", tmp));
+
+    LD_ASSERT(flag = LDNewObject());
+    LD_ASSERT(LDObjectSetKey(flag, "key", LDNewText(key)));
+    LD_ASSERT(LDObjectSetKey(flag, "version", LDNewNumber(1)));
+    LD_ASSERT(LDObjectSetKey(flag, "on", LDNewBool(LDBooleanTrue)));
+    LD_ASSERT(LDObjectSetKey(flag, "salt", LDNewText("abc")));
+    setFallthrough(flag, 0);
+    addVariation(flag, LDNewBool(LDBooleanFalse));
+    addVariation(flag, LDNewBool(LDBooleanTrue));
+    LD_ASSERT(tmp = LDNewArray());
+    LD_ASSERT(LDArrayPush(tmp, rule));
+    LD_ASSERT(LDObjectSetKey(flag, "rules", tmp));
+
+    return flag;
+}
+
+static struct LDJSON *
+makeSegmentClause(const char *const *const segments, const unsigned int count) {
+    struct LDJSON *clause, *values;
+    unsigned int i;
+
+    LD_ASSERT(clause = LDNewObject());
+    LD_ASSERT(LDObjectSetKey(clause, "attribute", LDNewText("")));
+    LD_ASSERT(LDObjectSetKey(clause, "op", LDNewText("segmentMatch")));
+    LD_ASSERT(values = LDNewArray());
+    for (i = 0; i < count; i++) {
+        LD_ASSERT(LDArrayPush(values, LDNewText(segments[i])));
+    }
+    LD_ASSERT(LDObjectSetKey(clause, "values", values));
+
+    return clause;
+}
+
+static unsigned int
+countWarmAllocations(
+        struct LDClient *const client, const struct LDUser *const user, const char *const key) {
+    unsigned int before;
+
+    /* warm up */
+    LD_ASSERT(LDBoolVariation(client, user, key, LDBooleanFalse, NULL));
+
+    before = allocations;
+    LD_ASSERT(LDBoolVariation(client, user, key, LDBooleanFalse, NULL));
+
+    return allocations - before;
+}
+
+TEST_F(VariationsFixture, WarmStoreLookupsDoNotAllocate) {
+    struct LDClient *client;
+    struct LDUser *user;
+    struct LDJSON *segment, *included;
+    struct LDJSONRC *lookup;
+    unsigned int oneLookup, fourLookups, before;
+    const char *const segments[] = {"missing1", "missing2", "missing3", "segment"};
+
+    /* installed before the client starts its thread, and removed after it
+    stops, since the routines are not safe to swap concurrently */
+    LDSetMemoryRoutines(countingAlloc, freeWrapper, countingRealloc,
+            countingStrDup, countingCalloc, countingStrNDup);
+
+    ASSERT_TRUE(client = makeTestClient());
+    ASSERT_TRUE(user = LDUserNew("userkey"));
+
+    ASSERT_TRUE(segment = LDNewObject());
+    ASSERT_TRUE(LDObjectSetKey(segment, "key", LDNewText("segment")));
+    ASSERT_TRUE(LDObjectSetKey(segment, "version", LDNewNumber(1)));
+    ASSERT_TRUE(included = LDNewArray());
+    ASSERT_TRUE(LDArrayPush(included, LDNewText("userkey")));
+    ASSERT_TRUE(LDObjectSetKey(segment, "included", included));
+
+    ASSERT_TRUE(LDStoreInitEmpty(client->store));
+    ASSERT_TRUE(LDStoreUpsert(client->store, LD_SEGMENT, segment));
+    ASSERT_TRUE(LDStoreUpsert(client->store, LD_FLAG,
+            makeFlagWithClause("one", makeSegmentClause(&segments[3], 1))));
+    ASSERT_TRUE(LDStoreUpsert(client->store, LD_FLAG,
+            makeFlagWithClause("four", makeSegmentClause(segments, 4))));
+
+    /* direct lookups, including a miss */
+    before = allocations;
+    ASSERT_TRUE(LDStoreGet(client->store, LD_FLAG, "four", &lookup));
+    ASSERT_TRUE(lookup);
+    LDJSONRCDecrement(lookup);
+    ASSERT_TRUE(LDStoreGet(client->store, LD_SEGMENT, "segment", &lookup));
+    ASSERT_TRUE(lookup);
+    LDJSONRCDecrement(lookup);
+    ASSERT_TRUE(LDStoreGet(client->store, LD_FLAG, "missing", &lookup));
+    ASSERT_FALSE(lookup);
+    ASSERT_EQ(allocations, before);
+
+    /* both flags match the same rule and produce the same event, one with a
+    single segment lookup and one with four, so any difference is allocation on
+    the store path */
+    oneLookup = countWarmAllocations(client, user, "one");
+    fourLookups = countWarmAllocations(client, user, "four");
+
+    LDUserFree(user);
+    LDClientClose(client);
+
+    LDSetMemoryRoutines(malloc, freeWrapper, realloc, strdup, calloc, strndup);
+
+    ASSERT_EQ(fourLookups, oneLookup);
+}
+
+static void
+addValueFlag(
+        struct LDClient *const client,
+        const char *const key,
+        struct LDJSON *const off,
+        struct LDJSON *const on) {
+    struct LDJSON *flag;
+
+    LD_ASSERT(flag = LDNewObject());
+    LD_ASSERT(LDObjectSetKey(flag, "key", LDNewText(key)));
+    LD_ASSERT(LDObjectSetKey(flag, "version", LDNewNumber(1)));
+    LD_ASSERT(LDObjectSetKey(flag, "on", LDNewBool(LDBooleanTrue)));
+    LD_ASSERT(LDObjectSetKey(flag, "salt", LDNewText("abc")));
+    setFallthrough(flag, 1);
+    addVariation(flag, off);
+    addVariation(flag, on);
+    LD_ASSERT(LDStoreUpsert(client->store, LD_FLAG, flag));
+}
+
+TEST_F(VariationsFixture, BatchMatchesSingleVariations) {
+    struct LDClient *client;
+    struct LDUser *user;
+    struct LDJSON *expected, *fallback;
+    struct LDDetails details;
+    struct LDVariationRequest requests[8];
+    struct LDVariationResult results[8];
+    char *text;
+    /* setup */
+    ASSERT_TRUE(client = makeTestClient());
+    ASSERT_TRUE(user = LDUserNew("userkey"));
+    ASSERT_TRUE(LDStoreInitEmpty(client->store));
+    ASSERT_TRUE(expected = LDNewObject());
+    ASSERT_TRUE(LDObjectSetKey(expected, "field", LDNewText("value")));
+    ASSERT_TRUE(fallback = LDNewArray());
+    addValueFlag(client, "bool", LDNewBool(LDBooleanFalse),
+            LDNewBool(LDBooleanTrue));
+    addValueFlag(client, "int", LDNewNumber(-1), LDNewNumber(100));
+    addValueFlag(client, "double", LDNewNumber(-1), LDNewNumber(100.01));
+    addValueFlag(client, "string", LDNewText("a"), LDNewText("b"));
+    addValueFlag(client, "json", LDNewObject(), LDJSONDuplicate(expected));
+    /* requests */
+    requests[0].key = "bool";
+    requests[0].type = LD_VARIATION_BOOL;
+    requests[0].fallback.boolean = LDBooleanFalse;
+    requests[1].key = "int";
+    requests[1].type = LD_VARIATION_INT;
+    requests[1].fallback.integer = 1000;
+    requests[2].key = "double";
+    requests[2].type = LD_VARIATION_DOUBLE;
+    requests[2].fallback.number = 0.5;
+    requests[3].key = "string";
+    requests[3].type = LD_VARIATION_STRING;
+    requests[3].fallback.text = "a";
+    requests[4].key = "json";
+    requests[4].type = LD_VARIATION_JSON;
+    requests[4].fallback.json = fallback;
+    requests[5].key = "missing";
+    requests[5].type = LD_VARIATION_STRING;
+    requests[5].fallback.text = "fallback";
+    requests[6].key = "int";
+    requests[6].type = LD_VARIATION_STRING;
+    requests[6].fallback.text = NULL;
+    requests[7].key = "missing";
+    requests[7].type = LD_VARIATION_JSON;
+    requests[7].fallback.json = NULL;
+    /* run */
+    ASSERT_TRUE(LDVariations(client, user, requests, results, 8, LDBooleanTrue));
+    /* validate */
+    ASSERT_EQ(results[0].value.boolean, LDBooleanTrue);
+    ASSERT_EQ(results[0].details.reason, LD_FALLTHROUGH);
+    ASSERT_EQ(results[1].value.integer, 100);
+    ASSERT_EQ(results[2].value.number, 100.01);
+    ASSERT_STREQ(results[3].value.text, "b");
+    ASSERT_TRUE(LDJSONCompare(results[4].value.json, expected));
+    ASSERT_STREQ(results[5].value.text, "fallback");
+    ASSERT_EQ(results[5].details.reason, LD_ERROR);
+    ASSERT_EQ(results[5].details.extra.errorKind, LD_FLAG_NOT_FOUND);
+    ASSERT_EQ(results[6].value.text, nullptr);
+    ASSERT_EQ(results[6].details.reason, LD_ERROR);
+    ASSERT_EQ(results[6].details.extra.errorKind, LD_WRONG_TYPE);
+    ASSERT_EQ(results[7].value.json, nullptr);
+    ASSERT_EQ(results[7].details.extra.errorKind, LD_FLAG_NOT_FOUND);
+    /* the same as a single evaluation */
+    text = LDStringVariation(client, user, "int", NULL, &details);
+    ASSERT_EQ(text, nullptr);
+    ASSERT_EQ(details.extra.errorKind, results[6].details.extra.errorKind);
+    /* cleanup */
+    LDVariationResultsClear(results, 8);
+    LDDetailsClear(&details);
+    LDJSONFree(expected);
+    LDJSONFree(fallback);
+    LDUserFree(user);
+    LDClientClose(client);
+}
+
+TEST_F(VariationsFixture, BatchBeforeInitializationReturnsFallbacks) {
+    struct LDClient *client;
+    struct LDUser *user;
+    struct LDVariationRequest requests[2];
+    struct LDVariationResult results[2];
+    /* setup */
+    ASSERT_TRUE(client = makeTestClient());
+    ASSERT_TRUE(user = LDUserNew("userkey"));
+    requests[0].key = "bool";
+    requests[0].type = LD_VARIATION_BOOL;
+    requests[0].fallback.boolean = LDBooleanTrue;
+    requests[1].key = "string";
+    requests[1].type = LD_VARIATION_STRING;
+    requests[1].fallback.text = "fallback";
+    /* run */
+    ASSERT_FALSE(
+            LDVariations(client, user, requests, results, 2, LDBooleanFalse));
+    /* validate */
+    ASSERT_EQ(results[0].value.boolean, LDBooleanTrue);
+    ASSERT_EQ(results[0].details.extra.errorKind, LD_CLIENT_NOT_READY);
+    ASSERT_STREQ(results[1].value.text, "fallback");
+    ASSERT_EQ(results[1].details.extra.errorKind, LD_CLIENT_NOT_READY);
+    /* cleanup */
+    LDVariationResultsClear(results, 2);
+    LDUserFree(user);
+    LDClientClose(client);
+}
+
+TEST_F(VariationsFixture, BatchRejectsInvalidRequests) {
+    struct LDClient *client;
+    struct LDUser *user;
+    struct LDVariationRequest requests[4];
+    struct LDVariationResult results[4];
+    /* setup */
+    ASSERT_TRUE(client = makeTestClient());
+    ASSERT_TRUE(user = LDUserNew("userkey"));
+    ASSERT_TRUE(LDStoreInitEmpty(client->store));
+    addValueFlag(client, "int", LDNewNumber(-1), LDNewNumber(100));
+    /* requests */
+    requests[0].key = NULL;
+    requests[0].type = LD_VARIATION_STRING;
+    requests[0].fallback.text = "fallback";
+    requests[1].key = "int";
+    requests[1].type = LD_VARIATION_INT;
+    requests[1].fallback.integer = 1000;
+    requests[2].key = "int";
+    requests[2].type = (enum LDVariationType) (LD_VARIATION_JSON + 1);
+    requests[2].fallback.json = NULL;
+    requests[3].key = NULL;
+    requests[3].type = LD_VARIATION_BOOL;
+    requests[3].fallback.boolean = LDBooleanTrue;
+    /* run */
+    ASSERT_TRUE(LDVariations(client, user, requests, results, 4, LDBooleanTrue));
+    /* validate */
+    ASSERT_STREQ(results[0].value.text, "fallback");
+    ASSERT_EQ(results[0].details.reason, LD_ERROR);
+    ASSERT_EQ(results[0].details.extra.errorKind, LD_NULL_KEY);
+    ASSERT_EQ(results[1].value.integer, 100);
+    ASSERT_EQ(results[1].details.reason, LD_FALLTHROUGH);
+    ASSERT_EQ(results[2].details.reason, LD_ERROR);
+    ASSERT_EQ(results[2].details.extra.errorKind, LD_WRONG_TYPE);
+    ASSERT_EQ(results[3].value.boolean, LDBooleanTrue);
+    ASSERT_EQ(results[3].details.reason, LD_ERROR);
+    ASSERT_EQ(results[3].details.extra.errorKind, LD_NULL_KEY);
+    /* cleanup */
+    LDVariationResultsClear(results, 4);
+    LDUserFree(user);
+    LDClientClose(client);
+}